@@ -28,6 +28,7 @@
 #include <data/mask.h>
 #include <data/polar.h>
 #include <data/xmipp_image_generic.h>
+#include <set>
 
 // Pointer to parameters
 ProgClassifyCL2D *prm = NULL;
@@ -203,7 +204,7 @@ void CL2DClass::transferUpdate(bool centerReference)
 //#define DEBUG
 //#define DEBUG_MORE
 void CL2DClass::fitBasic(MultidimArray<double> &I, CL2DAssignment &result,
-                         bool reverse)
+                         bool reverse, size_t objId)
 {
     if (reverse)
     {
@@ -253,9 +254,21 @@ void CL2DClass::fitBasic(MultidimArray<double> &I, CL2DAssignment &result,
 			std::cout << "ASR\n" << ASR << std::endl;
 	#endif
 
-			// Rotate then shift
-			normalizedPolarFourierTransform(IauxRS, polarFourierI, true,
-											XSIZE(P) / 5, XSIZE(P) / 2-2, plans, 1);
+			// Rotate then shift. At the first iteration IauxRS is still the
+			// input image, whose transform is the same for all nodes
+			if (i == 0 && objId != BAD_OBJID && prm->polarCache.isOpen())
+			{
+				int variant = reverse ? 1 : 0;
+				if (!prm->polarCache.get(objId, variant, polarFourierI))
+				{
+					normalizedPolarFourierTransform(IauxRS, polarFourierI, true,
+													XSIZE(P) / 5, XSIZE(P) / 2-2, plans, 1);
+					prm->polarCache.set(objId, variant, polarFourierI);
+				}
+			}
+			else
+				normalizedPolarFourierTransform(IauxRS, polarFourierI, true,
+												XSIZE(P) / 5, XSIZE(P) / 2-2, plans, 1);
 			bestRot = best_rotation(polarFourierP, polarFourierI, rotAux);
 			rotation2DMatrix(bestRot, R);
 			M3x3_BY_M3x3(ARS,R,ARS);
@@ -380,7 +393,7 @@ void CL2DClass::fitBasic(MultidimArray<double> &I, CL2DAssignment &result,
 #undef DEBUG
 #undef DEBUG_MORE
 
-void CL2DClass::fit(MultidimArray<double> &I, CL2DAssignment &result)
+void CL2DClass::fit(MultidimArray<double> &I, CL2DAssignment &result, size_t objId)
 {
     if (currentListImg.size() == 0)
         return;
@@ -388,7 +401,7 @@ void CL2DClass::fit(MultidimArray<double> &I, CL2DAssignment &result)
     // Try this image
     MultidimArray<double> Idirect = I;
     CL2DAssignment resultDirect;
-    fitBasic(Idirect, resultDirect);
+    fitBasic(Idirect, resultDirect, false, objId);
 
     // Try its mirror
 	CL2DAssignment resultMirror;
@@ -396,7 +409,7 @@ void CL2DClass::fit(MultidimArray<double> &I, CL2DAssignment &result)
     if (prm->mirrorImages)
     {
     	Imirror=I;
-		fitBasic(Imirror, resultMirror, true);
+		fitBasic(Imirror, resultMirror, true, objId);
     }
     else
     	resultMirror.corr=-1e38;
@@ -820,7 +833,7 @@ void CL2D::initialize(MetaData &_SF,
                 if (q != -1)
                 {
                     Iaux = I();
-                    P[q]->fit(Iaux, inClass);
+                    P[q]->fit(Iaux, inClass, objId);
                     P[q]->updateProjection(Iaux, inClass);
                     if (prm->Ncodes0 > 1)
                         for (int qp = 0; qp < prm->Ncodes0; qp++)
@@ -828,7 +841,7 @@ void CL2D::initialize(MetaData &_SF,
                             if (qp == q)
                                 continue;
                             Iaux = I();
-                            P[qp]->fit(Iaux, outClass);
+                            P[qp]->fit(Iaux, outClass, objId);
                             P[qp]->updateNonProjection(outClass.corr);
                         }
                 }
@@ -944,7 +957,7 @@ void CL2D::lookNode(MultidimArray<double> &I, int oldnode, int &newnode,
 		if (proceed) {
 			// Try this image
 			Iaux = I;
-			P[q]->fit(Iaux, assignment);
+			P[q]->fit(Iaux, assignment, objId);
 			VEC_ELEM(corrList,q) = assignment.corr;
 #ifdef DEBUG
 	std::cout << "   Proceeding with node " << q << " corr=" << assignment.corr << std::endl;
@@ -1266,7 +1279,7 @@ void CL2D::splitNode(CL2DClass *node, CL2DClass *&node1, CL2DClass *&node2,
             if ((i + 1) % (prm->node->size) == prm->node->rank)
             {
                 readImage(I, node->currentListImg[i].objId, false);
-                node->fit(I(), assignment);
+                node->fit(I(), assignment, node->currentListImg[i].objId);
                 A1D_ELEM(corrList,i) = assignment.corr;
             }
             if (prm->node->rank == 1 && i % 25 == 0 && prm->verbose >= 2)
@@ -1305,7 +1318,7 @@ void CL2D::splitNode(CL2DClass *node, CL2DClass *&node1, CL2DClass *&node2,
                 {
                     assignment.objId = node->currentListImg[i].objId;
                     readImage(I, assignment.objId, false);
-                    node->fit(I(), assignment);
+                    node->fit(I(), assignment, assignment.objId);
                     if ((i + 1) % 2 == 0)
                     {
                         node1->updateProjection(I(), assignment,true);
@@ -1345,7 +1358,7 @@ void CL2D::splitNode(CL2DClass *node, CL2DClass *&node1, CL2DClass *&node2,
                 {
                     assignment.objId = node->currentListImg[i].objId;
                     readImage(I, assignment.objId, false);
-                    node->fit(I(), assignment);
+                    node->fit(I(), assignment, assignment.objId);
                     if (assignment.corr < corrThreshold)
                     {
                         node1->updateProjection(I(), assignment);
@@ -1408,9 +1421,9 @@ void CL2D::splitNode(CL2DClass *node, CL2DClass *&node1, CL2DClass *&node2,
                     readImage(I, assignment.objId, false);
 
                     Iaux1 = I();
-                    node1->fit(Iaux1, assignment1);
+                    node1->fit(Iaux1, assignment1, assignment.objId);
                     Iaux2 = I();
-                    node2->fit(Iaux2, assignment2);
+                    node2->fit(Iaux2, assignment2, assignment.objId);
 
                     //std::cout << "Image " << i << " Likelihood: " << assignment1.likelihood << " " << assignment2.likelihood << std::endl;
                 	//std::cout << "Image " << i << " Corr: " << assignment1.corr << " " << assignment2.corr << std::endl;
@@ -1615,6 +1628,7 @@ void ProgClassifyCL2D::readParams()
 	if (useThresholdMask)
 		threshold=getDoubleParam("--useThresholdMask");
 	alignImages = !checkParam("--dontAlign");
+	fnPolarCache = getParam("--polarCache");
 }
 
 void ProgClassifyCL2D::show() const {
@@ -1637,6 +1651,7 @@ void ProgClassifyCL2D::show() const {
 			<< "Normalize images:        " << normalizeImages << std::endl
 			<< "Mirror images:           " << mirrorImages << std::endl
 			<< "Align images:            " << alignImages << std::endl
+			<< "Polar cache:             " << fnPolarCache << std::endl
 	;
 	if (useThresholdMask)
 		std::cout << "Threshold mask:          " << threshold << std::endl;
@@ -1681,6 +1696,13 @@ void ProgClassifyCL2D::defineParams()
 	addParamsLine("   [--dontMirrorImages]      : By default, input images are studied unmirrored and mirrored");
 	addParamsLine("   [--useThresholdMask <t>]  : Use a mask to compare images. Remove pixels whose value is smaller or equal t");
 	addParamsLine("   [--dontAlign]             : Do not align images");
+	addParamsLine("   [--polarCache+ <file=\"\">] : File to cache the polar Fourier transforms of the input images.");
+	addParamsLine("                             : It can be reused by later runs on the same images. Each MPI process");
+	addParamsLine("                             : uses its own file (the process rank is added to the name). The file of");
+	addParamsLine("                             : each process may grow up to Nimgs x variants x transformSize x 16 bytes,");
+	addParamsLine("                             : where Nimgs is the number of input images, variants is 2 (1 with");
+	addParamsLine("                             : --dontMirrorImages) and transformSize is the number of polar Fourier");
+	addParamsLine("                             : coefficients of an image (about Xdim^2/3)");
     addExampleLine("mpirun -np 3 `which xmipp_mpi_classify_CL2D` -i images.stk --nref 256 --oroot class --odir CL2Dresults --iter 10");
 }
 
@@ -1704,6 +1726,35 @@ void ProgClassifyCL2D::produceSideInfo()
     SF.findObjects(objId);
     // size_t Nimgs = objId.size();
 
+    // Cache of the polar Fourier transforms of the input images. The key
+    // includes the image names, the size and modification time of the
+    // files holding them, and their preprocessing, so that a file that is
+    // rewritten under the same name invalidates the cache
+    if (fnPolarCache != "")
+    {
+        unsigned long hash = 5381;
+        FileName fnImg, fnFile;
+        std::set<FileName> filesSeen;
+        Stat info;
+        FOR_ALL_OBJECTS_IN_METADATA(SF)
+        {
+            SF.getValue(MDL_IMAGE, fnImg, __iter.objId);
+            for (size_t i = 0; i < fnImg.size(); i++)
+                hash = hash * 33 + fnImg[i];
+            fnFile = fnImg.removeAllPrefixes().removeFileFormat();
+            if (!filesSeen.insert(fnFile).second)
+                continue;
+            if (stat(fnFile.c_str(), &info) != 0)
+                REPORT_ERROR(ERR_IO_NOTEXIST, formatString("Cannot stat %s", fnFile.c_str()));
+            hash = hash * 33 + (unsigned long)info.st_size;
+            hash = hash * 33 + (unsigned long)info.st_mtime;
+        }
+        polarCache.open(fnPolarCache.insertBeforeExtension(formatString("_%03d", node->rank)),
+                        objId, Xdim, Ydim, Xdim / 5, Xdim / 2 - 2, 1, CONJUGATE,
+                        formatString("images=%lx normalize=%d", hash, (int)normalizeImages),
+                        mirrorImages ? 2 : 1);
+    }
+
     // Prepare mask for evaluating the noise outside
     mask.resize(prm->Ydim, prm->Xdim);
     mask.setXmippOrigin();
@@ -0,0 +1,124 @@
+#include <reconstruction/angular_projection_matching.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class AngularProjectionMatchingTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        // Stack of random references
+        Nrefs = 6;
+        dim = 32;
+        fnStack.initUniqueName("/tmp/temp_stk_XXXXXX");
+        fnStack.deleteFile();
+        fnStack = fnStack + ".stk";
+        Image<double> stack(dim, dim, 1, Nrefs);
+        stack().initRandom(0, 1);
+        stack.write(fnStack);
+
+        prog.fn_ref = fnStack;
+        prog.fn_ctf = "";
+        prog.dim = prog.workdim = prog.paddim = dim;
+        prog.Ri = 1;
+        prog.Ro = dim / 2 - 1;
+        prog.total_nr_refs = Nrefs;
+
+        // Reference numbers in a different order than the stack
+        size_t refnos[] = {3, 0, 5, 1, 4, 2};
+        prog.mysampling.no_redundant_sampling_points_index.assign(refnos, refnos + Nrefs);
+        prog.convert_refno_to_stack_position.resize(Nrefs);
+        for (int pos = 0; pos < Nrefs; pos++)
+            prog.convert_refno_to_stack_position[refnos[pos]] = pos;
+
+        // Layout of the polar transforms as in produceSideInfo
+        MultidimArray<double> I(dim, dim), Maux;
+        I.setXmippOrigin();
+        Polar<double> P;
+        produceSplineCoefficients(BSPLINE3, Maux, I);
+        P.getPolarFromCartesianBSpline(Maux, prog.Ri, prog.Ro);
+        P.calculateFftwPlans(prog.global_plans);
+        fourierTransformRings(P, prog.fP_layout, prog.global_plans, false);
+
+        // Cache of references in memory
+        prog.max_nr_refs_in_memory = Nrefs;
+        prog.pointer_allrefs2refsinmem.assign(Nrefs, -1);
+        prog.pointer_refsinmem2allrefs.assign(Nrefs, -1);
+        prog.counter_refs_in_memory = 0;
+        prog.fP_ref = new Polar<std::complex<double> >[Nrefs];
+        prog.proj_ref = new MultidimArray<double>[Nrefs];
+        prog.stddev_ref = new double[Nrefs];
+    }
+
+    virtual void TearDown()
+    {
+        delete [] prog.fP_ref;
+        delete [] prog.proj_ref;
+        delete [] prog.stddev_ref;
+        fnStack.deleteFile();
+    }
+
+    ProgAngularProjectionMatching prog;
+    FileName fnStack;
+    int Nrefs, dim;
+};
+
+TEST_F( AngularProjectionMatchingTest, sharedGalleryAsCache)
+{
+    XMIPP_TRY
+    // References as prepared in the cache of each node
+    std::vector<MultidimArray<double> > Mref(Nrefs);
+    std::vector<Polar<std::complex<double> > > fP(Nrefs);
+    std::vector<double> stddev(Nrefs);
+    for (int refno = 0; refno < Nrefs; refno++)
+    {
+        prog.getCurrentReference(refno, prog.global_plans);
+        int counter = prog.pointer_allrefs2refsinmem[refno];
+        ASSERT_GE(counter, 0);
+        Mref[refno] = prog.proj_ref[counter];
+        fP[refno] = prog.fP_ref[counter];
+        stddev[refno] = prog.stddev_ref[counter];
+    }
+
+    // Gallery prepared in turns by three nodes, as in the shared window
+    size_t refSize = prog.getGalleryReferenceSize();
+    std::vector<double> gallery(Nrefs * refSize);
+    int hostSize = 3;
+    for (int hostRank = 0; hostRank < hostSize; hostRank++)
+        for (int pos = hostRank; pos < Nrefs; pos += hostSize)
+            prog.storeReferenceInGallery(pos, &gallery[0], prog.global_plans);
+    prog.aliasGallery(&gallery[0]);
+
+    EXPECT_EQ(Nrefs, prog.counter_refs_in_memory);
+    for (int refno = 0; refno < Nrefs; refno++)
+    {
+        int pos = prog.pointer_allrefs2refsinmem[refno];
+        ASSERT_GE(pos, 0);
+        EXPECT_EQ(refno, prog.pointer_refsinmem2allrefs[pos]);
+        EXPECT_EQ(stddev[refno], prog.stddev_ref[pos]);
+
+        // The references alias the gallery and are equal to the cached ones
+        const MultidimArray<double> &Mgallery = prog.proj_ref[pos];
+        EXPECT_EQ(&gallery[pos * refSize + 1], MULTIDIM_ARRAY(Mgallery));
+        EXPECT_TRUE(Mref[refno].sameShape(Mgallery));
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Mgallery)
+        EXPECT_EQ(DIRECT_MULTIDIM_ELEM(Mref[refno], n), DIRECT_MULTIDIM_ELEM(Mgallery, n));
+
+        const Polar<std::complex<double> > &fPgallery = prog.fP_ref[pos];
+        ASSERT_EQ(fP[refno].getRingNo(), fPgallery.getRingNo());
+        for (int i = 0; i < fPgallery.getRingNo(); i++)
+        {
+            ASSERT_EQ(fP[refno].getSampleNo(i), fPgallery.getSampleNo(i));
+            EXPECT_EQ(fP[refno].ring_radius[i], fPgallery.ring_radius[i]);
+            for (int j = 0; j < fPgallery.getSampleNo(i); j++)
+                EXPECT_EQ(fP[refno](i, j), fPgallery(i, j));
+        }
+    }
+    XMIPP_CATCH
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
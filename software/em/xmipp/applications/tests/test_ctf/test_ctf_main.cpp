@@ -5,6 +5,7 @@
 #include "data/transform_downsample.h"
 #include <gtest/gtest.h>
 #include "data/ctf.h"
+#include "data/xmipp_fft.h"
 
 // MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
 // This test is named "Size", and belongs to the "MetadataTest"
@@ -143,6 +144,79 @@ TEST_F( CtfTest, errorMaxFreqCTFs2D)
     XMIPP_CATCH
 }
 
+TEST_F( CtfTest, wienerAccumulator)
+{
+    XMIPP_TRY
+    // Object seen through two CTFs that are never zero at the same frequency
+    int Xdim=32;
+    MultidimArray<double> obj(Xdim,Xdim);
+    obj.setXmippOrigin();
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(obj)
+    A2D_ELEM(obj,i,j)=exp(-((i-3)*(i-3)+(j+2)*(j+2))/20.)+0.5*exp(-(i*i+(j-5)*(j-5))/8.);
+    MultidimArray<double> ctf1(Xdim,Xdim), ctf2(Xdim,Xdim);
+    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(ctf1)
+    {
+        int ii=(i<=Xdim/2) ? i : Xdim-i;
+        int jj=(j<=Xdim/2) ? j : Xdim-j;
+        double r=sqrt((double)(ii*ii+jj*jj));
+        dAij(ctf1,i,j)=cos(0.4*r);
+        dAij(ctf2,i,j)=sin(0.4*r+0.3);
+    }
+
+    // Sums of 3 and 5 images of each group, accumulated together and apart
+    MultidimArray< std::complex<double> > Fobj, Faux;
+    FourierTransform(obj,Fobj);
+    double n[2]={3,5};
+    MultidimArray<double> *ctfs[2]={&ctf1,&ctf2};
+    CTFWienerAccumulator wien, wienGroup[2];
+    wien.initialize(Xdim);
+    for (int g=0; g<2; g++)
+    {
+        Faux=Fobj;
+        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(Faux)
+        dAij(Faux,i,j)*=n[g]*dAij(*ctfs[g],i,j);
+        MultidimArray<double> sum;
+        InverseFourierTransform(Faux,sum);
+        wien.add(sum,n[g],*ctfs[g]);
+        wienGroup[g].initialize(Xdim);
+        wienGroup[g].add(sum,n[g],*ctfs[g]);
+    }
+    wienGroup[0].add(wienGroup[1]);
+    EXPECT_DOUBLE_EQ(8,wien.weight);
+    EXPECT_DOUBLE_EQ(8,wienGroup[0].weight);
+
+    // Without Wiener constant the CTFs are fully corrected
+    MultidimArray<double> avg, avgGroups;
+    wien.getAverage(0,Xdim,avg);
+    wienGroup[0].getAverage(0,Xdim,avgGroups);
+    ASSERT_TRUE(avg.sameShape(obj));
+    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(obj)
+    {
+        EXPECT_NEAR(DIRECT_A2D_ELEM(obj,i,j),DIRECT_A2D_ELEM(avg,i,j),1e-10);
+        EXPECT_NEAR(DIRECT_A2D_ELEM(avg,i,j),DIRECT_A2D_ELEM(avgGroups,i,j),1e-12);
+    }
+
+    // The constant is added once for all the images: at each frequency the
+    // gain is <CTF^2>/(<CTF^2>+c), with the average over both groups
+    double c=0.2;
+    wien.getAverage(c,Xdim,avg);
+    double ctf1_0=dAij(ctf1,0,0), ctf2_0=dAij(ctf2,0,0);
+    double ctf2avg=(n[0]*ctf1_0*ctf1_0+n[1]*ctf2_0*ctf2_0)/8;
+    EXPECT_NEAR(obj.sum()*ctf2avg/(ctf2avg+c),avg.sum(),1e-9);
+
+    // Padding and default constant
+    CTFWienerAccumulator wienPad;
+    MultidimArray<double> ctfPad(2*Xdim,2*Xdim);
+    ctfPad.initConstant(1.);
+    wienPad.initialize(2*Xdim);
+    wienPad.add(obj,1.,ctfPad);
+    wienPad.getAverage(-1,Xdim,avg);
+    ASSERT_EQ(XSIZE(obj),XSIZE(avg));
+    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(obj)
+    EXPECT_NEAR(DIRECT_A2D_ELEM(obj,i,j)/1.1,DIRECT_A2D_ELEM(avg,i,j),1e-10);
+    XMIPP_CATCH
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
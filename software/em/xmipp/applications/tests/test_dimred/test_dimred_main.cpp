@@ -89,6 +89,128 @@ TEST_F( DimRedTest, intrinsic_dimensionality)
 	EXPECT_LT(fabs(dimCorrDim-expectedDim),1e-6);
 }
 
+TEST_F( DimRedTest, k_nearest_neighbours)
+{
+	GenerateData generator;
+	generator.generateNewDataset("swiss",2000,0);
+	const int K=12;
+
+	// Single and multithreaded brute force must be the same
+	Matrix2D<int> idx, idxThreads, idxApprox;
+	Matrix2D<double> D2, D2Threads, D2Approx;
+	kNearestNeighboursBruteForce(generator.X,K,idx,D2);
+	kNearestNeighboursBruteForce(generator.X,K,idxThreads,D2Threads,NULL,3);
+	ASSERT_TRUE(D2.equal(D2Threads,1e-9));
+
+	// Most of the neighbours must be found by NN-descent
+	kNearestNeighboursNNDescent(generator.X,K,idxApprox,D2Approx,NULL,3);
+	size_t found=0;
+	FOR_ALL_ELEMENTS_IN_MATRIX2D(idxApprox)
+		for (int k=0; k<K; ++k)
+			if (MAT_ELEM(idxApprox,i,j)==MAT_ELEM(idx,i,k))
+			{
+				++found;
+				break;
+			}
+	EXPECT_GT(found,0.95*MAT_XSIZE(idx)*MAT_YSIZE(idx));
+
+	// A sample with NaN coordinates is nobody's neighbour and has no neighbours
+	MAT_ELEM(generator.X,5,0)=sqrt(-1.0);
+	kNearestNeighboursNNDescent(generator.X,K,idxApprox,D2Approx,NULL,3);
+	FOR_ALL_ELEMENTS_IN_MATRIX2D(idxApprox)
+	{
+		EXPECT_NE(MAT_ELEM(idxApprox,i,j),5);
+		if (i==5)
+			EXPECT_EQ(MAT_ELEM(idxApprox,i,j),-1);
+		else
+			EXPECT_FALSE(ISNAN(MAT_ELEM(D2Approx,i,j)));
+	}
+}
+
+// Euclidean distance, NaN for sample 5 and infinite for sample 7
+static size_t userDistanceCalls=0;
+static double userDistance(const Matrix2D<double> &X, size_t i1, size_t i2)
+{
+	++userDistanceCalls;
+	if (i1==5 || i2==5)
+		return sqrt(-1.0);
+	if (i1==7 || i2==7)
+		return HUGE_VAL;
+	double d=0;
+	for (size_t j=0; j<MAT_XSIZE(X); ++j)
+		d+=(MAT_ELEM(X,i1,j)-MAT_ELEM(X,i2,j))*(MAT_ELEM(X,i1,j)-MAT_ELEM(X,i2,j));
+	return d;
+}
+
+TEST_F( DimRedTest, k_nearest_neighbours_user_distance)
+{
+	GenerateData generator;
+	generator.generateNewDataset("swiss",300,0);
+	size_t N=MAT_YSIZE(generator.X);
+	const int K=12;
+
+	// Each pair is evaluated once
+	Matrix2D<int> idx;
+	Matrix2D<double> D2;
+	userDistanceCalls=0;
+	kNearestNeighboursBruteForce(generator.X,K,idx,D2,&userDistance);
+	EXPECT_EQ(N*(N-1)/2,userDistanceCalls);
+	FOR_ALL_ELEMENTS_IN_MATRIX2D(idx)
+		if (i==5 || i==7)
+			EXPECT_EQ(MAT_ELEM(idx,i,j),-1);
+		else
+		{
+			EXPECT_NE(MAT_ELEM(idx,i,j),5);
+			EXPECT_NE(MAT_ELEM(idx,i,j),7);
+		}
+
+	// The samples without neighbours are isolated
+	Matrix2D<double> D;
+	computeDistanceToNeighbours(generator.X,K,D,&userDistance);
+	for (size_t j=0; j<N; ++j)
+	{
+		EXPECT_EQ(0,MAT_ELEM(D,5,j));
+		EXPECT_EQ(0,MAT_ELEM(D,j,7));
+	}
+	SparseMatrix2D W;
+	computeSparseNeighbourSimilarity(generator.X,K,1.0,W,&userDistance);
+	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(W.jIdx)
+	{
+		int j=DIRECT_MULTIDIM_ELEM(W.jIdx,n);
+		EXPECT_TRUE(j>=1 && j<=(int)N);
+		EXPECT_GT(DIRECT_MULTIDIM_ELEM(W.values,n),0);
+	}
+	EXPECT_EQ(0,W.getElemIJ(5,6));
+}
+
+TEST_F( DimRedTest, diffusionKernelSingularVectors)
+{
+	// Kernel normalized by its row sums, as in diffusion maps with t=1.
+	// It is not symmetric.
+	GenerateData generator;
+	generator.generateNewDataset("swiss",300,0);
+	Matrix2D<double> K;
+	computeDistance(generator.X,K,NULL,false);
+	computeSimilarityMatrix(K,1.0);
+	Matrix1D<double> p;
+	K.rowSum(p);
+	FOR_ALL_ELEMENTS_IN_MATRIX2D(K)
+		MAT_ELEM(K,i,j)/=VEC_ELEM(p,i);
+
+	// Lanczos must give the same vectors as the dense SVD, up to their sign
+	const int M=3;
+	Matrix2D<double> U, Ulanczos;
+	diffusionKernelSingularVectors(K,M,false,true,U);
+	diffusionKernelSingularVectors(K,M,false,false,Ulanczos);
+	for (int j=0; j<M; ++j)
+	{
+		double dot=0;
+		for (size_t i=0; i<MAT_YSIZE(K); ++i)
+			dot+=MAT_ELEM(U,i,j)*MAT_ELEM(Ulanczos,i,j);
+		EXPECT_NEAR(1,fabs(dot),1e-6) << "singular vector " << j;
+	}
+}
+
 #define INCOMPLETE_TEST(method,DimredClass,dataset,Npoints,file) \
 	TEST_F( DimRedTest, method) \
 { \
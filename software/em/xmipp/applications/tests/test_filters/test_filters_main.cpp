@@ -68,6 +68,41 @@ TEST_F( FiltersTest, bestShift)
 
 }
 
+TEST_F( FiltersTest, bestShiftInWindow)
+{
+    // Gaussian blobs displaced by a fraction of pixel
+    MultidimArray<double> I1(64,64), I2(64,64);
+    I1.setXmippOrigin();
+    I2.setXmippOrigin();
+    double dx=0.7, dy=-1.4;
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(I1)
+    {
+        A2D_ELEM(I1,i,j)=exp(-((i-dy)*(i-dy)+(j-dx)*(j-dx))/18.0);
+        A2D_ELEM(I2,i,j)=exp(-(i*i+j*j)/18.0);
+    }
+    FourierTransformer transformer1, transformer2;
+    MultidimArray< std::complex<double> > FFTI1, FFTI2;
+    transformer1.FourierTransform(I1,FFTI1,true);
+    transformer2.FourierTransform(I2,FFTI2,true);
+
+    // Small windows use the partial inverse DFT and large ones the FFT,
+    // both must give the same correlation as bestShift
+    int maxShift[]={2,10};
+    for (int n=0; n<2; n++)
+    {
+        double x, y, xw, yw;
+        MultidimArray<double> Mcorr;
+        Mcorr.resize(I1);
+        CorrelationAux aux;
+        double corr=bestShift(FFTI1,FFTI2,Mcorr,x,y,aux,NULL,maxShift[n]);
+        WindowedShiftAux waux;
+        double corrw=bestShiftInWindow(FFTI1,FFTI2,XSIZE(I1),YSIZE(I1),xw,yw,maxShift[n],waux);
+        EXPECT_NEAR(corr,corrw,1e-6);
+        EXPECT_NEAR(xw,dx,0.15);
+        EXPECT_NEAR(yw,dy,0.15);
+    }
+}
+
 TEST_F( FiltersTest, correlation_matrix)
 {
     MultidimArray<double> Mcorr;
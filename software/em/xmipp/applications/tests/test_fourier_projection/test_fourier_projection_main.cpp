@@ -0,0 +1,97 @@
+#include <reconstruction/fourier_projection.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class FourierProjectionTest : public ::testing::Test
+{
+protected:
+    // Two blobs of different densities and a set of directions
+    virtual void SetUp()
+    {
+        V.initZeros(32, 32, 32);
+        V.setXmippOrigin();
+        FOR_ALL_ELEMENTS_IN_ARRAY3D(V)
+        {
+            if (k * k + 2 * i * i + 3 * j * j < 300)
+                A3D_ELEM(V, k, i, j) += 1;
+            if ((k - 8) * (k - 8) + i * i + (j + 5) * (j + 5) < 30)
+                A3D_ELEM(V, k, i, j) += 2;
+        }
+        angles.initZeros(20, 3);
+        for (size_t n = 0; n < MAT_YSIZE(angles); n++)
+        {
+            MAT_ELEM(angles, n, 0) = n * 17.3;
+            MAT_ELEM(angles, n, 1) = n * 8.9;
+            MAT_ELEM(angles, n, 2) = n * 31.1;
+        }
+    }
+    MultidimArray<double> V;
+    Matrix2D<double> angles;
+};
+
+TEST_F( FourierProjectionTest, batchProjection)
+{
+    // The projector takes the volume, so each projector gets a copy
+    MultidimArray<double> V1(V), V2(V);
+    FourierProjector projector(V1, 2, 0.5, BSPLINE3);
+    FourierProjector projectorBatch(V2, 2, 0.5, BSPLINE3);
+
+    MultidimArray<double> gallery, P;
+    projectorBatch.project(angles, gallery, 3);
+    ASSERT_EQ(NSIZE(gallery), MAT_YSIZE(angles));
+    ASSERT_EQ(XSIZE(gallery), XSIZE(V));
+    P.resizeNoCopy(YSIZE(gallery), XSIZE(gallery));
+    for (size_t k = 0; k < MAT_YSIZE(angles); k++)
+    {
+        projector.project(MAT_ELEM(angles, k, 0), MAT_ELEM(angles, k, 1), MAT_ELEM(angles, k, 2));
+        gallery.getImage(k, P);
+        const MultidimArray<double> &Psingle = projector.projection();
+        double maxDiff = 0;
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(P)
+        maxDiff = XMIPP_MAX(maxDiff, fabs(DIRECT_MULTIDIM_ELEM(P, n) - DIRECT_MULTIDIM_ELEM(Psingle, n)));
+        EXPECT_LT(maxDiff, 1e-9) << "projection " << k;
+    }
+}
+
+TEST_F( FourierProjectionTest, reducedSize)
+{
+    // A smaller output is the full size projection cropped in Fourier
+    const int N = XSIZE(V), M = 16;
+    FourierProjector projector(V, 2, 0.5, BSPLINE3);
+    std::vector< MultidimArray< std::complex<double> > > small;
+    projector.projectFourier(angles, small, 3, M);
+    ASSERT_EQ(small.size(), MAT_YSIZE(angles));
+
+    Matrix2D<double> E;
+    MultidimArray< std::complex<double> > full;
+    for (size_t n = 0; n < MAT_YSIZE(angles); n++)
+    {
+        ASSERT_EQ(YSIZE(small[n]), M);
+        ASSERT_EQ(XSIZE(small[n]), M / 2 + 1);
+        Euler_angles2matrix(MAT_ELEM(angles, n, 0), MAT_ELEM(angles, n, 1), MAT_ELEM(angles, n, 2), E);
+        projector.projectFourier(E, full);
+        double maxDiff = 0;
+        for (int i = 0; i < M; i++)
+        {
+            // The Nyquist row and column are not shared by both sizes
+            if (i == M / 2)
+                continue;
+            int ifull = (i < M / 2) ? i : N - M + i;
+            for (int j = 0; j < M / 2; j++)
+                maxDiff = XMIPP_MAX(maxDiff, std::abs(DIRECT_A2D_ELEM(small[n], i, j) - DIRECT_A2D_ELEM(full, ifull, j)));
+        }
+        EXPECT_LT(maxDiff, 1e-9) << "projection " << n;
+    }
+
+    MultidimArray<double> gallery;
+    projector.project(angles, gallery, 2, M);
+    EXPECT_EQ(NSIZE(gallery), MAT_YSIZE(angles));
+    EXPECT_EQ(XSIZE(gallery), M);
+    EXPECT_EQ(YSIZE(gallery), M);
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,4 +1,5 @@
 #include <data/xmipp_funcs.h>
+#include <data/numerical_tools.h>
 #include <iostream>
 #include <gtest/gtest.h>
 // MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
@@ -29,6 +30,48 @@ TEST_F( FuncTest, CompareTwoFiles)
     ASSERT_FALSE(compareTwoFiles(source1,source2,0));
 }
 
+class ShiftedRosenbrock: public OptimizationObjective
+{
+public:
+    double a;
+    double evaluate(double *x)
+    {
+        double u=x[1]-a, v=x[2]-a*a;
+        return (1-u)*(1-u)+100*(v-u*u)*(v-u*u);
+    }
+};
+
+TEST_F( FuncTest, PowellBatch)
+{
+    size_t N=20;
+    std::vector<ShiftedRosenbrock> objectives(N);
+    std::vector<PowellProblem> problems(N);
+    for (size_t i=0; i<N; i++)
+    {
+        objectives[i].a=0.1*i;
+        problems[i].f=&objectives[i];
+        problems[i].p.initZeros(2);
+        problems[i].steps.initConstant(2,1);
+        problems[i].n=2;
+        problems[i].ftol=1e-10;
+    }
+    powellOptimizerBatch(problems,4);
+    for (size_t i=0; i<N; i++)
+    {
+        // Same result as optimizing the problems one by one
+        Matrix1D<double> p(2), steps(2);
+        steps.initConstant(1);
+        double fitness;
+        int iter;
+        powellOptimizer(p,1,2,objectives[i],1e-10,fitness,iter,steps);
+        ASSERT_FALSE(problems[i].failed);
+        ASSERT_EQ(fitness,problems[i].fret);
+        ASSERT_EQ(p(0),problems[i].p(0));
+        ASSERT_EQ(p(1),problems[i].p(1));
+        ASSERT_NEAR(problems[i].p(0),1+objectives[i].a,1e-3);
+        ASSERT_NEAR(problems[i].p(1),1+objectives[i].a*objectives[i].a,1e-3);
+    }
+}
 
 GTEST_API_ int main(int argc, char **argv)
 {
@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <data/xmipp_image.h>
 #include <data/xmipp_image_extension.h>
+#include <data/xmipp_image_stack.h>
+#include <data/xmipp_threads.h>
 #include <iostream>
 #include <gtest/gtest.h>
 #include <data/metadata.h>
@@ -294,6 +296,29 @@ TEST_F( ImageTest, writeTIFimage)
     XMIPP_CATCH
 }
 
+TEST_F( ImageTest, readRangeTIFstack)
+{
+    XMIPP_TRY
+    FileName auxFn;
+    auxFn.initUniqueName("/tmp/temp_tifstk_XXXXXX");
+    auxFn = auxFn + ".tif";
+    myStack.write(auxFn);
+    size_t Xdim, Ydim, Zdim, Ndim;
+    myStack.getDimensions(Xdim, Ydim, Zdim, Ndim);
+    Image<double> auxImage, auxRange;
+    auxRange.readRange(auxFn, 2, Ndim, 3);
+    EXPECT_EQ(Ndim - 1, NSIZE(auxRange()));
+    for (size_t n = 2; n <= Ndim; ++n)
+    {
+        auxImage.read(auxFn, DATA, n);
+        MultidimArray<double> slice;
+        auxRange().getImage(n - 2, slice);
+        EXPECT_TRUE(auxImage().equal(slice));
+    }
+    auxFn.deleteFile();
+    XMIPP_CATCH
+}
+
 TEST_F( ImageTest, writeINFimage)
 {
     XMIPP_TRY
@@ -420,6 +445,94 @@ TEST_F( ImageTest, checkImageFileSize)
     XMIPP_CATCH
 }
 
+// Image n of the stacks written by the threads
+void fillPreallocatedStackImage(Image<double> &I, size_t n)
+{
+    I().initZeros(24, 32);
+    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(I())
+    DIRECT_A2D_ELEM(I(), i, j) = 100. * n + i - 0.5 * j;
+}
+
+struct PreallocatedStackData
+{
+    FileName fn;
+    size_t N;
+    int nThreads;
+};
+
+// Each thread opens the stack and writes its own images
+void threadWritePreallocatedStack(ThreadArgument &thArg)
+{
+    PreallocatedStackData *data = (PreallocatedStackData *) thArg.workClass;
+    PreallocatedStack stack;
+    stack.open(data->fn);
+    Image<double> I;
+    for (size_t n = thArg.thread_id + 1; n <= data->N; n += data->nThreads)
+    {
+        fillPreallocatedStackImage(I, n);
+        stack.write(I, n);
+    }
+}
+
+TEST_F( ImageTest, preallocatedStack)
+{
+    XMIPP_TRY
+    const char *extensions[] = {"stk", "mrcs"};
+    for (int e = 0; e < 2; e++)
+    {
+        FileName auxFn;
+        auxFn.initUniqueName("/tmp/temp_pstk_XXXXXX");
+        PreallocatedStackData data;
+        data.fn = auxFn + "." + extensions[e];
+        data.N = 10;
+        data.nThreads = 3;
+        PreallocatedStack::create(data.fn, 32, 24, 1, data.N);
+        ThreadManager thMgr(data.nThreads, &data);
+        thMgr.run(threadWritePreallocatedStack);
+
+        PreallocatedStack stack;
+        stack.open(data.fn);
+        stack.finalize();
+        stack.close();
+
+        Image<double> I, expectedI;
+        double minVal, maxVal;
+        for (size_t n = 1; n <= data.N; n++)
+        {
+            fillPreallocatedStackImage(expectedI, n);
+            I.read(formatString("%lu@%s", n, data.fn.c_str()));
+            EXPECT_TRUE(expectedI().equal(I(), 1e-6)) << "image " << n << " of " << data.fn;
+        }
+        I.read(data.fn, HEADER);
+        I.MDMainHeader.getValue(MDL_MIN, minVal);
+        I.MDMainHeader.getValue(MDL_MAX, maxVal);
+        EXPECT_DOUBLE_EQ(100. - 15.5, minVal);
+        EXPECT_DOUBLE_EQ(100. * data.N + 23, maxVal);
+        data.fn.deleteFile();
+        auxFn.deleteFile();
+    }
+
+    // A single SPIDER image has no image header after the main one
+    FileName auxFn;
+    auxFn.initUniqueName("/tmp/temp_pstk_XXXXXX");
+    FileName fnSingle = auxFn + ".spi";
+    Image<double> I, expectedI;
+    I().initZeros(24, 32);
+    I.write(fnSingle);
+    size_t fileSize = fnSingle.getFileSize();
+    PreallocatedStack stack;
+    stack.open(fnSingle);
+    fillPreallocatedStackImage(expectedI, 1);
+    stack.write(expectedI, 1);
+    stack.close();
+    I.read(fnSingle);
+    EXPECT_TRUE(expectedI().equal(I(), 1e-6));
+    EXPECT_EQ(fileSize, fnSingle.getFileSize());
+    fnSingle.deleteFile();
+    auxFn.deleteFile();
+    XMIPP_CATCH
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,55 @@
+#include <classification/gaussian_kerdensom.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class KerDenSOMTest : public ::testing::Test
+{
+protected:
+    // Two clusters of vectors
+    virtual void SetUp()
+    {
+        const int dim = 50;
+        for (int n = 0; n < 300; n++)
+        {
+            FeatureVector v(dim);
+            for (int d = 0; d < dim; d++)
+                v[d] = (floatFeature) (((n % 2) ? 1 : -1) * sin(0.1 * d) + 0.3 * sin(1.7 * n + 0.37 * d));
+            ts.add(v, integerToString(n % 2));
+        }
+    }
+    ClassicTrainingVectors ts;
+};
+
+TEST_F( KerDenSOMTest, threads)
+{
+    // The initial memberships are random, so both trainings start from the
+    // same code vectors (update mode) instead
+    FuzzyMap initialMap("RECT", 4, 3, ts);
+    FuzzyMap map1(initialMap), mapN(initialMap);
+    TextualListener listener;
+    listener.setVerbosity() = 0;
+    FileName fnDummy;
+
+    GaussianKerDenSOM som1(1000, 100, 3, 1e-7, 20);
+    som1.setListener(&listener);
+    som1.train(map1, ts, fnDummy, true);
+
+    GaussianKerDenSOM somN(1000, 100, 3, 1e-7, 20);
+    somN.setListener(&listener);
+    somN.setThreads(3);
+    somN.train(mapN, ts, fnDummy, true);
+
+    ASSERT_EQ(map1.size(), mapN.size());
+    for (size_t i = 0; i < map1.size(); i++)
+        for (size_t d = 0; d < map1.theItems[i].size(); d++)
+            EXPECT_EQ(map1.theItems[i][d], mapN.theItems[i][d]);
+    for (size_t n = 0; n < ts.size(); n++)
+        for (size_t i = 0; i < map1.size(); i++)
+            EXPECT_EQ(map1.memb[n][i], mapN.memb[n][i]);
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
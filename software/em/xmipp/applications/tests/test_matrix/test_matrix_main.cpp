@@ -1,4 +1,5 @@
 #include <data/matrix2d.h>
+#include <data/sparse_matrix2d.h>
 #include <iostream>
 #include <gtest/gtest.h>
 // MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
@@ -322,6 +323,118 @@ TEST_F( MatrixTest, matrixOperation_AtA)
     EXPECT_EQ(expectedB,B) << "matrixOperation_AtA failed";
 }
 
+// Reference product C=op(A)*op(B) with the plain triple loop
+void naiveProduct(const Matrix2D<double> &A, bool transA, const Matrix2D<double> &B, bool transB,
+                  Matrix2D<double> &C)
+{
+    size_t m = transA ? MAT_XSIZE(A) : MAT_YSIZE(A);
+    size_t k = transA ? MAT_YSIZE(A) : MAT_XSIZE(A);
+    size_t n = transB ? MAT_YSIZE(B) : MAT_XSIZE(B);
+    C.initZeros(m, n);
+    for (size_t i = 0; i < m; ++i)
+        for (size_t j = 0; j < n; ++j)
+            for (size_t l = 0; l < k; ++l)
+                MAT_ELEM(C, i, j) += (transA ? MAT_ELEM(A, l, i) : MAT_ELEM(A, i, l)) *
+                                     (transB ? MAT_ELEM(B, j, l) : MAT_ELEM(B, l, j));
+}
+
+TEST_F( MatrixTest, matrixProducts)
+{
+    // Sizes that are not multiple of the blocks of the products
+    Matrix2D<double> A, B, C, expectedC;
+    A.initGaussian(301, 257, 0, 1);
+    B.initGaussian(257, 190, 0, 1);
+    Matrix2D<double> At = A.transpose(), Bt = B.transpose();
+    Matrix1D<double> x, y;
+    x.initZeros(257);
+    FOR_ALL_ELEMENTS_IN_MATRIX1D(x)
+    VEC_ELEM(x, i) = 0.1 * i;
+    Matrix2D<double> X;
+    X.fromVector(x);
+
+    for (int nThreads = 1; nThreads <= 3; nThreads += 2)
+    {
+        setMatrixOperationThreads(nThreads);
+        naiveProduct(A, false, B, false, expectedC);
+        EXPECT_TRUE(expectedC.equal(A * B, 1e-9)) << "operator* failed";
+        matrixOperation_AB(A, B, C);
+        EXPECT_TRUE(expectedC.equal(C, 1e-9)) << "matrixOperation_AB failed";
+        matrixOperation_ABt(A, Bt, C);
+        EXPECT_TRUE(expectedC.equal(C, 1e-9)) << "matrixOperation_ABt failed";
+        matrixOperation_AtB(At, B, C);
+        EXPECT_TRUE(expectedC.equal(C, 1e-9)) << "matrixOperation_AtB failed";
+        matrixOperation_AtBt(At, Bt, C);
+        EXPECT_TRUE(expectedC.equal(C, 1e-9)) << "matrixOperation_AtBt failed";
+
+        naiveProduct(A, true, A, false, expectedC);
+        matrixOperation_AtA(A, C);
+        EXPECT_TRUE(expectedC.equal(C, 1e-9)) << "matrixOperation_AtA failed";
+        naiveProduct(A, false, A, true, expectedC);
+        matrixOperation_AAt(A, C);
+        EXPECT_TRUE(expectedC.equal(C, 1e-9)) << "matrixOperation_AAt failed";
+
+        naiveProduct(A, false, X, false, expectedC);
+        matrixOperation_Ax(A, x, y);
+        C.fromVector(y);
+        EXPECT_TRUE(expectedC.equal(C, 1e-9)) << "matrixOperation_Ax failed";
+        naiveProduct(At, true, X, false, expectedC);
+        matrixOperation_Atx(At, x, y);
+        C.fromVector(y);
+        EXPECT_TRUE(expectedC.equal(C, 1e-9)) << "matrixOperation_Atx failed";
+    }
+    setMatrixOperationThreads(1);
+
+    // Small products keep the summation order of the direct triple loop
+    Matrix2D<double> A4, B4;
+    A4.initGaussian(4, 4, 0, 1);
+    B4.initGaussian(4, 4, 0, 1);
+    naiveProduct(A4, false, B4, false, expectedC);
+    EXPECT_TRUE(expectedC.equal(A4 * B4, 0.)) << "operator* failed for 4x4 matrices";
+}
+
+TEST_F( MatrixTest, lanczosEigs)
+{
+    // Symmetric band matrix, stored as dense and sparse
+    const int N=200;
+    Matrix2D<double> A;
+    A.initZeros(N,N);
+    std::vector<SparseElement> elements;
+    SparseElement e;
+    for (int i=0; i<N; ++i)
+        for (int j=XMIPP_MAX(0,i-3); j<=XMIPP_MIN(N-1,i+3); ++j)
+        {
+            MAT_ELEM(A,i,j)=(i==j) ? 2+0.01*i : 1.0/(1+i+j);
+            e.i=i;
+            e.j=j;
+            e.value=MAT_ELEM(A,i,j);
+            elements.push_back(e);
+        }
+    SparseMatrix2D As(elements,N);
+
+    Matrix1D<double> D, Dlanczos;
+    Matrix2D<double> P, Planczos;
+    firstEigs(A,3,D,P);
+    lanczosEigs(As,3,Dlanczos,Planczos);
+    for (int j=0; j<3; ++j)
+        EXPECT_NEAR(VEC_ELEM(D,j),VEC_ELEM(Dlanczos,j),1e-8) << "lanczosEigs (largest) failed";
+    lastEigs(A,3,D,P);
+    lanczosEigs(A,3,Dlanczos,Planczos,false);
+    for (int j=0; j<3; ++j)
+        EXPECT_NEAR(VEC_ELEM(D,j),VEC_ELEM(Dlanczos,j),1e-8) << "lanczosEigs (smallest) failed";
+
+    // Eigenvectors are equal up to their sign
+    for (int j=0; j<3; ++j)
+    {
+        double dot=0;
+        for (int i=0; i<N; ++i)
+            dot+=MAT_ELEM(P,i,j)*MAT_ELEM(Planczos,i,j);
+        EXPECT_NEAR(1,fabs(dot),1e-6);
+    }
+
+    // Unconverged eigenpairs are not returned
+    EXPECT_THROW(lanczosEigs(As,3,Dlanczos,Planczos,true,1e-30,0), XmippError);
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
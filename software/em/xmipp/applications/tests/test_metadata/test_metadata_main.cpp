@@ -7,6 +7,7 @@
 #include <gtest/gtest.h>
 #include <string.h>
 #include <fstream>
+#include <iterator>
 /*
  * Define a "Fixture so we may reuse the metadatas
  */
@@ -1145,6 +1146,163 @@ TEST_F( MetadataTest, ReadWrite)
     unlink(sfn);
 }
 
+TEST_F( MetadataTest, Serialize)
+{
+    MetaData md = mDsource;
+    std::vector<double> vd;
+    vd.push_back(1.5);
+    vd.push_back(-2.);
+    std::vector<size_t> vl(3, 7);
+    FOR_ALL_OBJECTS_IN_METADATA(md)
+    {
+        md.setValue(MDL_IMAGE, (String)"000001@images.stk", __iter.objId);
+        md.setValue(MDL_REF, (int)__iter.objId, __iter.objId);
+        md.setValue(MDL_ITEM_ID, (size_t)3, __iter.objId);
+        md.setValue(MDL_FLIP, true, __iter.objId);
+        md.setValue(MDL_CLASSIFICATION_DATA, vd, __iter.objId);
+        md.setValue(MDL_NEIGHBORS, vl, __iter.objId);
+    }
+    std::vector<char> buffer;
+    md.serialize(buffer);
+    MetaData auxMetadata;
+    auxMetadata.deserialize(&buffer[0], buffer.size());
+    EXPECT_EQ(md, auxMetadata);
+
+    MetaData emptyMetadata;
+    emptyMetadata.addLabel(MDL_X);
+    emptyMetadata.serialize(buffer);
+    auxMetadata.deserialize(&buffer[0], buffer.size());
+    EXPECT_TRUE(auxMetadata.isEmpty());
+    EXPECT_TRUE(auxMetadata.containsLabel(MDL_X));
+}
+
+TEST_F( MetadataTest, ReadWriteBinary)
+{
+    MetaData md = mDsource;
+    std::vector<double> vd;
+    vd.push_back(1.5);
+    vd.push_back(-2.);
+    std::vector<size_t> vl(3, 7);
+    FOR_ALL_OBJECTS_IN_METADATA(md)
+    {
+        md.setValue(MDL_IMAGE, formatString("%06lu@images.stk", __iter.objId), __iter.objId);
+        md.setValue(MDL_REF, (int)__iter.objId, __iter.objId);
+        md.setValue(MDL_ITEM_ID, (size_t)3, __iter.objId);
+        md.setValue(MDL_FLIP, true, __iter.objId);
+        md.setValue(MDL_CLASSIFICATION_DATA, vd, __iter.objId);
+        md.setValue(MDL_NEIGHBORS, vl, __iter.objId);
+    }
+    char sfn[32] = "";
+    strncpy(sfn, "/tmp/testBinary_XXXXXX", sizeof sfn);
+    if (mkstemp(sfn)==-1)
+    	REPORT_ERROR(ERR_IO_NOTOPEN,"Cannot create temporary file");
+    FileName fn = (String)sfn + ".xmdb";
+    md.write(fn);
+    MetaData auxMetadata;
+    auxMetadata.read(fn);
+    EXPECT_EQ(md, auxMetadata);
+
+    // Only some columns, the rest are loaded later
+    std::vector<MDLabel> labels;
+    labels.push_back(MDL_IMAGE);
+    labels.push_back(MDL_X);
+    auxMetadata.read(fn, &labels);
+    EXPECT_TRUE(auxMetadata.containsLabel(MDL_IMAGE));
+    EXPECT_FALSE(auxMetadata.containsLabel(MDL_Y));
+    EXPECT_EQ(md.size(), auxMetadata.size());
+    labels.clear();
+    labels.push_back(MDL_Y);
+    labels.push_back(MDL_REF);
+    labels.push_back(MDL_ITEM_ID);
+    labels.push_back(MDL_FLIP);
+    labels.push_back(MDL_CLASSIFICATION_DATA);
+    labels.push_back(MDL_NEIGHBORS);
+    auxMetadata.readBinaryColumns(fn, labels);
+    EXPECT_EQ(md, auxMetadata);
+
+    MetaData emptyMetadata;
+    emptyMetadata.addLabel(MDL_X);
+    emptyMetadata.write(fn);
+    auxMetadata.read(fn);
+    EXPECT_TRUE(auxMetadata.isEmpty());
+    EXPECT_TRUE(auxMetadata.containsLabel(MDL_X));
+    unlink(fn.c_str());
+    unlink(sfn);
+}
+
+/* Read a field of a binary metadata file and advance the position */
+template <typename T>
+T binaryField(const std::vector<char> &bytes, size_t &pos)
+{
+    T value;
+    memcpy(&value, &bytes[pos], sizeof(T));
+    pos += sizeof(T);
+    return value;
+}
+
+/* Write some bytes in a file, and expect an error when reading it */
+void expectBinaryError(const FileName &fn, const std::vector<char> &bytes, size_t size)
+{
+    std::ofstream ofs(fn.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    ofs.write(&bytes[0], size);
+    ofs.close();
+    MetaData md;
+    EXPECT_THROW(md.read(fn), XmippError);
+}
+
+TEST_F( MetadataTest, ReadCorruptedBinary)
+{
+    MetaData md;
+    for (size_t i = 0; i < 5; ++i)
+        md.setValue(MDL_IMAGE, formatString("%06lu@images.stk", i + 1), md.addObject());
+    char sfn[32] = "";
+    strncpy(sfn, "/tmp/testBinary_XXXXXX", sizeof sfn);
+    if (mkstemp(sfn)==-1)
+    	REPORT_ERROR(ERR_IO_NOTOPEN,"Cannot create temporary file");
+    FileName fn = (String)sfn + ".xmdb";
+    md.write(fn);
+    std::vector<char> bytes;
+    std::ifstream ifs(fn.c_str(), std::ios_base::in | std::ios_base::binary);
+    bytes.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    ifs.close();
+
+    // Position of the table with the offsets of the strings
+    size_t pos = 8;
+    size_t nObjects = binaryField<unsigned long long>(bytes, pos);
+    ASSERT_EQ(5u, nObjects);
+    ASSERT_EQ(1, binaryField<int>(bytes, pos));
+    for (int n = 0; n < 3; ++n)
+        pos += binaryField<int>(bytes, pos); // block name, comment and label
+    ASSERT_EQ(LABEL_STRING, binaryField<int>(bytes, pos));
+    size_t tablePos = binaryField<unsigned long long>(bytes, pos);
+    ASSERT_LT(tablePos + (nObjects + 1) * sizeof(unsigned long long), bytes.size());
+
+    // Truncated files
+    expectBinaryError(fn, bytes, 2);
+    expectBinaryError(fn, bytes, tablePos / 2);
+    expectBinaryError(fn, bytes, bytes.size() - 8);
+
+    // Offsets out of the column or decreasing
+    std::vector<char> corrupted = bytes;
+    unsigned long long wrongOffset = (unsigned long long) -1;
+    memcpy(&corrupted[tablePos + nObjects * sizeof(wrongOffset)], &wrongOffset, sizeof(wrongOffset));
+    expectBinaryError(fn, corrupted, corrupted.size());
+    corrupted = bytes;
+    wrongOffset = 100;
+    memcpy(&corrupted[tablePos + 2 * sizeof(wrongOffset)], &wrongOffset, sizeof(wrongOffset));
+    expectBinaryError(fn, corrupted, corrupted.size());
+
+    // The file is still readable once repaired
+    std::ofstream ofs(fn.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    ofs.write(&bytes[0], bytes.size());
+    ofs.close();
+    MetaData auxMetadata;
+    auxMetadata.read(fn);
+    EXPECT_EQ(md, auxMetadata);
+    unlink(fn.c_str());
+    unlink(sfn);
+}
+
 TEST_F( MetadataTest, WriteIntermediateBlock)
 {
     //read metadata block between another two
@@ -0,0 +1,154 @@
+#include <reconstruction/mlf_align2d.h>
+#include <data/xmipp_fft.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class MlfAlign2dTest : public ::testing::Test
+{
+protected:
+    // Use the points of the half transform up to a given radius
+    void setDim(int _dim, double maxRadius)
+    {
+        prog.dim = _dim;
+        prog.hdim = _dim / 2;
+        int dim = _dim, hdim = _dim / 2;
+        prog.pointer_2d.clear();
+        prog.pointer_i.clear();
+        prog.pointer_j.clear();
+        for (int i = 0; i <= hdim; i++)
+            for (int j = 0; j < dim; j++)
+            {
+                int kx = j > hdim ? j - dim : j;
+                if ((i == 0 && j > hdim) || sqrt((double)(i * i + kx * kx)) > maxRadius)
+                    continue;
+                prog.pointer_2d.push_back(i * dim + j);
+                prog.pointer_i.push_back(i);
+                prog.pointer_j.push_back(j);
+            }
+        prog.nr_points_2d = prog.pointer_2d.size();
+    }
+
+    // Rotated transform as computed by rotateReference
+    void fourierRotation(const MultidimArray<double> &I, double psi, std::vector<double> &out)
+    {
+        int pdim = 2 * prog.dim;
+        MultidimArray<double> Ipad;
+        MultidimArray<std::complex<double> > Fpad;
+        I.window(Ipad, FIRST_XMIPP_INDEX(pdim), FIRST_XMIPP_INDEX(pdim),
+                 LAST_XMIPP_INDEX(pdim), LAST_XMIPP_INDEX(pdim));
+        CenterFFT(Ipad, false);
+        FourierTransformer transformer;
+        transformer.FourierTransform(Ipad, Fpad, false);
+        out.clear();
+        prog.appendRotatedFTtoVector(Fpad, pdim, psi, out);
+    }
+
+    // Rotated transform as computed with --real_space_rotations
+    void realSpaceRotation(const MultidimArray<double> &I, double psi, std::vector<double> &out)
+    {
+        MultidimArray<double> Irot(prog.dim, prog.dim);
+        Irot.setXmippOrigin();
+        MultidimArray<std::complex<double> > F;
+        rotate(BSPLINE3, Irot, I, -psi, 'Z', WRAP);
+        FourierTransformHalf(Irot, F);
+        out.clear();
+        prog.appendFTtoVector(F, out);
+    }
+
+    // Maximum absolute difference between two vectors
+    double maxDifference(const std::vector<double> &v1, const std::vector<double> &v2)
+    {
+        double maxDiff = 0;
+        for (size_t n = 0; n < v1.size(); n++)
+            maxDiff = XMIPP_MAX(maxDiff, fabs(v1[n] - v2[n]));
+        return maxDiff;
+    }
+
+    ProgMLF2D prog;
+};
+
+TEST_F( MlfAlign2dTest, rotatedTransformMultiplesOf90)
+{
+    // Rotations by multiples of 90 degrees sample the padded transform at
+    // its grid points, so the result is the same as in real space
+    setDim(32, 14);
+    MultidimArray<double> I(32, 32);
+    I.initRandom(0, 1);
+    I.setXmippOrigin();
+    std::vector<double> v, vref;
+    for (int k = 0; k < 4; k++)
+    {
+        fourierRotation(I, 90 * k, v);
+        realSpaceRotation(I, 90 * k, vref);
+        ASSERT_EQ(vref.size(), v.size());
+        EXPECT_LT(maxDifference(v, vref), 1e-10) << "psi=" << 90 * k;
+    }
+}
+
+TEST_F( MlfAlign2dTest, rotatedTransformSmoothImage)
+{
+    // For a smooth image any rotation agrees with the real space one up to
+    // the interpolation errors of both methods (a few percent of the
+    // largest coefficient for the bilinear interpolation of the transform
+    // padded twice). A wrong rotation or phase gives errors of the order
+    // of the coefficients themselves
+    for (int dim = 32; dim <= 33; dim++)
+    {
+        setDim(dim, dim / 4);
+        MultidimArray<double> I(dim, dim);
+        I.setXmippOrigin();
+        FOR_ALL_ELEMENTS_IN_ARRAY2D(I)
+        A2D_ELEM(I, i, j) = exp(-((i - 3) * (i - 3) + (j + 4) * (j + 4)) / 18.) +
+                            0.5 * exp(-((i + 5) * (i + 5) + (j - 2) * (j - 2)) / 8.);
+        std::vector<double> v, vref;
+        double psis[] = {SMALLANGLE, 13, 37, 61.5, 80};
+        for (int k = 0; k < 5; k++)
+        {
+            fourierRotation(I, psis[k], v);
+            realSpaceRotation(I, psis[k], vref);
+            ASSERT_EQ(vref.size(), v.size());
+            double maxRef = 0;
+            for (size_t n = 0; n < vref.size(); n++)
+                maxRef = XMIPP_MAX(maxRef, fabs(vref[n]));
+            EXPECT_LT(maxDifference(v, vref), 0.05 * maxRef) << "dim=" << dim << " psi=" << psis[k];
+        }
+    }
+}
+
+TEST_F( MlfAlign2dTest, flippedTransform)
+{
+    // Flips reindex the transform and are exact for even and odd sizes
+    prog.psi_step = 5;
+    prog.search_rot = 999;
+    prog.do_mirror = true;
+    prog.initSamplingStuff();
+    ASSERT_EQ(8, (int)prog.F.size());
+    for (int dim = 32; dim <= 33; dim++)
+    {
+        setDim(dim, dim / 2);
+        MultidimArray<double> I(dim, dim), Iflip(dim, dim);
+        I.initRandom(0, 1);
+        I.setXmippOrigin();
+        Iflip.setXmippOrigin();
+        MultidimArray<std::complex<double> > Ffull, F;
+        FourierTransform(I, Ffull);
+        std::vector<double> v, vref;
+        for (size_t iflip = 0; iflip < prog.F.size(); iflip++)
+        {
+            applyGeometry(LINEAR, Iflip, I, prog.F[iflip], IS_INV, WRAP);
+            FourierTransformHalf(Iflip, F);
+            vref.clear();
+            prog.appendFTtoVector(F, vref);
+            v.clear();
+            prog.appendFlippedFTtoVector(Ffull, prog.F[iflip], -STARTINGX(I), v);
+            ASSERT_EQ(vref.size(), v.size());
+            EXPECT_LT(maxDifference(v, vref), 1e-10) << "dim=" << dim << " flip=" << iflip;
+        }
+    }
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,144 @@
+#include <parallel/xmipp_mpi.h>
+#include <algorithm>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+
+MpiNode *node = NULL;
+
+typedef std::pair<size_t, size_t> Block;
+
+// Blocks taken by several threads from a distributor
+struct BlockCollector
+{
+    ParallelTaskDistributor *td;
+    Mutex mutex;
+    std::vector<Block> blocks;
+};
+
+void threadCollectBlocks(ThreadArgument &thArg)
+{
+    BlockCollector *collector = (BlockCollector *) thArg.workClass;
+    size_t first, last;
+    while (collector->td->getTasks(first, last))
+    {
+        collector->mutex.lock();
+        collector->blocks.push_back(Block(first, last));
+        collector->mutex.unlock();
+    }
+}
+
+// Access to the guided schedule
+class GuidedDistributor: public MpiRmaTaskDistributor
+{
+public:
+    GuidedDistributor(size_t nTasks, size_t bSize, MpiNode *node):
+            MpiRmaTaskDistributor(nTasks, bSize, node, true)
+    {}
+
+    // Schedule as if there were nNodes nodes
+    const std::vector<size_t> &schedule(size_t nNodes)
+    {
+        size_t size = node->size;
+        node->size = nNodes;
+        computeGuidedBlocks();
+        node->size = size;
+        return blockStart;
+    }
+};
+
+class MpiTaskDistributorTest : public ::testing::Test
+{
+protected:
+    void collectBlocks(ParallelTaskDistributor &td, int nThreads, std::vector<Block> &blocks)
+    {
+        BlockCollector collector;
+        collector.td = &td;
+        ThreadManager thMgr(nThreads, &collector);
+        thMgr.run(threadCollectBlocks);
+        blocks = collector.blocks;
+        std::sort(blocks.begin(), blocks.end());
+    }
+
+    // Blocks cover all the tasks once and in order
+    void checkPartition(const std::vector<Block> &blocks, size_t nTasks)
+    {
+        size_t next = 0;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            EXPECT_EQ(next, blocks[b].first);
+            EXPECT_LE(blocks[b].first, blocks[b].second);
+            next = blocks[b].second + 1;
+        }
+        EXPECT_EQ(nTasks, next);
+    }
+};
+
+TEST_F( MpiTaskDistributorTest, fixedBlocksAsThreadDistributor)
+{
+    // The same blocks as the thread distributor, also after a reset
+    size_t cases[][2] = {{1, 1}, {3, 3}, {10, 3}, {12, 3}, {100, 7}, {9, 2}};
+    for (int c = 0; c < 6; c++)
+    {
+        size_t nTasks = cases[c][0], bSize = cases[c][1];
+        ThreadTaskDistributor tdRef(nTasks, bSize);
+        std::vector<Block> blocksRef, blocks;
+        collectBlocks(tdRef, 1, blocksRef);
+
+        MpiRmaTaskDistributor td(nTasks, bSize, node);
+        for (int pass = 0; pass < 2; pass++)
+        {
+            collectBlocks(td, 4, blocks);
+            checkPartition(blocks, nTasks);
+            EXPECT_EQ(blocksRef, blocks) << "nTasks=" << nTasks << " bSize=" << bSize;
+            td.reset();
+        }
+    }
+}
+
+TEST_F( MpiTaskDistributorTest, guidedBlocks)
+{
+    size_t cases[][2] = {{1, 1}, {3, 3}, {10, 3}, {100, 1}, {1000, 7}, {9, 2}};
+    for (int c = 0; c < 6; c++)
+    {
+        size_t nTasks = cases[c][0], bSize = cases[c][1];
+        GuidedDistributor td(nTasks, bSize, node);
+
+        // The blocks given to the threads are those of the schedule
+        std::vector<Block> blocks;
+        collectBlocks(td, 4, blocks);
+        checkPartition(blocks, nTasks);
+        const std::vector<size_t> &start = td.schedule(node->size);
+        ASSERT_EQ(start.size(), blocks.size() + 1);
+        for (size_t b = 0; b < blocks.size(); b++)
+            EXPECT_EQ(start[b], blocks[b].first);
+
+        // Each block is half of the remaining tasks divided by the number
+        // of nodes, but never smaller than bSize (except the last one)
+        for (size_t nNodes = 1; nNodes <= 8; nNodes *= 2)
+        {
+            const std::vector<size_t> &start = td.schedule(nNodes);
+            ASSERT_GE(start.size(), (size_t)1);
+            EXPECT_EQ(0u, start[0]);
+            EXPECT_EQ(nTasks, start.back());
+            for (size_t b = 0; b + 1 < start.size(); b++)
+            {
+                size_t remaining = nTasks - start[b];
+                size_t size = XMIPP_MAX((remaining + 2 * nNodes - 1) / (2 * nNodes), bSize);
+                EXPECT_EQ(XMIPP_MIN(start[b] + size, nTasks), start[b + 1]);
+                if (b > 0)
+                    EXPECT_LE(start[b + 1] - start[b], start[b] - start[b - 1]);
+            }
+        }
+    }
+}
+
+// The tests expect a single MPI process, which takes all the tasks
+GTEST_API_ int main(int argc, char **argv)
+{
+    node = new MpiNode(argc, argv);
+    testing::InitGoogleTest(&argc, argv);
+    int result = RUN_ALL_TESTS();
+    delete node;
+    return result;
+}
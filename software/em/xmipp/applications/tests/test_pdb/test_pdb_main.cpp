@@ -0,0 +1,143 @@
+#include <data/pdb.h>
+#include <reconstruction/volume_from_pdb.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class PDBTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        fnRoot.initUniqueName("/tmp/temp_pdb_XXXXXX");
+    }
+
+    virtual void TearDown()
+    {
+        fnRoot.deleteFile();
+    }
+
+    /* Write a PDB file with the given atoms */
+    void writePDB(const FileName &fn, const char *types, const double *coords, int nAtoms)
+    {
+        FILE *fh = fopen(fn.c_str(), "w");
+        for (int n = 0; n < nAtoms; n++)
+            fprintf(fh, "ATOM  %5d  %c   ALA A   1    %8.3f%8.3f%8.3f  1.00 20.00           %c\n",
+                    n + 1, types[n], coords[3 * n], coords[3 * n + 1], coords[3 * n + 2], types[n]);
+        fclose(fh);
+    }
+
+    FileName fnRoot;
+};
+
+TEST_F( PDBTest, atomTable)
+{
+    // The same atoms in PDB and mmCIF
+    FileName fnPDB = fnRoot + ".pdb", fnCIF = fnRoot + ".cif";
+    FILE *fh = fopen(fnPDB.c_str(), "w");
+    fprintf(fh, "REMARK xmipp_convert_vol2pseudo\n"
+            "ATOM      1  N   ALA A   1      11.104   6.134  -6.504  1.00  0.00           N\n"
+            "ATOM      2  CA  ALA A   1      -1.500 100.250   0.001  0.50 12.34           C\n"
+            "HETATM    3  O   HOH B   2       0.000  -0.125   3.750  1.00 40.00           O\n"
+            "ATOM      4 DENS DENS    4       2.000   3.000   4.000  0.75  1.00      DENS\n"
+            "END\n");
+    fclose(fh);
+    fh = fopen(fnCIF.c_str(), "w");
+    fprintf(fh, "data_test\n"
+            "loop_\n"
+            "_entity.id\n"
+            "_entity.type\n"
+            "1 polymer\n"
+            "#\n"
+            "loop_\n"
+            "_atom_site.group_PDB\n"
+            "_atom_site.id\n"
+            "_atom_site.type_symbol\n"
+            "_atom_site.label_atom_id\n"
+            "_atom_site.Cartn_x\n"
+            "_atom_site.Cartn_y\n"
+            "_atom_site.Cartn_z\n"
+            "_atom_site.occupancy\n"
+            "_atom_site.B_iso_or_equiv\n"
+            "ATOM 1 N N 11.104 6.134 -6.504 1.00 0.00\n"
+            "ATOM 2 C CA -1.500 100.250 0.001 0.50 12.34\n"
+            "HETATM 3 O \"O5'\" 0.000 -0.125 3.750 1.00 40.00\n"
+            "ATOM 4 E DENS 2.000 3.000 4.000 0.75 1.00\n"
+            "#\n");
+    fclose(fh);
+
+    PDBAtomTable atomsPDB, atomsCIF;
+    atomsPDB.read(fnPDB);
+    atomsCIF.read(fnCIF);
+    ASSERT_EQ((size_t)4, atomsPDB.size());
+    ASSERT_EQ((size_t)4, atomsCIF.size());
+    EXPECT_EQ((size_t)1, atomsPDB.remarks.size());
+
+    const char types[] = "NCOE";
+    const double x[] = {11.104, -1.5, 0, 2}, z[] = {-6.504, 0.001, 3.75, 4};
+    const double occupancy[] = {1, 0.5, 1, 0.75}, bfactor[] = {0, 12.34, 40, 1};
+    PDBAtomTable *tables[] = {&atomsPDB, &atomsCIF};
+    for (int t = 0; t < 2; t++)
+    {
+        const PDBAtomTable &atoms = *tables[t];
+        for (size_t n = 0; n < atoms.size(); n++)
+        {
+            EXPECT_EQ(types[n], atoms.atomType[n]);
+            EXPECT_EQ(n == 2, atoms.hetatm[n] != 0);
+            EXPECT_EQ(n == 3, atoms.pseudoatom[n] != 0);
+            EXPECT_DOUBLE_EQ(x[n], atoms.x[n]);
+            EXPECT_DOUBLE_EQ(z[n], atoms.z[n]);
+            EXPECT_DOUBLE_EQ(occupancy[n], atoms.occupancy[n]);
+            EXPECT_DOUBLE_EQ(bfactor[n], atoms.bfactor[n]);
+        }
+        EXPECT_DOUBLE_EQ(100.25, atoms.y[1]);
+    }
+    fnPDB.deleteFile();
+    fnCIF.deleteFile();
+}
+
+TEST_F( PDBTest, volumeInFourierNearTheBorder)
+{
+    // Atoms on grid points close to the border, one of them outside the box
+    FileName fnPDB = fnRoot + ".pdb";
+    const double coords[] = {10, -11, 0, -12, 3, 5, 2, 13, -4};
+    writePDB(fnPDB, "CNO", coords, 3);
+
+    ProgPdbConverter converter;
+    converter.fn_pdb = fnPDB;
+    converter.fn_out = "";
+    converter.Ts = 1;
+    converter.output_dim = 24;
+    converter.verbose = 0;
+    converter.produceSideInfo();
+    converter.computeProteinGeometry();
+    converter.createProteinUsingScatteringProfiles();
+    MultidimArray<double> Vreal = converter.Vlow();
+    converter.createProteinInFourier();
+    const MultidimArray<double> &Vfourier = converter.Vlow();
+    ASSERT_TRUE(Vreal.sameShape(Vfourier));
+    double maxDiff = 0;
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Vreal)
+    maxDiff = XMIPP_MAX(maxDiff, fabs(DIRECT_MULTIDIM_ELEM(Vreal, n) - DIRECT_MULTIDIM_ELEM(Vfourier, n)));
+    EXPECT_LT(maxDiff, 1e-9);
+
+    // An atom off the grid does not wrap around to the opposite face
+    const double coordsOff[] = {10.4, -11.3, 0.2};
+    writePDB(fnPDB, "C", coordsOff, 1);
+    converter.produceSideInfo();
+    converter.createProteinInFourier();
+    double maxVal = Vfourier.computeMax(), maxOpposite = 0;
+    for (int k = STARTINGZ(Vfourier); k <= FINISHINGZ(Vfourier); k++)
+        for (int i = STARTINGY(Vfourier); i <= FINISHINGY(Vfourier); i++)
+            maxOpposite = XMIPP_MAX(maxOpposite, fabs(A3D_ELEM(Vfourier, k, i, STARTINGX(Vfourier))));
+    for (int k = STARTINGZ(Vfourier); k <= FINISHINGZ(Vfourier); k++)
+        for (int j = STARTINGX(Vfourier); j <= FINISHINGX(Vfourier); j++)
+            maxOpposite = XMIPP_MAX(maxOpposite, fabs(A3D_ELEM(Vfourier, k, FINISHINGY(Vfourier), j)));
+    EXPECT_LT(maxOpposite, 1e-3 * maxVal);
+    fnPDB.deleteFile();
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
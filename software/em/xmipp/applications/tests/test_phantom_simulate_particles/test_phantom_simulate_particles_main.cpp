@@ -0,0 +1,153 @@
+#include <reconstruction/phantom_simulate_particles.h>
+#include <data/xmipp_fftw.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class SimulateParticlesTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        // Two Gaussian blobs, so that the projections have no symmetry
+        fnRoot.initUniqueName("/tmp/temp_simulate_XXXXXX");
+        fnVol = fnRoot + ".vol";
+        Image<double> V;
+        V().initZeros(32, 32, 32);
+        V().setXmippOrigin();
+        FOR_ALL_ELEMENTS_IN_ARRAY3D(V())
+        A3D_ELEM(V(), k, i, j) = exp(-((j - 4) * (j - 4) + (i + 3) * (i + 3) + k * k) / 18.) +
+                                 0.5 * exp(-((j + 6) * (j + 6) + (i - 5) * (i - 5) + (k - 2) * (k - 2)) / 8.);
+        V.write(fnVol);
+    }
+
+    virtual void TearDown()
+    {
+        fnVol.deleteFile();
+        fnRoot.deleteFile();
+    }
+
+    // Simulate the particles in md, returns the output stack
+    void simulate(MetaData &md, double sigma, int nThreads, size_t batchSize, Image<double> &particles)
+    {
+        ProgSimulateParticles prog;
+        prog.verbose = 0;
+        prog.fnVol = fnVol;
+        prog.fnAngles = fnRoot + "_particles.xmd";
+        prog.fnOut = fnRoot + "_out.stk";
+        prog.Ts = 2;
+        prog.sigma = sigma;
+        prog.ctfNoise = false;
+        prog.paddFactor = 2;
+        prog.maxFrequency = 0.5;
+        prog.BSplineDeg = BSPLINE3;
+        prog.nThreads = nThreads;
+        prog.batchSize = batchSize;
+        prog.seed = 7;
+        md.write(prog.fnAngles);
+        prog.run();
+
+        particles.read(prog.fnOut);
+        MetaData mdOut(prog.fnOut.withoutExtension().addExtension("xmd"));
+        EXPECT_EQ(md.size(), mdOut.size());
+        EXPECT_TRUE(mdOut.containsLabel(MDL_IMAGE));
+        prog.fnAngles.deleteFile();
+        prog.fnOut.deleteFile();
+        prog.fnOut.withoutExtension().addExtension("xmd").deleteFile();
+    }
+
+    FileName fnRoot, fnVol;
+};
+
+TEST_F( SimulateParticlesTest, shiftsAndCTF)
+{
+    // The same projection, unshifted and shifted by (3,-2)
+    MetaData md;
+    size_t id = md.addObject();
+    md.setValue(MDL_ANGLE_TILT, 30., id);
+    id = md.addObject();
+    md.setValue(MDL_ANGLE_TILT, 30., id);
+    md.setValue(MDL_SHIFT_X, 3., id);
+    md.setValue(MDL_SHIFT_Y, -2., id);
+    Image<double> particles;
+    simulate(md, 0, 2, 1, particles);
+    ASSERT_EQ(2u, NSIZE(particles()));
+    ASSERT_EQ(32u, XSIZE(particles()));
+
+    // The shift centers the particle, so the projection is moved by -shift
+    MultidimArray<double> I0, I1;
+    I0.resizeNoCopy(32, 32);
+    I1.resizeNoCopy(32, 32);
+    particles().getImage(0, I0);
+    particles().getImage(1, I1);
+    EXPECT_GT(I0.computeMax(), 0.1);
+    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(I1)
+    EXPECT_NEAR(DIRECT_A2D_ELEM(I0, intWRAP(i - 2, 0, 31), intWRAP(j + 3, 0, 31)),
+                DIRECT_A2D_ELEM(I1, i, j), 1e-6);
+
+    // With a CTF, the unshifted projection multiplied by the CTF
+    md.clear();
+    id = md.addObject();
+    md.setValue(MDL_ANGLE_TILT, 30., id);
+    md.setValue(MDL_CTF_VOLTAGE, 300., id);
+    md.setValue(MDL_CTF_DEFOCUSU, 10000., id);
+    md.setValue(MDL_CTF_DEFOCUSV, 10000., id);
+    md.setValue(MDL_CTF_DEFOCUS_ANGLE, 0., id);
+    md.setValue(MDL_CTF_CS, 2., id);
+    md.setValue(MDL_CTF_Q0, 0.1, id);
+    Image<double> particlesCTF;
+    simulate(md, 0, 1, 1, particlesCTF);
+    ASSERT_EQ(1u, NSIZE(particlesCTF()));
+
+    MDRow row;
+    md.getRow(row, md.firstObject());
+    CTFDescription ctf;
+    ctf.enable_CTF = true;
+    ctf.enable_CTFnoise = false;
+    ctf.readFromMdRow(row);
+    ctf.produceSideInfo();
+    FourierTransformer transformer;
+    MultidimArray< std::complex<double> > F0;
+    transformer.FourierTransform(I0, F0, false);
+    double freqx, freqy;
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(F0)
+    {
+        FFT_IDX2DIGFREQ(i, 32, freqy);
+        FFT_IDX2DIGFREQ(j, 32, freqx);
+        ctf.precomputeValues(freqx / 2, freqy / 2);
+        A2D_ELEM(F0, i, j) *= ctf.getValueAt();
+    }
+    transformer.inverseFourierTransform();
+    MultidimArray<double> ICTF;
+    ICTF.resizeNoCopy(32, 32);
+    particlesCTF().getImage(0, ICTF);
+    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(ICTF)
+    EXPECT_NEAR(DIRECT_A2D_ELEM(I0, i, j), DIRECT_A2D_ELEM(ICTF, i, j), 1e-6);
+}
+
+TEST_F( SimulateParticlesTest, noiseIndependentOfThreads)
+{
+    // The noise of a particle only depends on the seed and the particle number
+    MetaData md;
+    for (int n = 0; n < 5; ++n)
+    {
+        size_t id = md.addObject();
+        md.setValue(MDL_ANGLE_ROT, 20. * n, id);
+        md.setValue(MDL_ANGLE_TILT, 10. * n, id);
+    }
+    Image<double> particles1, particles3;
+    simulate(md, 0.5, 1, 5, particles1);
+    simulate(md, 0.5, 3, 2, particles3);
+    ASSERT_EQ(5u, NSIZE(particles1()));
+    EXPECT_TRUE(particles1().equal(particles3(), 1e-6));
+
+    // and the particles are not equal to their noiseless version
+    Image<double> particles0;
+    simulate(md, 0, 1, 5, particles0);
+    EXPECT_FALSE(particles0().equal(particles1(), 0.1));
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -39,6 +39,52 @@ TEST_F( PolarTest, computeAverageAndStddev)
     EXPECT_NEAR(stddev,0.49643800057938808,XMIPP_EQUAL_ACCURACY);
 }
 
+TEST_F( PolarTest, polarFourierCache)
+{
+    XMIPP_TRY
+    MultidimArray<double> I(32,32);
+    I.initRandom(0,1);
+    I.setXmippOrigin();
+    Polar_fftw_plans *plans=NULL;
+    Polar< std::complex<double> > F, G;
+    normalizedPolarFourierTransform(I,F,CONJUGATE,6,14,plans,1);
+    delete plans;
+
+    std::vector<size_t> objIds;
+    objIds.push_back(3);
+    objIds.push_back(7);
+    FileName auxFn;
+    auxFn.initUniqueName("/tmp/temp_pfc_XXXXXX");
+    {
+        PolarFourierCache cache;
+        cache.open(auxFn,objIds,32,32,6,14,1,CONJUGATE,"test",2);
+        EXPECT_FALSE(cache.get(7,1,G));
+        cache.set(7,1,F);
+    }
+
+    // The transform is kept in the file
+    PolarFourierCache cache;
+    cache.open(auxFn,objIds,32,32,6,14,1,CONJUGATE,"test",2);
+    EXPECT_FALSE(cache.get(7,0,G));
+    EXPECT_FALSE(cache.get(3,1,G));
+    ASSERT_TRUE(cache.get(7,1,G));
+    ASSERT_EQ(F.getRingNo(),G.getRingNo());
+    for (int r=0; r<F.getRingNo(); r++)
+    {
+        EXPECT_EQ(F.ring_radius[r],G.ring_radius[r]);
+        ASSERT_TRUE(F.rings[r].sameShape(G.rings[r]));
+        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(F.rings[r])
+        EXPECT_TRUE(DIRECT_A1D_ELEM(F.rings[r],i)==DIRECT_A1D_ELEM(G.rings[r],i));
+    }
+
+    // But not if the preprocessing is different
+    cache.open(auxFn,objIds,32,32,6,14,1,CONJUGATE,"other",2);
+    EXPECT_FALSE(cache.get(7,1,G));
+    cache.close();
+    auxFn.deleteFile();
+    XMIPP_CATCH
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
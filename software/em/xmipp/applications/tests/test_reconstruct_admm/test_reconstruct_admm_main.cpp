@@ -0,0 +1,97 @@
+#include <reconstruction/reconstruct_ADMM.h>
+#include <data/xmipp_fft.h>
+#include <iostream>
+#include <cfloat>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class ReconstructAdmmTest : public ::testing::Test
+{
+protected:
+    // Volumes of even, odd and different sizes in each direction
+    virtual void SetUp()
+    {
+        int sizes[][3] = {{8, 8, 8}, {9, 9, 9}, {5, 6, 7}, {6, 9, 4}};
+        for (int s = 0; s < 4; s++)
+        {
+            MultidimArray<double> V(sizes[s][0], sizes[s][1], sizes[s][2]);
+            V.initRandom(0, 1);
+            V.setXmippOrigin();
+            volumes.push_back(V);
+        }
+    }
+
+    std::vector< MultidimArray<double> > volumes;
+};
+
+TEST_F( ReconstructAdmmTest, centeredCropIndexes)
+{
+    // Reading the padded volume at the indexes is the same as centering it
+    // and taking its central region
+    std::vector<size_t> cropZ, cropY, cropX;
+    for (size_t v = 0; v < volumes.size(); v++)
+    {
+        const MultidimArray<double> &V = volumes[v];
+        MultidimArray<double> padded(2 * ZSIZE(V) - 1, 2 * YSIZE(V) - 1, 2 * XSIZE(V) - 1);
+        padded.initRandom(0, 1);
+        padded.setXmippOrigin();
+        centeredCropIndexes(padded, V, cropZ, cropY, cropX);
+
+        MultidimArray<double> centered = padded;
+        CenterFFT(centered, false);
+        centered.selfWindow(STARTINGZ(V), STARTINGY(V), STARTINGX(V),
+                            FINISHINGZ(V), FINISHINGY(V), FINISHINGX(V));
+        ASSERT_EQ(ZSIZE(V), cropZ.size());
+        ASSERT_EQ(YSIZE(V), cropY.size());
+        ASSERT_EQ(XSIZE(V), cropX.size());
+        for (size_t k = 0; k < ZSIZE(V); k++)
+            for (size_t i = 0; i < YSIZE(V); i++)
+                for (size_t j = 0; j < XSIZE(V); j++)
+                    EXPECT_EQ(DIRECT_A3D_ELEM(centered, k, i, j),
+                              DIRECT_A3D_ELEM(padded, cropZ[k], cropY[i], cropX[j]));
+    }
+}
+
+TEST_F( ReconstructAdmmTest, addCenteringPhase)
+{
+    // Filtering with the phase is the same as filtering and centering, up
+    // to the rounding of the largest values
+    for (size_t v = 0; v < volumes.size(); v++)
+    {
+        FourierTransformer transformerV, transformerL;
+        MultidimArray< std::complex<double> > fourierV, fourierL, fourierLphase;
+        const MultidimArray<double> &V = volumes[v];
+        MultidimArray<double> L(V), filtered, filteredPhase;
+        L.initRandom(0, 1);
+        transformerL.FourierTransform(L, fourierL);
+        fourierLphase = fourierL;
+        addCenteringPhase(fourierLphase, V);
+
+        filtered = V;
+        transformerV.FourierTransform(filtered, fourierV, false);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(fourierV)
+        DIRECT_MULTIDIM_ELEM(fourierV, n) *= DIRECT_MULTIDIM_ELEM(fourierL, n);
+        transformerV.inverseFourierTransform();
+        CenterFFT(filtered, false);
+
+        filteredPhase = V;
+        transformerV.FourierTransform(filteredPhase, fourierV, false);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(fourierV)
+        DIRECT_MULTIDIM_ELEM(fourierV, n) *= DIRECT_MULTIDIM_ELEM(fourierLphase, n);
+        transformerV.inverseFourierTransform();
+
+        double maxDiff = 0, maxVal = 0;
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(filtered)
+        {
+            maxDiff = XMIPP_MAX(maxDiff, fabs(DIRECT_MULTIDIM_ELEM(filtered, n) -
+                                              DIRECT_MULTIDIM_ELEM(filteredPhase, n)));
+            maxVal = XMIPP_MAX(maxVal, fabs(DIRECT_MULTIDIM_ELEM(filtered, n)));
+        }
+        EXPECT_LE(maxDiff, 4 * DBL_EPSILON * maxVal) << "volume " << v;
+    }
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
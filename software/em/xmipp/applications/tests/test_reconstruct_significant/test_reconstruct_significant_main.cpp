@@ -0,0 +1,60 @@
+#include <reconstruction/reconstruct_significant.h>
+#include <data/xmipp_fftw.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class ReconstructSignificantTest : public ::testing::Test
+{
+protected:
+    // Two Gaussian blobs, so that the image has no symmetry
+    void blobs(MultidimArray<double> &I, double shiftX, double shiftY)
+    {
+        I.initZeros(64, 64);
+        I.setXmippOrigin();
+        FOR_ALL_ELEMENTS_IN_ARRAY2D(I)
+        {
+            double x = j - shiftX, y = i - shiftY;
+            A2D_ELEM(I, i, j) = exp(-((x - 4) * (x - 4) / 50 + (y + 3) * (y + 3) / 18)) +
+                                0.5 * exp(-((x + 8) * (x + 8) + (y - 7) * (y - 7)) / 12);
+        }
+    }
+};
+
+TEST_F( ReconstructSignificantTest, workingBoxShifts)
+{
+    // The alignment runs at half the size, the shifts are in the original pixels
+    ProgReconstructSignificant prog;
+    prog.Xdim = 64;
+    prog.workXdim = 32;
+    prog.workScale = 0.5;
+
+    MultidimArray<double> mGalleryProjection, mImage;
+    blobs(mGalleryProjection, 0, 0);
+    blobs(mImage, 6, -4);
+    selfScaleToSizeFourier(32, 32, mGalleryProjection);
+    selfScaleToSizeFourier(32, 32, mImage);
+    mGalleryProjection.setXmippOrigin();
+    mImage.setXmippOrigin();
+
+    AlignmentTransforms transforms;
+    AlignmentAux aux;
+    CorrelationAux aux2;
+    RotationalCorrelationAux aux3;
+    aux2.transformer1.FourierTransform(mGalleryProjection, transforms.FFTI, true);
+    normalizedPolarFourierTransform(mGalleryProjection, transforms.polarFourierI, false,
+                                    XSIZE(mGalleryProjection) / 5, XSIZE(mGalleryProjection) / 2, aux.plans, 1);
+
+    Matrix2D<double> M;
+    double corr = prog.alignToGalleryProjection(mGalleryProjection, transforms, mImage, M, aux, aux2, aux3);
+    EXPECT_GT(corr, 0.95);
+    EXPECT_NEAR(MAT_ELEM(M, 0, 0), 1, 0.01);
+    EXPECT_NEAR(MAT_ELEM(M, 1, 1), 1, 0.01);
+    EXPECT_NEAR(MAT_ELEM(M, 0, 2), 6, 0.1);
+    EXPECT_NEAR(MAT_ELEM(M, 1, 2), -4, 0.1);
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,112 @@
+#include <reconstruction/reconstruct_wbp.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class ReconstructWbpTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        dim = 32;
+        prog.dim = dim;
+        prog.diameter = dim;
+    }
+
+    // Random image with the given projection direction
+    void randomProjection(Projection &P, double rot, double tilt, double psi)
+    {
+        P().initZeros(dim, dim);
+        P().initRandom(0, 1);
+        P().setXmippOrigin();
+        P.setRot(rot);
+        P.setTilt(tilt);
+        P.setPsi(psi);
+    }
+
+    // Bilinear backprojection computed voxel by voxel
+    void referenceBackprojection(const Projection &P, MultidimArray<double> &V)
+    {
+        Matrix2D<double> A;
+        Euler_angles2matrix(P.rot(), -P.tilt(), P.psi(), A);
+        A = A.inv();
+        double dim2 = dim / 2, radius2 = dim * dim / 4.;
+        const MultidimArray<double> &I = P();
+        for (int i = 0; i < dim; i++)
+            for (int j = 0; j < dim; j++)
+                for (int k = 0; k < dim; k++)
+                {
+                    double z = -i + dim2, y = j - dim2, x = k - dim2;
+                    if (x * x + y * y + z * z > radius2)
+                        continue;
+                    double xp = x * A(0, 0) + y * A(1, 0) + z * A(2, 0) + dim2;
+                    double yp = x * A(0, 1) + y * A(1, 1) + z * A(2, 1) + dim2;
+                    if (xp < 0 || xp >= dim - 1 || yp < 0 || yp >= dim - 1)
+                        continue;
+                    int m = (int) xp, l = (int) yp;
+                    double sx = xp - m, sy = yp - l;
+                    dAkij(V, i, j, k) += (1 - sy) * ((1 - sx) * dAij(I, l, m) + sx * dAij(I, l, m + 1)) +
+                                         sy * ((1 - sx) * dAij(I, l + 1, m) + sx * dAij(I, l + 1, m + 1));
+                }
+    }
+
+    ProgRecWbp prog;
+    int dim;
+};
+
+TEST_F( ReconstructWbpTest, backprojectionAsReference)
+{
+    // Single axis tilts (the rows of the volume fall on a single image row,
+    // the last rows fall outside the image) and general orientations
+    double angles[][3] =
+        {
+            {0, 0, 0}, {0, 35, 0}, {0, -60, 0}, {90, 20, -90}, {33, 47, -21}, {-120, 80, 15}
+        };
+    for (int o = 0; o < 6; o++)
+    {
+        Projection P;
+        randomProjection(P, angles[o][0], angles[o][1], angles[o][2]);
+        MultidimArray<double> V, Vref;
+        V.initZeros(dim, dim, dim);
+        Vref.initZeros(dim, dim, dim);
+        prog.simpleBackprojection(P, V, dim);
+        referenceBackprojection(P, Vref);
+        ASSERT_GT(Vref.sum(), 0);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(V)
+        ASSERT_NEAR(DIRECT_MULTIDIM_ELEM(Vref, n), DIRECT_MULTIDIM_ELEM(V, n), 1e-10)
+        << "Orientation " << o;
+    }
+}
+
+TEST_F( ReconstructWbpTest, batchesAndThreads)
+{
+    // A batch backprojected by several threads is the sum of the images
+    int N = 7;
+    std::vector<Projection> P(N);
+    MultidimArray<double> Vref;
+    Vref.initZeros(dim, dim, dim);
+    for (int n = 0; n < N; n++)
+    {
+        randomProjection(P[n], 17 * n, -60 + 20 * n, 5 * n);
+        referenceBackprojection(P[n], Vref);
+    }
+
+    prog.batchImgs.resize(3);
+    prog.batchInfo.resize(3);
+    prog.batchNImgs = 0;
+    prog.thMgr = new ThreadManager(3, &prog);
+    prog.planeDistributor = new ThreadTaskDistributor(dim, 1);
+    prog.reconstructedVolume().initZeros(dim, dim, dim);
+    for (int n = 0; n < N; n++)
+        prog.addToBatch(P[n]);
+    prog.backprojectBatch();
+    const MultidimArray<double> &V = prog.reconstructedVolume();
+    ASSERT_GT(Vref.sum(), 0);
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(V)
+    ASSERT_NEAR(DIRECT_MULTIDIM_ELEM(Vref, n), DIRECT_MULTIDIM_ELEM(V, n), 1e-10);
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
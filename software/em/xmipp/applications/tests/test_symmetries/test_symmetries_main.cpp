@@ -1,4 +1,5 @@
 #include "data/sampling.h"
+#include "reconstruction/symmetrize.h"
 
 #include <iostream>
 #include <gtest/gtest.h>
@@ -123,6 +124,76 @@ TEST_F(SamplingTest, computeDistanceMetadata)
     XMIPP_CATCH
 }
 
+TEST_F(SamplingTest, symmetricAngles)
+{
+    XMIPP_TRY
+    FileName fn_sym("i3h");
+    SL.readSymmetryFile(fn_sym);
+    std::vector<double> angles, symAngles;
+    angles.push_back(10.);
+    angles.push_back(20.);
+    angles.push_back(30.);
+    angles.push_back(-45.);
+    angles.push_back(100.);
+    angles.push_back(5.);
+    SL.symmetricAngles(angles, symAngles);
+    size_t Nsym = SL.symsNo() + 1;
+    ASSERT_EQ(symAngles.size(), 2 * 3 * Nsym);
+
+    Matrix2D<double> L, R;
+    for (int n = 0; n < 2; n++)
+        for (size_t i = 1; i < Nsym; i++)
+        {
+            double rot, tilt, psi;
+            SL.getMatrices(i - 1, L, R, false);
+            Euler_apply_transf(L, R, angles[3 * n], angles[3 * n + 1], angles[3 * n + 2], rot, tilt, psi);
+            size_t idx = 3 * (n * Nsym + i);
+            EXPECT_NEAR(rot, symAngles[idx], 1e-9);
+            EXPECT_NEAR(tilt, symAngles[idx + 1], 1e-9);
+            EXPECT_NEAR(psi, symAngles[idx + 2], 1e-9);
+        }
+    XMIPP_CATCH
+}
+
+/* Maximum difference between the Fourier and the real space symmetrization
+   of a sum of Gaussians within the sphere inscribed in the box (outside it
+   the real space path wraps the corners of the rotated volumes), relative
+   to the maximum of the volume */
+double compareSymmetrizations(const SymList &SL)
+{
+    MultidimArray<double> V(40, 40, 40), Vreal, Vfourier;
+    V.setXmippOrigin();
+    const double centers[] = {3, -5, 8, -7, 2, 1, 0, 9, -4};
+    FOR_ALL_ELEMENTS_IN_ARRAY3D(V)
+    for (int g = 0; g < 3; g++)
+    {
+        double dx = j - centers[3 * g], dy = i - centers[3 * g + 1], dz = k - centers[3 * g + 2];
+        A3D_ELEM(V, k, i, j) += (g + 1) * exp(-(dx * dx + dy * dy + dz * dz) / 8);
+    }
+    symmetrizeVolume(SL, V, Vreal);
+    symmetrizeVolumeFourier(SL, V, Vfourier, false, 2, 2);
+    double maxDiff = 0;
+    FOR_ALL_ELEMENTS_IN_ARRAY3D(V)
+    if (k * k + i * i + j * j <= 400)
+        maxDiff = XMIPP_MAX(maxDiff, fabs(A3D_ELEM(Vreal, k, i, j) - A3D_ELEM(Vfourier, k, i, j)));
+    return maxDiff / Vreal.computeMax();
+}
+
+TEST_F(SamplingTest, symmetrizeVolumeFourier)
+{
+    XMIPP_TRY
+    // The rotations of c4 keep the grid, both paths are the same
+    SL.readSymmetryFile("c4");
+    EXPECT_LT(compareSymmetrizations(SL), 1e-5);
+
+    // With pad 2 the trilinear interpolation in Fourier space attenuates
+    // the rotated copies by about 4% (the real space path is within 0.1%
+    // of the exact symmetrization)
+    SL.readSymmetryFile("i3");
+    EXPECT_LT(compareSymmetrizations(SL), 0.05);
+    XMIPP_CATCH
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
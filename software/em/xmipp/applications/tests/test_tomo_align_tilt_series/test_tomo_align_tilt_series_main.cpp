@@ -0,0 +1,205 @@
+#include <reconstruction/tomo_align_tilt_series.h>
+#include <queue>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class TomoAlignTiltSeriesTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        srand(1);
+        prog.showRefinement = false;
+        prog.isCapillar = false;
+        prog.Nimg = 2;
+
+        // Smooth random image, so that the correlation has a clear peak,
+        // plus a shifted and noisy copy of it
+        dim = 64;
+        MultidimArray<double> smooth(dim, dim);
+        smooth.initRandom(0, 1);
+        for (int it = 0; it < 3; it++)
+        {
+            MultidimArray<double> aux = smooth;
+            for (int i = 1; i < dim - 1; i++)
+                for (int j = 1; j < dim - 1; j++)
+                    dAij(smooth, i, j) = (dAij(aux, i - 1, j) + dAij(aux, i + 1, j) +
+                                          dAij(aux, i, j - 1) + dAij(aux, i, j + 1) +
+                                          dAij(aux, i, j)) / 5;
+        }
+        double minval, maxval;
+        smooth.computeDoubleMinMax(minval, maxval);
+        for (int k = 0; k < 2; k++)
+        {
+            MultidimArray<unsigned char> *I = new MultidimArray<unsigned char>(dim, dim);
+            for (int i = 0; i < dim; i++)
+                for (int j = 0; j < dim; j++)
+                {
+                    int is = k == 0 ? i : (i + 2) % dim;
+                    int js = k == 0 ? j : (j + dim - 3) % dim;
+                    double val = 200 * (dAij(smooth, is, js) - minval) / (maxval - minval) +
+                                 10 * rnd_unif(0, 1);
+                    dAij(*I, i, j) = (unsigned char) val;
+                }
+            I->setXmippOrigin();
+            prog.img.push_back(I);
+        }
+    }
+
+    // Piece of the first image centered at r
+    void getPiece(const Matrix1D<double> &r, int halfSize, MultidimArray<double> &piece)
+    {
+        piece.initZeros(2 * halfSize + 1, 2 * halfSize + 1);
+        piece.setXmippOrigin();
+        const MultidimArray<unsigned char> &I = *prog.img[0];
+        FOR_ALL_ELEMENTS_IN_ARRAY2D(piece)
+        A2D_ELEM(piece, i, j) = A2D_ELEM(I, (int)(YY(r) + i), (int)(XX(r) + j));
+    }
+
+    // Search of refineLandmark normalizing each piece of the second image
+    // and then correlating
+    bool referenceRefine(const MultidimArray<double> &piece, Matrix1D<double> &rjj,
+                         double threshold, bool reversed, double &maxCorr)
+    {
+        int halfSize = XSIZE(piece) / 2;
+        double N = MULTIDIM_SIZE(piece);
+        MultidimArray<double> pieceii = piece;
+        double mean_ii, stddev_ii;
+        pieceii.computeAvgStdev(mean_ii, stddev_ii);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(pieceii)
+        DIRECT_MULTIDIM_ELEM(pieceii, n) = (DIRECT_MULTIDIM_ELEM(pieceii, n) - mean_ii) / stddev_ii;
+
+        MultidimArray<double> corr((int)(1.5 * (2 * halfSize + 1)), (int)(1.5 * (2 * halfSize + 1)));
+        corr.setXmippOrigin();
+        corr.initConstant(-1.1);
+        MultidimArray<double> piecejj(2 * halfSize + 1, 2 * halfSize + 1);
+        piecejj.setXmippOrigin();
+        const MultidimArray<unsigned char> &Ijj = *prog.img[1];
+        double maxval = -1;
+        int imax = 0, jmax = 0;
+        std::queue< std::pair<int, int> > Q;
+        Q.push(std::pair<int, int>(0, 0));
+        while (!Q.empty())
+        {
+            int shifty = Q.front().first;
+            int shiftx = Q.front().second;
+            Q.pop();
+            if (A2D_ELEM(corr, shifty, shiftx) >= -1)
+                continue;
+            if (XX(rjj) + shiftx - halfSize < STARTINGX(Ijj) ||
+                YY(rjj) + shifty - halfSize < STARTINGY(Ijj) ||
+                XX(rjj) + shiftx + halfSize > FINISHINGX(Ijj) ||
+                YY(rjj) + shifty + halfSize > FINISHINGY(Ijj))
+                continue;
+            FOR_ALL_ELEMENTS_IN_ARRAY2D(piecejj)
+            A2D_ELEM(piecejj, i, j) = A2D_ELEM(Ijj, (int)(YY(rjj) + shifty + i),
+                                               (int)(XX(rjj) + shiftx + j));
+            if (reversed)
+                piecejj.selfReverseY();
+            double mean_jj, stddev_jj;
+            piecejj.computeAvgStdev(mean_jj, stddev_jj);
+            double &corrRef = A2D_ELEM(corr, shifty, shiftx);
+            corrRef = 0;
+            if (stddev_jj > XMIPP_EQUAL_ACCURACY)
+            {
+                FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(piecejj)
+                corrRef += DIRECT_MULTIDIM_ELEM(pieceii, n) *
+                           (DIRECT_MULTIDIM_ELEM(piecejj, n) - mean_jj) / stddev_jj;
+                corrRef /= N;
+            }
+            if (corrRef > maxval)
+            {
+                maxval = corrRef;
+                imax = shifty;
+                jmax = shiftx;
+                for (int step = 1; step <= 5; step += 2)
+                    for (int stepy = -1; stepy <= 1; stepy++)
+                        for (int stepx = -1; stepx <= 1; stepx++)
+                        {
+                            int newshifty = shifty + stepy * step;
+                            int newshiftx = shiftx + stepx * step;
+                            if (newshifty >= STARTINGY(corr) && newshifty <= FINISHINGY(corr) &&
+                                newshiftx >= STARTINGX(corr) && newshiftx <= FINISHINGX(corr) &&
+                                (XX(rjj) + newshiftx - halfSize) >= STARTINGX(Ijj) &&
+                                (XX(rjj) + newshiftx + halfSize) <= FINISHINGX(Ijj) &&
+                                (YY(rjj) + newshifty - halfSize) >= STARTINGY(Ijj) &&
+                                (YY(rjj) + newshifty + halfSize) <= FINISHINGY(Ijj) &&
+                                A2D_ELEM(corr, newshifty, newshiftx) < -1)
+                                Q.push(std::pair<int, int>(newshifty, newshiftx));
+                        }
+            }
+        }
+        maxCorr = maxval;
+        if (maxval <= threshold)
+            return false;
+        XX(rjj) += jmax;
+        YY(rjj) += reversed ? -imax : imax;
+        return true;
+    }
+
+    // Compare refineLandmark with the reference at a given position
+    void compare(const Matrix1D<double> &rii, const Matrix1D<double> &rjj0,
+                 int halfSize, bool reversed)
+    {
+        MultidimArray<double> piece;
+        getPiece(rii, halfSize, piece);
+        Matrix1D<double> rjj = rjj0, rjjRef = rjj0;
+        double corr, corrRef;
+        bool accepted = prog.refineLandmark(piece, 1, rjj, 0.1, reversed, corr);
+        bool acceptedRef = referenceRefine(piece, rjjRef, 0.1, reversed, corrRef);
+        EXPECT_EQ(acceptedRef, accepted);
+        EXPECT_NEAR(corrRef, corr, 1e-12);
+        EXPECT_EQ(XX(rjjRef), XX(rjj));
+        EXPECT_EQ(YY(rjjRef), YY(rjj));
+    }
+
+    ProgTomographAlignment prog;
+    int dim;
+};
+
+TEST_F( TomoAlignTiltSeriesTest, refineLandmarkFusedCorrelation)
+{
+    // Pieces in the middle of the image, where the search finds the shift
+    // between both images, and pieces close to the border, where part of
+    // the shifts are not evaluated
+    int positions[][4] =
+        {
+            {0, 0, 1, -1},
+            {5, -7, 7, -8},
+            {-20, 3, -21, 1},
+            {24, 24, 25, 23},
+            {-26, -25, -27, -26}
+        };
+    for (int p = 0; p < 5; p++)
+        for (int halfSize = 4; halfSize <= 6; halfSize += 2)
+        {
+            Matrix1D<double> rii = vectorR2(positions[p][0], positions[p][1]);
+            Matrix1D<double> rjj = vectorR2(positions[p][2], positions[p][3]);
+            if (XX(rii) - halfSize < STARTINGX(*prog.img[0]) ||
+                XX(rii) + halfSize > FINISHINGX(*prog.img[0]) ||
+                YY(rii) - halfSize < STARTINGY(*prog.img[0]) ||
+                YY(rii) + halfSize > FINISHINGY(*prog.img[0]))
+                continue;
+            compare(rii, rjj, halfSize, false);
+            compare(rii, rjj, halfSize, true);
+        }
+}
+
+TEST_F( TomoAlignTiltSeriesTest, refineLandmarkFindsShift)
+{
+    // The second image is the first one shifted by (3,-2)
+    MultidimArray<double> piece;
+    Matrix1D<double> rii = vectorR2(2, -1);
+    getPiece(rii, 6, piece);
+    Matrix1D<double> rjj = vectorR2(4, -2);
+    double corr;
+    EXPECT_TRUE(prog.refineLandmark(piece, 1, rjj, 0.5, false, corr));
+    EXPECT_EQ(5, XX(rjj));
+    EXPECT_EQ(-3, YY(rjj));
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,85 @@
+#include <reconstruction/tomo_extract_subvolume.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class TomoExtractSubvolumeTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        dim = 96;
+        prog.vol().resizeNoCopy(dim, dim, dim);
+        prog.vol().initRandom(0, 1);
+        prog.vol().setXmippOrigin();
+        typeCast(prog.vol(), V);
+        V.setXmippOrigin();
+
+        prog.size = 16;
+        prog.x0 = FIRST_XMIPP_INDEX(prog.size);
+        prog.xF = LAST_XMIPP_INDEX(prog.size);
+    }
+
+    // Extract the subvolumes with the given shifts and compare them with
+    // the translation of the whole volume followed by a window
+    void compareWithTranslate(const std::vector<Matrix1D<double> > &shifts, double accuracy)
+    {
+        size_t nsub = shifts.size();
+        prog.shifts = shifts;
+        prog.subvolumes.resize(nsub);
+        for (size_t i = 0; i < nsub; i++)
+        {
+            prog.subvolumes[i].resizeNoCopy(prog.size, prog.size, prog.size);
+            prog.subvolumes[i].setXmippOrigin();
+        }
+        prog.produceBrickCoefficients();
+        prog.extractSlices(0, nsub * prog.size - 1);
+
+        MultidimArray<double> Vshifted;
+        for (size_t i = 0; i < nsub; i++)
+        {
+            translate(BSPLINE3, Vshifted, V, shifts[i]);
+            Vshifted.selfWindow(prog.x0, prog.x0, prog.x0, prog.xF, prog.xF, prog.xF);
+            const MultidimArray<double> &subvolume = prog.subvolumes[i];
+            ASSERT_TRUE(Vshifted.sameShape(subvolume));
+            double maxDiff = 0;
+            FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(subvolume)
+            maxDiff = XMIPP_MAX(maxDiff, fabs(DIRECT_MULTIDIM_ELEM(subvolume, n) -
+                                              DIRECT_MULTIDIM_ELEM(Vshifted, n)));
+            EXPECT_LT(maxDiff, accuracy) << "subvolume " << i;
+        }
+    }
+
+    ProgTomoExtractSubvolume prog;
+    MultidimArray<double> V;
+    int dim;
+};
+
+TEST_F( TomoExtractSubvolumeTest, brickAsTranslate)
+{
+    // All the subvolumes are inside the volume, the coefficients are only
+    // computed in a brick
+    std::vector<Matrix1D<double> > shifts;
+    shifts.push_back(vectorR3(0., 0., 0.));
+    shifts.push_back(vectorR3(2.3, -1.7, 3.1));
+    shifts.push_back(vectorR3(-4.5, 0.25, -2.75));
+    shifts.push_back(vectorR3(5., -3., 1.));
+    compareWithTranslate(shifts, 1e-13);
+    EXPECT_LT(XSIZE(prog.coeffs), XSIZE(prog.vol()));
+}
+
+TEST_F( TomoExtractSubvolumeTest, wrappedAsTranslate)
+{
+    // Some subvolume falls outside the volume and is wrapped
+    std::vector<Matrix1D<double> > shifts;
+    shifts.push_back(vectorR3(1.5, -0.5, 0.3));
+    shifts.push_back(vectorR3(43.4, -2.2, 0.7));
+    shifts.push_back(vectorR3(-3.1, -45.6, 42.2));
+    compareWithTranslate(shifts, 1e-13);
+    EXPECT_EQ(XSIZE(prog.coeffs), XSIZE(prog.vol()));
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -250,6 +250,72 @@ TEST_F(TransformationTest, str2TransformationMatrix)
 
 }
 
+/* Index of a coefficient with mirror boundary conditions */
+int mirrorIndex(int l, int N)
+{
+    if (l < 0)
+        return -l - 1;
+    if (l >= N)
+        return 2 * N - l - 1;
+    return l;
+}
+
+/* Tap by tap cubic B-spline evaluation, as done before the cubic kernels */
+double referenceBSpline3D(const MultidimArray<double> &C, double x, double y, double z)
+{
+    x -= STARTINGX(C);
+    y -= STARTINGY(C);
+    z -= STARTINGZ(C);
+    int l1 = (int)ceil(x - 2), m1 = (int)ceil(y - 2), n1 = (int)ceil(z - 2);
+    double sum = 0, wx, wy, wz;
+    for (int n = n1; n <= n1 + 3; n++)
+        for (int m = m1; m <= m1 + 3; m++)
+            for (int l = l1; l <= l1 + 3; l++)
+            {
+                BSPLINE03(wx, x - l);
+                BSPLINE03(wy, y - m);
+                BSPLINE03(wz, z - n);
+                sum += wx * wy * wz * DIRECT_A3D_ELEM(C, mirrorIndex(n, ZSIZE(C)),
+                                                      mirrorIndex(m, YSIZE(C)), mirrorIndex(l, XSIZE(C)));
+            }
+    return sum;
+}
+
+TEST_F(TransformationTest, bsplineInterpolation)
+{
+    init_random_generator(13);
+    MultidimArray<double> V(9, 10, 11), I(10, 11), coeffs;
+    V.initRandom(-1, 1);
+    V.setXmippOrigin();
+    I.initRandom(-1, 1);
+    I.setXmippOrigin();
+
+    // The spline interpolates the samples
+    produceSplineCoefficients(BSPLINE3, coeffs, V);
+    FOR_ALL_ELEMENTS_IN_ARRAY3D(V)
+    EXPECT_NEAR(A3D_ELEM(V, k, i, j), coeffs.interpolatedElementBSpline3D(j, i, k), 1e-6);
+
+    // Random points, border and outside points included
+    for (int n = 0; n < 500; n++)
+    {
+        double x = rnd_unif(STARTINGX(coeffs) - 2, FINISHINGX(coeffs) + 2);
+        double y = rnd_unif(STARTINGY(coeffs) - 2, FINISHINGY(coeffs) + 2);
+        double z = rnd_unif(STARTINGZ(coeffs) - 2, FINISHINGZ(coeffs) + 2);
+        EXPECT_NEAR(referenceBSpline3D(coeffs, x, y, z), coeffs.interpolatedElementBSpline3D(x, y, z), 1e-12);
+    }
+
+    // The same in 2D, a single slice is a 3D array with ZSIZE=1
+    produceSplineCoefficients(BSPLINE3, coeffs, I);
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(I)
+    EXPECT_NEAR(A2D_ELEM(I, i, j), coeffs.interpolatedElementBSpline2D(j, i), 1e-6);
+    for (int n = 0; n < 500; n++)
+    {
+        double x = rnd_unif(STARTINGX(coeffs) - 2, FINISHINGX(coeffs) + 2);
+        double y = rnd_unif(STARTINGY(coeffs) - 2, FINISHINGY(coeffs) + 2);
+        EXPECT_NEAR(referenceBSpline3D(coeffs, x, y, 0), coeffs.interpolatedElementBSpline2D(x, y), 1e-12);
+    }
+}
+
 /*
 
 
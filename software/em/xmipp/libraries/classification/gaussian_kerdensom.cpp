@@ -50,16 +50,7 @@ void GaussianKerDenSOM::train(FuzzyMap& _som, TS& _examples, FileName& _fn,
 {
 	MetaData MDconvergence;
 	FileName tmpN;
-    numNeurons = _som.size();
-    numVectors = _examples.size();
-    dim = _examples.theItems[0].size();
-    tmpV.resize(dim, 0.);
-    tmpDens.resize(numNeurons, 0.);
-    tmpMap.resize(numNeurons);
-    for (size_t i = 0; i < numNeurons; i++)
-        tmpMap[i].resize(dim, 0.);
-    tmpD.resize(numNeurons);
-    tmpD1.resize(numNeurons);
+    initTraining(&_som, &_examples);
     double stopError;
 
     int verbosity = listener->getVerbosity();
@@ -229,73 +220,82 @@ void GaussianKerDenSOM::train(FuzzyMap& _som, TS& _examples, FileName& _fn,
     } // for
     MDconvergence.write(formatString("KerDenSOM_Convergence@%s",_fn.c_str()),MD_APPEND);
 
-    tmpV.clear();
-    tmpDens.clear();
-    tmpMap.clear();
-    tmpD.clear();
-    tmpD1.clear();
-
+    finishTraining();
 }
 
 //-----------------------------------------------------------------------------
 /**
- * Update the U (Membership)
+ * Update the U (Membership) of a set of training vectors.
+ * D2 must contain the squared distances to the code vectors. The contribution
+ * of each training vector to alpha is stored in partial.
  */
-double GaussianKerDenSOM::updateU(FuzzyMap* _som, const TS* _examples,
-		                          const double& _sigma, double& _alpha)
+void threadGaussianKerDenSOMUpdateU(ThreadArgument &thArg)
 {
-    // Create auxiliar stuff
-    double auxDist;
+    GaussianKerDenSOM *self = static_cast<GaussianKerDenSOM *>((KerDenSOM *) thArg.workClass);
+    size_t numNeurons = self->numNeurons;
+    double irr1 = 1.0 / (2.0 * self->thSigma);
+    double idim = 1.0 / self->dim;
+    std::vector<double> tmpD1(numNeurons);
+    double *ptrTmpD1 = &tmpD1[0];
     double rr2, max1, d1, tmp, r1;
 
-    double irr1 =1.0/( 2.0 * _sigma);
-    _alpha = 0;
-
-    // Update Membership matrix
-    double *ptrTmpD=&tmpD[0];
-    double *ptrTmpD1=&tmpD1[0];
-    double idim=1.0/dim;
-    for (size_t k = 0; k < numVectors; k++)
-    {
-        max1 = -MAXFLOAT;
-        const floatFeature *ptrExample=&(_examples->theItems[k][0]);
-        for (size_t i = 0; i < numNeurons; i ++)
+    size_t first, last;
+    while (self->td->getTasks(first, last))
+        for (size_t k = first; k <= last; k++)
         {
-            auxDist = 0;
-            const floatFeature *ptrCodeVector=&(_som->theItems[i][0]);
-            for (size_t j = 0; j < dim; j++)
+            double *ptrTmpD = &(self->D2[k*numNeurons]);
+            max1 = -MAXFLOAT;
+            for (size_t i = 0; i < numNeurons; i ++)
             {
-                double tmp=((double)ptrExample[j] - (double)ptrCodeVector[j]);
-                auxDist += tmp * tmp;
+                double auxDist = ptrTmpD[i] * idim;
+                ptrTmpD[i] = auxDist;
+                rr2 = -auxDist * irr1;
+                ptrTmpD1[i] = rr2;
+                if (max1 < rr2)
+                    max1 = rr2;
             }
-            auxDist*=idim;
-            ptrTmpD[i] = auxDist;
-            rr2 = -auxDist * irr1;
-            ptrTmpD1[i] = rr2;
-            if (max1 < rr2)
-                max1 = rr2;
-        }
-        r1 = 0;
-        for (size_t j = 0; j < numNeurons; j ++)
-        {
-            rr2 = ptrTmpD1[j] - max1;
-            if (rr2 < MAXZ)
-                d1 = 0;
-            else
-                d1 = (double)exp(rr2);
-            r1 += d1;
-            ptrTmpD1[j] = d1;
-        }
-        double ir1=1.0/r1;
+            r1 = 0;
+            for (size_t j = 0; j < numNeurons; j ++)
+            {
+                rr2 = ptrTmpD1[j] - max1;
+                if (rr2 < MAXZ)
+                    d1 = 0;
+                else
+                    d1 = (double)exp(rr2);
+                r1 += d1;
+                ptrTmpD1[j] = d1;
+            }
+            double ir1=1.0/r1;
 
-        floatFeature *ptrSomMembK=&(_som->memb[k][0]);
-        for (size_t j = 0; j < numNeurons; j ++)
-        {
-            tmp = ptrTmpD1[j] * ir1;
-            ptrSomMembK[j] = (floatFeature) tmp;
-            _alpha += tmp * ptrTmpD[j];
-        }
-    } // for k
+            floatFeature *ptrSomMembK=&(self->thSom->memb[k][0]);
+            double alpha_k = 0;
+            for (size_t j = 0; j < numNeurons; j ++)
+            {
+                tmp = ptrTmpD1[j] * ir1;
+                ptrSomMembK[j] = (floatFeature) tmp;
+                alpha_k += tmp * ptrTmpD[j];
+            }
+            self->partial[k] = alpha_k;
+        } // for k
+}
+
+/**
+ * Update the U (Membership)
+ */
+double GaussianKerDenSOM::updateU(FuzzyMap* _som, const TS* _examples,
+		                          const double& _sigma, double& _alpha)
+{
+    computeDistances(_som, _examples);
+
+    // Update Membership matrix
+    thSom = _som;
+    thSigma = _sigma;
+    runThreads(threadGaussianKerDenSOMUpdateU, numVectors, 64);
+
+    // Reduce in a fixed order so that the result does not depend on the threads
+    _alpha = 0;
+    for (size_t k = 0; k < numVectors; k++)
+        _alpha += partial[k];
     return 0.0;
 }
 
@@ -389,10 +389,26 @@ double GaussianKerDenSOM::functional(const TS* _examples, const FuzzyMap* _som,
 {
     unsigned j, vv, cc;
     double t;
+
+    // Same as codeDens for all the training vectors
+    computeDistances(_som, _examples);
+    double K=-1.0/(2*_sigma);
+    double densityFactor=std::pow(2*PI*_sigma, -0.5*dim);
     _likelihood = 0;
     for (vv = 0; vv < numVectors; vv++)
     {
-        t = codeDens(_som, &(_examples->theItems[vv]), _sigma);
+        const double *ptrD2=&D2[vv*numNeurons];
+        double s = 0;
+        for (cc = 0; cc < numNeurons; cc++)
+        {
+            t = ptrD2[cc] * K;
+            if (t < MAXZ)
+                t = 0;
+            else
+                t = exp(t);
+            s += t;
+        }
+        t = densityFactor*s / numNeurons;
         if (t == 0)
         {
             t = 1e-300;
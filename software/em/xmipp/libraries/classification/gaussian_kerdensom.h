@@ -98,6 +98,7 @@ protected:
     // Estimate the PD (Method 2: Using the data)
     virtual double dataDens(const TS* _examples, const FeatureVector* _example, double _sigma) const;
 
+    friend void threadGaussianKerDenSOMUpdateU(ThreadArgument &thArg);
 };
 
 //@}
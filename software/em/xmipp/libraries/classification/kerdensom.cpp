@@ -63,6 +63,210 @@ void KerDenSOM::setAnnSteps(const unsigned long& _annSteps)
 }
 
 
+//-----------------------------------------------------------------------------
+
+/**
+ * Destructor
+ */
+KerDenSOM::~KerDenSOM()
+{
+    delete thMgr;
+}
+
+/**
+ * Sets the number of threads
+ * Parameter: _nThreads  Number of threads
+ */
+void KerDenSOM::setThreads(int _nThreads)
+{
+    nThreads = XMIPP_MAX(1, _nThreads);
+    delete thMgr;
+    thMgr = NULL;
+}
+
+//-----------------------------------------------------------------------------
+/**************** Batched computations ****************************************/
+//-----------------------------------------------------------------------------
+
+// Number of training vectors that share every load of a code vector
+#define KERDENSOM_ROWS 4
+// Number of components of the inner products accumulated per block
+#define KERDENSOM_DIM_BLOCK 512
+// Training vectors per task of the distance computation
+#define KERDENSOM_ROW_TASK 64
+// Columns per task of the code vector accumulation
+#define KERDENSOM_COLUMN_BLOCK 128
+
+void KerDenSOM::initTraining(const FuzzyMap* _som, const TS* _examples)
+{
+    numNeurons = _som->size();
+    numVectors = _examples->size();
+    dim = _examples->theItems[0].size();
+    tmpV.resize(dim, 0.);
+    tmpDens.resize(numNeurons, 0.);
+    tmpMap.resize(numNeurons*dim, 0.);
+    D2.resize(numVectors*numNeurons);
+    partial.resize(numVectors);
+    packedExamples = NULL;
+    packExamples(_examples);
+}
+
+void KerDenSOM::finishTraining()
+{
+    std::vector<double>().swap(tmpV);
+    std::vector<double>().swap(tmpDens);
+    std::vector<double>().swap(tmpMap);
+    std::vector<floatFeature>().swap(X);
+    std::vector<double>().swap(normX);
+    std::vector<double>().swap(V);
+    std::vector<double>().swap(normV);
+    std::vector<double>().swap(D2);
+    std::vector<double>().swap(partial);
+    packedExamples = NULL;
+}
+
+void KerDenSOM::packExamples(const TS* _examples)
+{
+    if (_examples == packedExamples)
+        return;
+    X.resize(numVectors*dim);
+    normX.resize(numVectors);
+    for (size_t vv = 0; vv < numVectors; vv++)
+    {
+        const floatFeature *ptrExample=&(_examples->theItems[vv][0]);
+        floatFeature *ptrX=&X[vv*dim];
+        memcpy(ptrX, ptrExample, dim*sizeof(floatFeature));
+        double norm2 = 0;
+        for (size_t j = 0; j < dim; j++)
+            norm2 += (double)ptrX[j] * (double)ptrX[j];
+        normX[vv] = norm2;
+    }
+    packedExamples = _examples;
+}
+
+void KerDenSOM::runThreads(ThreadFunction _function, size_t _numTasks, size_t _blockSize)
+{
+    if (thMgr == NULL)
+        thMgr = new ThreadManager(nThreads, this);
+    td = new ThreadTaskDistributor(_numTasks, XMIPP_MAX(1, XMIPP_MIN(_numTasks, _blockSize)));
+    thMgr->run(_function);
+    delete td;
+    td = NULL;
+}
+
+void threadKerDenSOMDistances(ThreadArgument &thArg)
+{
+    KerDenSOM *self = (KerDenSOM *) thArg.workClass;
+    size_t N = self->numNeurons;
+    size_t dim = self->dim;
+    const floatFeature *X = &(self->X[0]);
+    const double *V = &(self->V[0]);
+    size_t first, last;
+    while (self->td->getTasks(first, last))
+        for (size_t k0 = first; k0 <= last; k0 += KERDENSOM_ROWS)
+        {
+            // The last block may have less rows, the missing ones repeat
+            // the last valid row and are not stored
+            size_t nRows = XMIPP_MIN((size_t)KERDENSOM_ROWS, last + 1 - k0);
+            const floatFeature *x[KERDENSOM_ROWS];
+            for (size_t r = 0; r < KERDENSOM_ROWS; r++)
+                x[r] = X + (k0 + XMIPP_MIN(r, nRows - 1)) * dim;
+
+            double *ptrD2 = &(self->D2[k0*N]);
+            memset(ptrD2, 0, nRows*N*sizeof(double));
+            for (size_t j0 = 0; j0 < dim; j0 += KERDENSOM_DIM_BLOCK)
+            {
+                size_t jn = XMIPP_MIN(dim - j0, (size_t)KERDENSOM_DIM_BLOCK);
+                const floatFeature *x0 = x[0] + j0, *x1 = x[1] + j0, *x2 = x[2] + j0, *x3 = x[3] + j0;
+                for (size_t i = 0; i < N; i++)
+                {
+                    const double *v = V + i*dim + j0;
+                    double p0 = 0, p1 = 0, p2 = 0, p3 = 0;
+                    for (size_t j = 0; j < jn; j++)
+                    {
+                        double vj = v[j];
+                        p0 += x0[j] * vj;
+                        p1 += x1[j] * vj;
+                        p2 += x2[j] * vj;
+                        p3 += x3[j] * vj;
+                    }
+                    double p[KERDENSOM_ROWS] = {p0, p1, p2, p3};
+                    for (size_t r = 0; r < nRows; r++)
+                        ptrD2[r*N + i] += p[r];
+                }
+            }
+
+            for (size_t r = 0; r < nRows; r++)
+            {
+                double normX_r = self->normX[k0 + r];
+                double *ptrD2r = ptrD2 + r*N;
+                for (size_t i = 0; i < N; i++)
+                {
+                    double d2 = normX_r + self->normV[i] - 2 * ptrD2r[i];
+                    ptrD2r[i] = (d2 > 0) ? d2 : 0.;
+                }
+            }
+        }
+}
+
+void KerDenSOM::computeDistances(const FuzzyMap* _som, const TS* _examples)
+{
+    packExamples(_examples);
+    V.resize(numNeurons*dim);
+    normV.resize(numNeurons);
+    for (size_t cc = 0; cc < numNeurons; cc++)
+    {
+        const floatFeature *ptrCodeVector=&(_som->theItems[cc][0]);
+        double *ptrV=&V[cc*dim];
+        double norm2 = 0;
+        for (size_t j = 0; j < dim; j++)
+        {
+            double vj = ptrCodeVector[j];
+            ptrV[j] = vj;
+            norm2 += vj * vj;
+        }
+        normV[cc] = norm2;
+    }
+    runThreads(threadKerDenSOMDistances, numVectors, KERDENSOM_ROW_TASK);
+}
+
+void threadKerDenSOMAccumulate(ThreadArgument &thArg)
+{
+    KerDenSOM *self = (KerDenSOM *) thArg.workClass;
+    size_t N = self->numNeurons;
+    size_t dim = self->dim;
+    const FuzzyMap *som = self->thSom;
+    size_t first, last;
+    while (self->td->getTasks(first, last))
+        for (size_t b = first; b <= last; b++)
+        {
+            size_t j0 = b * KERDENSOM_COLUMN_BLOCK;
+            size_t jn = XMIPP_MIN(dim - j0, (size_t)KERDENSOM_COLUMN_BLOCK);
+            for (size_t cc = 0; cc < N; cc++)
+                memset(&(self->tmpMap[cc*dim + j0]), 0, jn*sizeof(double));
+            for (size_t vv = 0; vv < self->numVectors; vv++)
+            {
+                const floatFeature *ptrExample = &(self->X[vv*dim + j0]);
+                const floatFeature *ptrMemb = &(som->memb[vv][0]);
+                for (size_t cc = 0; cc < N; cc++)
+                {
+                    double tmpU = (double) ptrMemb[cc];
+                    double *ptrTmpMap_cc = &(self->tmpMap[cc*dim + j0]);
+                    for (size_t j = 0; j < jn; j++)
+                        ptrTmpMap_cc[j] += tmpU * ptrExample[j];
+                }
+            }
+        }
+}
+
+void KerDenSOM::accumulateCodeVectors(const FuzzyMap* _som, const TS* _examples)
+{
+    packExamples(_examples);
+    thSom = (FuzzyMap*) _som;
+    size_t numBlocks = (dim + KERDENSOM_COLUMN_BLOCK - 1) / KERDENSOM_COLUMN_BLOCK;
+    runThreads(threadKerDenSOMAccumulate, numBlocks, 1);
+}
+
 //-----------------------------------------------------------------------------
 
 /**
@@ -117,23 +321,16 @@ void KerDenSOM::updateV(FuzzyMap* _som, const TS* _examples, const double& _reg)
     unsigned t2 = 0;  // Iteration index
 
     // Calculate Temporal scratch values
+    accumulateCodeVectors(_som, _examples);
     for (size_t cc = 0; cc < numNeurons; cc++)
     {
-    	double *ptrTmpMap_cc=&(tmpMap[cc][0]);
-    	memset(ptrTmpMap_cc,0,dim*sizeof(double));
     	double &tmpDens_cc=tmpDens[cc];
         if (_reg != 0)
         	tmpDens_cc = _reg * _som->getLayout().numNeig(_som, (SomPos) _som->indexToPos(cc));
         else
         	tmpDens_cc = 0.;
         for (size_t vv = 0; vv < numVectors; vv++)
-        {
-            double tmpU = (double) _som->memb[vv][cc];
-            tmpDens_cc += tmpU;
-            const floatFeature * ptrExample=&(_examples->theItems[vv][0]);
-            for (size_t j = 0; j < dim; j++)
-            	ptrTmpMap_cc[j] +=  tmpU * ptrExample[j];
-        }
+            tmpDens_cc += (double) _som->memb[vv][cc];
     }
 
     // Update Code vectors using a sort of Gauss-Seidel iterative algorithm.
@@ -149,7 +346,7 @@ void KerDenSOM::updateV(FuzzyMap* _som, const TS* _examples, const double& _reg)
         {
             if (_reg != 0)
                 _som->localAve(_som->indexToPos(cc), tmpV);
-        	double *ptrTmpMap_cc=&(tmpMap[cc][0]);
+        	double *ptrTmpMap_cc=&(tmpMap[cc*dim]);
         	double iTmpDens_cc=1.0/tmpDens[cc];
         	floatFeature *ptrCodeVector_cc=&(_som->theItems[cc][0]);
             for (size_t j = 0; j < dim; j++)
@@ -208,22 +405,13 @@ double KerDenSOM::updateSigmaI(FuzzyMap* _som, const TS* _examples)
     double t = 0;
 
     // Computing Sigma (Part I)
+    computeDistances(_som, _examples);
+    const double *ptrD2=&D2[0];
     for (size_t vv = 0; vv < numVectors; vv++)
     {
-    	const FeatureVector &example=_examples->theItems[vv];
-    	const floatFeature *ptrExample0=&example[0];
+    	const floatFeature *ptrMemb=&(_som->memb[vv][0]);
         for (size_t cc = 0; cc < numNeurons; cc++)
-        {
-            double r = 0.0;
-        	const floatFeature *ptrExample=ptrExample0;
-        	const floatFeature *ptrCodeVector=&(_som->theItems[cc][0]);
-            for (size_t j = 0; j < dim; j++)
-            {
-            	double diff=(double)(*ptrExample++) - (double)(*ptrCodeVector++);
-                r += diff*diff;
-            }
-            t += r * (double)(_som->memb[vv][cc]);
-        }
+            t += (*ptrD2++) * (double)(ptrMemb[cc]);
     }
     return (double)(t / (double)(numVectors*dim));
 }
@@ -240,36 +428,23 @@ double KerDenSOM::updateSigmaI(FuzzyMap* _som, const TS* _examples)
  */
 void KerDenSOM::updateV1(FuzzyMap* _som, const TS* _examples)
 {
+    accumulateCodeVectors(_som, _examples);
     for (size_t cc = 0; cc < numNeurons; cc++)
     {
-    	std::vector<double> &tmpMap_cc=tmpMap[cc];
-    	double *ptrTmpMap_cc0=&tmpMap_cc[0];
-    	memset(ptrTmpMap_cc0,0,dim*sizeof(double));
         double &tmpDens_cc=tmpDens[cc];
         tmpDens_cc = 0.0;
         for (size_t vv = 0; vv < numVectors; vv++)
-        {
-            double tmpU = _som->memb[vv][cc];
-            tmpDens_cc += tmpU;
-            const floatFeature *ptrExample=&(_examples->theItems[vv][0]);
-            double *ptrTmpMap_cc=ptrTmpMap_cc0;
-            for (size_t j = 0; j < dim; j++)
-            {
-            	*ptrTmpMap_cc += tmpU * (*ptrExample);
-            	++ptrExample;
-            	++ptrTmpMap_cc;
-            }
-        }
+            tmpDens_cc += _som->memb[vv][cc];
     }
 
     for (size_t cc = 0; cc < numNeurons; cc++)
     {
-    	const std::vector<double> &tmpMap_cc=tmpMap[cc];
+    	const double *ptrTmpMap_cc=&tmpMap[cc*dim];
         double itmpDens_cc=1.0/tmpDens[cc];
     	FeatureVector &codevector=_som->theItems[cc];
         for (size_t j = 0; j < dim; j++)
         {
-            double tmpU =tmpMap_cc[j] * itmpDens_cc;
+            double tmpU =ptrTmpMap_cc[j] * itmpDens_cc;
             codevector[j] = (floatFeature) tmpU;
         }
     } // for
@@ -278,42 +453,43 @@ void KerDenSOM::updateV1(FuzzyMap* _som, const TS* _examples)
 //-----------------------------------------------------------------------------
 /**
  * Special Initialization of Membership Matrix (Fuzzy c-means style)
+ * The membership of the code vector i is 1/sum_j (d_i/d_j)^2, that is
+ * 1/(d_i^2 sum_j 1/d_j^2). Squared distances smaller than a relative
+ * tolerance are considered to be 0 (the rounding error of the inner product
+ * formulation of the distance).
  */
 void KerDenSOM::updateU1(FuzzyMap* _som, const TS* _examples)
 {
-
-    double auxProd, auxDist, tmp;
-    size_t k, j, i;
+    computeDistances(_som, _examples);
 
     // Update Membership matrix
-    for (k = 0; k < numVectors; k++)
+    for (size_t k = 0; k < numVectors; k++)
     {
-        auxProd = 1;
-        for (j = 0; j < numNeurons; j++)
-            auxProd *= euclideanDistance(_som->theItems[j], _examples->theItems[k]);
+        double *ptrD2=&D2[k*numNeurons];
+        bool zeroDistance=false;
+        double sumInv=0;
+        for (size_t j = 0; j < numNeurons; j++)
+        {
+            if (ptrD2[j] <= 1e-12*(normX[k]+normV[j]))
+            {
+                ptrD2[j]=0.;
+                zeroDistance=true;
+            }
+            else
+                sumInv += 1.0/ptrD2[j];
+        }
 
-        if (auxProd == 0.)
+        floatFeature *ptrMemb=&(_som->memb[k][0]);
+        if (zeroDistance)
         { // Apply k-means criterion (Data-CB) must be > 0
-            for (j = 0; j < numNeurons; j ++)
-                if (euclideanDistance(_som->theItems[j], _examples->theItems[k]) == 0.)
-                    _som->memb[k][j] = 1.0;
-                else
-                    _som->memb[k][j] =  0.0;
+            for (size_t j = 0; j < numNeurons; j ++)
+                ptrMemb[j] = (ptrD2[j] == 0.) ? 1.0 : 0.0;
         }
         else
         {
-            for (i = 0; i < numNeurons; i ++)
-            {
-                auxDist = 0;
-                for (j = 0; j < numNeurons; j ++)
-                {
-                    tmp = euclideanDistance(_som->theItems[i], _examples->theItems[k]) /
-                    		euclideanDistance(_som->theItems[j], _examples->theItems[k]);
-                    auxDist += pow(tmp, 2);
-                } // for j
-                _som->memb[k][i] = (floatFeature) 1.0 / auxDist;
-            } // for i
-        } // if auxProd
+            for (size_t i = 0; i < numNeurons; i ++)
+                ptrMemb[i] = (floatFeature) (1.0 / (ptrD2[i]*sumInv));
+        } // if zeroDistance
     } // for k
 }
 
@@ -379,6 +555,7 @@ double KerDenSOM::randApproxGVC(const TS* _examples, const FuzzyMap* _som, doubl
             tmpTS.theItems[vv][j] += rnd_gaus() * _dataSD;
     }
     updateV(&tmpSOM, &tmpTS, _reg);
+    packedExamples = NULL; // tmpTS is about to be destroyed
     den = 0.0;
 
     init_random_generator();
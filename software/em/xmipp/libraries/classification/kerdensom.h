@@ -32,6 +32,7 @@
 #ifndef XMIPPKERDENSOM_H
 #define XMIPPKERDENSOM_H
 
+#include <data/xmipp_threads.h>
 #include "base_algorithm.h"
 #include "map.h"
 
@@ -56,14 +57,20 @@ public:
     KerDenSOM(double _reg0, double _reg1, unsigned long _annSteps,
                    double _epsilon, unsigned long _nSteps)
             : ClassificationAlgorithm<FuzzyMap>(), annSteps(_annSteps), reg0(_reg0), reg1(_reg1),
-            epsilon(_epsilon), somNSteps(_nSteps)
+            epsilon(_epsilon), somNSteps(_nSteps), packedExamples(NULL), nThreads(1),
+            thMgr(NULL), td(NULL)
     {};
 
     /**
      * Virtual destructor
      */
-    virtual ~KerDenSOM()
-    {};
+    virtual ~KerDenSOM();
+
+    /**
+     * Sets the number of threads used to train the map.
+     * The result of the training does not depend on the number of threads.
+     */
+    void setThreads(int _nThreads);
 
     /**
      * Sets the number of training steps
@@ -130,8 +137,30 @@ protected:
     size_t numNeurons;
     size_t numVectors;
     size_t dim;
-    std::vector < std::vector<double> > tmpMap;
-    std::vector<double> tmpD, tmpD1, tmpDens, tmpV;
+    std::vector<double> tmpMap;        // numNeurons x dim, row-major
+    std::vector<double> tmpDens, tmpV;
+
+    // Training vectors as a contiguous row-major numVectors x dim matrix
+    // and their squared norms
+    std::vector<floatFeature> X;
+    std::vector<double> normX;
+    const TS* packedExamples;
+    // Code vectors as a contiguous row-major numNeurons x dim matrix
+    // and their squared norms
+    std::vector<double> V, normV;
+    // Squared distances between training vectors and code vectors
+    // (numVectors x numNeurons, row-major)
+    std::vector<double> D2;
+    // Per training vector terms of the reductions, summed in order
+    std::vector<double> partial;
+
+    // Threads
+    int nThreads;
+    ThreadManager *thMgr;
+    ThreadTaskDistributor *td;
+    // Arguments of the task being run by the threads
+    FuzzyMap* thSom;
+    double thSigma;
 
 
     /** Declaration of virtual method */
@@ -173,6 +202,32 @@ protected:
     // Estimate Sigma I
     virtual double updateSigmaI(FuzzyMap* _som, const TS* _examples);
 
+    // Allocate the scratch and pack the training set before training
+    void initTraining(const FuzzyMap* _som, const TS* _examples);
+
+    // Free the scratch after training
+    void finishTraining();
+
+    // Copy the training vectors into X (only if they are not already there)
+    void packExamples(const TS* _examples);
+
+    /* Fill D2 with the squared distances between all training vectors and
+       all code vectors. They are computed as ||x||^2+||v||^2-2<x,v>, the
+       inner products being evaluated by blocks of training and code vectors. */
+    void computeDistances(const FuzzyMap* _som, const TS* _examples);
+
+    /* Compute tmpMap = U^t X (the membership weighted sum of the training
+       vectors for every code vector). Threads work on disjoint blocks of
+       columns, so every element is summed in the same order as in a serial
+       loop. */
+    void accumulateCodeVectors(const FuzzyMap* _som, const TS* _examples);
+
+    // Run a function over numTasks tasks with the thread pool
+    void runThreads(ThreadFunction _function, size_t _numTasks, size_t _blockSize);
+
+    friend void threadKerDenSOMDistances(ThreadArgument &thArg);
+    friend void threadKerDenSOMAccumulate(ThreadArgument &thArg);
+
     // Some printing methods.
     void showX(const TS* _ts);
     void showV(FuzzyMap* _som);
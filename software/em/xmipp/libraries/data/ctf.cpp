@@ -918,6 +918,76 @@ void CTFDescription::forcePhysicalMeaning()
 }
 #undef DEBUG
 
+/* Wiener average ---------------------------------------------------------- */
+void CTFWienerAccumulator::initialize(size_t paddim)
+{
+    FctfSum.initZeros(paddim,paddim);
+    ctf2Sum.initZeros(paddim,paddim);
+    weight=0;
+}
+
+void CTFWienerAccumulator::add(const MultidimArray<double> &sum, double w,
+                               const MultidimArray<double> &ctf)
+{
+    if (XSIZE(ctf)!=XSIZE(ctf2Sum) || YSIZE(ctf)!=YSIZE(ctf2Sum))
+        REPORT_ERROR(ERR_MULTIDIM_SIZE,"CTFWienerAccumulator: the CTF and the accumulator have different sizes");
+    MultidimArray<double> Mpad=sum;
+    Mpad.setXmippOrigin();
+    int paddim=XSIZE(ctf2Sum);
+    if (XSIZE(Mpad)<(size_t)paddim)
+    {
+        int x0=FIRST_XMIPP_INDEX(paddim);
+        int xF=LAST_XMIPP_INDEX(paddim);
+        Mpad.selfWindow(x0,x0,xF,xF);
+    }
+    MultidimArray< std::complex<double> > Faux;
+    FourierTransform(Mpad,Faux);
+    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(ctf2Sum)
+    {
+        double ctfij=dAij(ctf,i,j);
+        dAij(FctfSum,i,j)+=ctfij*dAij(Faux,i,j);
+        dAij(ctf2Sum,i,j)+=w*ctfij*ctfij;
+    }
+    weight+=w;
+}
+
+void CTFWienerAccumulator::add(const CTFWienerAccumulator &other)
+{
+    FctfSum+=other.FctfSum;
+    ctf2Sum+=other.ctf2Sum;
+    weight+=other.weight;
+}
+
+void CTFWienerAccumulator::getAverage(double wienerConstant, size_t Xdim,
+                                      MultidimArray<double> &avg) const
+{
+    if (weight<=0)
+    {
+        avg.clear();
+        return;
+    }
+    if (wienerConstant<0)
+        wienerConstant=0.1*ctf2Sum.computeAvg()/weight;
+    double nc=weight*wienerConstant;
+    MultidimArray< std::complex<double> > Faux(FctfSum);
+    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(Faux)
+    {
+        double denom=dAij(ctf2Sum,i,j)+nc;
+        if (denom>0)
+            dAij(Faux,i,j)/=denom;
+        else
+            dAij(Faux,i,j)=0.;
+    }
+    InverseFourierTransform(Faux,avg);
+    avg.setXmippOrigin();
+    if (XSIZE(avg)>Xdim)
+    {
+        int x0=FIRST_XMIPP_INDEX(Xdim);
+        int xF=LAST_XMIPP_INDEX(Xdim);
+        avg.selfWindow(x0,x0,xF,xF);
+    }
+}
+
 void generateCTFImageWith2CTFs(const MetaData &MD1, const MetaData &MD2, int Xdim, MultidimArray<double> &imgOut)
 {
     CTFDescription CTF1, CTF2;
@@ -690,6 +690,48 @@ public:
     void forcePhysicalMeaning();
 };
 
+/** Wiener average of images with different CTFs.
+ * The sum of the images of each CTF (or defocus group) is added together with
+ * its CTF, and the Wiener filter is applied only once at the end:
+ * average = IFFT( sum_g CTF_g FFT(S_g) / (sum_g n_g CTF_g^2 + n c) ),
+ * where S_g is the sum of the n_g images of group g, n is the total number
+ * of images and c is the Wiener constant. The CTFs are full size images in
+ * FFT order, as the _ctf images written by ctf_group.
+ * @code
+ * CTFWienerAccumulator wien;
+ * wien.initialize(paddim);
+ * for each defocus group
+ *     wien.add(sumOfImages, numberOfImages, ctf);
+ * wien.getAverage(-1, Xdim, avg);
+ * @endcode
+ */
+class CTFWienerAccumulator
+{
+public:
+    /// Sum of the CTFs times the Fourier transforms of the image sums
+    MultidimArray< std::complex<double> > FctfSum;
+    /// Sum of the squared CTFs, weighted by the number of images
+    MultidimArray<double> ctf2Sum;
+    /// Total number of images
+    double weight;
+public:
+    /// Set to zero with the size of the padded images
+    void initialize(size_t paddim);
+
+    /** Add the sum of w images with the same CTF.
+        The sum is padded with zeros to the size of the CTF. */
+    void add(const MultidimArray<double> &sum, double w, const MultidimArray<double> &ctf);
+
+    /// Add the images of another accumulator
+    void add(const CTFWienerAccumulator &other);
+
+    /** Wiener average of the images.
+        The average is cropped to Xdim x Xdim. If the Wiener constant is
+        negative, 10% of the average of ctf2Sum/weight is used (Grigorieff,
+        JSB 157 (2006) 117-125). The average is empty if there are no images. */
+    void getAverage(double wienerConstant, size_t Xdim, MultidimArray<double> &avg) const;
+};
+
 /** Generate CTF 2D image with two CTFs.
  * The two CTFs are in fn1 and fn2. The output image is written to the file fnOut and has size Xdim x Xdim. */
 void generateCTFImageWith2CTFs(const MetaData &MD1, const MetaData &MD2, int Xdim, MultidimArray<double> &imgOut);
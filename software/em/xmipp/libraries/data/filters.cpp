@@ -1227,6 +1227,176 @@ double bestShift(const MultidimArray< std::complex<double> > &FFTI1,
 	return bestShift(Mcorr, shiftX, shiftY, mask, maxShift);
 }
 
+/* Best shift within a window ---------------------------------------------- */
+WindowedShiftAux::WindowedShiftAux()
+{
+    Xdim=Ydim=0;
+    window=-1;
+    partialDFT=true;
+}
+
+void WindowedShiftAux::prepare(size_t _Xdim, size_t _Ydim, int _window)
+{
+    if (Xdim==_Xdim && Ydim==_Ydim && window==_window)
+        return;
+    Xdim=_Xdim;
+    Ydim=_Ydim;
+    window=_window;
+    size_t XdimFourier=Xdim/2+1;
+    int W=2*window+1;
+
+    // A partial DFT costs about 4*W flops per pixel and an FFT about
+    // 2.5*log2(Xdim*Ydim)
+    partialDFT=4.0*W<2.5*log2((double)(Xdim*Ydim));
+
+    Mcorr.resizeNoCopy(W,W);
+    Mcorr.setXmippOrigin();
+    if (partialDFT)
+    {
+        // The real inverse transform only uses half of the spectrum, the
+        // columns that have a symmetric one count twice
+        expY.resizeNoCopy(Ydim,W);
+        expX.resizeNoCopy(W,XdimFourier);
+        Q.resizeNoCopy(W,XdimFourier);
+        for (size_t ky=0; ky<Ydim; ++ky)
+            for (int y=-window; y<=window; ++y)
+            {
+                double s, c;
+                sincos(2*PI*(double)ky*y/Ydim,&s,&c);
+                DIRECT_A2D_ELEM(expY,ky,y+window)=std::complex<double>(c,s);
+            }
+        for (int x=-window; x<=window; ++x)
+            for (size_t kx=0; kx<XdimFourier; ++kx)
+            {
+                double s, c;
+                sincos(2*PI*(double)kx*x/Xdim,&s,&c);
+                double w=(kx==0 || 2*kx==Xdim) ? 1 : 2;
+                DIRECT_A2D_ELEM(expX,x+window,kx)=std::complex<double>(w*c,w*s);
+            }
+        fullCorr.clear();
+    }
+    else
+    {
+        fullCorr.resizeNoCopy(Ydim,Xdim);
+        transformer.setReal(fullCorr);
+        expY.clear();
+        expX.clear();
+        Q.clear();
+    }
+}
+
+double bestShiftInWindow(const MultidimArray< std::complex<double> > &FFTI1,
+                         const MultidimArray< std::complex<double> > &FFTI2,
+                         size_t Xdim, size_t Ydim,
+                         double &shiftX, double &shiftY,
+                         int maxShift, WindowedShiftAux &aux)
+{
+    size_t XdimFourier=Xdim/2+1;
+    if (XSIZE(FFTI1)!=XdimFourier || YSIZE(FFTI1)!=Ydim || !FFTI1.sameShape(FFTI2))
+        REPORT_ERROR(ERR_MULTIDIM_SIZE,"bestShiftInWindow: the transforms do not correspond to the image size");
+    maxShift=XMIPP_MIN(maxShift,(int)XMIPP_MIN(Xdim,Ydim)/2-2);
+    if (maxShift<0)
+        REPORT_ERROR(ERR_VALUE_INCORRECT,"bestShiftInWindow: maxShift must be non-negative");
+    int window=maxShift+1;
+    aux.prepare(Xdim,Ydim,window);
+
+    // Cross power spectrum and its statistics (Parseval). The correlation
+    // at all shifts has the DC term as average.
+    MultidimArray< std::complex<double> > &P=aux.transformer.fFourier;
+    if (aux.partialDFT)
+        aux.P.resizeNoCopy(FFTI1);
+    MultidimArray< std::complex<double> > &mP=aux.partialDFT ? aux.P : P;
+    double sum2=0;
+    for (size_t ky=0; ky<Ydim; ++ky)
+        for (size_t kx=0; kx<XdimFourier; ++kx)
+        {
+            std::complex<double> &p=DIRECT_A2D_ELEM(mP,ky,kx);
+            p=DIRECT_A2D_ELEM(FFTI1,ky,kx)*conj(DIRECT_A2D_ELEM(FFTI2,ky,kx));
+            double w=(kx==0 || 2*kx==Xdim) ? 1 : 2;
+            sum2+=w*norm(p);
+        }
+    double avg=real(DIRECT_A2D_ELEM(mP,0,0));
+    double stddev=sqrt(fabs(sum2-avg*avg));
+    double istddev=(stddev>0) ? 1.0/stddev : 0;
+
+    // Correlation within the window
+    MultidimArray<double> &Mcorr=aux.Mcorr;
+    int W=2*window+1;
+    if (aux.partialDFT)
+    {
+        // Inverse DFT along Y only for the rows of the window
+        MultidimArray< std::complex<double> > &Q=aux.Q;
+        Q.initZeros();
+        for (size_t ky=0; ky<Ydim; ++ky)
+        {
+            const std::complex<double> *ptrP=&DIRECT_A2D_ELEM(mP,ky,0);
+            for (int y=0; y<W; ++y)
+            {
+                std::complex<double> e=DIRECT_A2D_ELEM(aux.expY,ky,y);
+                std::complex<double> *ptrQ=&DIRECT_A2D_ELEM(Q,y,0);
+                for (size_t kx=0; kx<XdimFourier; ++kx)
+                    ptrQ[kx]+=ptrP[kx]*e;
+            }
+        }
+
+        // and along X for the columns of the window
+        for (int y=0; y<W; ++y)
+        {
+            const std::complex<double> *ptrQ=&DIRECT_A2D_ELEM(Q,y,0);
+            for (int x=0; x<W; ++x)
+            {
+                const std::complex<double> *ptrE=&DIRECT_A2D_ELEM(aux.expX,x,0);
+                double corr=0;
+                for (size_t kx=0; kx<XdimFourier; ++kx)
+                    corr+=real(ptrQ[kx])*real(ptrE[kx])-imag(ptrQ[kx])*imag(ptrE[kx]);
+                DIRECT_A2D_ELEM(Mcorr,y,x)=corr;
+            }
+        }
+    }
+    else
+    {
+        // Full inverse transform, only the window is read
+        aux.transformer.inverseFourierTransform();
+        for (int y=-window; y<=window; ++y)
+        {
+            size_t yy=(y<0) ? y+Ydim : y;
+            for (int x=-window; x<=window; ++x)
+            {
+                size_t xx=(x<0) ? x+Xdim : x;
+                A2D_ELEM(Mcorr,y,x)=DIRECT_A2D_ELEM(aux.fullCorr,yy,xx);
+            }
+        }
+    }
+
+    // Maximum within maxShift
+    int maxShift2=maxShift*maxShift;
+    int imax=0, jmax=0;
+    double bestCorr=-1e38;
+    for (int i=-maxShift; i<=maxShift; i++)
+        for (int j=-maxShift; j<=maxShift; j++)
+            if (i*i+j*j<=maxShift2 && A2D_ELEM(Mcorr,i,j)>bestCorr)
+            {
+                imax=i;
+                jmax=j;
+                bestCorr=A2D_ELEM(Mcorr,i,j);
+            }
+
+    // Subpixel refinement with a parabola in each direction
+    double c0=A2D_ELEM(Mcorr,imax,jmax);
+    double cm=A2D_ELEM(Mcorr,imax,jmax-1);
+    double cp=A2D_ELEM(Mcorr,imax,jmax+1);
+    double den=cm-2*c0+cp;
+    double dx=(den<0) ? 0.5*(cm-cp)/den : 0;
+    cm=A2D_ELEM(Mcorr,imax-1,jmax);
+    cp=A2D_ELEM(Mcorr,imax+1,jmax);
+    den=cm-2*c0+cp;
+    double dy=(den<0) ? 0.5*(cm-cp)/den : 0;
+    shiftX=jmax+XMIPP_MAX(-0.5,XMIPP_MIN(0.5,dx));
+    shiftY=imax+XMIPP_MAX(-0.5,XMIPP_MIN(0.5,dy));
+
+    return (c0-avg)*istddev;
+}
+
 /* Best shift -------------------------------------------------------------- */
 void bestShift(const MultidimArray<double> &I1, const MultidimArray<double> &I2,
                double &shiftX, double &shiftY, double &shiftZ, CorrelationAux &aux,
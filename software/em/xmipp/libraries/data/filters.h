@@ -483,6 +483,70 @@ double bestShift(const MultidimArray< std::complex<double> > &FFTI1,
                double &shiftX, double &shiftY, CorrelationAux &aux,
                const MultidimArray<int> *mask=NULL, int maxShift=-1);
 
+/** Auxiliary class for the translational search within a window.
+ * @ingroup Filters
+ *
+ * It keeps the tables of the partial inverse DFT and the work arrays, so
+ * the same object should be reused for all the calls with the same image
+ * size and maximum shift.
+ */
+class WindowedShiftAux
+{
+public:
+    /// Size of the images and half size of the window of the tables
+    size_t Xdim, Ydim;
+    int window;
+    /// Use a partial inverse DFT (true) or a full inverse FFT (false)
+    bool partialDFT;
+    /// exp(i*2*pi*ky*y/Ydim) for all ky and the window rows y
+    MultidimArray< std::complex<double> > expY;
+    /// w(kx)*exp(i*2*pi*kx*x/Xdim) for the stored kx and the window columns x
+    MultidimArray< std::complex<double> > expX;
+    /// Product of the transforms and its partial transform along Y
+    MultidimArray< std::complex<double> > P, Q;
+    /// Correlation within the window (logical indexes)
+    MultidimArray<double> Mcorr;
+    /// Full correlation (only for large windows)
+    MultidimArray<double> fullCorr;
+    FourierTransformer transformer;
+
+    /// Empty constructor
+    WindowedShiftAux();
+
+    /// Prepare the tables for images of this size and a window of half size window
+    void prepare(size_t _Xdim, size_t _Ydim, int _window);
+};
+
+/** Translational search within a window.
+ * @ingroup Filters
+ *
+ * FFTI1 and FFTI2 are the Fourier transforms (as computed by
+ * FourierTransformer) of two images of size Ydim x Xdim. The correlation
+ * is only computed for the shifts within maxShift pixels (plus one pixel
+ * for the peak fit): with a partial inverse DFT for small windows and with
+ * an inverse FFT of which only the window is read for large ones. For an
+ * image of N pixels and a window of W=2*maxShift+3 shifts per side, the
+ * partial DFT costs O(N*W) (the pass along Y dominates) and the FFT
+ * O(N*log(N)), so the partial DFT is only used when W is small compared
+ * to log2(N). Its
+ * average and standard deviation over all shifts are computed from the
+ * spectrum, so the returned correlation is normalized as in bestShift.
+ *
+ * The shift is refined to subpixel accuracy with a parabola through the
+ * maximum and its two neighbours in each direction. As in bestShift, I1
+ * must be shifted by (-shiftX,-shiftY) to match I2.
+ * @code
+ * WindowedShiftAux aux;
+ * for (...)
+ *    corr=bestShiftInWindow(FFT1,FFT2,Xdim,Ydim,shiftX,shiftY,maxShift,aux);
+ * @endcode
+ */
+double bestShiftInWindow(const MultidimArray< std::complex<double> > &FFTI1,
+                         const MultidimArray< std::complex<double> > &FFTI2,
+                         size_t Xdim, size_t Ydim,
+                         double &shiftX, double &shiftY,
+                         int maxShift, WindowedShiftAux &aux);
+
 /** Translational search (3D)
  * @ingroup Filters
  *
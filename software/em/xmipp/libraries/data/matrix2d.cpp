@@ -29,6 +29,10 @@
 #include <alglib/src/linalg.h>
 
 #include "matrix2d.h"
+#include "xmipp_threads.h"
+#ifdef XMIPP_CBLAS
+#include <cblas.h>
+#endif
 
 /* Cholesky decomposition -------------------------------------------------- */
 void cholesky(const Matrix2D<double> &M, Matrix2D<double> &L)
@@ -524,120 +528,313 @@ void connectedComponentsOfUndirectedGraph(const Matrix2D<double> &G, Matrix1D<in
 	} while (workDone);
 }
 
+/* Dense products ---------------------------------------------------------- */
+// Rows of the result computed by each task
+#define GEMM_MC 32
+// Block of the inner dimension kept in cache
+#define GEMM_KC 128
+// Block of columns of the result kept in cache
+#define GEMM_NC 256
+// Products with fewer multiply-adds are computed by the calling thread
+#define GEMM_MIN_THREADED_OPS 4194304.0
+// Products with fewer multiply-adds (e.g. the 3x3 and 4x4 geometric
+// transformations) are computed by operator* with a direct triple loop
+#define GEMM_MIN_BLOCKED_OPS 512
+
+static int matrixOperationThreads = 1;
+
+void setMatrixOperationThreads(int nThreads)
+{
+    matrixOperationThreads = XMIPP_MAX(1, nThreads);
+}
+
+int getMatrixOperationThreads()
+{
+    return matrixOperationThreads;
+}
+
+/* Arguments of C=op(A)*B. op(A)(i,k) is at A[i*strideAi+k*strideAk] and
+ * B is a row major matrix, so that the innermost loop runs along
+ * contiguous rows of B and C and is vectorized by the compiler. */
+struct GemmArgs
+{
+    const double *A;
+    size_t strideAi, strideAk;
+    const double *B;
+    double *C;
+    size_t m, n, k;
+    // Compute only the upper triangle (j>=i) of a symmetric result
+    bool upper;
+    ThreadTaskDistributor *td;
+};
+
+static void gemmRows(const GemmArgs &g, size_t i0, size_t i1)
+{
+    for (size_t j0 = (g.upper ? i0 - i0 % GEMM_NC : 0); j0 < g.n; j0 += GEMM_NC)
+    {
+        size_t j1 = XMIPP_MIN(j0 + GEMM_NC, g.n);
+        for (size_t k0 = 0; k0 < g.k; k0 += GEMM_KC)
+        {
+            size_t k1 = XMIPP_MIN(k0 + GEMM_KC, g.k);
+            for (size_t i = i0; i < i1; ++i)
+            {
+                size_t js = g.upper ? XMIPP_MAX(j0, i) : j0;
+                if (js >= j1)
+                    continue;
+                const double *Ai = g.A + i * g.strideAi;
+                double *Ci = g.C + i * g.n;
+                size_t k = k0;
+                for (; k + 3 < k1; k += 4)
+                {
+                    double a0 = Ai[k * g.strideAk];
+                    double a1 = Ai[(k + 1) * g.strideAk];
+                    double a2 = Ai[(k + 2) * g.strideAk];
+                    double a3 = Ai[(k + 3) * g.strideAk];
+                    const double *B0 = g.B + k * g.n;
+                    const double *B1 = B0 + g.n;
+                    const double *B2 = B1 + g.n;
+                    const double *B3 = B2 + g.n;
+                    for (size_t j = js; j < j1; ++j)
+                        Ci[j] += a0 * B0[j] + a1 * B1[j] + a2 * B2[j] + a3 * B3[j];
+                }
+                for (; k < k1; ++k)
+                {
+                    double a = Ai[k * g.strideAk];
+                    const double *Bk = g.B + k * g.n;
+                    for (size_t j = js; j < j1; ++j)
+                        Ci[j] += a * Bk[j];
+                }
+            }
+        }
+    }
+}
+
+static void threadGemm(ThreadArgument &thArg)
+{
+    GemmArgs *g = (GemmArgs *) thArg.workClass;
+    size_t first, last;
+    while (g->td->getTasks(first, last))
+        for (size_t t = first; t <= last; ++t)
+            gemmRows(*g, t * GEMM_MC, XMIPP_MIN((t + 1) * GEMM_MC, g->m));
+}
+
+/* C=op(A)*op(B). If symmetric, only the upper triangle is computed and
+ * then copied onto the lower one. */
+static void matrixProduct(const Matrix2D<double> &A, bool transA,
+                          const Matrix2D<double> &B, bool transB,
+                          Matrix2D<double> &C, bool symmetric=false)
+{
+    size_t m = transA ? MAT_XSIZE(A) : MAT_YSIZE(A);
+    size_t k = transA ? MAT_YSIZE(A) : MAT_XSIZE(A);
+    size_t kB = transB ? MAT_XSIZE(B) : MAT_YSIZE(B);
+    size_t n = transB ? MAT_YSIZE(B) : MAT_XSIZE(B);
+    if (k != kB)
+        REPORT_ERROR(ERR_MATRIX_SIZE, "Not compatible sizes in matrix multiplication");
+    if (&C == &A || &C == &B)
+        REPORT_ERROR(ERR_ARG_INCORRECT, "The result of a matrix product cannot be one of its operands");
+    C.initZeros(m, n);
+    if (m == 0 || n == 0 || k == 0)
+        return;
+
+#ifdef XMIPP_CBLAS
+
+    if (symmetric && &A == &B && transA != transB)
+        cblas_dsyrk(CblasRowMajor, CblasUpper, transA ? CblasTrans : CblasNoTrans,
+                    m, k, 1.0, MATRIX2D_ARRAY(A), MAT_XSIZE(A), 0.0, MATRIX2D_ARRAY(C), n);
+    else
+    {
+        cblas_dgemm(CblasRowMajor, transA ? CblasTrans : CblasNoTrans,
+                    transB ? CblasTrans : CblasNoTrans, m, n, k,
+                    1.0, MATRIX2D_ARRAY(A), MAT_XSIZE(A), MATRIX2D_ARRAY(B), MAT_XSIZE(B),
+                    0.0, MATRIX2D_ARRAY(C), n);
+        symmetric = false;
+    }
+#else
+
+    GemmArgs g;
+    g.A = MATRIX2D_ARRAY(A);
+    g.strideAi = transA ? 1 : MAT_XSIZE(A);
+    g.strideAk = transA ? MAT_XSIZE(A) : 1;
+    Matrix2D<double> Bt;
+    if (transB)
+    {
+        Bt = B.transpose();
+        g.B = MATRIX2D_ARRAY(Bt);
+    }
+    else
+        g.B = MATRIX2D_ARRAY(B);
+    g.C = MATRIX2D_ARRAY(C);
+    g.m = m;
+    g.n = n;
+    g.k = k;
+    g.upper = symmetric;
+
+    size_t nTasks = (m + GEMM_MC - 1) / GEMM_MC;
+    int nThreads = (int) XMIPP_MIN((size_t) matrixOperationThreads, nTasks);
+    if (nThreads > 1 && (double) m * n * k >= GEMM_MIN_THREADED_OPS)
+    {
+        ThreadTaskDistributor td(nTasks, 1);
+        g.td = &td;
+        ThreadManager thMgr(nThreads, &g);
+        thMgr.run(threadGemm);
+    }
+    else
+        gemmRows(g, 0, m);
+#endif
+
+    if (symmetric)
+        for (size_t i = 1; i < m; ++i)
+            for (size_t j = 0; j < i; ++j)
+                MAT_ELEM(C, i, j) = MAT_ELEM(C, j, i);
+}
+
+/* y=op(A)*x. Rows (or columns if transposed) of A are split among threads. */
+struct GemvArgs
+{
+    const Matrix2D<double> *A;
+    const double *x;
+    double *y;
+    bool transA;
+    ThreadTaskDistributor *td;
+};
+
+static void gemvRange(const GemvArgs &g, size_t i0, size_t i1)
+{
+    const Matrix2D<double> &A = *g.A;
+    if (g.transA)
+    {
+        // y(i0:i1)+=x(k)*A(k,i0:i1), contiguous along the rows of A
+        for (size_t k = 0; k < MAT_YSIZE(A); ++k)
+        {
+            double xk = g.x[k];
+            const double *Ak = &MAT_ELEM(A, k, 0);
+            for (size_t i = i0; i < i1; ++i)
+                g.y[i] += xk * Ak[i];
+        }
+    }
+    else
+        for (size_t i = i0; i < i1; ++i)
+        {
+            double aux = 0.;
+            const double *Ai = &MAT_ELEM(A, i, 0);
+            for (size_t k = 0; k < MAT_XSIZE(A); ++k)
+                aux += Ai[k] * g.x[k];
+            g.y[i] = aux;
+        }
+}
+
+static void threadGemv(ThreadArgument &thArg)
+{
+    GemvArgs *g = (GemvArgs *) thArg.workClass;
+    size_t size = g->transA ? MAT_XSIZE(*g->A) : MAT_YSIZE(*g->A);
+    size_t first, last;
+    while (g->td->getTasks(first, last))
+        gemvRange(*g, first * GEMM_NC, XMIPP_MIN((last + 1) * GEMM_NC, size));
+}
+
+static void matrixVectorProduct(const Matrix2D<double> &A, bool transA,
+                                const Matrix1D<double> &x, Matrix1D<double> &y)
+{
+    size_t m = transA ? MAT_XSIZE(A) : MAT_YSIZE(A);
+    size_t k = transA ? MAT_YSIZE(A) : MAT_XSIZE(A);
+    if (VEC_XSIZE(x) != k)
+        REPORT_ERROR(ERR_MATRIX_SIZE, "Not compatible sizes in matrix by vector multiplication");
+    y.initZeros(m);
+    if (m == 0 || k == 0)
+        return;
+
+#ifdef XMIPP_CBLAS
+
+    cblas_dgemv(CblasRowMajor, transA ? CblasTrans : CblasNoTrans,
+                MAT_YSIZE(A), MAT_XSIZE(A), 1.0, MATRIX2D_ARRAY(A), MAT_XSIZE(A),
+                MATRIX1D_ARRAY(x), 1, 0.0, MATRIX1D_ARRAY(y), 1);
+#else
+
+    GemvArgs g;
+    g.A = &A;
+    g.x = MATRIX1D_ARRAY(x);
+    g.y = MATRIX1D_ARRAY(y);
+    g.transA = transA;
+
+    size_t nTasks = (m + GEMM_NC - 1) / GEMM_NC;
+    int nThreads = (int) XMIPP_MIN((size_t) matrixOperationThreads, nTasks);
+    if (nThreads > 1 && (double) m * k >= GEMM_MIN_THREADED_OPS)
+    {
+        ThreadTaskDistributor td(nTasks, 1);
+        g.td = &td;
+        ThreadManager thMgr(nThreads, &g);
+        thMgr.run(threadGemv);
+    }
+    else
+        gemvRange(g, 0, m);
+#endif
+}
+
 void matrixOperation_AB(const Matrix2D <double> &A, const Matrix2D<double> &B, Matrix2D<double> &C)
 {
-	C.initZeros(MAT_YSIZE(A), MAT_XSIZE(B));
-	for (size_t i = 0; i < MAT_YSIZE(A); ++i)
-		for (size_t j = 0; j < MAT_XSIZE(B); ++j)
-		{
-			double aux=0.;
-			for (size_t k = 0; k < MAT_XSIZE(A); ++k)
-				aux += MAT_ELEM(A, i, k) * MAT_ELEM(B, k, j);
-			MAT_ELEM(C, i, j)=aux;
-		}
+    matrixProduct(A, false, B, false, C);
 }
 
 void matrixOperation_Ax(const Matrix2D <double> &A, const Matrix1D<double> &x, Matrix1D<double> &y)
 {
-    y.initZeros(MAT_YSIZE(A));
-	for (size_t i = 0; i < MAT_YSIZE(A); ++i)
-	{
-		double aux=0.;
-		for (size_t k = 0; k < MAT_XSIZE(A); ++k)
-			aux += MAT_ELEM(A, i, k) * VEC_ELEM(x, k);
-		VEC_ELEM(y, i)=aux;
-	}
+    matrixVectorProduct(A, false, x, y);
 }
 
 void matrixOperation_AtA(const Matrix2D <double> &A, Matrix2D<double> &B)
 {
-    B.resizeNoCopy(MAT_XSIZE(A), MAT_XSIZE(A));
-    for (size_t i = 0; i < MAT_XSIZE(A); ++i)
-        for (size_t j = i; j < MAT_XSIZE(A); ++j)
-        {
-            double aux=0.;
-            for (size_t k = 0; k < MAT_YSIZE(A); ++k)
-                aux += MAT_ELEM(A, k, i) * MAT_ELEM(A, k, j);
-            MAT_ELEM(B, j, i) = MAT_ELEM(B, i, j) = aux;
-        }
+    matrixProduct(A, true, A, false, B, true);
 }
 
 void matrixOperation_AAt(const Matrix2D <double> &A, Matrix2D<double> &C)
 {
-	C.initZeros(MAT_YSIZE(A), MAT_YSIZE(A));
-	for (size_t i = 0; i < MAT_YSIZE(A); ++i)
-		for (size_t j = i; j < MAT_YSIZE(A); ++j)
-		{
-			double aux=0.;
-			for (size_t k = 0; k < MAT_XSIZE(A); ++k)
-				aux += MAT_ELEM(A, i, k) * MAT_ELEM(A, j, k);
-			MAT_ELEM(C, j, i)=MAT_ELEM(C, i, j)=aux;
-		}
+    matrixProduct(A, false, A, true, C, true);
 }
 
 void matrixOperation_ABt(const Matrix2D <double> &A, const Matrix2D <double> &B, Matrix2D<double> &C)
 {
-	C.initZeros(MAT_YSIZE(A), MAT_YSIZE(B));
-	for (size_t i = 0; i < MAT_YSIZE(A); ++i)
-		for (size_t j = 0; j < MAT_YSIZE(B); ++j)
-		{
-			double aux=0.;
-			for (size_t k = 0; k < MAT_XSIZE(A); ++k)
-				aux += MAT_ELEM(A, i, k) * MAT_ELEM(B, j, k);
-			MAT_ELEM(C, i, j)=aux;
-		}
+    matrixProduct(A, false, B, true, C);
 }
 
 void matrixOperation_AtB(const Matrix2D <double> &A, const Matrix2D<double> &B, Matrix2D<double> &C)
 {
-    C.resizeNoCopy(MAT_XSIZE(A), MAT_XSIZE(B));
-    for (size_t i = 0; i < MAT_XSIZE(A); ++i)
-        for (size_t j = 0; j < MAT_XSIZE(B); ++j)
-        {
-            double aux=0.;
-            for (size_t k = 0; k < MAT_YSIZE(A); ++k)
-                aux += MAT_ELEM(A, k, i) * MAT_ELEM(B, k, j);
-			MAT_ELEM(C, i, j)=aux;
-        }
+    matrixProduct(A, true, B, false, C);
 }
 
 void matrixOperation_Atx(const Matrix2D <double> &A, const Matrix1D<double> &x, Matrix1D<double> &y)
 {
-    y.resizeNoCopy(MAT_XSIZE(A));
-    for (size_t i = 0; i < MAT_XSIZE(A); ++i)
-	{
-		double aux=0.;
-		for (size_t k = 0; k < MAT_YSIZE(A); ++k)
-			aux += MAT_ELEM(A, k, i) * VEC_ELEM(x, k);
-		VEC_ELEM(y, i)=aux;
-	}
+    matrixVectorProduct(A, true, x, y);
 }
 
 void matrixOperation_AtBt(const Matrix2D <double> &A, const Matrix2D<double> &B, Matrix2D<double> &C)
 {
-	C.initZeros(MAT_XSIZE(A), MAT_YSIZE(B));
-	for (size_t i = 0; i < MAT_XSIZE(A); ++i)
-		for (size_t j = 0; j < MAT_YSIZE(B); ++j)
-		{
-			double aux=0.;
-			for (size_t k = 0; k < MAT_YSIZE(A); ++k)
-				aux += MAT_ELEM(A, k, i) * MAT_ELEM(B, j, k);
-			MAT_ELEM(C, i, j)=aux;
-		}
+    matrixProduct(A, true, B, true, C);
 }
 
 void matrixOperation_XtAX_symmetric(const Matrix2D<double> &X, const Matrix2D<double> &A, Matrix2D<double> &B)
 {
-	Matrix2D<double> AX=A*X;
-    B.resizeNoCopy(MAT_XSIZE(X), MAT_XSIZE(X));
-    for (size_t i = 0; i < MAT_XSIZE(X); ++i)
-        for (size_t j = i; j < MAT_XSIZE(X); ++j)
-        {
-            double aux=0.;
-            for (size_t k = 0; k < MAT_YSIZE(X); ++k)
-                aux += MAT_ELEM(X, k, i) * MAT_ELEM(AX, k, j);
-            MAT_ELEM(B, j, i) = MAT_ELEM(B, i, j) = aux;
-        }
+    Matrix2D<double> AX;
+    matrixProduct(A, false, X, false, AX);
+    matrixProduct(X, true, AX, false, B, true);
+}
+
+template<>
+Matrix2D<double> Matrix2D<double>::operator*(const Matrix2D<double>& op1) const
+{
+    Matrix2D<double> result;
+    if (mdimy * mdimx * op1.mdimx >= GEMM_MIN_BLOCKED_OPS)
+    {
+        matrixProduct(*this, false, op1, false, result);
+        return result;
+    }
+
+    if (mdimx != op1.mdimy)
+        REPORT_ERROR(ERR_MATRIX_SIZE, "Not compatible sizes in matrix multiplication");
+    result.initZeros(mdimy, op1.mdimx);
+    for (size_t i = 0; i < mdimy; i++)
+        for (size_t j = 0; j < op1.mdimx; j++)
+            for (size_t k = 0; k < mdimx; k++)
+                MAT_ELEM(result,i, j) += MAT_ELEM(*this,i, k) * MAT_ELEM(op1, k, j);
+    return result;
 }
 
 void matrixOperation_IplusA(Matrix2D<double> &A)
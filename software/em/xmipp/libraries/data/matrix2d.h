@@ -1765,6 +1765,14 @@ public:
     //@}
 };
 
+/** Matrix by Matrix multiplication for doubles.
+ * Large products are computed by the blocked and multithreaded engine of
+ * matrixOperation_AB. Small ones (as the 3x3 and 4x4 geometric
+ * transformations) keep the direct triple loop of the generic operator.
+ */
+template<>
+Matrix2D<double> Matrix2D<double>::operator*(const Matrix2D<double>& op1) const;
+
 typedef Matrix2D<double> DMatrix;
 typedef Matrix2D<int> IMatrix;
 
@@ -1964,6 +1972,18 @@ void normalizeColumnsBetween0and1(Matrix2D<double> &A);
  */
 void subtractColumnMeans(Matrix2D<double> &A);
 
+/** Number of threads of the matrix operations.
+ * The products below (and the product of two Matrix2D<double>) are computed
+ * by blocks of the result that are distributed among this number of threads
+ * (1 by default). Small products are always computed by the calling thread.
+ * If Xmipp is compiled with -DXMIPP_CBLAS, they are computed by the CBLAS
+ * library instead, and its own threading applies.
+ */
+void setMatrixOperationThreads(int nThreads);
+
+/** Number of threads of the matrix operations. */
+int getMatrixOperationThreads();
+
 /** Matrix operation: B=A^t*A. */
 void matrixOperation_AtA(const Matrix2D <double> &A, Matrix2D<double> &B);
 
@@ -47,6 +47,20 @@ void getBlocksInMetaDataFile(const FileName &inFile, StringVector& blockList)
     {
         getBlocksInMetaDataFileDB(inFile,blockList);
     }
+    else if(extFile=="xmdb")
+    {
+        // Binary files have a single block, its name follows the magic,
+        // version, number of objects and number of labels
+        std::ifstream is(inFile.c_str(), std::ios_base::in | std::ios_base::binary);
+        char header[4 + 2 * sizeof(int) + sizeof(unsigned long long)];
+        int length = -1;
+        if (is.read(header, sizeof(header)) && is.read((char *) &length, sizeof(int)) && length >= 0)
+        {
+            String blockName(length, ' ');
+            if (length == 0 || is.read(&blockName[0], length))
+                blockList.push_back(blockName);
+        }
+    }
     else
     {    //map file
         int fd;
@@ -630,6 +644,8 @@ void MetaData::write(const FileName &_outFile, WriteModeMetaData mode) const
         writeXML(outFile, blockName, mode);
     else if(extFile=="sqlite")
         writeDB(outFile, blockName, mode);
+    else if(extFile=="xmdb")
+        writeBinary(outFile, blockName, mode);
     else
         writeStar(outFile, blockName, mode);
 }
@@ -769,6 +785,552 @@ void MetaData::print() const
     write(std::cout);
 }
 
+#define MD_SERIALIZATION_MAGIC "XMDB"
+#define MD_SERIALIZATION_VERSION 1
+
+/* Helpers to pack and unpack binary values in a buffer */
+template <typename T>
+inline void bufferPut(std::vector<char> &buffer, const T &value)
+{
+    const char *ptr = (const char *) &value;
+    buffer.insert(buffer.end(), ptr, ptr + sizeof(T));
+}
+
+inline void bufferPutBytes(std::vector<char> &buffer, const void *data, size_t n)
+{
+    const char *ptr = (const char *) data;
+    buffer.insert(buffer.end(), ptr, ptr + n);
+}
+
+inline const char * bufferGetBytes(const char *&ptr, const char *end, size_t n)
+{
+    if ((size_t)(end - ptr) < n)
+        REPORT_ERROR(ERR_MD, "MetaData: binary data is truncated");
+    const char *data = ptr;
+    ptr += n;
+    return data;
+}
+
+template <typename T>
+inline T bufferGet(const char *&ptr, const char *end)
+{
+    T value;
+    memcpy(&value, bufferGetBytes(ptr, end, sizeof(T)), sizeof(T));
+    return value;
+}
+
+void MetaData::serialize(std::vector<char> &buffer) const
+{
+    std::vector<size_t> objects;
+    findObjects(objects);
+    size_t nObjects = objects.size();
+    size_t nLabels = activeLabels.size();
+
+    buffer.clear();
+    bufferPutBytes(buffer, MD_SERIALIZATION_MAGIC, 4);
+    bufferPut(buffer, (int) MD_SERIALIZATION_VERSION);
+    bufferPut(buffer, (unsigned long long) nObjects);
+    bufferPut(buffer, (int) nLabels);
+    for (size_t l = 0; l < nLabels; ++l)
+    {
+        String name = MDL::label2Str(activeLabels[l]);
+        bufferPut(buffer, (int) name.size());
+        bufferPutBytes(buffer, name.c_str(), name.size());
+        bufferPut(buffer, (int) MDL::labelType(activeLabels[l]));
+    }
+
+    for (size_t l = 0; l < nLabels; ++l)
+    {
+        MDLabel label = activeLabels[l];
+        MDLabelType type = MDL::labelType(label);
+        MDObject value(label);
+        for (size_t i = 0; i < nObjects; ++i)
+        {
+            myMDSql->getObjectValue(objects[i], value);
+            switch (type)
+            {
+            case LABEL_INT:
+                bufferPut(buffer, value.data.intValue);
+                break;
+            case LABEL_BOOL:
+                bufferPut(buffer, (char) value.data.boolValue);
+                break;
+            case LABEL_DOUBLE:
+                bufferPut(buffer, value.data.doubleValue);
+                break;
+            case LABEL_SIZET:
+                bufferPut(buffer, (unsigned long long) value.data.longintValue);
+                break;
+            case LABEL_STRING:
+                {
+                    const String &str = *(value.data.stringValue);
+                    bufferPut(buffer, (int) str.size());
+                    bufferPutBytes(buffer, str.c_str(), str.size());
+                }
+                break;
+            case LABEL_VECTOR_DOUBLE:
+                {
+                    const std::vector<double> &v = *(value.data.vectorValue);
+                    bufferPut(buffer, (unsigned long long) v.size());
+                    if (!v.empty())
+                        bufferPutBytes(buffer, &v[0], v.size() * sizeof(double));
+                }
+                break;
+            case LABEL_VECTOR_SIZET:
+                {
+                    const std::vector<size_t> &v = *(value.data.vectorValueLong);
+                    bufferPut(buffer, (unsigned long long) v.size());
+                    for (size_t k = 0; k < v.size(); ++k)
+                        bufferPut(buffer, (unsigned long long) v[k]);
+                }
+                break;
+            default:
+                REPORT_ERROR(ERR_MD_BADTYPE, formatString("MetaData::serialize: unsupported type for label %s",
+                             MDL::label2Str(label).c_str()));
+            }
+        }
+    }
+}
+
+void MetaData::deserialize(const char *buffer, size_t bufferSize)
+{
+    const char *ptr = buffer, *end = buffer + bufferSize;
+    if (strncmp(bufferGetBytes(ptr, end, 4), MD_SERIALIZATION_MAGIC, 4) != 0)
+        REPORT_ERROR(ERR_MD, "MetaData::deserialize: the buffer does not contain a serialized metadata");
+    int version = bufferGet<int>(ptr, end);
+    if (version != MD_SERIALIZATION_VERSION)
+        REPORT_ERROR(ERR_MD, formatString("MetaData::deserialize: unsupported version %d", version));
+    size_t nObjects = (size_t) bufferGet<unsigned long long>(ptr, end);
+    int nLabels = bufferGet<int>(ptr, end);
+
+    clear();
+    std::vector<MDLabel> labels(nLabels);
+    std::vector<MDLabelType> types(nLabels);
+    for (int l = 0; l < nLabels; ++l)
+    {
+        int length = bufferGet<int>(ptr, end);
+        String name(bufferGetBytes(ptr, end, length), length);
+        types[l] = (MDLabelType) bufferGet<int>(ptr, end);
+        labels[l] = MDL::str2Label(name);
+        // Unknown labels or labels whose type has changed are skipped
+        if (labels[l] != MDL_UNDEFINED && MDL::labelType(labels[l]) != types[l])
+            labels[l] = MDL_UNDEFINED;
+        if (labels[l] != MDL_UNDEFINED)
+            addLabel(labels[l]);
+    }
+
+    std::vector<size_t> objects(nObjects);
+    for (size_t i = 0; i < nObjects; ++i)
+        objects[i] = addObject();
+
+    for (int l = 0; l < nLabels; ++l)
+    {
+        MDLabel label = labels[l];
+        bool keep = label != MDL_UNDEFINED;
+        MDObject value(label);
+        for (size_t i = 0; i < nObjects; ++i)
+        {
+            switch (types[l])
+            {
+            case LABEL_INT:
+                value.data.intValue = bufferGet<int>(ptr, end);
+                break;
+            case LABEL_BOOL:
+                value.data.boolValue = bufferGet<char>(ptr, end) != 0;
+                break;
+            case LABEL_DOUBLE:
+                value.data.doubleValue = bufferGet<double>(ptr, end);
+                break;
+            case LABEL_SIZET:
+                value.data.longintValue = (size_t) bufferGet<unsigned long long>(ptr, end);
+                break;
+            case LABEL_STRING:
+                {
+                    int length = bufferGet<int>(ptr, end);
+                    const char *str = bufferGetBytes(ptr, end, length);
+                    if (keep)
+                        value.data.stringValue->assign(str, length);
+                }
+                break;
+            case LABEL_VECTOR_DOUBLE:
+                {
+                    size_t n = (size_t) bufferGet<unsigned long long>(ptr, end);
+                    const char *data = bufferGetBytes(ptr, end, n * sizeof(double));
+                    if (keep)
+                    {
+                        std::vector<double> &v = *(value.data.vectorValue);
+                        v.resize(n);
+                        if (n > 0)
+                            memcpy(&v[0], data, n * sizeof(double));
+                    }
+                }
+                break;
+            case LABEL_VECTOR_SIZET:
+                {
+                    size_t n = (size_t) bufferGet<unsigned long long>(ptr, end);
+                    std::vector<size_t> v(n);
+                    for (size_t k = 0; k < n; ++k)
+                        v[k] = (size_t) bufferGet<unsigned long long>(ptr, end);
+                    if (keep)
+                        *(value.data.vectorValueLong) = v;
+                }
+                break;
+            default:
+                REPORT_ERROR(ERR_MD_BADTYPE, "MetaData::deserialize: unsupported label type");
+            }
+            if (keep)
+                myMDSql->setObjectValue(objects[i], value);
+        }
+    }
+}
+
+#define MD_BINARY_MAGIC "XMDC"
+#define MD_BINARY_VERSION 1
+#define MD_BINARY_OFFSET_SIZE sizeof(unsigned long long)
+
+/* Pad a buffer with zeros to a multiple of 8 bytes */
+inline void bufferAlign(std::vector<char> &buffer)
+{
+    buffer.resize((buffer.size() + 7) & ~((size_t) 7), 0);
+}
+
+inline void bufferPutString(std::vector<char> &buffer, const String &str)
+{
+    bufferPut(buffer, (int) str.size());
+    bufferPutBytes(buffer, str.c_str(), str.size());
+}
+
+inline String bufferGetString(const char *&ptr, const char *end)
+{
+    int length = bufferGet<int>(ptr, end);
+    return String(bufferGetBytes(ptr, end, length), length);
+}
+
+void MetaData::writeBinary(const FileName &outFile, const String &blockName, WriteModeMetaData mode) const
+{
+    if (mode != MD_OVERWRITE)
+        REPORT_ERROR(ERR_NOT_IMPLEMENTED, formatString("MetaData::writeBinary: %s can only store one block, "
+                     "it should be overwritten", outFile.c_str()));
+
+    std::vector<size_t> objects;
+    findObjects(objects);
+    size_t nObjects = objects.size();
+    size_t nLabels = activeLabels.size();
+
+    // Pack the columns, variable size values go after a table with the
+    // offset of every object (nObjects+1 entries)
+    std::vector< std::vector<char> > columns(nLabels);
+    for (size_t l = 0; l < nLabels; ++l)
+    {
+        MDLabel label = activeLabels[l];
+        MDLabelType type = MDL::labelType(label);
+        MDObject value(label);
+        std::vector<char> &column = columns[l];
+        std::vector<unsigned long long> offsets;
+        std::vector<char> data;
+        if (type == LABEL_STRING || type == LABEL_VECTOR_DOUBLE || type == LABEL_VECTOR_SIZET)
+            offsets.resize(nObjects + 1, 0);
+        for (size_t i = 0; i < nObjects; ++i)
+        {
+            myMDSql->getObjectValue(objects[i], value);
+            switch (type)
+            {
+            case LABEL_INT:
+                bufferPut(column, value.data.intValue);
+                break;
+            case LABEL_BOOL:
+                bufferPut(column, (char) value.data.boolValue);
+                break;
+            case LABEL_DOUBLE:
+                bufferPut(column, value.data.doubleValue);
+                break;
+            case LABEL_SIZET:
+                bufferPut(column, (unsigned long long) value.data.longintValue);
+                break;
+            case LABEL_STRING:
+                {
+                    const String &str = *(value.data.stringValue);
+                    bufferPutBytes(data, str.c_str(), str.size());
+                    offsets[i + 1] = offsets[i] + str.size();
+                }
+                break;
+            case LABEL_VECTOR_DOUBLE:
+                {
+                    const std::vector<double> &v = *(value.data.vectorValue);
+                    if (!v.empty())
+                        bufferPutBytes(data, &v[0], v.size() * sizeof(double));
+                    offsets[i + 1] = offsets[i] + v.size();
+                }
+                break;
+            case LABEL_VECTOR_SIZET:
+                {
+                    const std::vector<size_t> &v = *(value.data.vectorValueLong);
+                    for (size_t k = 0; k < v.size(); ++k)
+                        bufferPut(data, (unsigned long long) v[k]);
+                    offsets[i + 1] = offsets[i] + v.size();
+                }
+                break;
+            default:
+                REPORT_ERROR(ERR_MD_BADTYPE, formatString("MetaData::writeBinary: unsupported type for label %s",
+                             MDL::label2Str(label).c_str()));
+            }
+        }
+        if (!offsets.empty())
+        {
+            bufferPutBytes(column, &offsets[0], offsets.size() * MD_BINARY_OFFSET_SIZE);
+            column.insert(column.end(), data.begin(), data.end());
+        }
+    }
+
+    // Header and dictionary, the offsets of the columns are set later
+    std::vector<char> header;
+    std::vector<size_t> offsetPositions(nLabels);
+    bufferPutBytes(header, MD_BINARY_MAGIC, 4);
+    bufferPut(header, (int) MD_BINARY_VERSION);
+    bufferPut(header, (unsigned long long) nObjects);
+    bufferPut(header, (int) nLabels);
+    bufferPutString(header, blockName);
+    bufferPutString(header, getComment());
+    for (size_t l = 0; l < nLabels; ++l)
+    {
+        bufferPutString(header, MDL::label2Str(activeLabels[l]));
+        bufferPut(header, (int) MDL::labelType(activeLabels[l]));
+        offsetPositions[l] = header.size();
+        bufferPut(header, (unsigned long long) 0);
+        bufferPut(header, (unsigned long long) columns[l].size());
+    }
+    bufferAlign(header);
+    unsigned long long offset = header.size();
+    for (size_t l = 0; l < nLabels; ++l)
+    {
+        memcpy(&header[offsetPositions[l]], &offset, sizeof(offset));
+        bufferAlign(columns[l]);
+        offset += columns[l].size();
+    }
+
+    std::ofstream ofs(outFile.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    if (!ofs)
+        REPORT_ERROR(ERR_IO_NOTOPEN, formatString("MetaData::writeBinary: cannot open %s", outFile.c_str()));
+    ofs.write(&header[0], header.size());
+    for (size_t l = 0; l < nLabels; ++l)
+        if (!columns[l].empty())
+            ofs.write(&(columns[l][0]), columns[l].size());
+    if (!ofs)
+        REPORT_ERROR(ERR_IO_NOWRITE, formatString("MetaData::writeBinary: cannot write %s", outFile.c_str()));
+}
+
+/* Get the value of object i from a column of a binary metadata file */
+inline void binaryColumnValue(const char *column, size_t nObjects, size_t i, MDObject &value)
+{
+    const unsigned long long *offsets = (const unsigned long long *) column;
+    const char *data = column + (nObjects + 1) * MD_BINARY_OFFSET_SIZE;
+    switch (value.type)
+    {
+    case LABEL_INT:
+        memcpy(&value.data.intValue, column + i * sizeof(int), sizeof(int));
+        break;
+    case LABEL_BOOL:
+        value.data.boolValue = column[i] != 0;
+        break;
+    case LABEL_DOUBLE:
+        memcpy(&value.data.doubleValue, column + i * sizeof(double), sizeof(double));
+        break;
+    case LABEL_SIZET:
+        value.data.longintValue = (size_t) ((const unsigned long long *) column)[i];
+        break;
+    case LABEL_STRING:
+        value.data.stringValue->assign(data + offsets[i], offsets[i + 1] - offsets[i]);
+        break;
+    case LABEL_VECTOR_DOUBLE:
+        value.data.vectorValue->assign((const double *) data + offsets[i],
+                                       (const double *) data + offsets[i + 1]);
+        break;
+    case LABEL_VECTOR_SIZET:
+        value.data.vectorValueLong->assign((const unsigned long long *) data + offsets[i],
+                                           (const unsigned long long *) data + offsets[i + 1]);
+        break;
+    default:
+        REPORT_ERROR(ERR_MD_BADTYPE, "MetaData::readBinary: unsupported label type");
+    }
+}
+
+/* Read only map of a file, unmapped when it goes out of scope (also when
+   an error is reported while reading it) */
+class BinaryFileMap
+{
+public:
+    char *map;
+    size_t size;
+    int fd;
+
+    BinaryFileMap(const FileName &fn): map(NULL), size(0), fd(-1)
+    {
+        mapFile(fn, map, size, fd);
+    }
+
+    ~BinaryFileMap()
+    {
+        try
+        {
+            unmapFile(map, size, fd);
+        }
+        catch (XmippError &)
+        {}
+    }
+};
+
+/* Values of the columns being read, deleted when they go out of scope */
+class BinaryColumnValues
+{
+public:
+    std::vector<MDObject*> values;
+
+    ~BinaryColumnValues()
+    {
+        for (size_t c = 0; c < values.size(); ++c)
+            delete values[c];
+    }
+};
+
+void MetaData::_readBinary(const FileName &inFile, const std::vector<MDLabel> *desiredLabels,
+                           const String &blockRegExp, bool addRows)
+{
+    BinaryFileMap file(inFile);
+    const char *map = file.map;
+    size_t mapSize = file.size;
+    const char *ptr = map, *end = map + mapSize;
+
+    if (mapSize < 4 || strncmp(map, MD_BINARY_MAGIC, 4) != 0)
+        REPORT_ERROR(ERR_MD, formatString("MetaData::readBinary: %s is not a binary metadata file", inFile.c_str()));
+    ptr += 4;
+    int version = bufferGet<int>(ptr, end);
+    if (version != MD_BINARY_VERSION)
+        REPORT_ERROR(ERR_MD, formatString("MetaData::readBinary: unsupported version %d in %s", version, inFile.c_str()));
+    size_t nObjects = (size_t) bufferGet<unsigned long long>(ptr, end);
+    int nLabels = bufferGet<int>(ptr, end);
+    String blockName = bufferGetString(ptr, end);
+    String comment = bufferGetString(ptr, end);
+
+    if (!blockRegExp.empty())
+    {
+        regex_t re;
+        if (regcomp(&re, (blockRegExp+"$").c_str(), REG_EXTENDED|REG_NOSUB) != 0)
+            REPORT_ERROR(ERR_ARG_INCORRECT, formatString("Pattern '%s' cannot be parsed: %s",
+                         blockRegExp.c_str(), inFile.c_str()));
+        bool found = regexec(&re, blockName.c_str(), (size_t) 0, NULL, 0) == 0;
+        regfree(&re);
+        if (!found)
+            REPORT_ERROR(ERR_MD_BADBLOCK, formatString("Block: '%s': %s", blockRegExp.c_str(), inFile.c_str()));
+    }
+
+    // Select the columns to read from the dictionary
+    BinaryColumnValues columnValues;
+    std::vector<MDObject*> &values = columnValues.values;
+    std::vector<const char*> columns;
+    for (int l = 0; l < nLabels; ++l)
+    {
+        String name = bufferGetString(ptr, end);
+        MDLabelType type = (MDLabelType) bufferGet<int>(ptr, end);
+        size_t offset = (size_t) bufferGet<unsigned long long>(ptr, end);
+        size_t size = (size_t) bufferGet<unsigned long long>(ptr, end);
+        MDLabel label = MDL::str2Label(name);
+        if (label == MDL_UNDEFINED)
+        {
+            std::cout << "WARNING: Ignoring unknown column: " + name << std::endl;
+            continue;
+        }
+        if (MDL::labelType(label) != type ||
+            (desiredLabels != NULL && !vectorContainsLabel(*desiredLabels, label)) ||
+            (!addRows && containsLabel(label)))
+            continue;
+        if (offset % 8 != 0 || offset > mapSize || size > mapSize - offset)
+            REPORT_ERROR(ERR_MD, formatString("MetaData::readBinary: column %s is out of the file %s",
+                         name.c_str(), inFile.c_str()));
+        const char *column = map + offset;
+        bool truncated;
+        switch (type)
+        {
+        case LABEL_INT:
+            truncated = nObjects > size / sizeof(int);
+            break;
+        case LABEL_BOOL:
+            truncated = nObjects > size;
+            break;
+        case LABEL_DOUBLE:
+        case LABEL_SIZET:
+            truncated = nObjects > size / MD_BINARY_OFFSET_SIZE;
+            break;
+        case LABEL_STRING:
+        case LABEL_VECTOR_DOUBLE:
+        case LABEL_VECTOR_SIZET:
+            // The offsets of the values must start at 0, not decrease and
+            // end within the column
+            truncated = nObjects >= size / MD_BINARY_OFFSET_SIZE;
+            if (!truncated)
+            {
+                const unsigned long long *offsets = (const unsigned long long *) column;
+                size_t elementSize = (type == LABEL_STRING) ? 1 : MD_BINARY_OFFSET_SIZE;
+                size_t maxOffset = (size - (nObjects + 1) * MD_BINARY_OFFSET_SIZE) / elementSize;
+                if (offsets[0] != 0 || offsets[nObjects] > maxOffset)
+                    truncated = true;
+                for (size_t i = 0; i < nObjects && !truncated; ++i)
+                    truncated = offsets[i + 1] < offsets[i];
+            }
+            break;
+        default:
+            REPORT_ERROR(ERR_MD_BADTYPE, formatString("MetaData::readBinary: unsupported type for column %s in %s",
+                         name.c_str(), inFile.c_str()));
+        }
+        if (truncated)
+            REPORT_ERROR(ERR_MD, formatString("MetaData::readBinary: column %s is truncated or corrupted in %s",
+                         name.c_str(), inFile.c_str()));
+        addLabel(label);
+        values.push_back(new MDObject(label));
+        columns.push_back(column);
+    }
+
+    size_t nColumns = values.size();
+    if (addRows)
+    {
+        setComment(comment);
+        _parsedLines = nObjects;
+        size_t nRead = (_maxRows > 0 && _maxRows < nObjects) ? _maxRows : nObjects;
+        for (size_t i = 0; i < nRead; ++i)
+        {
+            for (size_t c = 0; c < nColumns; ++c)
+                binaryColumnValue(columns[c], nObjects, i, *values[c]);
+            myMDSql->addRow(values);
+        }
+    }
+    else
+    {
+        std::vector<size_t> objects;
+        findObjects(objects);
+        if (objects.size() != nObjects)
+            REPORT_ERROR(ERR_MD_OBJECTNUMBER, formatString("MetaData::readBinaryColumns: %s has %lu objects and the "
+                         "metadata %lu", inFile.c_str(), nObjects, objects.size()));
+        for (size_t c = 0; c < nColumns; ++c)
+            for (size_t i = 0; i < nObjects; ++i)
+            {
+                binaryColumnValue(columns[c], nObjects, i, *values[c]);
+                myMDSql->setObjectValue(objects[i], *values[c]);
+            }
+    }
+}
+
+void MetaData::readBinary(const FileName &inFile, const std::vector<MDLabel> *desiredLabels,
+                          const String &blockRegExp)
+{
+    isMetadataFile = true;
+    this->inFile = inFile;
+    _readBinary(inFile, desiredLabels, blockRegExp, true);
+}
+
+void MetaData::readBinaryColumns(const FileName &inFile, const std::vector<MDLabel> &labels)
+{
+    _readBinary(inFile.removeBlockName(), &labels, "", false);
+}
+
 
 void MetaData::write(std::ostream &os,const String &blockName, WriteModeMetaData mode ) const
 {
@@ -1080,6 +1642,8 @@ void MetaData::read(const FileName &_filename,
         readXML(inFile, desiredLabels, blockName, decomposeStack);
     else if(extFile=="sqlite")
         readDB(inFile, desiredLabels, blockName, decomposeStack);
+    else if(extFile=="xmdb")
+        readBinary(inFile, desiredLabels, blockName);
     else
         readStar(_filename, desiredLabels, blockName, decomposeStack);
 
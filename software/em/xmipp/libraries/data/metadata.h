@@ -410,6 +410,13 @@ public:
      */
     void _parseObject(std::istream &is, MDObject &object, size_t id = BAD_OBJID);
 
+    /* Helper function to read the columns of a binary metadata file.
+     * If addRows, the objects are created, otherwise the columns are set
+     * to the current objects.
+     */
+    void _readBinary(const FileName &inFile, const std::vector<MDLabel> *desiredLabels,
+                     const String &blockRegExp, bool addRows);
+
     /** Get Metadata labels for the block defined by start
      * and end loop pointers. Return pointer to newline after last label
      */
@@ -771,6 +778,35 @@ public:
     void write(std::ostream &os, const String & blockName="",WriteModeMetaData mode=MD_OVERWRITE) const;
     void print() const;
 
+    /** Serialize the metadata into a memory buffer.
+     * The buffer contains the number of objects and the name and type of
+     * every active label, followed by the values of each column packed
+     * contiguously in binary (native byte order). Object ids are not stored.
+     * This is intended to exchange metadata between processes (e.g. through
+     * MPI) without writing and parsing text files.
+     */
+    void serialize(std::vector<char> &buffer) const;
+
+    /** Read the metadata from a buffer filled by serialize.
+     * The current content is cleared. Columns whose label is unknown to this
+     * program are skipped.
+     */
+    void deserialize(const char *buffer, size_t bufferSize);
+
+    /** Write metadata in a binary columnar file (.xmdb).
+     * The file has a header with the number of objects, the block name, the
+     * comment and a dictionary with the name, type, offset and size of every
+     * column, followed by the columns. Numeric columns are stored as plain
+     * arrays; strings and vectors as an offset table plus the packed values.
+     * Values are in native byte order. Only one block is stored per file, so
+     * MD_APPEND is not supported.
+     * @code
+     * md.write("particles.xmdb"); // or xmipp_metadata_utilities -i particles.xmd -o particles.xmdb
+     * @endcode
+     */
+    void writeBinary(const FileName &outFile, const String &blockName = DEFAULT_BLOCK_NAME,
+                     WriteModeMetaData mode = MD_OVERWRITE) const;
+
     /** Append data lines to file.
      * This function can be used to add new data to
      * an existing metadata. Now should be used with
@@ -808,6 +844,29 @@ public:
                 const String & blockRegExp=DEFAULT_BLOCK_NAME,
                 bool decomposeStack=true);
 
+    /** Read metadata from a binary columnar file (.xmdb).
+     * The file is memory mapped and only the columns in desiredLabels are
+     * touched, so the cost does not depend on the columns that are not read.
+     */
+    void readBinary(const FileName &inFile,
+                    const std::vector<MDLabel> *desiredLabels= NULL,
+                    const String & blockRegExp=DEFAULT_BLOCK_NAME);
+
+    /** Load more columns from a binary columnar file (.xmdb).
+     * The metadata should have been read from the same file (e.g. with only
+     * some of its labels), the new columns are set to its objects in the
+     * order of the file. Columns already present are not loaded again.
+     * @code
+     * std::vector<MDLabel> labels;
+     * labels.push_back(MDL_IMAGE);
+     * md.read("particles.xmdb", &labels);
+     * ...
+     * labels[0] = MDL_ANGLE_ROT;
+     * md.readBinaryColumns("particles.xmdb", labels);
+     * @endcode
+     */
+    void readBinaryColumns(const FileName &inFile, const std::vector<MDLabel> &labels);
+
     /** Read data from file. Guess the blockname from the filename
      * @code
      * inFilename="first@md1.doc" -> filename = md1.doc, blockname = first
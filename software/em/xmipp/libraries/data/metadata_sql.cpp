@@ -172,6 +172,46 @@ size_t MDSql::addRow()
     return id;
 }
 
+size_t MDSql::addRow(const std::vector<MDObject*> &values)
+{
+    size_t n = values.size();
+    if (n == 0)
+        return addRow();
+
+    sqlite3_stmt * &stmt = myCache->addRowValuesStmt;
+    std::vector<MDLabel> &labels = myCache->addRowValuesLabels;
+    bool sameLabels = stmt != NULL && labels.size() == n;
+    for (size_t i = 0; sameLabels && i < n; ++i)
+        sameLabels = labels[i] == values[i]->label;
+
+    if (!sameLabels)
+    {
+        if (stmt != NULL)
+            sqlite3_finalize(stmt);
+        labels.resize(n);
+        std::stringstream ss;
+        ss << "INSERT INTO " << tableName(tableId) << " (";
+        for (size_t i = 0; i < n; ++i)
+        {
+            labels[i] = values[i]->label;
+            ss << (i ? ", " : "") << MDL::label2StrSql(labels[i]);
+        }
+        ss << ") VALUES (";
+        for (size_t i = 0; i < n; ++i)
+            ss << (i ? ", ?" : "?");
+        ss << ");";
+        rc = sqlite3_prepare_v2(db, ss.str().c_str(), -1, &stmt, &zLeftover);
+    }
+    rc = sqlite3_reset(stmt);
+    for (size_t i = 0; i < n; ++i)
+        bindValue(stmt, i + 1, *values[i]);
+    size_t id = BAD_OBJID;
+    if (execSingleStmt(stmt))
+        id = sqlite3_last_insert_rowid(db);
+
+    return id;
+}
+
 bool MDSql::addColumn(MDLabel column)
 {
     std::stringstream ss;
@@ -1300,6 +1340,7 @@ void MDSql::extractValue(sqlite3_stmt *stmt, const int position, MDObject &value
 MDCache::MDCache()
 {
     this->addRowStmt = NULL;
+    this->addRowValuesStmt = NULL;
     this->iterStmt = NULL;
 }
 
@@ -1332,4 +1373,11 @@ void MDCache::clear()
         sqlite3_finalize(addRowStmt);
         addRowStmt = NULL;
     }
+
+    if (addRowValuesStmt != NULL)
+    {
+        sqlite3_finalize(addRowValuesStmt);
+        addRowValuesStmt = NULL;
+    }
+    addRowValuesLabels.clear();
 }
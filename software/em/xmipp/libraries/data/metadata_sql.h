@@ -140,6 +140,12 @@ private:
      */
     size_t addRow();
 
+    /** Add a new row with the values of some columns and return its objId.
+     * The statement is cached while the same columns are inserted, so
+     * this is the fast way of filling many rows.
+     */
+    size_t addRow(const std::vector<MDObject*> &values);
+
     /** Add a new column to a metadata.
      */
     bool addColumn(MDLabel column);
@@ -662,6 +668,8 @@ public:
     std::map<MDLabel, sqlite3_stmt*> getValueCache;
     std::map<MDLabel, sqlite3_stmt*> setValueCache;
     sqlite3_stmt *addRowStmt;
+    sqlite3_stmt *addRowValuesStmt;
+    std::vector<MDLabel> addRowValuesLabels;
 
     MDCache();
     ~MDCache();
@@ -613,6 +613,26 @@ extern String floatToString(float F, int _width, int _prec);
             ((j) < STARTINGX(*this) || (j) > FINISHINGX(*this) || \
              (i) < STARTINGY(*this) || (i) > FINISHINGY(*this) || \
              (k) < STARTINGZ(*this) || (k) > FINISHINGZ(*this))
+
+/** Weights of the 4 samples of a cubic B-spline.
+ * t is the fractional part of the position (0<=t<1), w[0]...w[3] are the
+ * weights of the samples floor(x)-1 ... floor(x)+2. They are the values of
+ * BSPLINE03 at t+1, t, t-1 and t-2 computed without branches.
+ */
+#define BSPLINE03_WEIGHTS(w, t) \
+{ \
+    double t2_ = (t) * (t); \
+    double t3_ = t2_ * (t); \
+    double u_ = 1.0 - (t); \
+    w[0] = u_ * u_ * u_ * (1.0 / 6.0); \
+    w[1] = 0.5 * t3_ - t2_ + 2.0 / 3.0; \
+    w[2] = -0.5 * t3_ + 0.5 * t2_ + 0.5 * (t) + 1.0 / 6.0; \
+    w[3] = t3_ * (1.0 / 6.0); \
+}
+
+/** Index of a B-spline coefficient with mirror boundary conditions */
+#define BSPLINE_MIRROR(l, N) \
+            (((l) < 0) ? (-(l) - 1) : (((l) >= (N)) ? (2 * (N) - (l) - 1) : (l)))
 //@}
 
 // Forward declarations ====================================================
@@ -2596,6 +2616,116 @@ public:
         return (T) LIN_INTERP(fx, d0, d1);
     }
 
+    /** Interpolates the value of the 3D matrix M at the point (x,y,z) knowing
+     * that it is a set of cubic B-spline coefficients.
+     *
+     * (x,y,z) are in logical coordinates. It gives the same value as
+     * interpolatedElementBSpline3D(x,y,z,3) but the 4 weights of each
+     * direction are computed once and, away from the borders, the
+     * coefficients are read as contiguous rows of 4 elements.
+     */
+    T interpolatedElementCubicBSpline3D(double x, double y, double z) const
+    {
+        // Logical to physical
+        z -= STARTINGZ(*this);
+        y -= STARTINGY(*this);
+        x -= STARTINGX(*this);
+
+        double fx = floor(x), fy = floor(y), fz = floor(z);
+        int l0 = (int)fx - 1;
+        int m0 = (int)fy - 1;
+        int n0 = (int)fz - 1;
+        double wx[4], wy[4], wz[4];
+        BSPLINE03_WEIGHTS(wx, x - fx);
+        BSPLINE03_WEIGHTS(wy, y - fy);
+        BSPLINE03_WEIGHTS(wz, z - fz);
+
+        int Xdim=(int)XSIZE(*this);
+        int Ydim=(int)YSIZE(*this);
+        int Zdim=(int)ZSIZE(*this);
+        double zyxsum = 0.0;
+        if (l0 >= 0 && l0 + 3 < Xdim && m0 >= 0 && m0 + 3 < Ydim &&
+            n0 >= 0 && n0 + 3 < Zdim)
+        {
+            size_t slice = YXSIZE(*this);
+            const T *ptrSlice = &DIRECT_A3D_ELEM(*this, n0, m0, l0);
+            for (int n = 0; n < 4; ++n, ptrSlice += slice)
+            {
+                const T *ptr = ptrSlice;
+                double yxsum = 0.0;
+                for (int m = 0; m < 4; ++m, ptr += Xdim)
+                    yxsum += wy[m] * (wx[0] * ptr[0] + wx[1] * ptr[1] +
+                                      wx[2] * ptr[2] + wx[3] * ptr[3]);
+                zyxsum += wz[n] * yxsum;
+            }
+        }
+        else
+        {
+            int l[4];
+            for (int i = 0; i < 4; ++i)
+                l[i] = BSPLINE_MIRROR(l0 + i, Xdim);
+            for (int n = 0; n < 4; ++n)
+            {
+                int nn = BSPLINE_MIRROR(n0 + n, Zdim);
+                double yxsum = 0.0;
+                for (int m = 0; m < 4; ++m)
+                {
+                    int mm = BSPLINE_MIRROR(m0 + m, Ydim);
+                    const T *ptr = &DIRECT_A3D_ELEM(*this, nn, mm, 0);
+                    yxsum += wy[m] * (wx[0] * ptr[l[0]] + wx[1] * ptr[l[1]] +
+                                      wx[2] * ptr[l[2]] + wx[3] * ptr[l[3]]);
+                }
+                zyxsum += wz[n] * yxsum;
+            }
+        }
+        return (T) zyxsum;
+    }
+
+    /** Interpolates the value of the 2D matrix M at the point (x,y) knowing
+     * that it is a set of cubic B-spline coefficients.
+     *
+     * (x,y) are in logical coordinates. Faster version of
+     * interpolatedElementBSpline2D(x,y,3), see
+     * interpolatedElementCubicBSpline3D.
+     */
+    inline T interpolatedElementCubicBSpline2D(double x, double y) const
+    {
+        // Logical to physical
+        y -= STARTINGY(*this);
+        x -= STARTINGX(*this);
+
+        double fx = floor(x), fy = floor(y);
+        int l0 = (int)fx - 1;
+        int m0 = (int)fy - 1;
+        double wx[4], wy[4];
+        BSPLINE03_WEIGHTS(wx, x - fx);
+        BSPLINE03_WEIGHTS(wy, y - fy);
+
+        int Xdim=(int)XSIZE(*this);
+        int Ydim=(int)YSIZE(*this);
+        double columns = 0.0;
+        if (l0 >= 0 && l0 + 3 < Xdim && m0 >= 0 && m0 + 3 < Ydim)
+        {
+            const T *ptr = &DIRECT_A2D_ELEM(*this, m0, l0);
+            for (int m = 0; m < 4; ++m, ptr += Xdim)
+                columns += wy[m] * (wx[0] * ptr[0] + wx[1] * ptr[1] +
+                                    wx[2] * ptr[2] + wx[3] * ptr[3]);
+        }
+        else
+        {
+            int l[4];
+            for (int i = 0; i < 4; ++i)
+                l[i] = BSPLINE_MIRROR(l0 + i, Xdim);
+            for (int m = 0; m < 4; ++m)
+            {
+                const T *ptr = &DIRECT_A2D_ELEM(*this, BSPLINE_MIRROR(m0 + m, Ydim), 0);
+                columns += wy[m] * (wx[0] * ptr[l[0]] + wx[1] * ptr[l[1]] +
+                                    wx[2] * ptr[l[2]] + wx[3] * ptr[l[3]]);
+            }
+        }
+        return (T) columns;
+    }
+
     /** Interpolates the value of the nth 3D matrix M at the point (x,y,z) knowing
      * that this image is a set of B-spline coefficients.
      *
@@ -2604,6 +2734,9 @@ public:
     T interpolatedElementBSpline3D(double x, double y, double z,
                                    int SplineDegree = 3) const
     {
+        if (SplineDegree == 3)
+            return interpolatedElementCubicBSpline3D(x, y, z);
+
         int SplineDegree_1 = SplineDegree - 1;
 
         // Logical to physical
@@ -2764,6 +2897,9 @@ public:
      */
     inline T interpolatedElementBSpline2D(double x, double y, int SplineDegree = 3) const
     {
+        if (SplineDegree == 3)
+            return interpolatedElementCubicBSpline2D(x, y);
+
         int SplineDegree_1 = SplineDegree - 1;
 
         // Logical to physical
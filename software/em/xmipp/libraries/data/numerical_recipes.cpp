@@ -27,15 +27,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include "numerical_recipes.h"
+#include "xmipp_error.h"
 
 
 /* NUMERICAL UTILITIES ----------------------------------------------------- */
+// An exception is thrown instead of exiting so that the error can be
+// handled by the caller (e.g. a thread optimizing one of many problems)
 void nrerror(const char error_text[])
 {
-    fprintf(stderr, "Numerical Recipes run-time error...\n");
-    fprintf(stderr, "%s\n", error_text);
-    fprintf(stderr, "...now exiting to system...\n");
-    exit(1);
+    REPORT_ERROR(ERR_NUMERICAL, (String)"Numerical Recipes run-time error: "+
+                 error_text);
 }
 #define NRSIGN(a,b) ((b) >= 0.0 ? fabs(a) : -fabs(a))
 
@@ -787,15 +788,17 @@ void instantiate_recipes()
         xt[j] = pcom[j] + x * xicom[j]; \
     f = (*func)(xt,prm);}
 
+// If knownFa is true, fa already contains the value of the function at ax
 void mnbrak(double *ax, double *bx, double *cx,
             double *fa, double *fb, double *fc, double(*func)(double *, void*),
-            void *prm, int ncom, double *pcom, double *xicom)
+            void *prm, int ncom, double *pcom, double *xicom, bool knownFa)
 {
     double ulim, u, r, q, fu, dum;
     double *xt=NULL;
     ask_Tvector(xt, 1, ncom);
 
-    F1DIM(*ax,*fa);
+    if (!knownFa)
+        F1DIM(*ax,*fa);
     F1DIM(*bx,*fb);
     if (*fb > *fa)
     {
@@ -820,12 +823,14 @@ void mnbrak(double *ax, double *bx, double *cx,
                 *bx = u;
                 *fa = (*fb);
                 *fb = fu;
+                free_Tvector(xt, 1, ncom);
                 return;
             }
             else if (fu > *fb)
             {
                 *cx = u;
                 *fc = fu;
+                free_Tvector(xt, 1, ncom);
                 return;
             }
             u = (*cx) + GOLD * (*cx - *bx);
@@ -958,6 +963,7 @@ double brent(double ax, double bx, double cx, double(*func)(double *,void*),
 #undef SHFT
 #undef F1DIM
 
+// At the input fret must be the value of the function at p
 #define TOL 2.0e-4
 void linmin(double *p, double *xi, int n, double &fret,
             double(*func)(double *, void*), void *prm)
@@ -978,7 +984,8 @@ void linmin(double *p, double *xi, int n, double &fret,
     ax = 0.0;
     xx = 1.0;
     bx = 2.0;
-    mnbrak(&ax, &xx, &bx, &fa, &fx, &fb, func, prm, ncom, pcom, xicom);
+    fa = fret;
+    mnbrak(&ax, &xx, &bx, &fa, &fx, &fb, func, prm, ncom, pcom, xicom, true);
     fret = brent(ax, xx, bx, func, prm, TOL, &xmin, ncom, pcom, xicom);
     for (j = 1;j <= n;j++)
     {
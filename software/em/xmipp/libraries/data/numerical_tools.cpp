@@ -23,6 +23,7 @@
  *  e-mail address 'xmipp@cnb.csic.es'
  ***************************************************************************/
 #include "numerical_tools.h"
+#include "xmipp_threads.h"
 
 /* Random permutation ------------------------------------------------------ */
 void randomPermutation(int N, MultidimArray<int>& result)
@@ -62,6 +63,76 @@ void powellOptimizer(Matrix1D<double> &p, int i0, int n,
     free_Tvector(xi, 1, n*n);
 }
 
+/* Powell's optimizer with an objective ------------------------------------ */
+double evaluateOptimizationObjective(double *x, void *prm)
+{
+    return ((OptimizationObjective *)prm)->evaluate(x);
+}
+
+void powellOptimizer(Matrix1D<double> &p, int i0, int n,
+                     OptimizationObjective &f,
+                     double ftol, double &fret,
+                     int &iter, const Matrix1D<double> &steps, bool show)
+{
+    powellOptimizer(p, i0, n, &evaluateOptimizationObjective, &f, ftol, fret,
+                    iter, steps, show);
+}
+
+/* Batch of Powell problems ------------------------------------------------ */
+struct PowellBatchData
+{
+    std::vector<PowellProblem> *problems;
+    ThreadTaskDistributor *distributor;
+};
+
+void solvePowellProblem(PowellProblem &problem)
+{
+    try
+    {
+        powellOptimizer(problem.p, problem.i0, problem.n, *problem.f,
+                        problem.ftol, problem.fret, problem.iter,
+                        problem.steps);
+        problem.failed=false;
+    }
+    catch (XmippError &XE)
+    {
+        problem.failed=true;
+        problem.errorMsg=XE.getMessage();
+    }
+}
+
+void threadPowellBatch(ThreadArgument &thArg)
+{
+    PowellBatchData *data=(PowellBatchData *)thArg.workClass;
+    std::vector<PowellProblem> &problems=*(data->problems);
+    size_t first, last;
+    while (data->distributor->getTasks(first, last))
+        for (size_t i=first; i<=last; i++)
+            solvePowellProblem(problems[i]);
+}
+
+void powellOptimizerBatch(std::vector<PowellProblem> &problems,
+                          int numThreads)
+{
+    size_t N=problems.size();
+    if (N==0)
+        return;
+    if (numThreads<=1 || N==1)
+    {
+        for (size_t i=0; i<N; i++)
+            solvePowellProblem(problems[i]);
+        return;
+    }
+
+    // Problems can take very different times, so they are given one by one
+    ThreadTaskDistributor distributor(N, 1);
+    PowellBatchData data;
+    data.problems=&problems;
+    data.distributor=&distributor;
+    ThreadManager thMgr(XMIPP_MIN(numThreads,(int)N), &data);
+    thMgr.run(threadPowellBatch);
+}
+
 /* Gaussian interpolator -------------------------------------------------- */
 void GaussianInterpolator::initialize(double _xmax, int N, bool normalize)
 {
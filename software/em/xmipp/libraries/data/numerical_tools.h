@@ -95,6 +95,125 @@ void powellOptimizer(Matrix1D< double >& p,
                      const Matrix1D< double >& steps,
                      bool show = false);
 
+/** Objective function for the optimizers.
+  * @ingroup NumericalTools
+  *
+  * Instead of passing a function and a void pointer with global or shared
+  * state, derive a class from this one and keep in it everything the
+  * function needs. As long as different objects do not share writable
+  * data, several optimizations can run at the same time in different
+  * threads.
+  *
+  * As in powellOptimizer, x starts at index 1.
+  *
+  * @code
+  * class QuadraticObjective: public OptimizationObjective
+  * {
+  * public:
+  *     double a;
+  *     double evaluate(double *x)
+  *     {
+  *         return (x[1]-a)*(x[1]-a)+x[2]*x[2];
+  *     }
+  * };
+  * @endcode
+  */
+class OptimizationObjective
+{
+public:
+    /// Destructor
+    virtual ~OptimizationObjective()
+    {}
+
+    /// Value of the function at x[1]...x[n]
+    virtual double evaluate(double *x) = 0;
+};
+
+/** Optimize an objective object using Powell's method.
+  * @ingroup NumericalTools
+  *
+  * Same as powellOptimizer with a function and a void pointer, but the
+  * state of the function is carried by the objective. The optimizer itself
+  * does not use any global variable.
+  *
+  * @code
+  * QuadraticObjective f;
+  * f.a=3;
+  * Matrix1D<double> x(2), steps(2);
+  * steps.initConstant(1);
+  * powellOptimizer(x,1,2,f,0.01,fitness,iter,steps);
+  * @endcode
+  */
+void powellOptimizer(Matrix1D< double >& p,
+                     int i0, int n,
+                     OptimizationObjective &f,
+                     double ftol,
+                     double& fret,
+                     int& iter,
+                     const Matrix1D< double >& steps,
+                     bool show = false);
+
+/** Problem for the batch Powell optimizer.
+  * @ingroup NumericalTools
+  *
+  * The meaning of the fields is the same as in powellOptimizer. p contains
+  * the initial point at the input and the minimum at the output.
+  */
+class PowellProblem
+{
+public:
+    /// Objective function (not owned by the problem)
+    OptimizationObjective *f;
+    /// Initial point and solution
+    Matrix1D<double> p;
+    /// Steps of the variables
+    Matrix1D<double> steps;
+    /// First variable to optimize (starting at 1)
+    int i0;
+    /// Number of variables to optimize
+    int n;
+    /// Tolerance
+    double ftol;
+    /// Value of the function at the minimum
+    double fret;
+    /// Number of iterations
+    int iter;
+    /// The optimization threw an error (the message is in errorMsg)
+    bool failed;
+    /// Error message
+    String errorMsg;
+
+    /// Empty constructor
+    PowellProblem(): f(NULL), i0(1), n(0), ftol(0.01), fret(0), iter(0),
+            failed(false)
+    {}
+};
+
+/** Optimize many independent problems.
+  * @ingroup NumericalTools
+  *
+  * The problems are distributed among numThreads threads. Each problem
+  * must have its own objective (or objectives that can be evaluated at the
+  * same time). An error in one problem does not stop the rest, it is
+  * signaled by the failed field of that problem.
+  *
+  * @code
+  * std::vector<QuadraticObjective> objectives(N);
+  * std::vector<PowellProblem> problems(N);
+  * for (size_t i=0; i<N; i++)
+  * {
+  *     objectives[i].a=i;
+  *     problems[i].f=&objectives[i];
+  *     problems[i].p.initZeros(2);
+  *     problems[i].steps.initConstant(2,1);
+  *     problems[i].n=2;
+  * }
+  * powellOptimizerBatch(problems,4);
+  * @endcode
+  */
+void powellOptimizerBatch(std::vector<PowellProblem> &problems,
+                          int numThreads);
+
 /** Gaussian interpolator
  * @ingroup NumericalTools
  *
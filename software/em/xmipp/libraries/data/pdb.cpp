@@ -100,81 +100,9 @@ void computePDBgeometry(const std::string &fnPDB,
                         Matrix1D<double> &limit0, Matrix1D<double> &limitF,
                         const std::string &intensityColumn)
 {
-    // Initialization
-    centerOfMass.initZeros(3);
-    limit0.initZeros(3);
-    limitF.initZeros(3);
-    limit0.initConstant(1e30);
-    limitF.initConstant(-1e30);
-    double total_mass = 0;
-
-    // Open the file
-    std::ifstream fh_pdb;
-    fh_pdb.open(fnPDB.c_str());
-    if (!fh_pdb)
-        REPORT_ERROR(ERR_IO_NOTEXIST, fnPDB);
-
-    // Process all lines of the file
-    int col=1;
-    if (intensityColumn=="Bfactor")
-        col=2;
-    while (!fh_pdb.eof())
-    {
-        // Read a ATOM line
-        std::string line;
-        getline(fh_pdb, line);
-        if (line == "")
-            continue;
-        std::string kind = line.substr(0,4);
-        if (kind != "ATOM" && kind!="HETA")
-            continue;
-
-        // Extract atom type and position
-        // Typical line:
-        // ATOM    909  CA  ALA A 161      58.775  31.984 111.803  1.00 34.78
-        std::string atom_type = line.substr(13,2);
-        double x = textToFloat(line.substr(30,8));
-        double y = textToFloat(line.substr(38,8));
-        double z = textToFloat(line.substr(46,8));
-
-        // Update center of mass and limits
-        if (x < XX(limit0))
-            XX(limit0) = x;
-        else if (x > XX(limitF))
-            XX(limitF) = x;
-        if (y < YY(limit0))
-            YY(limit0) = y;
-        else if (y > YY(limitF))
-            YY(limitF) = y;
-        if (z < ZZ(limit0))
-            ZZ(limit0) = z;
-        else if (z > ZZ(limitF))
-            ZZ(limitF) = z;
-        double weight;
-        if (atom_type=="EN")
-        {
-            if      (col==1)
-                weight=textToFloat(line.substr(54,6));
-            else if (col==2)
-                weight=textToFloat(line.substr(60,6));
-        }
-        else
-        {
-            if (kind=="HETA")
-                continue;
-            weight=(double) atomCharge(atom_type);
-        }
-        total_mass += weight;
-        XX(centerOfMass) += weight * x;
-        YY(centerOfMass) += weight * y;
-        ZZ(centerOfMass) += weight * z;
-    }
-
-    // Finish calculations
-    centerOfMass /= total_mass;
-
-    // Close file
-    fh_pdb.close();
+    PDBAtomTable atoms;
+    atoms.read(fnPDB);
+    atoms.computeGeometry(centerOfMass, limit0, limitF, intensityColumn);
 }
 
 /* Apply geometry ---------------------------------------------------------- */
@@ -258,39 +186,19 @@ void applyGeometryToPDBFile(const std::string &fn_in, const std::string &fn_out,
 /* Read phantom from PDB --------------------------------------------------- */
 void PDBPhantom::read(const FileName &fnPDB)
 {
-    // Open file
-    std::ifstream fh_in;
-    fh_in.open(fnPDB.c_str());
-    if (!fh_in)
-        REPORT_ERROR(ERR_IO_NOTEXIST, fnPDB);
-
-    // Process all lines of the file
-    std::string line, kind;
+    PDBAtomTable atoms;
+    atoms.read(fnPDB);
     Atom atom;
-    while (!fh_in.eof())
+    size_t nAtoms = atoms.size();
+    atomList.reserve(atomList.size() + nAtoms);
+    for (size_t n = 0; n < nAtoms; n++)
     {
-        // Read an ATOM line
-        getline(fh_in, line);
-        if (line == "")
-        {
-            continue;
-        }
-        kind = line.substr(0,4);
-        if (kind != "ATOM" && kind != "HETA")
-            continue;
-
-        // Extract atom type and position
-        // Typical line:
-        // ATOM    909  CA  ALA A 161      58.775  31.984 111.803  1.00 34.78
-        atom.atomType = line[13];
-        atom.x = textToFloat(line.substr(30,8));
-        atom.y = textToFloat(line.substr(38,8));
-        atom.z = textToFloat(line.substr(46,8));
+        atom.atomType = atoms.atomType[n];
+        atom.x = atoms.x[n];
+        atom.y = atoms.y[n];
+        atom.z = atoms.z[n];
         atomList.push_back(atom);
     }
-
-    // Close files
-    fh_in.close();
 }
 
 /* Shift ------------------------------------------------------------------- */
@@ -374,6 +282,288 @@ void PDBRichPhantom::write(const FileName &fnPDB)
     fclose(fh_out);
 }
 
+/* Atom table ------------------------------------------------------------- */
+void PDBAtomTable::clear()
+{
+    remarks.clear();
+    atomType.clear();
+    hetatm.clear();
+    pseudoatom.clear();
+    x.clear();
+    y.clear();
+    z.clear();
+    occupancy.clear();
+    bfactor.clear();
+}
+
+void PDBAtomTable::addAtom(char type, bool isHetatm, bool isPseudoatom,
+                           double _x, double _y, double _z,
+                           double _occupancy, double _bfactor)
+{
+    atomType.push_back(type);
+    hetatm.push_back(isHetatm);
+    pseudoatom.push_back(isPseudoatom);
+    x.push_back(_x);
+    y.push_back(_y);
+    z.push_back(_z);
+    occupancy.push_back(_occupancy);
+    bfactor.push_back(_bfactor);
+}
+
+// Convert the characters [start,start+width) of a line into a number
+// Missing fields are returned as 0, unless they are mandatory.
+static double pdbField(const char *line, size_t length, size_t start,
+                       size_t width, bool mandatory=false)
+{
+    char aux[32];
+    size_t n = 0;
+    if (start < length)
+        n = XMIPP_MIN(XMIPP_MIN(width, length - start), sizeof(aux) - 1);
+    memcpy(aux, line + start, n);
+    aux[n] = '\0';
+    char *endptr;
+    double retval = strtod(aux, &endptr);
+    if (mandatory && endptr == aux)
+        REPORT_ERROR(ERR_VALUE_INCORRECT, (String)"PDBAtomTable: cannot read a number from "+
+                     String(line, length));
+    return retval;
+}
+
+void PDBAtomTable::parsePDB(const char *buffer, size_t length)
+{
+    const char *ptr = buffer, *end = buffer + length;
+    while (ptr < end)
+    {
+        const char *eol = (const char *) memchr(ptr, '\n', end - ptr);
+        if (eol == NULL)
+            eol = end;
+        size_t len = eol - ptr;
+        if (len > 0 && ptr[len - 1] == '\r')
+            len--;
+        if (len >= 4 && (strncmp(ptr, "ATOM", 4) == 0 || strncmp(ptr, "HETA", 4) == 0))
+        {
+            // Extract atom type and position
+            // Typical line:
+            // ATOM    909  CA  ALA A 161      58.775  31.984 111.803  1.00 34.78
+            if (len < 54)
+                REPORT_ERROR(ERR_VALUE_INCORRECT, (String)"PDBAtomTable: line too short "+
+                             String(ptr, len));
+            addAtom(ptr[13], ptr[0] == 'H', ptr[13] == 'E' && ptr[14] == 'N',
+                    pdbField(ptr, len, 30, 8, true),
+                    pdbField(ptr, len, 38, 8, true),
+                    pdbField(ptr, len, 46, 8, true),
+                    pdbField(ptr, len, 54, 6),
+                    pdbField(ptr, len, 60, 6));
+        }
+        else if (len >= 6 && strncmp(ptr, "REMARK", 6) == 0)
+            remarks.push_back(String(ptr, len));
+        ptr = eol + 1;
+    }
+}
+
+// Split a line of an mmCIF file in tokens (quoted tokens are allowed)
+static void splitCIFLine(const char *line, size_t length,
+                         std::vector<size_t> &tokenStart,
+                         std::vector<size_t> &tokenLength)
+{
+    tokenStart.clear();
+    tokenLength.clear();
+    size_t i = 0;
+    while (i < length)
+    {
+        while (i < length && isspace(line[i]))
+            i++;
+        if (i == length)
+            break;
+        size_t start = i;
+        char quote = line[i];
+        if (quote == '\'' || quote == '"')
+        {
+            // The token ends with a quote followed by a space
+            start = ++i;
+            while (i < length && !(line[i] == quote && (i + 1 == length || isspace(line[i + 1]))))
+                i++;
+            tokenStart.push_back(start);
+            tokenLength.push_back(i - start);
+            i++;
+        }
+        else
+        {
+            while (i < length && !isspace(line[i]))
+                i++;
+            tokenStart.push_back(start);
+            tokenLength.push_back(i - start);
+        }
+    }
+}
+
+void PDBAtomTable::parseCIF(const char *buffer, size_t length, const FileName &fn)
+{
+    enum {OTHER, LOOP_START, ATOM_HEADER, ATOM_DATA} state = OTHER;
+    std::vector<String> columns;
+    std::vector<size_t> tokenStart, tokenLength;
+    int iGroup = -1, iType = -1, iName = -1, iX = -1, iY = -1, iZ = -1;
+    int iOccupancy = -1, iBfactor = -1;
+    const char *ptr = buffer, *end = buffer + length;
+    while (ptr < end)
+    {
+        const char *eol = (const char *) memchr(ptr, '\n', end - ptr);
+        if (eol == NULL)
+            eol = end;
+        const char *line = ptr;
+        ptr = eol + 1;
+        size_t len = eol - line;
+        while (len > 0 && isspace(*line))
+        {
+            line++;
+            len--;
+        }
+        if (len == 0)
+            continue;
+        if (strncmp(line, "loop_", 5) == 0)
+        {
+            state = LOOP_START;
+            columns.clear();
+        }
+        else if (len > 11 && strncmp(line, "_atom_site.", 11) == 0)
+        {
+            if (state == LOOP_START || state == ATOM_HEADER)
+            {
+                size_t n = 11;
+                while (n < len && !isspace(line[n]))
+                    n++;
+                columns.push_back(String(line + 11, n - 11));
+                state = ATOM_HEADER;
+            }
+        }
+        else if (line[0] == '_' || line[0] == '#' || strncmp(line, "data_", 5) == 0)
+            state = OTHER;
+        else if (state == ATOM_HEADER || state == ATOM_DATA)
+        {
+            if (state == ATOM_HEADER)
+            {
+                for (size_t i = 0; i < columns.size(); i++)
+                {
+                    const String &c = columns[i];
+                    if (c == "group_PDB")
+                        iGroup = i;
+                    else if (c == "type_symbol")
+                        iType = i;
+                    else if (c == "label_atom_id")
+                        iName = i;
+                    else if (c == "Cartn_x")
+                        iX = i;
+                    else if (c == "Cartn_y")
+                        iY = i;
+                    else if (c == "Cartn_z")
+                        iZ = i;
+                    else if (c == "occupancy")
+                        iOccupancy = i;
+                    else if (c == "B_iso_or_equiv")
+                        iBfactor = i;
+                }
+                if (iX < 0 || iY < 0 || iZ < 0 || (iType < 0 && iName < 0))
+                    REPORT_ERROR(ERR_VALUE_INCORRECT, (String)"PDBAtomTable: cannot find the "
+                                 "coordinates or the atom type in the _atom_site loop of " + fn);
+                state = ATOM_DATA;
+            }
+            splitCIFLine(line, len, tokenStart, tokenLength);
+            if (tokenStart.size() != columns.size())
+                REPORT_ERROR(ERR_VALUE_INCORRECT, (String)"PDBAtomTable: unexpected number of "
+                             "items in the _atom_site line " + String(line, len));
+#define CIF_TOKEN(i) (line + tokenStart[i])
+#define CIF_NUMBER(i, mandatory) pdbField(line, len, tokenStart[i], tokenLength[i], mandatory)
+            char type = (iType >= 0) ? *CIF_TOKEN(iType) : *CIF_TOKEN(iName);
+            bool isHetatm = iGroup >= 0 && strncmp(CIF_TOKEN(iGroup), "HETATM", 6) == 0;
+            bool isPseudoatom = iName >= 0 && tokenLength[iName] == 4 &&
+                                strncmp(CIF_TOKEN(iName), "DENS", 4) == 0;
+            addAtom(type, isHetatm, isPseudoatom,
+                    CIF_NUMBER(iX, true), CIF_NUMBER(iY, true), CIF_NUMBER(iZ, true),
+                    (iOccupancy >= 0) ? CIF_NUMBER(iOccupancy, false) : 1.0,
+                    (iBfactor >= 0) ? CIF_NUMBER(iBfactor, false) : 0.0);
+#undef CIF_TOKEN
+#undef CIF_NUMBER
+        }
+    }
+}
+
+void PDBAtomTable::read(const FileName &fn)
+{
+    clear();
+
+    // Read the whole file
+    std::ifstream fh_in;
+    fh_in.open(fn.c_str(), std::ios::in | std::ios::binary);
+    if (!fh_in)
+        REPORT_ERROR(ERR_IO_NOTEXIST, fn);
+    fh_in.seekg(0, std::ios::end);
+    std::string buffer;
+    buffer.resize((size_t)fh_in.tellg());
+    fh_in.seekg(0, std::ios::beg);
+    if (!buffer.empty())
+        fh_in.read(&buffer[0], buffer.size());
+    fh_in.close();
+
+    String ext = fn.getExtension();
+    if (ext == "cif" || ext == "mmcif" || buffer.compare(0, 5, "data_") == 0)
+        parseCIF(buffer.c_str(), buffer.size(), fn);
+    else
+        parsePDB(buffer.c_str(), buffer.size());
+}
+
+void PDBAtomTable::computeGeometry(Matrix1D<double> &centerOfMass,
+                                   Matrix1D<double> &limit0, Matrix1D<double> &limitF,
+                                   const std::string &intensityColumn) const
+{
+    // Initialization
+    centerOfMass.initZeros(3);
+    limit0.initZeros(3);
+    limitF.initZeros(3);
+    limit0.initConstant(1e30);
+    limitF.initConstant(-1e30);
+    double total_mass = 0;
+
+    int col=1;
+    if (intensityColumn=="Bfactor")
+        col=2;
+    String atom_type(1, ' ');
+    for (size_t n = 0; n < size(); n++)
+    {
+        double xn = x[n], yn = y[n], zn = z[n];
+
+        // Update center of mass and limits
+        if (xn < XX(limit0))
+            XX(limit0) = xn;
+        else if (xn > XX(limitF))
+            XX(limitF) = xn;
+        if (yn < YY(limit0))
+            YY(limit0) = yn;
+        else if (yn > YY(limitF))
+            YY(limitF) = yn;
+        if (zn < ZZ(limit0))
+            ZZ(limit0) = zn;
+        else if (zn > ZZ(limitF))
+            ZZ(limitF) = zn;
+        double weight;
+        if (pseudoatom[n])
+            weight = (col==1) ? occupancy[n] : bfactor[n];
+        else
+        {
+            if (hetatm[n])
+                continue;
+            atom_type[0] = atomType[n];
+            weight=(double) atomCharge(atom_type);
+        }
+        total_mass += weight;
+        XX(centerOfMass) += weight * xn;
+        YY(centerOfMass) += weight * yn;
+        ZZ(centerOfMass) += weight * zn;
+    }
+
+    // Finish calculations
+    centerOfMass /= total_mass;
+}
+
 /* Atom descriptors -------------------------------------------------------- */
 void atomDescriptors(const std::string &atom, Matrix1D<double> &descriptors)
 {
@@ -595,14 +785,20 @@ void fhlpf(const MultidimArray<double> &f, const MultidimArray<double> &filter,
 }
 
 /* Optimization of the low pass filter to fit a given atom ----------------- */
-Matrix1D<double> globalHlpfPrm(3);
-MultidimArray<double> globalf;
-int globalM;
-double globalT;
-std::string globalAtom;
+/* The objective keeps the atomic profile, the downsampling factor, the
+   sampling rate and the atom being fitted */
+class HlpfFitness: public OptimizationObjective
+{
+public:
+    MultidimArray<double> f;
+    int M;
+    double T;
+    std::string atom;
+    double evaluate(double *p);
+};
 
 //#define DEBUG
-double Hlpf_fitness(double *p, void *prm)
+double HlpfFitness::evaluate(double *p)
 {
     double reductionFactor=p[1];
     double ripple=p[2];
@@ -617,24 +813,24 @@ double Hlpf_fitness(double *p, void *prm)
 
     // Construct the filter with the current parameters
     MultidimArray<double> filter, auxf;
-    auxf=globalf;
-    hlpf(auxf, globalM, globalT, "SincKaiser", filter, reductionFactor,
+    auxf=f;
+    hlpf(auxf, M, T, "SincKaiser", filter, reductionFactor,
          ripple, deltaw);
 
     // Convolve the filter with the atomic profile
     MultidimArray<double> fhlpfFinelySampled;
-    fhlpf(auxf, filter, globalM, fhlpfFinelySampled);
+    fhlpf(auxf, filter, M, fhlpfFinelySampled);
 
     // Coarsely sample
-    double Rmax=FINISHINGX(fhlpfFinelySampled)*globalT;
-    int imax=CEIL(Rmax/(globalM*globalT));
+    double Rmax=FINISHINGX(fhlpfFinelySampled)*T;
+    int imax=CEIL(Rmax/(M*T));
     MultidimArray<double> fhlpfCoarselySampled(2*imax+1);
     MultidimArray<double> splineCoeffsfhlpfFinelySampled;
     produceSplineCoefficients(BSPLINE3,splineCoeffsfhlpfFinelySampled,fhlpfFinelySampled);
     fhlpfCoarselySampled.setXmippOrigin();
     FOR_ALL_ELEMENTS_IN_ARRAY1D(fhlpfCoarselySampled)
     {
-        double r=i*(globalM*globalT)/globalT;
+        double r=i*(M*T)/T;
         fhlpfCoarselySampled(i)=
             splineCoeffsfhlpfFinelySampled.interpolatedElementBSpline1D(r,3);
     }
@@ -651,15 +847,15 @@ double Hlpf_fitness(double *p, void *prm)
 
     FOR_ALL_ELEMENTS_IN_ARRAY1D(FfilterMag)
     FFT_IDX2DIGFREQ(i,XSIZE(FfilterMag),freq(i));
-    freq/=globalM*globalT;
+    freq/=M*T;
     double amplitudeFactor=fhlpfFinelySampled.sum()/
                            fhlpfCoarselySampled.sum();
 
     // Compute the error in representation
     double error=0;
     Matrix1D<double> descriptors;
-    atomDescriptors(globalAtom, descriptors);
-    double iglobalT=1.0/globalT;
+    atomDescriptors(atom, descriptors);
+    double iT=1.0/T;
 #ifdef DEBUG
     MultidimArray<double> f1array, f2array;
     f1array.initZeros(FfilterMag);
@@ -670,7 +866,7 @@ double Hlpf_fitness(double *p, void *prm)
     if (A1D_ELEM(freq,i)>=0)
     {
         double f1=log10(A1D_ELEM(FfilterMag,i)*XSIZE(FfilterMag)*amplitudeFactor);
-        double f2=log10(iglobalT*
+        double f2=log10(iT*
                            electronFormFactorFourier(A1D_ELEM(freq,i),descriptors));
         Npoints++;
         double diff=(f1-f2);
@@ -684,7 +880,7 @@ double Hlpf_fitness(double *p, void *prm)
 #ifdef DEBUG
         f1array.write("PPPf1.txt");
         f2array.write("PPPf2.txt");
-        std::cout << "Error " << error/Npoints << " " << Npoints << " M=" << globalM << " T=" << globalT << std::endl;
+        std::cout << "Error " << error/Npoints << " " << Npoints << " M=" << M << " T=" << T << std::endl;
 #endif
 
     return error/Npoints;
@@ -706,20 +902,21 @@ double Hlpf_fitness(double *p, void *prm)
 void optimizeHlpf(MultidimArray<double> &f, int M, double T, const std::string &atom,
 		MultidimArray<double> &filter, Matrix1D<double> &bestPrm)
 {
-    globalHlpfPrm(0)=1.0;     // reduction factor
-    globalHlpfPrm(1)=0.01;    // ripple
-    globalHlpfPrm(2)=1.0/8.0; // deltaw
-    globalf=f;
-    globalM=M;
-    globalT=T;
-    globalAtom=atom;
+    Matrix1D<double> prm(3);
+    prm(0)=1.0;     // reduction factor
+    prm(1)=0.01;    // ripple
+    prm(2)=1.0/8.0; // deltaw
+    HlpfFitness hlpfFitness;
+    hlpfFitness.f=f;
+    hlpfFitness.M=M;
+    hlpfFitness.T=T;
+    hlpfFitness.atom=atom;
     double fitness;
     int iter;
     Matrix1D<double> steps(3);
     steps.initConstant(1);
-    powellOptimizer(globalHlpfPrm, 1, 3,
-                    &Hlpf_fitness, NULL, 0.05, fitness, iter, steps, false);
-    bestPrm=globalHlpfPrm;
+    powellOptimizer(prm, 1, 3, hlpfFitness, 0.05, fitness, iter, steps, false);
+    bestPrm=prm;
     hlpf(f, M, T, "SincKaiser", filter, bestPrm(0), bestPrm(1), bestPrm(2));
 }
 
@@ -194,6 +194,74 @@ public:
 
 };
 
+/** Atoms of a PDB or mmCIF file stored by columns.
+    The whole file is read in memory and parsed once, so that programs
+    dealing with large assemblies do not have to go through the text
+    several times. mmCIF files are recognized by their extension (cif or
+    mmcif) or by a first line starting with data_. The atom type is the
+    first letter of the atom name in PDB files (as in PDBPhantom) and of
+    the element symbol in mmCIF files.
+    @code
+    PDBAtomTable atoms;
+    atoms.read("1o7d.pdb");
+    for (size_t n=0; n<atoms.size(); ++n)
+        if (!atoms.hetatm[n])
+            std::cout << atoms.atomType[n] << " " << atoms.x[n] << std::endl;
+    @endcode
+*/
+class PDBAtomTable
+{
+public:
+    /// List of remarks (PDB only)
+    std::vector<String> remarks;
+    /// Atom type
+    std::vector<char> atomType;
+    /// 1 if the atom comes from a HETATM record
+    std::vector<char> hetatm;
+    /// 1 if the atom is a pseudoatom (atom name DENS)
+    std::vector<char> pseudoatom;
+    /// Position X (Angstroms)
+    std::vector<double> x;
+    /// Position Y (Angstroms)
+    std::vector<double> y;
+    /// Position Z (Angstroms)
+    std::vector<double> z;
+    /// Occupancy
+    std::vector<double> occupancy;
+    /// Bfactor
+    std::vector<double> bfactor;
+
+    /// Number of atoms
+    size_t size() const
+    {
+        return x.size();
+    }
+
+    /// Empty the table
+    void clear();
+
+    /// Read from a PDB or mmCIF file
+    void read(const FileName &fn);
+
+    /** Compute the center of mass and limits.
+        Same as computePDBgeometry but without reading the file. */
+    void computeGeometry(Matrix1D<double> &centerOfMass,
+                         Matrix1D<double> &limit0, Matrix1D<double> &limitF,
+                         const std::string &intensityColumn) const;
+
+protected:
+    /// Add an atom at the end of the table
+    void addAtom(char type, bool isHetatm, bool isPseudoatom,
+                 double x, double y, double z,
+                 double occupancy, double bfactor);
+
+    /// Parse the ATOM and HETATM lines of a PDB file
+    void parsePDB(const char *buffer, size_t length);
+
+    /// Parse the _atom_site loop of an mmCIF file
+    void parseCIF(const char *buffer, size_t length, const FileName &fn);
+};
+
 /** Description of the electron scattering factors.
     The returned descriptor is descriptor(0)=Z (number of electrons of the
     atom), descriptor(1-5)=a1-5, descriptor(6-10)=b1-5.
@@ -23,6 +23,7 @@
  *  e-mail address 'xmipp@cnb.csic.es'
  ***************************************************************************/
 #include "polar.h"
+#include <unistd.h>
 
 void fourierTransformRings(Polar<double> & in,
 		Polar<std::complex<double> > &out, Polar_fftw_plans &plans,
@@ -132,6 +133,170 @@ void normalizedPolarFourierTransform(const MultidimArray<double> &in,
 	fourierTransformRings(polarIn, out, *plans, flag);
 }
 
+// Polar Fourier cache -----------------------------------------------------
+// Header of the cache files. It is followed by the object ids, a flag per
+// transform telling whether it has been computed, and the transforms.
+struct PolarFourierCacheHeader {
+	char magic[8];
+	int version;
+	int first_ring, last_ring, BsplineOrder, conjugated, Nvariants;
+	size_t Xdim, Ydim, Nimgs, transformSize;
+	char options[256];
+};
+
+PolarFourierCache::PolarFourierCache() {
+	map = NULL;
+	valid = NULL;
+	data = NULL;
+	mapSize = 0;
+	fd = -1;
+	transformSize = 0;
+}
+
+PolarFourierCache::~PolarFourierCache() {
+	close();
+}
+
+void PolarFourierCache::open(const FileName &fn,
+		const std::vector<size_t> &objIds, size_t _Xdim, size_t _Ydim,
+		int _first_ring, int _last_ring, int _BsplineOrder, bool _conjugated,
+		const String &options, int _Nvariants) {
+	close();
+	fnCache = fn;
+	Xdim = _Xdim;
+	Ydim = _Ydim;
+	first_ring = _first_ring;
+	last_ring = _last_ring;
+	BsplineOrder = _BsplineOrder;
+	conjugated = _conjugated;
+	Nvariants = _Nvariants;
+
+	// Size of the rings as sampled by getPolarFromCartesianBSpline
+	ringSize.clear();
+	transformSize = 0;
+	for (int iring = first_ring; iring <= last_ring; iring++) {
+		int nsam = 2 * (int) (0.5 * 2. * PI * iring);
+		nsam = XMIPP_MAX(1, nsam);
+		ringSize.push_back(nsam / 2 + 1);
+		transformSize += nsam / 2 + 1;
+	}
+
+	size_t Nimgs = objIds.size();
+	objIndex.clear();
+	for (size_t i = 0; i < Nimgs; i++)
+		objIndex[objIds[i]] = i;
+
+	PolarFourierCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "XMIPPPFC", 8);
+	header.version = 1;
+	header.first_ring = first_ring;
+	header.last_ring = last_ring;
+	header.BsplineOrder = BsplineOrder;
+	header.conjugated = conjugated;
+	header.Nvariants = Nvariants;
+	header.Xdim = Xdim;
+	header.Ydim = Ydim;
+	header.Nimgs = Nimgs;
+	header.transformSize = transformSize;
+	if (options.size() >= sizeof(header.options))
+		REPORT_ERROR(ERR_ARG_INCORRECT, "PolarFourierCache: the options string is too long");
+	strcpy(header.options, options.c_str());
+
+	size_t offsetValid = sizeof(header) + Nimgs * sizeof(size_t);
+	size_t offsetData = offsetValid + Nimgs * Nvariants;
+	offsetData = ((offsetData + 15) / 16) * 16;
+	size_t totalSize = offsetData
+			+ Nimgs * Nvariants * transformSize * sizeof(std::complex<double>);
+
+	// Check whether the existing file belongs to the same images and parameters
+	bool reuse = false;
+	if (fnCache.exists() && fnCache.getFileSize() == totalSize) {
+		FILE *fh = fopen(fnCache.c_str(), "rb");
+		if (fh != NULL) {
+			PolarFourierCacheHeader fileHeader;
+			std::vector<size_t> fileIds(Nimgs);
+			if (fread(&fileHeader, sizeof(fileHeader), 1, fh) == 1
+					&& (Nimgs == 0 || fread(&fileIds[0], sizeof(size_t), Nimgs, fh) == Nimgs))
+				reuse = memcmp(&header, &fileHeader, sizeof(header)) == 0
+						&& fileIds == objIds;
+			fclose(fh);
+		}
+	}
+
+	if (!reuse) {
+		FILE *fh = fopen(fnCache.c_str(), "wb");
+		if (fh == NULL)
+			REPORT_ERROR(ERR_IO_NOWRITE, (String)"PolarFourierCache: cannot create "+fnCache);
+		fwrite(&header, sizeof(header), 1, fh);
+		if (Nimgs > 0)
+			fwrite(&objIds[0], sizeof(size_t), Nimgs, fh);
+		fflush(fh);
+		// The rest of the file is zero, i.e., no transform is valid
+		if (ftruncate(fileno(fh), totalSize) != 0)
+			REPORT_ERROR(ERR_IO_NOWRITE, (String)"PolarFourierCache: cannot resize "+fnCache);
+		fclose(fh);
+	}
+
+	mapSize = totalSize;
+	mapFile(fnCache, map, mapSize, fd, false);
+	valid = (unsigned char*) (map + offsetValid);
+	data = (std::complex<double>*) (map + offsetData);
+}
+
+void PolarFourierCache::close() {
+	if (map != NULL)
+		unmapFile(map, mapSize, fd);
+	map = NULL;
+	valid = NULL;
+	data = NULL;
+	mapSize = 0;
+	fd = -1;
+}
+
+bool PolarFourierCache::get(size_t objId, int variant,
+		Polar<std::complex<double> > &out) const {
+	std::map<size_t, size_t>::const_iterator it = objIndex.find(objId);
+	if (map == NULL || it == objIndex.end())
+		return false;
+	size_t idx = it->second * Nvariants + variant;
+	if (!valid[idx])
+		return false;
+
+	const std::complex<double> *ptr = data + idx * transformSize;
+	size_t nrings = ringSize.size();
+	out.clear();
+	out.rings.resize(nrings);
+	for (size_t iring = 0; iring < nrings; iring++) {
+		MultidimArray<std::complex<double> > &ring = out.rings[iring];
+		ring.resizeNoCopy(ringSize[iring]);
+		memcpy(MULTIDIM_ARRAY(ring), ptr, ringSize[iring] * sizeof(std::complex<double>));
+		ptr += ringSize[iring];
+		out.ring_radius.push_back(first_ring + iring);
+	}
+	return true;
+}
+
+void PolarFourierCache::set(size_t objId, int variant,
+		const Polar<std::complex<double> > &in) {
+	std::map<size_t, size_t>::const_iterator it = objIndex.find(objId);
+	if (map == NULL || it == objIndex.end())
+		return;
+	size_t nrings = ringSize.size();
+	if (in.rings.size() != nrings)
+		REPORT_ERROR(ERR_MULTIDIM_SIZE, "PolarFourierCache: the transform does not have the cached rings");
+	size_t idx = it->second * Nvariants + variant;
+	std::complex<double> *ptr = data + idx * transformSize;
+	for (size_t iring = 0; iring < nrings; iring++) {
+		const MultidimArray<std::complex<double> > &ring = in.rings[iring];
+		if (XSIZE(ring) != ringSize[iring])
+			REPORT_ERROR(ERR_MULTIDIM_SIZE, "PolarFourierCache: the transform does not have the cached rings");
+		memcpy(ptr, MULTIDIM_ARRAY(ring), ringSize[iring] * sizeof(std::complex<double>));
+		ptr += ringSize[iring];
+	}
+	valid[idx] = 1;
+}
+
 // Best rotation -----------------------------------------------------------
 double best_rotation(const Polar<std::complex<double> > &I1,
 		const Polar<std::complex<double> > &I2, RotationalCorrelationAux &aux) {
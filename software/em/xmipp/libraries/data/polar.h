@@ -35,6 +35,7 @@
 #include "multidim_array.h"
 #include "transformations.h"
 #include "xmipp_fftw.h"
+#include <map>
 
 #define FULL_CIRCLES 0
 #define HALF_CIRCLES 1
@@ -806,6 +807,90 @@ void normalizedPolarFourierTransform(const MultidimArray<double> &in,
                                      int first_ring, int last_ring, Polar_fftw_plans *&plans,
                                      int BsplineOrder=3);
 
+/** Disk cache of normalized polar Fourier transforms.
+ *
+ * Iterative programs compare the same experimental images at every
+ * iteration. This class keeps their normalized polar Fourier transforms
+ * (as computed by normalizedPolarFourierTransform with full circles) in a
+ * memory mapped file, so that each image is resampled only once. The file
+ * is keyed by the list of object ids, the image size, the rings, the
+ * interpolation, the conjugation and a string describing the preprocessing
+ * of the images. If an existing file does not match, it is created again.
+ * Each image may have several variants (e.g., the image and its mirror).
+ * Transforms are stored when they are first computed, so that the same
+ * file can be reused by later runs on the same images.
+ *
+ * Different processes should not share the same file.
+ *
+ * @code
+ * PolarFourierCache cache;
+ * cache.open(fnCache,objIds,Xdim,Ydim,Xdim/5,Xdim/2,1,CONJUGATE,"normalized");
+ * if (!cache.get(objId,0,polarFourierI))
+ * {
+ *    normalizedPolarFourierTransform(I,polarFourierI,CONJUGATE,Xdim/5,Xdim/2,plans,1);
+ *    cache.set(objId,0,polarFourierI);
+ * }
+ * @endcode
+ */
+class PolarFourierCache
+{
+public:
+    /// Cache filename
+    FileName fnCache;
+    /// Image size
+    size_t Xdim, Ydim;
+    /// Rings
+    int first_ring, last_ring;
+    /// Interpolation
+    int BsplineOrder;
+    /// Conjugated transforms
+    bool conjugated;
+    /// Number of variants per image
+    int Nvariants;
+    /// Number of coefficients of each ring
+    std::vector<size_t> ringSize;
+    /// Number of coefficients of each transform
+    size_t transformSize;
+    /// Position of each object in the file
+    std::map<size_t,size_t> objIndex;
+protected:
+    char *map;
+    size_t mapSize;
+    int fd;
+    unsigned char *valid;
+    std::complex<double> *data;
+public:
+    /// Empty constructor
+    PolarFourierCache();
+
+    /// Destructor
+    ~PolarFourierCache();
+
+    /** Open the cache.
+     * The file is created if it does not exist or it does not correspond
+     * to these images and parameters. */
+    void open(const FileName &fn, const std::vector<size_t> &objIds,
+              size_t _Xdim, size_t _Ydim, int _first_ring, int _last_ring,
+              int _BsplineOrder, bool _conjugated, const String &options,
+              int _Nvariants=1);
+
+    /// Close the cache
+    void close();
+
+    /// Is the cache open
+    inline bool isOpen() const
+    {
+        return map!=NULL;
+    }
+
+    /** Get the transform of an image.
+     * Returns false if it is not in the cache. */
+    bool get(size_t objId, int variant, Polar< std::complex<double> > &out) const;
+
+    /// Store the transform of an image
+    void set(size_t objId, int variant, const Polar< std::complex<double> > &in);
+};
+
 /** Best rotation between two normalized polar Fourier transforms. */
 double best_rotation(const Polar< std::complex<double> > &I1,
                      const Polar< std::complex<double> > &I2, RotationalCorrelationAux &aux);
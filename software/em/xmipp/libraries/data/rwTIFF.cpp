@@ -50,9 +50,14 @@ void ImageBase::castTiffTile2T(
         y_max = imageLength;
 
 
-    for (j = y; j < y_max; j++)
-        for (i = x; i < x_max; i++)
-            setPage2T(offset+(j*imageWidth + i), (char*) tif_buf+((j-y)*samplesPerPixel*typeSize*tileWidth+(i-x)*samplesPerPixel*typeSize), datatype, (size_t) 1);
+    // Without extra samples each row of the tile is cast at once
+    if (samplesPerPixel == 1)
+        for (j = y; j < y_max; j++)
+            setPage2T(offset+(j*imageWidth + x), (char*) tif_buf+((j-y)*typeSize*tileWidth), datatype, (size_t) (x_max - x));
+    else
+        for (j = y; j < y_max; j++)
+            for (i = x; i < x_max; i++)
+                setPage2T(offset+(j*imageWidth + i), (char*) tif_buf+((j-y)*samplesPerPixel*typeSize*tileWidth+(i-x)*samplesPerPixel*typeSize), datatype, (size_t) 1);
 }
 
 /** castTiffLine2T
@@ -70,8 +75,117 @@ void ImageBase::castTiffLine2T(
     unsigned int x;
     int typeSize = gettypesize(datatype);
 
-    for (x = 0; x < imageWidth; x++)
-        setPage2T(offset+(y*imageWidth + x), (char*) tif_buf+(samplesPerPixel*typeSize * x), datatype, (size_t) 1);
+    if (samplesPerPixel == 1)
+        setPage2T(offset+(y*imageWidth), tif_buf, datatype, (size_t) imageWidth);
+    else
+        for (x = 0; x < imageWidth; x++)
+            setPage2T(offset+(y*imageWidth + x), (char*) tif_buf+(samplesPerPixel*typeSize * x), datatype, (size_t) 1);
+}
+
+/** Decode the strips or tiles of a range of TIFF directories.
+ */
+void ImageBase::decodeTiffChunks(TIFF * tifHandle, TiffDecodeData &decData)
+{
+    std::vector<TIFFDirHead> &dirHead = *decData.dirHead;
+    size_t imgStart = decData.imgStart;
+    size_t chunksPerImage = decData.chunksPerImage;
+    size_t pad = (size_t)dirHead[imgStart].imageWidth * dirHead[imgStart].imageLength;
+    size_t currentDir = (size_t) -1;
+    size_t first, last;
+    char*  tif_buf = NULL;
+    tsize_t bufSize = 0, chunkSize = 0, scanline = 0;
+    DataType datatype = DT_Unknown;
+
+    try
+    {
+        while (!decData.failed() && decData.td->getTasks(first, last))
+            for (size_t task = first; task <= last; ++task)
+            {
+                size_t n = task / chunksPerImage;
+                size_t chunk = task % chunksPerImage;
+                size_t i = imgStart + n;
+                TIFFDirHead &dh = dirHead[i];
+
+                if (chunk >= dh.chunks())
+                    continue;
+
+                if (i != currentDir)
+                {
+                    TIFFSetDirectory(tifHandle, (tdir_t) i);
+                    currentDir = i;
+                    datatype = datatypeTIFF(dh);
+                    scanline = TIFFScanlineSize(tifHandle);
+                    chunkSize = dh.isTiled ? TIFFTileSize(tifHandle) : TIFFStripSize(tifHandle);
+                    if (chunkSize > bufSize)
+                    {
+                        if (tif_buf != NULL)
+                            _TIFFfree(tif_buf);
+                        if ((tif_buf = (char*)_TIFFmalloc(chunkSize)) == NULL)
+                            REPORT_ERROR(ERR_MEM_NOTENOUGH, "rwTIFF: No space for strip buffer");
+                        bufSize = chunkSize;
+                    }
+                }
+
+                if (dh.isTiled)
+                {
+                    unsigned int tilesAcross = (dh.imageWidth + dh.tileWidth - 1) / dh.tileWidth;
+                    unsigned int x = (unsigned int)(chunk % tilesAcross) * dh.tileWidth;
+                    unsigned int y = (unsigned int)(chunk / tilesAcross) * dh.tileLength;
+
+                    if (TIFFReadEncodedTile(tifHandle, (ttile_t) chunk, tif_buf, (tsize_t) -1) < 0)
+                        REPORT_ERROR(ERR_IO_NOREAD, formatString("rwTIFF: Error reading tile %lu of image %lu from %s",
+                                     chunk, i + 1, filename.c_str()));
+                    if (swap)
+                        swapPage((char*)tif_buf, chunkSize*sizeof(unsigned char), datatype);
+
+                    castTiffTile2T(pad*n, tif_buf, x, y,
+                                   dh.imageWidth, dh.imageLength,
+                                   dh.tileWidth, dh.tileLength,
+                                   dh.samplesPerPixel,
+                                   datatype);
+                }
+                else
+                {
+                    unsigned int y0 = (unsigned int) chunk * dh.rowsPerStrip;
+                    unsigned int yF = XMIPP_MIN(y0 + dh.rowsPerStrip, dh.imageLength);
+
+                    if (TIFFReadEncodedStrip(tifHandle, (tstrip_t) chunk, tif_buf, (tsize_t) -1) < 0)
+                        REPORT_ERROR(ERR_IO_NOREAD, formatString("rwTIFF: Error reading strip %lu of image %lu from %s",
+                                     chunk, i + 1, filename.c_str()));
+
+                    for (unsigned int y = y0; y < yF; ++y)
+                        castTiffLine2T((pad*n), tif_buf + (y - y0)*scanline, y,
+                                       dh.imageWidth, dh.imageLength,
+                                       dh.samplesPerPixel,
+                                       datatype);
+                }
+            }
+    }
+    catch (XmippError &XE)
+    {
+        decData.setError(XE);
+    }
+
+    if (tif_buf != NULL)
+        _TIFFfree(tif_buf);
+}
+
+void ImageBase::decodeTiffThread(ThreadArgument &thArg)
+{
+    ImageBase * img = (ImageBase *) thArg.workClass;
+    TiffDecodeData * decData = (TiffDecodeData *) thArg.data;
+
+    // libtiff handles are not thread safe, so each thread opens its own
+    TIFF * tifHandle = TIFFOpen(img->dataFName.c_str(), "r");
+    if (tifHandle == NULL)
+    {
+        decData->setError(XmippError(ERR_IO_NOTOPEN, formatString("rwTIFF: Cannot open %s in thread %d",
+                                     img->dataFName.c_str(), thArg.thread_id), __FILE__, __LINE__));
+        return;
+    }
+
+    img->decodeTiffChunks(tifHandle, *decData);
+    TIFFClose(tifHandle);
 }
 
 /** Determine datatype of the TIFF format file.
@@ -135,7 +249,6 @@ int ImageBase::readTIFF(size_t select_img, bool isStack)
 
     //    TIFFSetWarningHandler(NULL); // Switch off warning messages
 
-    char*  tif_buf = NULL;
     std::vector<TIFFDirHead> dirHead;
     TIFFDirHead dhRef;
 
@@ -161,6 +274,19 @@ int ImageBase::readTIFF(size_t select_img, bool isStack)
         TIFFGetField(tif, TIFFTAG_YRESOLUTION,    &dhRef.yTiffRes);
         TIFFGetField(tif, TIFFTAG_PAGENUMBER,     &dhRef.pNumber, &dhRef.pTotal);
 
+        dhRef.isTiled = TIFFIsTiled(tif);
+        if (dhRef.isTiled)
+        {
+            TIFFGetField(tif, TIFFTAG_TILEWIDTH, &dhRef.tileWidth);
+            TIFFGetField(tif, TIFFTAG_TILELENGTH,&dhRef.tileLength);
+        }
+        else
+        {
+            uint32 rowsperstrip;
+            TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
+            dhRef.rowsPerStrip = XMIPP_MAX(1, XMIPP_MIN(rowsperstrip, dhRef.imageLength));
+        }
+
         if ((dhRef.subFileType & 0x00000001) != 0x00000001) //add image if not a thumbnail
             dirHead.push_back(dhRef);
     }
@@ -182,6 +308,16 @@ int ImageBase::readTIFF(size_t select_img, bool isStack)
                           " two of them with different dimensions. Try to read them individually.",filename.c_str(), dirHead.size()));*/
         }
     }
+    else if (rangeLastImg != ALL_IMAGES) // Reading a range of images (readRange)
+    {
+        if (rangeLastImg > dirHead.size())
+            REPORT_ERROR(ERR_INDEX_OUTOFBOUNDS, formatString("readTIFF (%s): Image number %lu exceeds stack size %lu", filename.c_str(), rangeLastImg, dirHead.size()));
+        for (size_t i = select_img; i < rangeLastImg; i++)
+            if (dirHead[select_img - 1].imageLength != dirHead[i].imageLength ||
+                dirHead[select_img - 1].imageWidth != dirHead[i].imageWidth)
+                REPORT_ERROR(ERR_IMG_NOREAD, formatString("readTIFF: %s images %lu and %lu have different dimensions.",
+                             filename.c_str(), select_img, i + 1));
+    }
 
     // Calculate x,y space dimension resolution
     double xRes, yRes;
@@ -215,10 +351,16 @@ int ImageBase::readTIFF(size_t select_img, bool isStack)
     aDim.xdim = (int) dirHead[imgStart].imageWidth;
     aDim.ydim = (int) dirHead[imgStart].imageLength;
     aDim.zdim = 1;
-    aDim.ndim = replaceNsize = (select_img == ALL_IMAGES)? dirHead.size() : 1;
-    setDimensions(aDim);
+    size_t   imgEnd;
+    if (select_img == ALL_IMAGES)
+        imgEnd = dirHead.size();
+    else if (rangeLastImg != ALL_IMAGES)
+        imgEnd = rangeLastImg;
+    else
+        imgEnd = imgStart + 1;
 
-    size_t   imgEnd = (select_img != ALL_IMAGES) ? imgStart + 1 : aDim.ndim;
+    aDim.ndim = replaceNsize = imgEnd - imgStart;
+    setDimensions(aDim);
 
     DataType datatype = datatypeTIFF(dirHead[0]);
 
@@ -246,82 +388,43 @@ int ImageBase::readTIFF(size_t select_img, bool isStack)
     //if memory already allocated use it (no resize allowed)
     mdaBase->coreAllocateReuse();
 
-    size_t pad = aDim.yxdim;
-    int imReaded = 0;
-
     MD.clear();
     MD.resize(aDim.ndim,MDL::emptyHeader);
 
-    uint32 rowsperstrip;
-    tsize_t scanline;
-
-    unsigned int x, y;
-    // Dimensions of tiles
-    unsigned int tileWidth, tileLength;
-
+    // If samplesPerPixel is higher than 3 it means there are extra samples, as associated alpha data
+    // Greyscale images are usually samplesPerPixel=1
+    // RGB images are usually samplesPerPixel=3 (this is only implemented for untiled 8-bit tiffs)
+    size_t chunksPerImage = 0;
     for (size_t i = imgStart; i < imgEnd; ++i)
     {
-        TIFFSetDirectory(tif,(tdir_t) i);
-
-        // If samplesPerPixel is higher than 3 it means there are extra samples, as associated alpha data
-        // Greyscale images are usually samplesPerPixel=1
-        // RGB images are usually samplesPerPixel=3 (this is only implemented for untiled 8-bit tiffs)
         if (dirHead[i].samplesPerPixel > 3)
             dirHead[i].samplesPerPixel = 1;
+        chunksPerImage = XMIPP_MAX(chunksPerImage, dirHead[i].chunks());
+    }
 
-        if (TIFFIsTiled(tif))
-        {
-            TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tileWidth);
-            TIFFGetField(tif, TIFFTAG_TILELENGTH,&tileLength);
-            tif_buf = (char*)_TIFFmalloc(TIFFTileSize(tif));
-        }
-        else
-        {
-            TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
-            scanline = TIFFScanlineSize(tif);
-            tif_buf = (char*)_TIFFmalloc(scanline);
-        }
-        if (tif_buf == 0)
-        {
-            TIFFError(TIFFFileName(tif), "No space for strip buffer");
-            exit(-1);
-        }
-
-        /* Start to convert the TIFF image to type T */
-
-        datatype = datatypeTIFF(dirHead[i]);
-
-        if (TIFFIsTiled(tif))
-        {
-            for (y = 0; y < dirHead[0].imageLength; y += tileLength)
-                for (x = 0; x < dirHead[0].imageWidth; x += tileWidth)
-                {
-                    TIFFReadTile(tif, tif_buf, x, y, 0, 0);
-                    if (swap)
-                        swapPage((char*)tif_buf, TIFFTileSize(tif)*sizeof(unsigned char), datatype);
-
-                    castTiffTile2T((pad*imReaded), tif_buf, x, y,
-                                   dirHead[i].imageWidth, dirHead[i].imageLength,
-                                   tileWidth, tileLength,
-                                   dirHead[i].samplesPerPixel,
-                                   datatype);
-                }
-        }
-        else
-        {
-            for (y = 0; y < dirHead[i].imageLength; y++)
-            {
-                TIFFReadScanline(tif, tif_buf, y);
-                castTiffLine2T((pad*imReaded), tif_buf, y,
-                               dirHead[i].imageWidth, dirHead[i].imageLength,
-                               dirHead[i].samplesPerPixel,
-                               datatype);
-            }
-        }
-
-        ++imReaded;
-        _TIFFfree(tif_buf);
+    /* Start to convert the TIFF image to type T. Strips (or tiles) of all the
+     * images are distributed among the threads, which decode and cast them
+     * straight into the image array.
+     */
+    size_t nTasks = aDim.ndim * chunksPerImage;
+    int nThreads = (int) XMIPP_MIN((size_t) readThreads, nTasks);
+    ThreadTaskDistributor td(nTasks, XMIPP_MAX((size_t) 1, nTasks / (XMIPP_MAX(nThreads, 1) * 16)));
+
+    TiffDecodeData decData;
+    decData.dirHead = &dirHead;
+    decData.imgStart = imgStart;
+    decData.chunksPerImage = chunksPerImage;
+    decData.td = &td;
+
+    if (nThreads <= 1)
+        decodeTiffChunks(tif, decData);
+    else
+    {
+        ThreadManager thMgr(nThreads, this);
+        thMgr.run(decodeTiffThread, &decData);
     }
+    if (decData.error != NULL)
+        throw XmippError(*decData.error);
     return 0;
 }
 
@@ -43,12 +43,64 @@ struct TIFFDirHead
     float            xTiffRes,yTiffRes;
     unsigned int subFileType;
     uint16 pNumber, pTotal; // pagenumber and total number of pages of current directory
+    bool isTiled;           // data organized in tiles instead of strips
+    unsigned int tileWidth, tileLength; // tile dimensions when isTiled
+    unsigned int rowsPerStrip; // rows in each strip when not tiled
     TIFFDirHead()
     {
         	bitsPerSample=samplesPerPixel=0;
         	imageWidth=imageLength=subFileType=0;
             imageSampleFormat=0;
             xTiffRes=yTiffRes=0;
+            isTiled=false;
+            tileWidth=tileLength=rowsPerStrip=0;
+    }
+    /// Number of strips or tiles of the image
+    size_t chunks() const
+    {
+        if (isTiled)
+            return ((imageWidth + tileWidth - 1) / tileWidth) * ((imageLength + tileLength - 1) / tileLength);
+        return (imageLength + rowsPerStrip - 1) / rowsPerStrip;
+    }
+};
+
+/** Data shared by the threads decoding a TIFF file
+*/
+struct TiffDecodeData
+{
+    std::vector<TIFFDirHead> * dirHead;
+    size_t imgStart;
+    size_t chunksPerImage;
+    ParallelTaskDistributor * td;
+    /// First error found by a thread. It is thrown by the calling thread
+    XmippError * error;
+    Mutex errorMutex;
+
+    TiffDecodeData()
+    {
+        error = NULL;
+    }
+
+    ~TiffDecodeData()
+    {
+        delete error;
+    }
+
+    /// Keep the first error, the rest of threads stop at their next task
+    void setError(const XmippError &XE)
+    {
+        errorMutex.lock();
+        if (error == NULL)
+            error = new XmippError(XE);
+        errorMutex.unlock();
+    }
+
+    bool failed()
+    {
+        errorMutex.lock();
+        bool retval = (error != NULL);
+        errorMutex.unlock();
+        return retval;
     }
 };
 
@@ -75,6 +127,20 @@ void castTiffLine2T(
     unsigned short samplesPerPixel,
     DataType datatype);
 
+/** Decode the strips or tiles of a range of TIFF directories.
+  * Tasks given by td are numbered as (image - imgStart) * chunksPerImage + chunk,
+  * where chunk is the strip or tile index. Each chunk is decoded and cast
+  * into its position of the image array, so that several threads may call this
+  * function at the same time as long as each one uses its own TIFF handle.
+  * Errors are not thrown but stored in decData, so that the caller can throw
+  * them once all the threads have finished.
+  */
+void decodeTiffChunks(TIFF * tifHandle, TiffDecodeData &decData);
+
+/** Thread function to decode TIFF chunks with a private TIFF handle.
+  */
+static void decodeTiffThread(ThreadArgument &thArg);
+
 /** Determine datatype of the TIFF format file.
   * @ingroup TIFF
   */
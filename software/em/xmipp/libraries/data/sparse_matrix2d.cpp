@@ -69,6 +69,12 @@ SparseMatrix2D::SparseMatrix2D(std::vector<SparseElement> &_elements, int _Nelem
 			++i;
 		}
 	}
+	// Rows after the last nonzero element are empty
+	while (actualRow < N-1)
+		DIRECT_MULTIDIM_ELEM(iIdx,++actualRow) = 0;
+	// Zero values are not stored
+	values.resize(i);
+	jIdx.resize(i);
 }
 
 /*
@@ -108,6 +114,8 @@ void SparseMatrix2D::sparseMatrix2DFromVector(std::vector<SparseElement> &_eleme
 		}
 	}
 	N = actualRow+1;
+	values.resize(i);
+	jIdx.resize(i);
 }
 
 SparseMatrix2D &SparseMatrix2D::operator =(const SparseMatrix2D &X)
@@ -122,24 +130,40 @@ SparseMatrix2D &SparseMatrix2D::operator =(const SparseMatrix2D &X)
 	return *this;
 }
 
+/**
+ * First and last+1 positions in values of the elements of a row.
+ * Empty rows have iIdx=0, so the end of a row is the beginning of the next
+ * nonempty one.
+ */
+void SparseMatrix2D::getRowRange(int i, int &rowBeg, int &rowEnd) const
+{
+	rowBeg = DIRECT_MULTIDIM_ELEM(iIdx,i) -1;
+	if (rowBeg < 0)
+	{
+		rowEnd = rowBeg;
+		return;
+	}
+	rowEnd = XSIZE(values);
+	for (int r = i+1; r < N; ++r)
+		if (DIRECT_MULTIDIM_ELEM(iIdx,r) > 0)
+		{
+			rowEnd = DIRECT_MULTIDIM_ELEM(iIdx,r) -1;
+			break;
+		}
+}
+
 /**
  * It computes y <- this*x
  */
-void SparseMatrix2D::multMv(double* x, double* y)
+void SparseMatrix2D::multMv(const double* x, double* y) const
 {
 	int col, rowEnd, rowBeg;
 	double val;
-	memset(y,0,N*sizeof(double));
 
-	size_t nnz=XSIZE(values);
     for(int i = 0; i< N; i++)
     {
     	// We get the gap where are the elements of the row i in value's vector
-		rowBeg = DIRECT_MULTIDIM_ELEM(iIdx,i) -1;
-		if( i != N-1 )
-			rowEnd = DIRECT_MULTIDIM_ELEM(iIdx,i+1) -1;
-		else
-			rowEnd = nnz;
+		getRowRange(i, rowBeg, rowEnd);
 
 		val = 0.0;
 		for(int j = rowBeg; j < rowEnd ; j++)
@@ -171,13 +195,8 @@ std::ostream & operator << (std::ostream &out, const SparseMatrix2D &X)
  */
 double SparseMatrix2D::getElemIJ(int row, int col) const
 {
-	int rowBeg = DIRECT_MULTIDIM_ELEM(iIdx,row) -1;
-	int rowEnd;
-
-	if( row != N-1 )
-		rowEnd = DIRECT_MULTIDIM_ELEM(iIdx,row+1) -1;
-	else
-		rowEnd = XSIZE(values);
+	int rowBeg, rowEnd;
+	getRowRange(row, rowBeg, rowEnd);
 
 	// If there is a non-zero element, the column is in jIdx
 	for(int i = rowBeg; i < rowEnd ; i++)
@@ -295,3 +314,207 @@ void SparseMatrix2D::loadMatrix(const FileName &fn)
 	sparseMatrix2DFromVector(elems);
 }
 
+/* Truncated eigendecomposition -------------------------------------------- */
+// y=A*x for a sparse matrix
+class SparseMatrixOperator
+{
+public:
+	const SparseMatrix2D &A;
+	SparseMatrixOperator(const SparseMatrix2D &_A): A(_A) {}
+	size_t size() const
+	{
+		return A.N;
+	}
+	void multiply(const Matrix1D<double> &x, Matrix1D<double> &y) const
+	{
+		y.resizeNoCopy(A.N);
+		A.multMv(MATRIX1D_ARRAY(x), MATRIX1D_ARRAY(y));
+	}
+};
+
+// y=A*x for a dense matrix
+class DenseMatrixOperator
+{
+public:
+	const Matrix2D<double> &A;
+	DenseMatrixOperator(const Matrix2D<double> &_A): A(_A) {}
+	size_t size() const
+	{
+		return MAT_YSIZE(A);
+	}
+	void multiply(const Matrix1D<double> &x, Matrix1D<double> &y) const
+	{
+		matrixOperation_Ax(A, x, y);
+	}
+};
+
+/* Thick restart Lanczos with full reorthogonalization.
+ * Wu, Simon. Thick-restart Lanczos method for large symmetric eigenvalue
+ * problems. SIAM J. Matrix Anal. Appl. 22: 602-616 (2000)
+ *
+ * The rows of V are the Lanczos vectors and T=V*A*V^t is computed
+ * explicitly while reorthogonalizing, so that the restarted (arrowhead)
+ * part does not need special treatment. */
+template <class Operator>
+void thickRestartLanczos(const Operator &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P,
+		bool largest, double tol, int maxRestarts)
+{
+	size_t N = A.size();
+	if (M == 0 || M > N)
+		REPORT_ERROR(ERR_ARG_INCORRECT, "lanczosEigs: incorrect number of eigenvalues");
+	size_t m = XMIPP_MIN(N, XMIPP_MAX(2*M+20, (size_t)40));
+
+	// Small problems are solved directly
+	if (m == N)
+	{
+		Matrix2D<double> Adense(N, N);
+		Matrix1D<double> e(N), Ae;
+		for (size_t j = 0; j < N; ++j)
+		{
+			e.initZeros();
+			VEC_ELEM(e, j) = 1;
+			A.multiply(e, Ae);
+			for (size_t i = 0; i < N; ++i)
+				MAT_ELEM(Adense, i, j) = VEC_ELEM(Ae, i);
+		}
+		if (largest)
+			firstEigs(Adense, M, D, P);
+		else
+			lastEigs(Adense, M, D, P);
+		return;
+	}
+
+	Matrix2D<double> V(m+1, N), T(m, m), S;
+	Matrix1D<double> v(N), w, theta;
+	unsigned short xsubi[3] = {0x330E, 0x1234, 0xABCD};
+	for (size_t n = 0; n < N; ++n)
+		VEC_ELEM(v, n) = erand48(xsubi) - 0.5;
+	v /= v.module();
+	memcpy(&MAT_ELEM(V, 0, 0), MATRIX1D_ARRAY(v), N*sizeof(double));
+
+	size_t l = 0; // Number of Ritz vectors kept at the restart
+	std::vector<size_t> wanted(M);
+	for (int restart = 0; ; ++restart)
+	{
+		double beta = 0;
+		for (size_t j = l; j < m; ++j)
+		{
+			memcpy(MATRIX1D_ARRAY(v), &MAT_ELEM(V, j, 0), N*sizeof(double));
+			A.multiply(v, w);
+			double *ptrW = MATRIX1D_ARRAY(w);
+
+			// Orthogonalize twice against all previous vectors
+			for (int pass = 0; pass < 2; ++pass)
+				for (size_t i = 0; i <= j; ++i)
+				{
+					const double *ptrVi = &MAT_ELEM(V, i, 0);
+					double h = 0;
+					for (size_t n = 0; n < N; ++n)
+						h += ptrVi[n] * ptrW[n];
+					for (size_t n = 0; n < N; ++n)
+						ptrW[n] -= h * ptrVi[n];
+					if (pass == 0)
+						MAT_ELEM(T, i, j) = h;
+					else
+						MAT_ELEM(T, i, j) += h;
+					MAT_ELEM(T, j, i) = MAT_ELEM(T, i, j);
+				}
+			beta = w.module();
+
+			// If an invariant subspace has been found, continue with a random direction
+			double *ptrVnext = &MAT_ELEM(V, j+1, 0);
+			if (beta < 1e-12)
+			{
+				for (size_t n = 0; n < N; ++n)
+					ptrW[n] = erand48(xsubi) - 0.5;
+				for (int pass = 0; pass < 2; ++pass)
+					for (size_t i = 0; i <= j; ++i)
+					{
+						const double *ptrVi = &MAT_ELEM(V, i, 0);
+						double h = 0;
+						for (size_t n = 0; n < N; ++n)
+							h += ptrVi[n] * ptrW[n];
+						for (size_t n = 0; n < N; ++n)
+							ptrW[n] -= h * ptrVi[n];
+					}
+				w /= w.module();
+				beta = 0;
+				memcpy(ptrVnext, ptrW, N*sizeof(double));
+			}
+			else
+				for (size_t n = 0; n < N; ++n)
+					ptrVnext[n] = ptrW[n] / beta;
+		}
+
+		// Ritz values, in descending order
+		firstEigs(T, m, theta, S);
+		for (size_t k = 0; k < M; ++k)
+			wanted[k] = largest ? k : m-1-k;
+
+		// Convergence: the residual of the Ritz pair k is |beta*S(m-1,k)|
+		double thetaMax = 0;
+		for (size_t k = 0; k < m; ++k)
+			thetaMax = XMIPP_MAX(thetaMax, fabs(VEC_ELEM(theta, k)));
+		bool converged = true;
+		for (size_t k = 0; k < M; ++k)
+			if (fabs(beta * MAT_ELEM(S, m-1, wanted[k])) > tol * XMIPP_MAX(thetaMax, 1e-300))
+			{
+				converged = false;
+				break;
+			}
+
+		if (!converged && restart == maxRestarts)
+			REPORT_ERROR(ERR_NUMERICAL, formatString("lanczosEigs: no convergence after %d restarts", maxRestarts));
+		if (converged)
+		{
+			D.resizeNoCopy(M);
+			P.initZeros(N, M);
+			for (size_t k = 0; k < M; ++k)
+			{
+				VEC_ELEM(D, k) = VEC_ELEM(theta, wanted[k]);
+				for (size_t r = 0; r < m; ++r)
+				{
+					double s = MAT_ELEM(S, r, wanted[k]);
+					const double *ptrVr = &MAT_ELEM(V, r, 0);
+					for (size_t n = 0; n < N; ++n)
+						MAT_ELEM(P, n, k) += s * ptrVr[n];
+				}
+			}
+			return;
+		}
+
+		// Restart with the l Ritz vectors at the wanted end and the last Lanczos vector
+		l = XMIPP_MIN(M + (m-M)/2, m-1);
+		Matrix2D<double> Vnew(l+1, N);
+		T.initZeros();
+		for (size_t k = 0; k < l; ++k)
+		{
+			size_t kk = largest ? k : m-1-k;
+			MAT_ELEM(T, k, k) = VEC_ELEM(theta, kk);
+			double *ptrVk = &MAT_ELEM(Vnew, k, 0);
+			for (size_t r = 0; r < m; ++r)
+			{
+				double s = MAT_ELEM(S, r, kk);
+				const double *ptrVr = &MAT_ELEM(V, r, 0);
+				for (size_t n = 0; n < N; ++n)
+					ptrVk[n] += s * ptrVr[n];
+			}
+		}
+		memcpy(&MAT_ELEM(Vnew, l, 0), &MAT_ELEM(V, m, 0), N*sizeof(double));
+		memcpy(&MAT_ELEM(V, 0, 0), &MAT_ELEM(Vnew, 0, 0), (l+1)*N*sizeof(double));
+	}
+}
+
+void lanczosEigs(const SparseMatrix2D &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P,
+		bool largest, double tol, int maxRestarts)
+{
+	SparseMatrixOperator op(A);
+	thickRestartLanczos(op, M, D, P, largest, tol, maxRestarts);
+}
+
+void lanczosEigs(const Matrix2D<double> &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P,
+		bool largest, double tol, int maxRestarts)
+{
+	DenseMatrixOperator op(A);
+	thickRestartLanczos(op, M, D, P, largest, tol, maxRestarts);
+}
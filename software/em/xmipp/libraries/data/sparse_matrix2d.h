@@ -103,7 +103,13 @@ public:
     /** Computes y=this*x
      * y and x are vectors of size Nx1
      */
-    void multMv(double* x, double* y);
+    void multMv(const double* x, double* y) const;
+
+    /** Range of positions in values of the elements of a row.
+     * The elements of row i are between rowBeg (included) and rowEnd
+     * (excluded). The range is empty for rows without elements.
+     */
+    void getRowRange(int i, int &rowBeg, int &rowEnd) const;
 
     /// Computes Y=this*X
     void multMM(const SparseMatrix2D &X, SparseMatrix2D &Y);
@@ -134,6 +140,27 @@ public:
      */
     void loadMatrix(const FileName &fn);
 };
+
+/** Truncated eigendecomposition of a symmetric, sparse matrix.
+ * Only the eigenvectors of the largest (or smallest) M eigenvalues are
+ * computed, by thick restart Lanczos. A is only accessed through
+ * multMv, so the cost is a few hundred sparse matrix-vector products
+ * instead of the O(N^3) of a full decomposition. Eigenvalues are sorted
+ * as in firstEigs (largest, descending) and lastEigs (smallest, ascending),
+ * and P has the corresponding eigenvectors as columns.
+ * The iterations stop when the residual of all the wanted eigenpairs is
+ * below tol times the largest Ritz value. An ERR_NUMERICAL exception is
+ * thrown if this does not happen within maxRestarts restarts.
+ */
+void lanczosEigs(const SparseMatrix2D &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P,
+		bool largest=true, double tol=1e-9, int maxRestarts=500);
+
+/** Truncated eigendecomposition of a symmetric, dense matrix.
+ * As the sparse version, for matrices (e.g. kernels) that are dense but of
+ * which only a few eigenvectors are needed.
+ */
+void lanczosEigs(const Matrix2D<double> &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P,
+		bool largest=true, double tol=1e-9, int maxRestarts=500);
 //@}
 
 #endif /* SPARSE_MATRIX2D_H_ */
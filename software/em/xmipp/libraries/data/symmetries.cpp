@@ -115,6 +115,8 @@ int SymList::readSymmetryFile(FileName fn_sym, double accuracy)
     // Ask for memory
     __L.resize(4*true_symNo, 4);
     __R.resize(4*true_symNo, 4);
+    __L3.resize(9*true_symNo);
+    __R3.resize(9*true_symNo);
     __shift.resize(true_symNo, 3);
     __chain_length.resize(true_symNo);
     __chain_length.initConstant(1);
@@ -384,6 +386,61 @@ void SymList::setMatrices(int i, const Matrix2D<double> &L,
             __L(k, l) = L(k - 4 * i, l);
             __R(k, l) = R(k - 4 * i, l);
         }
+    if (__L3.size() < 9 * (size_t)(i + 1))
+    {
+        __L3.resize(9 * (i + 1));
+        __R3.resize(9 * (i + 1));
+    }
+    double *L3 = &__L3[9 * i], *R3 = &__R3[9 * i];
+    for (k = 0; k < 3; k++)
+        for (l = 0; l < 3; l++)
+        {
+            *L3++ = dMij(L, k, l);
+            *R3++ = dMij(R, k, l);
+        }
+}
+
+// Symmetric angles and directions =========================================
+/* C=A*B for 3x3 row-major matrices, with the same summation order as
+   Matrix2D::operator* */
+inline void multiply3x3(const double *A, const double *B, double *C)
+{
+    for (int i = 0; i < 3; i++, A += 3)
+        for (int j = 0; j < 3; j++)
+            *C++ = A[0] * B[j] + A[1] * B[3 + j] + A[2] * B[6 + j];
+}
+
+void SymList::symmetricAngles(const std::vector<double> &angles,
+                              std::vector<double> &symAngles,
+                              bool object_rotation) const
+{
+    int Nsym = symsNo();
+    size_t Nangles = angles.size() / 3;
+    symAngles.resize(3 * Nangles * (Nsym + 1));
+    if (Nangles == 0)
+        return;
+
+    Matrix2D<double> E(3, 3), LER(3, 3);
+    double LE[9];
+    const double *ptrIn = &angles[0];
+    double *ptrOut = &symAngles[0];
+    for (size_t n = 0; n < Nangles; n++, ptrIn += 3)
+    {
+        ptrOut[0] = ptrIn[0];
+        ptrOut[1] = ptrIn[1];
+        ptrOut[2] = ptrIn[2];
+        ptrOut += 3;
+        Euler_angles2matrix(ptrIn[0], ptrIn[1], ptrIn[2], E);
+        for (int isym = 0; isym < Nsym; isym++, ptrOut += 3)
+        {
+            const double *L3 = &__L3[9 * isym], *R3 = &__R3[9 * isym];
+            if (object_rotation)
+                std::swap(L3, R3);
+            multiply3x3(L3, MATRIX2D_ARRAY(E), LE);
+            multiply3x3(LE, R3, MATRIX2D_ARRAY(LER));
+            Euler_matrix2angles(LER, ptrOut[0], ptrOut[1], ptrOut[2]);
+        }
+    }
 }
 
 // Get/Set shift ===========================================================
@@ -2713,27 +2770,20 @@ double SymList::computeDistance(double rot1, double tilt1, double psi1,
     Euler_angles2matrix(rot1, tilt1, psi1, E1, false);
 
     int imax = symsNo() + 1;
-    Matrix2D<double>  L(3, 3), R(3, 3);  // A matrix from the list
     double best_ang_dist = 3600;
     double best_rot2=0, best_tilt2=0, best_psi2=0;
 
+    std::vector<double> angles(3), symAngles;
+    angles[0] = rot2;
+    angles[1] = tilt2;
+    angles[2] = psi2;
+    symmetricAngles(angles, symAngles, object_rotation);
+
     for (int i = 0; i < imax; i++)
     {
-        double rot2p, tilt2p, psi2p;
-        if (i == 0)
-        {
-            rot2p = rot2;
-            tilt2p = tilt2;
-            psi2p = psi2;
-        }
-        else
-        {
-            getMatrices(i - 1, L, R, false);
-            if (object_rotation)
-                Euler_apply_transf(R, L, rot2, tilt2, psi2, rot2p, tilt2p, psi2p);
-            else
-                Euler_apply_transf(L, R, rot2, tilt2, psi2, rot2p, tilt2p, psi2p);
-        }
+        double rot2p = symAngles[3 * i];
+        double tilt2p = symAngles[3 * i + 1];
+        double psi2p = symAngles[3 * i + 2];
 
         double ang_dist = Euler_distanceBetweenAngleSets_fast(E1,rot2p, tilt2p, psi2p,
                           projdir_mode, E2);
@@ -143,6 +143,9 @@ public:
     // L and R matrices
     Matrix2D<double> __L, __R;
     Matrix2D<double> __shift;  // It is used for crystallographic symmetries
+    // The same L and R matrices packed as 3x3 row-major blocks
+    // (9 doubles per symmetry). They are kept up to date by setMatrices
+    std::vector<double> __L3, __R3;
     Matrix1D<int>    __chain_length;
 
     // As the symmetry elements form a subgroup, this is the number of
@@ -212,6 +215,34 @@ public:
     void setMatrices(int i, const Matrix2D<double> &L,
                       const Matrix2D<double> &R);
 
+    /** Packed 3x3 L matrix of the symmetry i.
+        The 9 elements are stored row-major. Inner loops should use these
+        arrays instead of getMatrices, that builds two Matrix2D per call.
+        \ Ex:
+        @code
+           const double *R=SL.matrixR3(i);
+           double z=R[6]*x+R[7]*y+R[8]*z;
+        @endcode */
+    const double * matrixL3(int i) const
+    {
+        return &__L3[9*i];
+    }
+
+    /** Packed 3x3 R matrix of the symmetry i. See matrixL3. */
+    const double * matrixR3(int i) const
+    {
+        return &__R3[9*i];
+    }
+
+    /** Symmetric Euler angles of a set of orientations.
+        angles is a list of (rot,tilt,psi) triplets. For each of them,
+        symAngles receives symsNo()+1 triplets: the input one and those of
+        L*E*R for every symmetry (R*E*L if object_rotation), as
+        Euler_apply_transf would compute them. */
+    void symmetricAngles(const std::vector<double> &angles,
+                         std::vector<double> &symAngles,
+                         bool object_rotation=false) const;
+
     /** Get shift.
         Returns the shift associated to a certain symmetry. */
     void getShift(int i, Matrix1D<double> &shift) const;
@@ -901,3 +901,33 @@ void randomizePhases(MultidimArray<double> &Min, double wRandom)
     }
 	transformer.inverseFourierTransform();
 }
+
+std::complex<double> getHalfFourierValue(const MultidimArray< std::complex<double> > &F,
+                                         int Xdim, int kx, int ky)
+{
+    int Ydim = YSIZE(F);
+    kx = intWRAP(kx, Xdim/2 - Xdim + 1, Xdim/2);
+    ky = intWRAP(ky, Ydim/2 - Ydim + 1, Ydim/2);
+    bool conjugate = (kx < 0);
+    if (conjugate)
+    {
+        kx = -kx;
+        ky = -ky;
+    }
+    if (ky < 0)
+        ky += Ydim;
+    if (conjugate)
+        return conj(DIRECT_A2D_ELEM(F, ky, kx));
+    return DIRECT_A2D_ELEM(F, ky, kx);
+}
+
+std::complex<double> interpolatedHalfFourierValue(const MultidimArray< std::complex<double> > &F,
+        int Xdim, double kx, double ky)
+{
+    int x0 = FLOOR(kx), y0 = FLOOR(ky);
+    double wx = kx - x0, wy = ky - y0;
+    return (1 - wy) * ((1 - wx) * getHalfFourierValue(F, Xdim, x0, y0) +
+                       wx * getHalfFourierValue(F, Xdim, x0 + 1, y0)) +
+           wy * ((1 - wx) * getHalfFourierValue(F, Xdim, x0, y0 + 1) +
+                 wx * getHalfFourierValue(F, Xdim, x0 + 1, y0 + 1));
+}
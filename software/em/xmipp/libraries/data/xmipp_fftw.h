@@ -671,5 +671,23 @@ void adaptSpectrum(MultidimArray<double> &Min,
  * @ingroup FourierOperations
 */
 void randomizePhases(MultidimArray<double> &Min, double wRandom);
+
+/** Value of a 2D half Fourier transform at any integer frequency
+ * @ingroup FourierOperations
+    F is the transform (FFTW format) of a real image of size YSIZE(F) x Xdim.
+    Frequencies are wrapped to the Fourier grid and the negative x
+    frequencies are taken from the Hermitian symmetry.
+*/
+std::complex<double> getHalfFourierValue(const MultidimArray< std::complex<double> > &F,
+                                         int Xdim, int kx, int ky);
+
+/** Bilinear interpolation of a 2D half Fourier transform
+ * @ingroup FourierOperations
+    Same as getHalfFourierValue for a non integer frequency (kx,ky), given
+    in samples of the Fourier grid. Transforms of padded images should be
+    used to keep the interpolation error low.
+*/
+std::complex<double> interpolatedHalfFourierValue(const MultidimArray< std::complex<double> > &F,
+        int Xdim, double kx, double ky);
 #endif
 /** @} */
@@ -282,7 +282,7 @@ bool FileName::hasMetadataExtension() const
     String ext = getFileFormat();
     return (ext == "sel"    || ext == "xmd" || ext == "doc" ||
             ext == "ctfdat" || ext == "ctfparam" || ext == "pos" ||
-            ext == "sqlite" || ext == "xml" || ext == "star");
+            ext == "sqlite" || ext == "xml" || ext == "star" || ext == "xmdb");
 }
 
 // Init random .............................................................
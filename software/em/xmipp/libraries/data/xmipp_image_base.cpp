@@ -46,6 +46,8 @@ void ImageBase::init()
     _exists = mmapOnRead = mmapOnWrite = false;
     mFd        = 0;
     mappedSize = mappedOffset = virtualOffset = 0;
+    rangeLastImg = ALL_IMAGES;
+    readThreads = 1;
 }
 
 void ImageBase::clearHeader()
@@ -97,6 +99,59 @@ int ImageBase::readOrReadMapped(const FileName &name, size_t select_img, int mod
     }
 }
 
+int ImageBase::readRange(const FileName &name, size_t firstImage, size_t lastImage, int nThreads)
+{
+    if (firstImage < FIRST_IMAGE || lastImage < firstImage)
+        REPORT_ERROR(ERR_INDEX_OUTOFBOUNDS, formatString("ImageBase::readRange: Incorrect image range %lu - %lu",
+                     firstImage, lastImage));
+
+    FileName fnStack = name.removePrefixNumber();
+    int err;
+
+    if (FileName(fnStack.getFileFormat()).contains("tif"))
+    {
+        // readTIFF reads from select_img to rangeLastImg
+        rangeLastImg = lastImage;
+        readThreads = (nThreads < 1) ? 1 : nThreads;
+        try
+        {
+            err = read(fnStack, DATA, firstImage);
+        }
+        catch (XmippError &)
+        {
+            rangeLastImg = ALL_IMAGES;
+            readThreads = 1;
+            throw;
+        }
+        rangeLastImg = ALL_IMAGES;
+        readThreads = 1;
+    }
+    else
+    {
+        err = read(fnStack, DATA, ALL_IMAGES);
+
+        ArrayDim aDim;
+        mdaBase->getDimensions(aDim);
+        if (lastImage > aDim.ndim)
+            REPORT_ERROR(ERR_INDEX_OUTOFBOUNDS, formatString("ImageBase::readRange (%s): Image number %lu exceeds stack size %lu",
+                         fnStack.c_str(), lastImage, aDim.ndim));
+
+        size_t nImages = lastImage - firstImage + 1;
+        if (nImages < aDim.ndim)
+        {
+            // Move the range to the beginning of the array and shrink it
+            size_t imgSize = aDim.zyxdim * gettypesize(myT());
+            char * ptr = (char *) mdaBase->getArrayPointer();
+            memmove(ptr, ptr + IMG_INDEX(firstImage) * imgSize, nImages * imgSize);
+            mdaBase->resize(nImages, aDim.zdim, aDim.ydim, aDim.xdim);
+            if (MD.size() >= lastImage)
+                MD.erase(MD.begin(), MD.begin() + IMG_INDEX(firstImage));
+            MD.resize(nImages, MDL::emptyHeader);
+        }
+    }
+    return err;
+}
+
 int ImageBase::readOrReadPreview(const FileName &name, size_t Xdim, size_t Ydim, int select_slice, size_t select_img,
                                  bool mapData)
 {
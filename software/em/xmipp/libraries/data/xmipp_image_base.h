@@ -31,6 +31,7 @@
 #include "transformations.h"
 #include "metadata.h"
 #include "xmipp_datatype.h"
+#include "xmipp_threads.h"
 //
 //// Includes for rwTIFF which cannot be inside it
 #include <tiffio.h>
@@ -255,6 +256,8 @@ protected:
     size_t              mappedSize;  // Size of the mapped file
     size_t              mappedOffset;// Offset for the mapped file
     size_t          virtualOffset;// MDA Offset when movePointerTo is used
+    size_t              rangeLastImg;// Last image to read when reading a range (ALL_IMAGES if none)
+    int                 readThreads; // Number of threads to decode image data (only TIFF so far)
 
 public:
 
@@ -344,6 +347,21 @@ public:
     int read(const FileName &name, DataMode datamode = DATA, size_t select_img = ALL_IMAGES,
              bool mapData = false, int mode = WRITE_READONLY);
 
+    /** Read a range of images from a stack.
+     * Images from firstImage to lastImage (both included, starting at FIRST_IMAGE)
+     * are read into a stack of lastImage-firstImage+1 images. Any image number
+     * given in the name is ignored.
+     *
+     * TIFF files (e.g. movies) only decode the requested directories, and their
+     * strips or tiles are decoded in parallel by nThreads threads, each one with
+     * its own libtiff handle. Other formats read the whole stack and keep the range.
+     * @code
+     * Image<double> frames;
+     * frames.readRange("movie.tif", 5, 20, 8); // frames 5..20 decoded with 8 threads
+     * @endcode
+     */
+    int readRange(const FileName &name, size_t firstImage, size_t lastImage, int nThreads = 1);
+
     /** General read function
      * you can read a single image from a single image file
      * or a single image file from an stack, in the second case
@@ -844,6 +862,9 @@ protected:
     /** Show ImageBase */
     friend std::ostream& operator<<(std::ostream& o, const ImageBase& I);
 
+    /// Preallocated stacks fill the SPIDER headers of their images
+    friend class PreallocatedStack;
+
 };
 //@}
 #endif /* IMAGE_BASE_H_ */
@@ -0,0 +1,275 @@
+/***************************************************************************
+ * Preallocated image stacks written in parallel by threads and MPI nodes
+ *
+ * Authors:     Xmipp team (xmipp@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "xmipp_image_stack.h"
+#include "xmipp_image_generic.h"
+
+// Fields of the MRC header used here (in 4 byte words, see rwMRC.cpp)
+#define MRC_HEADER_SIZE 1024
+#define MRC_NX      0
+#define MRC_NY      1
+#define MRC_NZ      2
+#define MRC_MODE    3
+#define MRC_MZ      9
+#define MRC_AMIN   19
+#define MRC_AMAX   20
+#define MRC_AMEAN  21
+#define MRC_ISPG   22
+#define MRC_NSYMBT 23
+#define MRC_ARMS   54
+
+// Read n bytes at offset, pread may return less than asked
+static void preadAll(int fd, char *buffer, size_t n, size_t offset,
+                     const FileName &fn)
+{
+    while (n > 0)
+    {
+        ssize_t nRead = pread(fd, buffer, n, offset);
+        if (nRead <= 0)
+            REPORT_ERROR(ERR_IO_NOREAD, formatString("PreallocatedStack: cannot read %s",
+                         fn.c_str()));
+        buffer += nRead;
+        offset += nRead;
+        n -= nRead;
+    }
+}
+
+// Write n bytes at offset, pwrite may write less than asked
+static void pwriteAll(int fd, const char *buffer, size_t n, size_t offset,
+                      const FileName &fn)
+{
+    while (n > 0)
+    {
+        ssize_t nWritten = pwrite(fd, buffer, n, offset);
+        if (nWritten <= 0)
+            REPORT_ERROR(ERR_IO_NOWRITE, formatString("PreallocatedStack: cannot write %s",
+                         fn.c_str()));
+        buffer += nWritten;
+        offset += nWritten;
+        n -= nWritten;
+    }
+}
+
+PreallocatedStack::PreallocatedStack()
+{
+    fd = -1;
+    isSpider = true;
+    Xdim = Ydim = Zdim = Ndim = 0;
+    headerSize = imageHeaderSize = dataSize = 0;
+}
+
+PreallocatedStack::~PreallocatedStack()
+{
+    close();
+}
+
+void PreallocatedStack::create(const FileName &fn, size_t Xdim, size_t Ydim,
+                               size_t Zdim, size_t Ndim)
+{
+    createEmptyFile(fn, Xdim, Ydim, Zdim, Ndim, true, WRITE_OVERWRITE);
+}
+
+void PreallocatedStack::open(const FileName &fn)
+{
+    close();
+    filename = fn;
+    String ext = fn.getExtension();
+    if (ext == "stk" || ext == "spi" || ext == "xmp" || ext == "vol")
+        isSpider = true;
+    else if (ext == "mrc" || ext == "mrcs" || ext == "st")
+        isSpider = false;
+    else
+        REPORT_ERROR(ERR_IO_NOTFILE, formatString("PreallocatedStack: %s is not a SPIDER or MRC stack",
+                     fn.c_str()));
+
+    if ((fd = ::open(fn.c_str(), O_RDWR)) < 0)
+        REPORT_ERROR(ERR_IO_NOTOPEN, formatString("PreallocatedStack: cannot open %s",
+                     fn.c_str()));
+
+    if (isSpider)
+    {
+        mainHeader.resize(SPIDERSIZE);
+        preadAll(fd, &mainHeader[0], SPIDERSIZE, 0, filename);
+        const ImageBase::SPIDERhead *header = (const ImageBase::SPIDERhead *) &mainHeader[0];
+        if (header->nslice < 1 || header->nslice > SWAPTRIG ||
+            header->labbyt != header->labrec * header->lenbyt)
+            REPORT_ERROR(ERR_IO_NOTFILE, formatString("PreallocatedStack: %s is not a SPIDER file of this machine",
+                         fn.c_str()));
+        Xdim = (size_t) header->nsam;
+        Ydim = (size_t) header->nrow;
+        Zdim = (size_t) header->nslice;
+        Ndim = (header->istack > 0) ? (size_t) header->maxim : 1;
+        headerSize = (size_t) header->labbyt;
+        // A single image has no header of its own, its data follows the main header
+        imageHeaderSize = (header->istack > 0) ? headerSize : 0;
+        // The header may be larger than the minimum for wide images
+        mainHeader.resize(headerSize);
+        preadAll(fd, &mainHeader[0], headerSize, 0, filename);
+    }
+    else
+    {
+        mainHeader.resize(MRC_HEADER_SIZE);
+        preadAll(fd, &mainHeader[0], MRC_HEADER_SIZE, 0, filename);
+        const int *header = (const int *) &mainHeader[0];
+        if (header[MRC_MODE] != 2)
+            REPORT_ERROR(ERR_IO_NOTFILE, formatString("PreallocatedStack: %s is not an MRC file of floats of this machine",
+                         fn.c_str()));
+        Xdim = header[MRC_NX];
+        Ydim = header[MRC_NY];
+        if (header[MRC_ISPG] == 0) // Stack of images
+        {
+            Zdim = 1;
+            Ndim = header[MRC_NZ];
+        }
+        else if (header[MRC_ISPG] == 401) // Stack of volumes
+        {
+            Zdim = header[MRC_MZ];
+            Ndim = header[MRC_NZ] / Zdim;
+        }
+        else
+        {
+            Zdim = header[MRC_NZ];
+            Ndim = 1;
+        }
+        headerSize = MRC_HEADER_SIZE + header[MRC_NSYMBT];
+        imageHeaderSize = 0;
+    }
+    dataSize = Xdim * Ydim * Zdim * sizeof(float);
+}
+
+void PreallocatedStack::close()
+{
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+size_t PreallocatedStack::imageOffset(size_t n) const
+{
+    if (n < 1 || n > Ndim)
+        REPORT_ERROR(ERR_INDEX_OUTOFBOUNDS, formatString("PreallocatedStack: image %lu is not in %s",
+                     n, filename.c_str()));
+    return headerSize + (n - 1) * (imageHeaderSize + dataSize);
+}
+
+void PreallocatedStack::write(const Image<double> &I, size_t n)
+{
+    const MultidimArray<double> &mI = I();
+    if (XSIZE(mI) != Xdim || YSIZE(mI) != Ydim || ZSIZE(mI) != Zdim)
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, formatString("PreallocatedStack: the image does not fit in %s",
+                     filename.c_str()));
+
+    // Header and data of the image are consecutive, write them at once
+    std::vector<char> buffer(imageHeaderSize + dataSize);
+    if (isSpider && imageHeaderSize > 0)
+    {
+        memcpy(&buffer[0], &mainHeader[0], imageHeaderSize);
+        ImageBase::SPIDERhead *header = (ImageBase::SPIDERhead *) &buffer[0];
+        header->xoff = I.Xoff();
+        header->yoff = I.Yoff();
+        header->zoff = I.Zoff();
+        header->phi = I.rot();
+        header->theta = I.tilt();
+        header->gamma = I.psi();
+        header->weight = I.weight();
+        header->flip = I.flip();
+        header->scale = I.scale();
+    }
+    float *data = (float *) &buffer[imageHeaderSize];
+    const double *ptrI = MULTIDIM_ARRAY(mI);
+    for (size_t i = 0; i < MULTIDIM_SIZE(mI); ++i)
+        data[i] = (float) ptrI[i];
+    pwriteAll(fd, &buffer[0], buffer.size(), imageOffset(n), filename);
+}
+
+void PreallocatedStack::read(Image<double> &I, size_t n)
+{
+    std::vector<char> buffer(imageHeaderSize + dataSize);
+    preadAll(fd, &buffer[0], buffer.size(), imageOffset(n), filename);
+    if (isSpider && imageHeaderSize > 0)
+    {
+        const ImageBase::SPIDERhead *header = (const ImageBase::SPIDERhead *) &buffer[0];
+        I.setShifts(header->xoff, header->yoff, header->zoff);
+        I.setEulerAngles(header->phi, header->theta, header->gamma);
+        I.setWeight(header->weight);
+        I.setFlip(header->flip != 0);
+        I.setScale(header->scale);
+    }
+    MultidimArray<double> &mI = I();
+    mI.resizeNoCopy(Zdim, Ydim, Xdim);
+    const float *data = (const float *) &buffer[imageHeaderSize];
+    double *ptrI = MULTIDIM_ARRAY(mI);
+    for (size_t i = 0; i < MULTIDIM_SIZE(mI); ++i)
+        ptrI[i] = data[i];
+}
+
+void PreallocatedStack::finalize()
+{
+    double minVal = 0, maxVal = 0, sum = 0, sum2 = 0;
+    size_t nPixels = dataSize / sizeof(float);
+    std::vector<char> buffer(dataSize);
+    const float *data = (const float *) &buffer[0];
+    for (size_t n = 1; n <= Ndim; ++n)
+    {
+        preadAll(fd, &buffer[0], dataSize, imageOffset(n) + imageHeaderSize, filename);
+        if (n == 1)
+            minVal = maxVal = data[0];
+        for (size_t i = 0; i < nPixels; ++i)
+        {
+            double val = data[i];
+            if (val < minVal)
+                minVal = val;
+            else if (val > maxVal)
+                maxVal = val;
+            sum += val;
+            sum2 += val * val;
+        }
+    }
+    double N = (double) nPixels * Ndim;
+    double avg = sum / N;
+    double stddev = sqrt(fabs(sum2 / N - avg * avg));
+
+    if (isSpider)
+    {
+        ImageBase::SPIDERhead *header = (ImageBase::SPIDERhead *) &mainHeader[0];
+        header->fmin = (float) minVal;
+        header->fmax = (float) maxVal;
+        header->av = (float) avg;
+        header->sig = (float) stddev;
+        header->imami = 1;
+    }
+    else
+    {
+        float *header = (float *) &mainHeader[0];
+        header[MRC_AMIN] = (float) minVal;
+        header[MRC_AMAX] = (float) maxVal;
+        header[MRC_AMEAN] = (float) avg;
+        header[MRC_ARMS] = (float) stddev;
+    }
+    pwriteAll(fd, &mainHeader[0], mainHeader.size(), 0, filename);
+}
@@ -0,0 +1,124 @@
+/***************************************************************************
+ * Preallocated image stacks written in parallel by threads and MPI nodes
+ *
+ * Authors:     Xmipp team (xmipp@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#ifndef XMIPP_IMAGE_STACK_H_
+#define XMIPP_IMAGE_STACK_H_
+
+#include "xmipp_image.h"
+
+/** @defgroup PreallocatedStack Preallocated output stacks
+ *  @ingroup Images
+ *  @{
+ */
+
+/** Stack of images written in parallel.
+ * The stack (main header plus Ndim images) is created once, so the
+ * position of each image in the file is known. Then any number of
+ * threads or MPI nodes can write and read their images with positional
+ * I/O (pwrite/pread) without any lock, as long as each image is written
+ * by a single writer at a time. The statistics of the main header are
+ * computed once at the end (finalize).
+ *
+ * Only SPIDER (stk, spi, xmp, vol) and MRC (mrc, mrcs, st) stacks of
+ * floats in the byte order of this machine are supported.
+ * @code
+ * if (node->isMaster())
+ *     PreallocatedStack::create("averages.stk", Xdim, Ydim, 1, Nclasses);
+ * node->barrierWait();
+ * PreallocatedStack stack;
+ * stack.open("averages.stk");
+ * ...
+ * stack.write(avg, classNumber); // No lock needed
+ * ...
+ * node->barrierWait();
+ * if (node->isMaster())
+ *     stack.finalize();
+ * @endcode
+ */
+class PreallocatedStack
+{
+public:
+    /// Filename
+    FileName filename;
+    /// Dimensions of the images
+    size_t Xdim, Ydim, Zdim;
+    /// Number of images
+    size_t Ndim;
+
+protected:
+    // File descriptor
+    int fd;
+    // SPIDER or MRC
+    bool isSpider;
+    // Size of the main header and offset of the first image
+    size_t headerSize;
+    // Size of the header of each image (only SPIDER)
+    size_t imageHeaderSize;
+    // Size in bytes of the data of one image
+    size_t dataSize;
+    // Main header, it is the template of the image headers in SPIDER
+    std::vector<char> mainHeader;
+
+public:
+    /// Empty constructor
+    PreallocatedStack();
+
+    /// Destructor, the file is closed
+    ~PreallocatedStack();
+
+    /** Create a stack with Ndim empty images.
+     * Only one process should create it, before the others open it.
+     */
+    static void create(const FileName &fn, size_t Xdim, size_t Ydim, size_t Zdim,
+                       size_t Ndim);
+
+    /** Open an existing stack for reading and writing. */
+    void open(const FileName &fn);
+
+    /** Close the file */
+    void close();
+
+    /** Write the image n (from 1 to Ndim).
+     * In SPIDER the image header keeps the shifts, angles, weight, flip
+     * and scale of I.
+     */
+    void write(const Image<double> &I, size_t n);
+
+    /** Read the image n (from 1 to Ndim). */
+    void read(Image<double> &I, size_t n);
+
+    /** Write the minimum, maximum, average and standard deviation of all
+     * images in the main header.
+     * Only one process should call it, after all images have been written.
+     */
+    void finalize();
+
+protected:
+    // Offset of the image n (of its header in SPIDER)
+    size_t imageOffset(size_t n) const;
+};
+//@}
+#endif /* XMIPP_IMAGE_STACK_H_ */
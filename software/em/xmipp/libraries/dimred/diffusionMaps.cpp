@@ -63,9 +63,9 @@ void DiffusionMaps::reduceDimensionality()
         MAT_ELEM(L2distance,i,j)/=VEC_ELEM(p,i)*VEC_ELEM(p,j);
 
     // L2distance=U*S*V^t
-    Matrix2D<double> U,V;
-    Matrix1D<double> S;
-    svdcmp(L2distance,U,S,V);
+    Matrix2D<double> U;
+    diffusionKernelSingularVectors(L2distance,outputDim+1,t!=1.,
+                                   MAT_YSIZE(L2distance)<=DIMRED_DENSE_EIGS_MAX,U);
 
     // Get columns 1 to outputDim of U as output
     // normalzied by the first element in its row
@@ -77,3 +77,34 @@ void DiffusionMaps::reduceDimensionality()
             MAT_ELEM(Y,i,j-1)=MAT_ELEM(U,i,j)*iK;
     }
 }
+
+void diffusionKernelSingularVectors(const Matrix2D<double> &K, size_t M, bool symmetric,
+                                    bool dense, Matrix2D<double> &U)
+{
+    Matrix1D<double> S;
+    if (dense)
+    {
+        // svdcmp does not sort the singular values
+        Matrix2D<double> Uall, V;
+        svdcmp(K,Uall,S,V);
+        Matrix1D<int> idx;
+        S.indexSort(idx);
+        size_t N=MAT_YSIZE(Uall);
+        U.resizeNoCopy(N,M);
+        for (size_t j=0; j<M; ++j)
+        {
+            int idxj=VEC_ELEM(idx,VEC_XSIZE(idx)-1-j)-1;
+            for (size_t i=0; i<N; ++i)
+                MAT_ELEM(U,i,j)=MAT_ELEM(Uall,i,idxj);
+        }
+    }
+    else if (symmetric)
+        lanczosEigs(K,M,S,U);
+    else
+    {
+        // The left singular vectors of K are the eigenvectors of K*K^t
+        Matrix2D<double> KKt;
+        matrixOperation_AAt(K,KKt);
+        lanczosEigs(KKt,M,S,U);
+    }
+}
@@ -46,5 +46,16 @@ public:
 	/// Reduce dimensionality
 	void reduceDimensionality();
 };
+
+/** Left singular vectors of a diffusion kernel.
+ * The M left singular vectors of K with the largest singular values are
+ * returned as columns of U, in decreasing order of their singular value.
+ * With dense, they are taken from a full SVD. Otherwise they are computed
+ * by Lanczos, as eigenvectors of K if it is symmetric and positive
+ * semidefinite, or of K*K^t if it is not (the kernel normalized by its
+ * row sums, t=1).
+ */
+void diffusionKernelSingularVectors(const Matrix2D<double> &K, size_t M, bool symmetric,
+                                    bool dense, Matrix2D<double> &U);
 //@}
 #endif
@@ -24,6 +24,7 @@
  ***************************************************************************/
 
 #include "dimred_tools.h"
+#include <data/xmipp_threads.h>
 
 void GenerateData::generateNewDataset(const String& method, int N, double noise)
 {
@@ -167,51 +168,377 @@ void GenerateData::generateNewDataset(const String& method, int N, double noise)
 		REPORT_ERROR(ERR_ARG_INCORRECT,"Incorrect method passed to generate data");
 }
 
-void insertNeighbour(Matrix2D<int> &idx, Matrix2D<double> &distance, int i1, int i2, double d)
+/* Neighbour search ------------------------------------------------------- */
+static int dimRedThreads=1;
+
+void setDimRedThreads(int nThreads)
 {
-	int K=MAT_XSIZE(idx);
-	int kInsert=K;
-	for (int k=K-1; k>=0; --k)
-		if (MAT_ELEM(distance,i1,k)>d)
-			kInsert=k;
-		else
-			break;
-	if (kInsert<K)
+	dimRedThreads=XMIPP_MAX(1,nThreads);
+}
+
+int getDimRedThreads()
+{
+	return dimRedThreads;
+}
+
+// Squared Euclidean distance. It stops as soon as the partial sum exceeds bound
+static inline double squaredDistance(const double *a, const double *b, size_t D, double bound)
+{
+	double d=0;
+	size_t j=0;
+	for (; j+32<=D; j+=32)
 	{
-		for (int kp=K-1; kp>kInsert; --kp)
+		for (size_t l=j; l<j+32; ++l)
 		{
-			int kp_1=kp-1;
-			MAT_ELEM(distance,i1,kp)=MAT_ELEM(distance,i1,kp_1);
-			MAT_ELEM(idx,i1,kp)=MAT_ELEM(idx,i1,kp_1);
+			double diff=a[l]-b[l];
+			d+=diff*diff;
 		}
-		MAT_ELEM(distance,i1,kInsert)=d;
-		MAT_ELEM(idx,i1,kInsert)=i2;
+		if (d>bound)
+			return d;
+	}
+	for (; j<D; ++j)
+	{
+		double diff=a[j]-b[j];
+		d+=diff*diff;
 	}
+	return d;
 }
 
-void kNearestNeighbours(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f, bool computeSqrt)
+static inline double neighbourDistance(const Matrix2D<double> &X, size_t i1, size_t i2, DimRedDistance2 f, double bound)
 {
-	K=std::min(K,(int)MAT_YSIZE(X)-1);
-	idx.initConstant(MAT_YSIZE(X),K,-1);
-	distance.initConstant(MAT_YSIZE(X),K,1e38);
-	for (size_t i1=0; i1<MAT_YSIZE(X)-1; ++i1)
-		for (size_t i2=i1+1; i2<MAT_YSIZE(X); ++i2)
+	if (f==NULL)
+		return squaredDistance(&MAT_ELEM(X,i1,0),&MAT_ELEM(X,i2,0),MAT_XSIZE(X),bound);
+	return (*f)(X,i1,i2);
+}
+
+/* Insert i2 in the list of K neighbours (sorted by distance) of a sample.
+ * Returns true if the list changed. NaN distances are never inserted. */
+static bool insertNeighbour(int *idx, double *distance, bool *isNew, int K, int i2, double d)
+{
+	if (!(d<distance[K-1]))
+		return false;
+	int kInsert=K-1;
+	while (kInsert>0 && distance[kInsert-1]>d)
+		--kInsert;
+	for (int k=0; k<K; ++k)
+		if (idx[k]==i2)
+			return false;
+	for (int kp=K-1; kp>kInsert; --kp)
+	{
+		distance[kp]=distance[kp-1];
+		idx[kp]=idx[kp-1];
+		if (isNew!=NULL)
+			isNew[kp]=isNew[kp-1];
+	}
+	distance[kInsert]=d;
+	idx[kInsert]=i2;
+	if (isNew!=NULL)
+		isNew[kInsert]=true;
+	return true;
+}
+
+// Number of samples compared at the same time with a block of candidates
+#define KNN_QUERY_BLOCK 16
+#define KNN_CANDIDATE_BLOCK 256
+
+struct KnnBruteForceArgs
+{
+	const Matrix2D<double> *X;
+	int K;
+	DimRedDistance2 f;
+	ThreadTaskDistributor *td;
+	// Neighbour lists of each thread
+	std::vector< Matrix2D<int> > idx;
+	std::vector< Matrix2D<double> > distance;
+};
+
+/* Compare the samples i0 to i1-1 with the following ones. Each pair is
+ * evaluated once and inserted in the lists of both samples. */
+static void kNearestNeighboursBruteForceRows(const KnnBruteForceArgs &args, Matrix2D<int> &idx, Matrix2D<double> &distance,
+		size_t i0, size_t i1)
+{
+	const Matrix2D<double> &X=*args.X;
+	size_t N=MAT_YSIZE(X);
+	int K=args.K;
+	for (size_t j0=i0+1; j0<N; j0+=KNN_CANDIDATE_BLOCK)
+	{
+		size_t j1=XMIPP_MIN(j0+KNN_CANDIDATE_BLOCK,N);
+		for (size_t i=i0; i<i1; ++i)
 		{
-			// Compute the distance between i1 and i2
-			double d=0;
-			if (f==NULL)
-				for (int j=0; j<MAT_XSIZE(X); ++j)
+			int *idx_i=&MAT_ELEM(idx,i,0);
+			double *distance_i=&MAT_ELEM(distance,i,0);
+			for (size_t j=XMIPP_MAX(j0,i+1); j<j1; ++j)
+			{
+				double *distance_j=&MAT_ELEM(distance,j,0);
+				double d=neighbourDistance(X,i,j,args.f,XMIPP_MAX(distance_i[K-1],distance_j[K-1]));
+				insertNeighbour(idx_i,distance_i,NULL,K,j,d);
+				insertNeighbour(&MAT_ELEM(idx,j,0),distance_j,NULL,K,i,d);
+			}
+		}
+	}
+}
+
+static void threadKNearestNeighboursBruteForce(ThreadArgument &thArg)
+{
+	KnnBruteForceArgs *args=(KnnBruteForceArgs *)thArg.workClass;
+	size_t N=MAT_YSIZE(*args->X);
+	Matrix2D<int> &idx=args->idx[thArg.thread_id];
+	Matrix2D<double> &distance=args->distance[thArg.thread_id];
+	idx.initConstant(N,args->K,-1);
+	distance.initConstant(N,args->K,1e38);
+	size_t first, last;
+	while (args->td->getTasks(first,last))
+		for (size_t t=first; t<=last; ++t)
+			kNearestNeighboursBruteForceRows(*args,idx,distance,t*KNN_QUERY_BLOCK,XMIPP_MIN((t+1)*KNN_QUERY_BLOCK,N));
+}
+
+void kNearestNeighboursBruteForce(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f, int nThreads)
+{
+	size_t N=MAT_YSIZE(X);
+	K=std::min(K,(int)N-1);
+	idx.initConstant(N,K,-1);
+	distance.initConstant(N,K,1e38);
+	if (K<=0)
+		return;
+
+	KnnBruteForceArgs args;
+	args.X=&X;
+	args.K=K;
+	args.f=f;
+	size_t nTasks=(N+KNN_QUERY_BLOCK-1)/KNN_QUERY_BLOCK;
+	// User distances are not assumed to be reentrant
+	if (f!=NULL)
+		nThreads=1;
+	nThreads=(int)XMIPP_MIN((size_t)nThreads,nTasks);
+	if (nThreads>1)
+	{
+		ThreadTaskDistributor td(nTasks,1);
+		args.td=&td;
+		args.idx.resize(nThreads);
+		args.distance.resize(nThreads);
+		ThreadManager thMgr(nThreads,&args);
+		thMgr.run(threadKNearestNeighboursBruteForce);
+
+		// Merge the lists of all threads, each pair is in the lists of one of them
+		for (size_t i=0; i<N; ++i)
+		{
+			int *idx_i=&MAT_ELEM(idx,i,0);
+			double *distance_i=&MAT_ELEM(distance,i,0);
+			for (int thread=0; thread<nThreads; ++thread)
+				for (int k=0; k<K; ++k)
 				{
-					double diff=MAT_ELEM(X,i1,j)-MAT_ELEM(X,i2,j);
-					d+=diff*diff;
+					int idxk=MAT_ELEM(args.idx[thread],i,k);
+					if (idxk<0)
+						break;
+					insertNeighbour(idx_i,distance_i,NULL,K,idxk,MAT_ELEM(args.distance[thread],i,k));
 				}
-			else
-				d=(*f)(X,i1,i2);
+		}
+	}
+	else
+		kNearestNeighboursBruteForceRows(args,idx,distance,0,N);
+}
 
-			// Check if they are nearest neighbours
-			insertNeighbour(idx,distance,i1,i2,d);
-			insertNeighbour(idx,distance,i2,i1,d);
+/* NN-descent --------------------------------------------------------------- */
+// Number of locks protecting the neighbour lists during the local joins
+#define NNDESCENT_LOCKS 1024
+
+struct NNDescentArgs
+{
+	const Matrix2D<double> *X;
+	int K;
+	DimRedDistance2 f;
+	int *idx;
+	double *distance;
+	bool *isNew;
+	std::vector< std::vector<int> > *newNeighbours, *oldNeighbours;
+	Mutex *locks;
+	std::vector<size_t> updates;
+	ThreadTaskDistributor *td;
+};
+
+// Try to make i2 neighbour of i1, locking the list of i1
+static bool updateNeighbour(NNDescentArgs &args, int i1, int i2, double d)
+{
+	size_t offset=((size_t)i1)*args.K;
+	Mutex &lock=args.locks[i1%NNDESCENT_LOCKS];
+	lock.lock();
+	bool changed=insertNeighbour(args.idx+offset,args.distance+offset,args.isNew+offset,args.K,i2,d);
+	lock.unlock();
+	return changed;
+}
+
+static void nnDescentLocalJoin(NNDescentArgs &args, size_t i, size_t &updates)
+{
+	const std::vector<int> &newI=(*args.newNeighbours)[i];
+	const std::vector<int> &oldI=(*args.oldNeighbours)[i];
+	for (size_t n1=0; n1<newI.size(); ++n1)
+	{
+		int u=newI[n1];
+		for (size_t n2=n1+1; n2<newI.size(); ++n2)
+		{
+			int v=newI[n2];
+			if (u==v)
+				continue;
+			double d=neighbourDistance(*args.X,u,v,args.f,1e38);
+			updates+=updateNeighbour(args,u,v,d);
+			updates+=updateNeighbour(args,v,u,d);
 		}
+		for (size_t n2=0; n2<oldI.size(); ++n2)
+		{
+			int v=oldI[n2];
+			if (u==v)
+				continue;
+			double d=neighbourDistance(*args.X,u,v,args.f,1e38);
+			updates+=updateNeighbour(args,u,v,d);
+			updates+=updateNeighbour(args,v,u,d);
+		}
+	}
+}
+
+static void threadNNDescentLocalJoin(ThreadArgument &thArg)
+{
+	NNDescentArgs *args=(NNDescentArgs *)thArg.workClass;
+	size_t first, last, updates=0;
+	while (args->td->getTasks(first,last))
+		for (size_t i=first; i<=last; ++i)
+			nnDescentLocalJoin(*args,i,updates);
+	args->updates[thArg.thread_id]=updates;
+}
+
+// Keep at most n randomly chosen elements of v
+static void sampleNeighbours(std::vector<int> &v, size_t n, unsigned short *xsubi)
+{
+	if (v.size()<=n)
+		return;
+	for (size_t k=0; k<n; ++k)
+		std::swap(v[k],v[k+(size_t)(erand48(xsubi)*(v.size()-k))%(v.size()-k)]);
+	v.resize(n);
+}
+
+void kNearestNeighboursNNDescent(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f,
+		int nThreads, int maxIter, double rho, double delta)
+{
+	size_t N=MAT_YSIZE(X);
+	K=std::min(K,(int)N-1);
+	idx.initConstant(N,K,-1);
+	distance.initConstant(N,K,1e38);
+	if (K<=0)
+		return;
+	if (f!=NULL)
+		nThreads=1;
+	unsigned short xsubi[3]={0x330E, 0xABCD, 0x1234};
+
+	// Random initial graph. Candidates at an infinite (or NaN) distance are
+	// not inserted, so the number of attempts is bounded and the lists that
+	// are not full are completed by the local joins
+	bool *flags=new bool[N*K];
+	for (size_t i=0; i<N*K; ++i)
+		flags[i]=true;
+	int *idxPtr=MATRIX2D_ARRAY(idx);
+	double *distancePtr=MATRIX2D_ARRAY(distance);
+	int maxAttempts=4*K+16;
+	for (size_t i=0; i<N; ++i)
+	{
+		size_t offset=i*K;
+		int inserted=0;
+		for (int attempt=0; attempt<maxAttempts && inserted<K; ++attempt)
+		{
+			int j=(int)(erand48(xsubi)*N)%N;
+			if (j==(int)i)
+				continue;
+			inserted+=insertNeighbour(idxPtr+offset,distancePtr+offset,flags+offset,K,j,neighbourDistance(X,i,j,f,1e38));
+		}
+	}
+
+	Mutex *locks=new Mutex[NNDESCENT_LOCKS];
+	std::vector< std::vector<int> > newNeighbours(N), oldNeighbours(N), newReverse(N), oldReverse(N);
+	NNDescentArgs args;
+	args.X=&X;
+	args.K=K;
+	args.f=f;
+	args.idx=idxPtr;
+	args.distance=distancePtr;
+	args.isNew=flags;
+	args.newNeighbours=&newNeighbours;
+	args.oldNeighbours=&oldNeighbours;
+	args.locks=locks;
+	args.updates.resize(nThreads);
+	ThreadManager *thMgr=NULL;
+	if (nThreads>1)
+		thMgr=new ThreadManager(nThreads,&args);
+
+	size_t sampleSize=XMIPP_MAX(1,(size_t)(rho*K));
+	for (int iter=0; iter<maxIter; ++iter)
+	{
+		// Split the neighbours into new (sampled) and old ones
+		for (size_t i=0; i<N; ++i)
+		{
+			newNeighbours[i].clear();
+			oldNeighbours[i].clear();
+			newReverse[i].clear();
+			oldReverse[i].clear();
+		}
+		for (size_t i=0; i<N; ++i)
+		{
+			size_t offset=i*K;
+			for (int k=0; k<K; ++k)
+			{
+				int j=idxPtr[offset+k];
+				if (j<0)
+					continue;
+				if (flags[offset+k])
+					newNeighbours[i].push_back(k);
+				else
+					oldNeighbours[i].push_back(j);
+			}
+			sampleNeighbours(newNeighbours[i],sampleSize,xsubi);
+			for (size_t n=0; n<newNeighbours[i].size(); ++n)
+			{
+				int k=newNeighbours[i][n];
+				flags[offset+k]=false;
+				newNeighbours[i][n]=idxPtr[offset+k];
+			}
+			for (size_t n=0; n<newNeighbours[i].size(); ++n)
+				newReverse[newNeighbours[i][n]].push_back(i);
+			for (size_t n=0; n<oldNeighbours[i].size(); ++n)
+				oldReverse[oldNeighbours[i][n]].push_back(i);
+		}
+		for (size_t i=0; i<N; ++i)
+		{
+			sampleNeighbours(newReverse[i],sampleSize,xsubi);
+			sampleNeighbours(oldReverse[i],sampleSize,xsubi);
+			newNeighbours[i].insert(newNeighbours[i].end(),newReverse[i].begin(),newReverse[i].end());
+			oldNeighbours[i].insert(oldNeighbours[i].end(),oldReverse[i].begin(),oldReverse[i].end());
+		}
+
+		// Compare the neighbours of each sample among themselves
+		size_t updates=0;
+		if (thMgr!=NULL)
+		{
+			ThreadTaskDistributor td(N,XMIPP_MIN(N,(size_t)64));
+			args.td=&td;
+			thMgr->run(threadNNDescentLocalJoin);
+			for (int t=0; t<nThreads; ++t)
+				updates+=args.updates[t];
+		}
+		else
+			for (size_t i=0; i<N; ++i)
+				nnDescentLocalJoin(args,i,updates);
+		if (updates<=delta*N*K)
+			break;
+	}
+
+	delete thMgr;
+	delete []locks;
+	delete []flags;
+}
+
+void kNearestNeighbours(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f, bool computeSqrt)
+{
+	if (MAT_YSIZE(X)<=KNN_EXACT_MAX_SIZE)
+		kNearestNeighboursBruteForce(X,K,idx,distance,f,dimRedThreads);
+	else
+		kNearestNeighboursNNDescent(X,K,idx,distance,f,dimRedThreads);
 	if (computeSqrt)
 		FOR_ALL_ELEMENTS_IN_MATRIX2D(distance)
 			MAT_ELEM(distance,i,j)=sqrt(MAT_ELEM(distance,i,j));
@@ -244,27 +571,58 @@ void computeRandomPointsDistance(const Matrix2D<double> &X, Matrix1D<double> &di
 	}
 }
 
-void computeDistance(const Matrix2D<double> &X, Matrix2D<double> &distance, DimRedDistance2 f, bool computeSqrt)
+struct DistanceArgs
 {
-	distance.initZeros(MAT_YSIZE(X),MAT_YSIZE(X));
-	for (size_t i1=0; i1<MAT_YSIZE(X)-1; ++i1)
-		for (size_t i2=i1+1; i2<MAT_YSIZE(X); ++i2)
-		{
-			// Compute the distance between i1 and i2
-			double d=0;
-			if (f==NULL)
-				for (int j=0; j<MAT_XSIZE(X); ++j)
-				{
-					double diff=MAT_ELEM(X,i1,j)-MAT_ELEM(X,i2,j);
-					d+=diff*diff;
-				}
-			else
-				d=(*f)(X,i1,i2);
+	const Matrix2D<double> *X;
+	Matrix2D<double> *distance;
+	DimRedDistance2 f;
+	bool computeSqrt;
+	ThreadTaskDistributor *td;
+};
+
+static void computeDistanceRow(const DistanceArgs &args, size_t i1)
+{
+	const Matrix2D<double> &X=*args.X;
+	for (size_t i2=i1+1; i2<MAT_YSIZE(X); ++i2)
+	{
+		// Compute the distance between i1 and i2
+		double d=neighbourDistance(X,i1,i2,args.f,1e38);
+		if (args.computeSqrt)
+			d=sqrt(d);
+		MAT_ELEM(*args.distance,i2,i1)=MAT_ELEM(*args.distance,i1,i2)=d;
+	}
+}
 
-			if (computeSqrt)
-				d=sqrt(d);
-			MAT_ELEM(distance,i2,i1)=MAT_ELEM(distance,i1,i2)=d;
-		}
+static void threadComputeDistance(ThreadArgument &thArg)
+{
+	DistanceArgs *args=(DistanceArgs *)thArg.workClass;
+	size_t first, last;
+	while (args->td->getTasks(first,last))
+		for (size_t i1=first; i1<=last; ++i1)
+			computeDistanceRow(*args,i1);
+}
+
+void computeDistance(const Matrix2D<double> &X, Matrix2D<double> &distance, DimRedDistance2 f, bool computeSqrt)
+{
+	size_t N=MAT_YSIZE(X);
+	distance.initZeros(N,N);
+	DistanceArgs args;
+	args.X=&X;
+	args.distance=&distance;
+	args.f=f;
+	args.computeSqrt=computeSqrt;
+	int nThreads=(f==NULL) ? (int)XMIPP_MIN((size_t)dimRedThreads,N) : 1;
+	if (nThreads>1)
+	{
+		// Rows have decreasing cost, so they are handed out in small blocks
+		ThreadTaskDistributor td(N,XMIPP_MIN(N,(size_t)KNN_QUERY_BLOCK));
+		args.td=&td;
+		ThreadManager thMgr(nThreads,&args);
+		thMgr.run(threadComputeDistance);
+	}
+	else
+		for (size_t i1=0; i1<N; ++i1)
+			computeDistanceRow(args,i1);
 }
 
 void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, Matrix2D<double> &distance, DimRedDistance2 f, bool computeSqrt)
@@ -275,11 +633,68 @@ void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, Matrix2D<doub
 	distance.initZeros(MAT_YSIZE(X),MAT_YSIZE(X));
 	FOR_ALL_ELEMENTS_IN_MATRIX2D(kDistance)
 	{
+		// Lists are not full if there are samples at a NaN or infinite distance
 		int idx_ij=MAT_ELEM(idx,i,j);
+		if (idx_ij<0)
+			continue;
 		MAT_ELEM(distance,idx_ij,i)=MAT_ELEM(distance,i,idx_ij)=MAT_ELEM(kDistance,i,j);
 	}
 }
 
+void mergeSparseElements(std::vector<SparseElement> &elements, bool sum)
+{
+	if (elements.empty())
+		return;
+	std::sort(elements.begin(),elements.end());
+	size_t last=0;
+	for (size_t n=1; n<elements.size(); ++n)
+	{
+		const SparseElement &e=elements[n];
+		SparseElement &eLast=elements[last];
+		if (e.i==eLast.i && e.j==eLast.j)
+		{
+			if (sum)
+				eLast.value+=e.value;
+		}
+		else
+			elements[++last]=e;
+	}
+	elements.resize(last+1);
+}
+
+void computeSparseNeighbourSimilarity(const Matrix2D<double> &X, int K, double sigma, SparseMatrix2D &W,
+		DimRedDistance2 f)
+{
+	Matrix2D<int> idx;
+	Matrix2D<double> D2;
+	kNearestNeighbours(X,K,idx,D2,f,false);
+
+	// Same weights as computeSimilarityMatrix(D2,sigma,true,true).
+	// Lists are not full if there are samples at a NaN or infinite distance
+	double maxDistance=0;
+	FOR_ALL_ELEMENTS_IN_MATRIX2D(idx)
+		if (MAT_ELEM(idx,i,j)>=0)
+			maxDistance=XMIPP_MAX(maxDistance,MAT_ELEM(D2,i,j));
+	double iK=-0.5/(sigma*sigma*maxDistance);
+	std::vector<SparseElement> elements;
+	elements.reserve(2*MAT_XSIZE(idx)*MAT_YSIZE(idx));
+	SparseElement e;
+	FOR_ALL_ELEMENTS_IN_MATRIX2D(idx)
+	{
+		double d2=MAT_ELEM(D2,i,j);
+		if (MAT_ELEM(idx,i,j)<0 || d2==0)
+			continue;
+		e.value=exp(d2*iK);
+		e.i=i;
+		e.j=MAT_ELEM(idx,i,j);
+		elements.push_back(e);
+		std::swap(e.i,e.j);
+		elements.push_back(e);
+	}
+	mergeSparseElements(elements,false);
+	W=SparseMatrix2D(elements,MAT_YSIZE(X));
+}
+
 void computeSimilarityMatrix(Matrix2D<double> &D2, double sigma, bool skipZeros, bool normalize)
 {
 	double maxDistance=1.0;
@@ -315,7 +730,7 @@ double intrinsicDimensionalityMLE(const Matrix2D<double> &X, DimRedDistance2 f)
 {
 	int k1=5;
 	int k2=12;
-	if (k2>MAT_YSIZE(X))
+	if (k2>(int)MAT_YSIZE(X))
 	{
 		k2=MAT_YSIZE(X)-1;
 		k1=k2/2;
@@ -328,11 +743,11 @@ double intrinsicDimensionalityMLE(const Matrix2D<double> &X, DimRedDistance2 f)
 	double dsum=0;
 	std::cerr << "Estimating dimensionality ... " << std::endl;
 	init_progress_bar(MAT_YSIZE(distance));
-	for (int i=0; i<MAT_YSIZE(distance); ++i)
+	for (size_t i=0; i<MAT_YSIZE(distance); ++i)
 	{
 		double dist=log(MAT_ELEM(distance,i,0));
 		double S=dist;
-	    for (int k=1; k<MAT_XSIZE(distance); ++k)
+	    for (int k=1; k<(int)MAT_XSIZE(distance); ++k)
 	    {
 	    	dist=log(MAT_ELEM(distance,i,k));
 	    	S+=dist;
@@ -377,7 +792,7 @@ double intrinsicDimensionalityCorrDim(const Matrix2D<double> &X, DimRedDistance2
 			// Compute the distance between i1 and i2
 			double d=0;
 			if (f==NULL)
-				for (int j=0; j<MAT_XSIZE(X); ++j)
+				for (size_t j=0; j<MAT_XSIZE(X); ++j)
 				{
 					double diff=MAT_ELEM(X,i1,j)-MAT_ELEM(X,i2,j);
 					d+=diff*diff;
@@ -424,7 +839,7 @@ void extractNearestNeighbours(const Matrix2D<double> &X, Matrix2D<int> &idx, int
 	Matrix2D<double> &Xi)
 {
 	Xi.resizeNoCopy(MAT_XSIZE(idx),MAT_XSIZE(X));
-	for (int j=0; j<MAT_XSIZE(idx); ++j)
+	for (size_t j=0; j<MAT_XSIZE(idx); ++j)
 	{
 		int jNeighbour=MAT_ELEM(idx,i,j);
 		memcpy(&MAT_ELEM(Xi,j,0),&MAT_ELEM(X,jNeighbour,0),MAT_XSIZE(X)*sizeof(double));
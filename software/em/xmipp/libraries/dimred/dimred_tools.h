@@ -27,6 +27,7 @@
 
 #include <data/matrix2d.h>
 #include <data/matrix1d.h>
+#include <data/sparse_matrix2d.h>
 
 /**@defgroup DimRedTools Tools for dimensionality reduction
    @ingroup DimRedLibrary */
@@ -92,6 +93,26 @@ void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, Matrix2D<doub
  */
 void computeSimilarityMatrix(Matrix2D<double> &D2, double sigma, bool skipZeros=false, bool normalize=false);
 
+/** Largest number of samples for which the dimensionality reduction
+ * algorithms compute full eigendecompositions of NxN matrices.
+ * Above it, the neighbour graphs are kept sparse and only the needed
+ * eigenvectors are computed with lanczosEigs.
+ */
+#define DIMRED_DENSE_EIGS_MAX 2000
+
+/** Merge the sparse elements with the same i,j.
+ * The elements are sorted. The values of repeated elements are summed if sum
+ * is true, otherwise only one of them is kept.
+ */
+void mergeSparseElements(std::vector<SparseElement> &elements, bool sum);
+
+/** Sparse similarity matrix of the K nearest neighbours.
+ * It is the sparse version of computeDistanceToNeighbours (with squared distances)
+ * followed by computeSimilarityMatrix(D2,sigma,true,true).
+ */
+void computeSparseNeighbourSimilarity(const Matrix2D<double> &X, int K, double sigma, SparseMatrix2D &W,
+		DimRedDistance2 f=NULL);
+
 /** Compute graph laplacian.
  * L=D-G where D is a diagonal matrix with the row sums of G.
  */
@@ -113,6 +134,20 @@ void computeGraphLaplacian(const Matrix2D<double> &G, Matrix2D<double> &L);
  */
 double intrinsicDimensionality(Matrix2D<double> &X, const String &method="MLE", bool normalize=true, DimRedDistance2 f=NULL);
 
+/** Number of threads of the distance and neighbour computations.
+ * It is 1 by default. Distance functions provided by the caller are not
+ * assumed to be reentrant, so they are always evaluated by a single thread.
+ */
+void setDimRedThreads(int nThreads);
+
+/** Number of threads of the distance and neighbour computations. */
+int getDimRedThreads();
+
+/** Largest number of samples for which kNearestNeighbours is exact.
+ * Above it, the neighbours are approximated by NN-descent.
+ */
+#define KNN_EXACT_MAX_SIZE 20000
+
 /** k-Nearest neighbours.
  * Given a data matrix (each row is a sample, each column a variable), this function
  * returns a matrix of the indexes of the K nearest neighbours to each one of the input samples sorted by distance.
@@ -121,9 +156,37 @@ double intrinsicDimensionality(Matrix2D<double> &X, const String &method="MLE",
  * The element i,j of the output matrices is the index(distance) of the j-th nearest neighbor to the i-th sample.
  *
  * You can provide a distance function of your own. If not, Euclidean distance is used.
+ *
+ * Up to KNN_EXACT_MAX_SIZE samples the neighbours are computed by
+ * kNearestNeighboursBruteForce, and by kNearestNeighboursNNDescent for larger sets.
  */
 void kNearestNeighbours(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f=NULL, bool computeSqrt=true);
 
+/** Exact k-nearest neighbours.
+ * Blocks of samples are compared to blocks of candidates, so that the
+ * candidates are reused from cache, and the Euclidean distance to a
+ * candidate is abandoned as soon as it exceeds the current K-th neighbour.
+ * Blocks of samples are distributed among threads.
+ *
+ * Distances are squared Euclidean distances (or the output of f).
+ */
+void kNearestNeighboursBruteForce(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f=NULL,
+		int nThreads=1);
+
+/** Approximate k-nearest neighbours by NN-descent.
+ * Starting from a random graph, the neighbours of the neighbours of each
+ * sample are compared until less than delta*N*K neighbours change in an
+ * iteration (or maxIter iterations). rho is the fraction of the K neighbours
+ * sampled at each iteration. The local joins are distributed among threads.
+ *
+ * Dong, Charikar, Li. Efficient k-nearest neighbor graph construction for generic
+ * similarity measures. WWW 2011.
+ *
+ * Distances are squared Euclidean distances (or the output of f).
+ */
+void kNearestNeighboursNNDescent(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f=NULL,
+		int nThreads=1, int maxIter=12, double rho=1.0, double delta=0.001);
+
 /** Extract k-nearest neighbours.
  * This function extracts from the matrix X, the neighbours given by idx for the i-th observation.
  */
@@ -26,7 +26,10 @@ void KernelPCA::reduceDimensionality() {
 
 	// Compute the largest eigenvalues
 	Matrix1D<double> lambda;
-	firstEigs(D2,outputDim,lambda,Y);
+	if (MAT_YSIZE(D2)>DIMRED_DENSE_EIGS_MAX)
+		lanczosEigs(D2,outputDim,lambda,Y);
+	else
+		firstEigs(D2,outputDim,lambda,Y);
 
 	// Readjust variances
 	FOR_ALL_ELEMENTS_IN_MATRIX1D(lambda)
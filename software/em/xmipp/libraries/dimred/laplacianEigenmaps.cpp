@@ -34,6 +34,12 @@ void LaplacianEigenmap::setSpecificParameters(double sigma, size_t numberOfNeigh
 
 void LaplacianEigenmap::reduceDimensionality()
 {
+	if (MAT_YSIZE(*X)>DIMRED_DENSE_EIGS_MAX)
+	{
+		reduceDimensionalitySparse();
+		return;
+	}
+
 	Matrix2D<double> G,L,D;
 	Matrix1D<double> mappedX;
 	//Construct neighborhood graph
@@ -50,3 +56,38 @@ void LaplacianEigenmap::reduceDimensionality()
 	generalizedEigs(L,D,mappedX,Y);
 	keepColumns(Y,1,(int)outputDim);
 }
+
+void LaplacianEigenmap::reduceDimensionalitySparse()
+{
+	//Construct neighborhood graph with heat kernel weights
+	SparseMatrix2D G;
+	computeSparseNeighbourSimilarity(*X,numberOfNeighbours,sigma,G,distance);
+
+	//Normalize the graph with the degree of each node
+	size_t N=MAT_YSIZE(*X);
+	Matrix1D<double> iSqrtD(N);
+	int rowBeg, rowEnd;
+	for (size_t i=0; i<N; ++i)
+	{
+		G.getRowRange(i,rowBeg,rowEnd);
+		double d=0;
+		for (int n=rowBeg; n<rowEnd; ++n)
+			d+=DIRECT_MULTIDIM_ELEM(G.values,n);
+		VEC_ELEM(iSqrtD,i)=(d>0) ? 1/sqrt(d) : 1;
+	}
+	for (size_t i=0; i<N; ++i)
+	{
+		G.getRowRange(i,rowBeg,rowEnd);
+		for (int n=rowBeg; n<rowEnd; ++n)
+			DIRECT_MULTIDIM_ELEM(G.values,n)*=VEC_ELEM(iSqrtD,i)*
+				VEC_ELEM(iSqrtD,DIRECT_MULTIDIM_ELEM(G.jIdx,n)-1);
+	}
+
+	//Construct eigenmaps, skipping the trivial one
+	Matrix1D<double> mappedX;
+	Matrix2D<double> Z;
+	lanczosEigs(G,outputDim+1,mappedX,Z);
+	Y.resizeNoCopy(N,outputDim);
+	FOR_ALL_ELEMENTS_IN_MATRIX2D(Y)
+		MAT_ELEM(Y,i,j)=MAT_ELEM(Z,i,j+1)*VEC_ELEM(iSqrtD,i);
+}
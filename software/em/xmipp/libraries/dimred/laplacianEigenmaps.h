@@ -45,6 +45,13 @@ public:
 
 	/// Reduce dimensionality
 	void reduceDimensionality();
+
+	/** Reduce dimensionality with a sparse neighbour graph.
+	 * The generalized problem L y=lambda D y is solved as the largest
+	 * eigenvectors z of D^-1/2 G D^-1/2, with y=D^-1/2 z.
+	 * It is used for more than DIMRED_DENSE_EIGS_MAX samples.
+	 */
+	void reduceDimensionalitySparse();
 };
 //@}
 #endif
@@ -53,6 +53,26 @@ void getLessWeightNColumns(const Matrix2D<double> &A, const Matrix1D<int> &weigh
             }
 }
 
+void LTSA::computeLocalAlignment(Matrix2D<int> &ni, size_t iLoop, Matrix2D<double> &Xi, Matrix2D<double> &Gi)
+{
+	Matrix2D<double> W, Vi, Vi2, Si;
+	Matrix1D<int> weightVector;
+	extractNearestNeighbours(*X, ni, iLoop, Xi);
+	subtractColumnMeans(Xi);
+
+	matrixOperation_AAt(Xi, W); // W=X*X^t
+	schur(W, Vi, Si);           // W=Vi*Si*Vi^t
+
+	computeWeightsVector(Si, weightVector);
+
+	Vi2.resizeNoCopy(MAT_YSIZE(Vi), outputDim + 1);
+	Vi2.setConstantCol(0, 1/sqrt(k)); //Vi2(0,:)=1/sqrt(k)
+	getLessWeightNColumns(Vi, weightVector, Vi2);
+
+	matrixOperation_AAt(Vi2, Gi); // Gi=Vi2*Vi2^t
+	matrixOperation_IminusA(Gi);  // Gi=I-Gi
+}
+
 void LTSA::computeAlignmentMatrix(Matrix2D<double> &B)
 {
 	subtractColumnMeans(*X);
@@ -61,26 +81,12 @@ void LTSA::computeAlignmentMatrix(Matrix2D<double> &B)
 	Matrix2D<int> ni;
 	Matrix2D<double> D;
 	kNearestNeighbours(*X, k, ni, D);
-	Matrix2D<double> Xi(MAT_XSIZE(ni), MAT_XSIZE(*X)), W, Vi, Vi2, Si, Gi;
+	Matrix2D<double> Xi(MAT_XSIZE(ni), MAT_XSIZE(*X)), Gi;
 
 	B.initIdentity(n);
-	Matrix1D<int> weightVector;
 	for (size_t iLoop = 0; iLoop < n; ++iLoop)
 	{
-		extractNearestNeighbours(*X, ni, iLoop, Xi);
-		subtractColumnMeans(Xi);
-
-		matrixOperation_AAt(Xi, W); // W=X*X^t
-		schur(W, Vi, Si);           // W=Vi*Si*Vi^t
-
-		computeWeightsVector(Si, weightVector);
-
-		Vi2.resizeNoCopy(MAT_YSIZE(Vi), outputDim + 1);
-		Vi2.setConstantCol(0, 1/sqrt(k)); //Vi2(0,:)=1/sqrt(k)
-		getLessWeightNColumns(Vi, weightVector, Vi2);
-
-		matrixOperation_AAt(Vi2, Gi); // Gi=Vi2*Vi2^t
-		matrixOperation_IminusA(Gi);  // Gi=I-Gi
+		computeLocalAlignment(ni, iLoop, Xi, Gi);
 
 		// Compute partial B with correlation matrix Gi
 		FOR_ALL_ELEMENTS_IN_MATRIX2D(Gi)
@@ -89,11 +95,53 @@ void LTSA::computeAlignmentMatrix(Matrix2D<double> &B)
 	}
 }
 
+void LTSA::computeSparseAlignmentMatrix(SparseMatrix2D &B)
+{
+	subtractColumnMeans(*X);
+
+	size_t n = MAT_YSIZE(*X);
+	Matrix2D<int> ni;
+	Matrix2D<double> D;
+	kNearestNeighbours(*X, k, ni, D);
+	Matrix2D<double> Xi(MAT_XSIZE(ni), MAT_XSIZE(*X)), Gi;
+
+	// The identity and the -1 of each sample cancel out, so B is the sum of the Gi
+	std::vector<SparseElement> elements;
+	elements.reserve(n*MAT_XSIZE(ni)*MAT_XSIZE(ni));
+	SparseElement e;
+	for (size_t iLoop = 0; iLoop < n; ++iLoop)
+	{
+		computeLocalAlignment(ni, iLoop, Xi, Gi);
+		FOR_ALL_ELEMENTS_IN_MATRIX2D(Gi)
+		{
+			e.i = MAT_ELEM(ni,iLoop,i);
+			e.j = MAT_ELEM(ni,iLoop,j);
+			e.value = MAT_ELEM(Gi, i, j);
+			elements.push_back(e);
+		}
+	}
+	mergeSparseElements(elements, true);
+	B = SparseMatrix2D(elements, n);
+}
+
 void LTSA::reduceDimensionality()
 {
+    Matrix1D<double> DEigs;
+    if (MAT_YSIZE(*X) > DIMRED_DENSE_EIGS_MAX)
+    {
+        // Smallest eigenvectors of the sparse alignment matrix, skipping the first one
+        SparseMatrix2D B;
+        computeSparseAlignmentMatrix(B);
+        Matrix2D<double> P;
+        lanczosEigs(B, outputDim + 1, DEigs, P, false);
+        Y.resizeNoCopy(MAT_YSIZE(P), outputDim);
+        FOR_ALL_ELEMENTS_IN_MATRIX2D(Y)
+            MAT_ELEM(Y, i, j) = MAT_ELEM(P, i, j + 1);
+        return;
+    }
+
 	Matrix2D<double> B;
     computeAlignmentMatrix(B);
 
-    Matrix1D<double> DEigs;
     eigsBetween(B, 1, outputDim, DEigs, Y);
 }
@@ -46,6 +46,13 @@ public:
 protected:
 	/// Common part
 	void computeAlignmentMatrix(Matrix2D<double> &B);
+
+	/// Sparse alignment matrix, for more than DIMRED_DENSE_EIGS_MAX samples
+	void computeSparseAlignmentMatrix(SparseMatrix2D &B);
+
+	/** Alignment Gi of the neighbourhood of sample iLoop.
+	 * Xi is workspace with the neighbours of the sample. */
+	void computeLocalAlignment(Matrix2D<int> &ni, size_t iLoop, Matrix2D<double> &Xi, Matrix2D<double> &Gi);
 };
 //@}
 #endif
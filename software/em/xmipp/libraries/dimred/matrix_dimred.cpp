@@ -39,6 +39,7 @@ void ProgDimRed::readParams()
     dimRefMethod = getParam("-m");
     outputDim  = getIntParam("--dout");
     dimEstMethod = getParam("--dout",1);
+    nThreads = getIntParam("--thr");
 
     if (dimRefMethod=="LTSA" || dimRefMethod=="LLTSA" || dimRefMethod=="LPP" || dimRefMethod=="LE" || dimRefMethod=="HLLE" ||
     	dimRefMethod=="NPE" || dimRefMethod=="SPE")
@@ -65,6 +66,7 @@ void ProgDimRed::show()
         << "Output mapping:         " << fnMapping     << std::endl
         << "Dim Red Method:         " << dimRefMethod  << std::endl
         << "Dimension out:          " << outputDim     << std::endl
+        << "Threads:                " << nThreads      << std::endl
         ;
     if (dimRefMethod=="LTSA" || dimRefMethod=="LLTSA" || dimRefMethod=="LPP" || dimRefMethod=="LE" || dimRefMethod=="HLLE" ||
     	dimRefMethod=="SPE" || dimRefMethod=="NPE")
@@ -104,11 +106,14 @@ void ProgDimRed::defineParams()
     addParamsLine("  [--saveMapping <fn=\"\">] : Save mapping if available (PCA, LLTSA, LPP, pPCA, NPE) so that it can be reused later (Y=X*M)");
     addParamsLine("                            :+X is the input matrix with individuals as rows");
     addParamsLine("                            :+Y is the output matrix with individuals as rows");
+    addParamsLine("  [--thr <N=1>]            : Number of threads");
 }
 
 // Produce Side info  ====================================================================
 void ProgDimRed::produceSideInfo()
 {
+    setMatrixOperationThreads(nThreads);
+    setDimRedThreads(nThreads);
     if (dimRefMethod=="PCA")
     {
     	algorithm=&algorithmPCA;
@@ -63,6 +63,7 @@ public:
     double t; // Markov random walk
     double sigma; // Sigma of kernel
     bool global; // Global for SPE
+    int nThreads; // Number of threads
 public:
     Matrix2D<double> X; // Input data
     DimRedAlgorithm*  algorithm;
@@ -28,13 +28,27 @@
 
 
 MpiProgAngularClassAverage::MpiProgAngularClassAverage()
-{}
+{
+    thMgr = NULL;
+    classTd = NULL;
+    classExpImgs = NULL;
+    ctfGroupLast = 0;
+}
 
 MpiProgAngularClassAverage::MpiProgAngularClassAverage(int argc, char **argv)
 {
+    thMgr = NULL;
+    classTd = NULL;
+    classExpImgs = NULL;
+    ctfGroupLast = 0;
     this->read(argc, argv);
 }
 
+MpiProgAngularClassAverage::~MpiProgAngularClassAverage()
+{
+    delete thMgr;
+}
+
 // Read arguments ==========================================================
 void MpiProgAngularClassAverage::readParams()
 {
@@ -103,7 +117,11 @@ void MpiProgAngularClassAverage::readParams()
 
     // Perform Wiener filtering of average?
     fn_wien = getParam("--wien");
+    fn_ctf = getParam("--ctf");
+    wiener_constant = getDoubleParam("--wc");
     pad = XMIPP_MAX(1.,getDoubleParam("--pad"));
+    if (fn_wien != "" && fn_ctf != "")
+        REPORT_ERROR(ERR_ARG_INCORRECT, "--wien and --ctf cannot be used at the same time");
 
     // Internal re-alignment of the class averages
     Ri = getIntParam("--Ri");
@@ -113,6 +131,8 @@ void MpiProgAngularClassAverage::readParams()
 
     do_save_images_assigned_to_classes = checkParam("--save_images_assigned_to_classes");
     mpi_job_size = getIntParam("--mpi_job_size");
+    nThreads = getIntParam("--thr");
+    do_real_space = checkParam("--real_space");
 }
 
 // Define parameters ==========================================================
@@ -127,9 +147,18 @@ void MpiProgAngularClassAverage::defineParams()
     addParamsLine("    -o <root_name>         : Output rootname for class averages and selfiles");
     addParamsLine("   [--split ]              : Also output averages of random halves of the data");
     addParamsLine("   [--wien <img=\"\"> ]    : Apply this Wiener filter to the averages");
+    addParamsLine("                           : The filter of each defocus group is applied to its partial average");
+    addParamsLine("   [--ctf <img=\"\"> ]     : CTFs of the defocus groups (_ctf images of ctf_group)");
+    addParamsLine("                           : Each class average is Wiener filtered once with the CTFs of all its images:");
+    addParamsLine("                           : sum(CTF*F)/(sum(CTF^2)+N*wc)");
+    addParamsLine("   [--wc <c=-1> ]          : Wiener constant for --ctf");
+    addParamsLine("                           : -1 = 10% of the average CTF^2 of each class");
     addParamsLine("   [--pad <factor=1.> ]    : Padding factor for Wiener correction");
     addParamsLine("   [--save_images_assigned_to_classes]    : Save images assigned te each class in output metadatas");
     addParamsLine("alias --siatc;");
+    addParamsLine("   [--thr <N=1>]           : Number of threads to average each class");
+    addParamsLine("   [--real_space]          : Align the images in real space (B-spline interpolation)");
+    addParamsLine("                           : By default they are shifted and rotated in Fourier space");
     addParamsLine("==+ IMAGE SELECTION BASED ON INPUT DOCFILE (select one between: limit 0, F and R ==");
     addParamsLine("   [--select <col=\"maxCC\">]     : Column to use for image selection (limit0, limitF or limitR)");
     addParamsLine("   [--limit0 <l0>]         : Discard images below <l0>");
@@ -146,7 +175,7 @@ void MpiProgAngularClassAverage::defineParams()
     addParamsLine("   [--Ri <ri=1>]             : Inner radius to limit rotational search");
     addParamsLine("   [--Ro <r0=-1>]            : Outer radius to limit rotational search");
     addParamsLine("                           : ro = -1 -> dim/2-1");
-    addParamsLine("  [--mpi_job_size <size=10>]   : Number of images sent to a cpu in a single job ");
+    addParamsLine("  [--mpi_job_size <size=10>]   : Number of classes sent to a cpu in a single job");
     addParamsLine("                                : 10 may be a good value");
 
     addExampleLine("Sample at default values and calculating output averages of random halves of the data",false);
@@ -158,182 +187,28 @@ void MpiProgAngularClassAverage::run()
 {
     mpi_preprocess();
 
-    int lockIndex;
-    size_t order_index;
-    int ref3d_index;
-
-    double lockWeightIndexes[lockWeightIndexesSize];
-
-    double * jobListRows = new double[ArraySize * mpi_job_size + 1];
-
-    if (node->rank == 0)
+    // Each class (3D reference and projection direction) is averaged by a
+    // single node, so all the nodes write their averages without locks.
+    // All the nodes have the same job list, so all of them skip the
+    // distribution if there are no classes
+    size_t nClasses = classJobs.size() - 1;
+    if (nClasses > 0)
     {
-        //for (int iCounter = 0; iCounter < nJobs; )//increase counter after I am free
-        size_t jobId = 0, size;
-        size_t finishedNodes = 1;
-        bool whileLoop = true;
-
-        size_t order, count;
-        int ctfGroup, ref3d, ref2d;
-        MDIterator __iterJobs(mdJobList);
-        while (whileLoop)
-        {
-            //wait until a worker is available
-            MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-            switch (status.MPI_TAG)
-            {
-            case TAG_I_AM_FREE:
-
-                size = 0;
-                for (size_t i=0;i<mpi_job_size && jobId < numberOfJobs;i++,size++,jobId++)
-                {
-                    //Some test values for defocus, 3D reference and projection direction
-                    mdJobList.getValue(MDL_REF3D, ref3d,  __iterJobs.objId);
-                    jobListRows[index_3DRef + ArraySize * i + 1] = (double) ref3d;
-                    mdJobList.getValue(MDL_DEFGROUP, ctfGroup, __iterJobs.objId);
-                    jobListRows[index_DefGroup + ArraySize * i + 1] = (double) ctfGroup;
-                    mdJobList.getValue(MDL_ORDER, order,  __iterJobs.objId);
-                    jobListRows[index_Order + ArraySize * i + 1] = (double) order;
-                    mdJobList.getValue(MDL_COUNT, count,  __iterJobs.objId);
-                    jobListRows[index_Count + ArraySize * i + 1] = (double) count;
-                    mdJobList.getValue(MDL_REF, ref2d,  __iterJobs.objId);
-                    jobListRows[index_2DRef + ArraySize * i + 1] = (double) ref2d;
-                    jobListRows[index_jobId + ArraySize * i + 1] = (double) __iterJobs.objId;
-                    mdJobList.getValue(MDL_ANGLE_ROT, jobListRows[index_Rot + ArraySize * i + 1],  __iterJobs.objId);
-                    mdJobList.getValue(MDL_ANGLE_TILT, jobListRows[index_Tilt + ArraySize * i + 1],  __iterJobs.objId);
-                    __iterJobs.moveNext();
-                }
-                jobListRows[0]=size;
-
-                //read worker call just to remove it from the queue
-                MPI_Recv(0, 0, MPI_INT, MPI_ANY_SOURCE, TAG_I_AM_FREE, MPI_COMM_WORLD,
-                         &status);
-                if(size > 0)
-                {
-                    //send work, first int defocus, second 3D reference, 3rd projection
-                    // direction and job number
-                    //#define DEBUG_MPI
-#ifdef DEBUG_MPI
-                    usleep(10000);
-                    std::cerr << "Sending job to worker " << status.MPI_SOURCE <<std::endl;
-#endif
-
-                    MPI_Send(jobListRows, ArraySize * mpi_job_size + 1, MPI_DOUBLE, status.MPI_SOURCE,
-                             TAG_WORK, MPI_COMM_WORLD);
-                    //__iterJobs.moveNext();
-                }
-                else
-                {
-                    MPI_Send(0, 0, MPI_INT, status.MPI_SOURCE, TAG_STOP, MPI_COMM_WORLD);
-                    finishedNodes ++;
-                    if (finishedNodes >= node->size)
-                        whileLoop=false;
-                }
-                break;
-            case TAG_MAY_I_WRITE:
-                //where do you want to write?
-                MPI_Recv(&lockIndex, 1, MPI_INT, MPI_ANY_SOURCE, TAG_MAY_I_WRITE, MPI_COMM_WORLD, &status);
-
-                mdJobList.getValue(MDL_ORDER, order_index, lockIndex);
-                mdJobList.getValue(MDL_REF3D, ref3d_index, lockIndex);
-
-                //#define DEBUG_MPI
-#ifdef DEBUG_MPI
-
-                std::cerr << "Blocking. lockIndex: " << lockIndex << " | status.MPI_SOURCE: " << status.MPI_SOURCE
-                << " | lockArray[" << order_index<< "," <<ref3d_index<< "]: " << dAij(lockArray,order_index,ref3d_index) << std::endl;
-#endif
-
-                if (dAij(lockArray,order_index,ref3d_index))
-                {//Locked
-                    MPI_Send(0, 0, MPI_INT, status.MPI_SOURCE,
-                             TAG_DO_NOT_DARE_TO_WRITE, MPI_COMM_WORLD);
-                }
-                else
-                {//Unlocked
-                    //JV : mirar esto imprimiendo
-                    dAij(lockArray,order_index,ref3d_index)=true;
-                    // Send the old weight
-                    lockWeightIndexes[index_lockIndex] = lockIndex;
-                    lockWeightIndexes[index_weight] = dAkij(weightArray,0,order_index,ref3d_index);
-                    lockWeightIndexes[index_weights1] = dAkij(weightArrays1,0,order_index,ref3d_index);
-                    lockWeightIndexes[index_weights2] = dAkij(weightArrays2,0,order_index,ref3d_index);
-                    lockWeightIndexes[index_ref3d] = ref3d_index;
-                    //lockWeightIndexes[index_weight] = dAij(weightArray,order_index,ref3d_index);
-                    //lockWeightIndexes[index_weights1] = dAij(weightArrays1,order_index,ref3d_index);
-                    //lockWeightIndexes[index_weights2] = dAij(weightArrays2,order_index,ref3d_index);
-                    //lockWeightIndexes[index_ref3d] = ref3d_index;
-#ifdef DEBUG_MPI
-
-                    std::cerr << "[" << node->rank << "] TAG_YES_YOU_MAY_WRITE.lockIndex: " << lockIndex <<std::endl;
-                    std::cerr <<  "lockWeightIndexes[index_weight]" << lockWeightIndexes[index_weight]<<std::endl;
-#endif
-#undef  DEBUG_MPI
-
-                    MPI_Send(lockWeightIndexes, lockWeightIndexesSize, MPI_DOUBLE, status.MPI_SOURCE,
-                             TAG_YES_YOU_MAY_WRITE, MPI_COMM_WORLD);
-                }
-                break;
-            case TAG_I_FINISH_WRITTING:
-                //release which lock?
-                MPI_Recv(lockWeightIndexes, lockWeightIndexesSize, MPI_DOUBLE, MPI_ANY_SOURCE, TAG_I_FINISH_WRITTING,
-                         MPI_COMM_WORLD, &status);
-
-                lockIndex = (int)lockWeightIndexes[index_lockIndex];
-                //#define DEBUG_MPI
-#ifdef DEBUG_MPI
-
-                std::cerr << "Unblocking. lockIndex: " << lockIndex << " | status.MPI_SOURCE: " << status.MPI_SOURCE << std::endl;
-#endif
-
-                mdJobList.getValue(MDL_ORDER, order_index, lockIndex);
-                mdJobList.getValue(MDL_REF3D, ref3d_index, lockIndex);
-                dAij(lockArray,order_index,ref3d_index)=false;
-                //dAij(weightArray,order_index,ref3d_index) += lockWeightIndexes[index_weight];
-                //dAij(weightArrays1,order_index,ref3d_index) += lockWeightIndexes[index_weights1];
-                //dAij(weightArrays2,order_index,ref3d_index) += lockWeightIndexes[index_weights2];
-
-                dAkij(weightArray,0,order_index,ref3d_index) += lockWeightIndexes[index_weight];
-                dAkij(weightArrays1,0,order_index,ref3d_index) += lockWeightIndexes[index_weights1];
-                dAkij(weightArrays2,0,order_index,ref3d_index) += lockWeightIndexes[index_weights2];
-                break;
-            default:
-                std::cerr << "WRONG TAG RECEIVED" << std::endl;
-                break;
-            }
-        }
+        MpiRmaTaskDistributor distributor(nClasses,
+                                          XMIPP_MIN(mpi_job_size, nClasses), node);
+        size_t first, last;
+        while (distributor.getTasks(first, last))
+            mpi_process_loop(first, last);
     }
-    else
-    {
-        bool whileLoop = true;
-        while (whileLoop)
-        {
-            //#define DEBUG_MPI
-#ifdef DEBUG_MPI
-            std::cerr << "[" << node->rank << "] Asking for a job " <<std::endl;
-#endif
-            //I am free
-            MPI_Send(0, 0, MPI_INT, 0, TAG_I_AM_FREE, MPI_COMM_WORLD);
-            //wait for message
-            MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
 
-            switch (status.MPI_TAG)
-            {
-            case TAG_STOP://I am free
-                MPI_Recv(0, 0, MPI_INT, 0, TAG_STOP,
-                         MPI_COMM_WORLD, &status);
-                whileLoop=false;
-                break;
-            case TAG_WORK://work to do
-                MPI_Recv(jobListRows, ArraySize * mpi_job_size + 1, MPI_DOUBLE, 0, TAG_WORK,
-                         MPI_COMM_WORLD, &status);
-                mpi_process_loop(jobListRows);
-                break;
-            default:
-                break;
-            }
-        }
-    }
+    // Only the node of each class has its weights
+    size_t nWeights = MULTIDIM_SIZE(weightArray);
+    double *weights[3] = {MULTIDIM_ARRAY(weightArray), MULTIDIM_ARRAY(weightArrays1),
+                          MULTIDIM_ARRAY(weightArrays2)};
+    for (int i = 0; i < 3; ++i)
+        MPI_Reduce(node->isMaster() ? MPI_IN_PLACE : weights[i], weights[i], nWeights,
+                   MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
     FileName gatherFile;
     formatStringFast( gatherFile, "%s_GatherMetadata.xmd", fn_out.c_str());
     node->gatherMetadatas(DFscore, gatherFile);
@@ -344,21 +219,27 @@ void MpiProgAngularClassAverage::run()
         fn = "all_exp_images@"+fn.removeBlockName();
         DFscore.write(fn);
         mpi_postprocess();
+        finalizeOutputFiles();
     }
 
     //    MPI_Finalize();
 }
 
 
-void MpiProgAngularClassAverage::mpi_process_loop(double * Def_3Dref_2Dref_JobNo)
+void MpiProgAngularClassAverage::mpi_process_loop(size_t first, size_t last)
 {
-    int size = ROUND(Def_3Dref_2Dref_JobNo[0]);
-
-    for(int i=0;i<size;i++)
+    for (size_t c = first; c <= last; c++)
     {
-        mpi_process(Def_3Dref_2Dref_JobNo+i*ArraySize+1);
+        if (fn_ctf != "")
+        {
+            wienAvg1.initialize(paddim);
+            wienAvg2.initialize(paddim);
+        }
+        for (size_t i = classJobs[c]; i < classJobs[c + 1]; i++)
+            mpi_process(&jobRows[i * ArraySize]);
+        if (fn_ctf != "")
+            writeWienerAverages(&jobRows[(classJobs[c + 1] - 1) * ArraySize]);
     }
-
 }
 
 void MpiProgAngularClassAverage::mpi_process(double * Def_3Dref_2Dref_JobNo)
@@ -383,11 +264,10 @@ void MpiProgAngularClassAverage::mpi_process(double * Def_3Dref_2Dref_JobNo)
     FileName fn_img, fn_tmp;
     MetaData SFclass, SFclass1, SFclass2;
     MetaData SFclassDiscarded;
-    double psi, xshift, yshift, w, w1, w2, scale;
-    bool mirror;
+    double w, w1, w2;
     int ref_number, this_image, ref3d, defGroup;
     static int defGroup_last = 0;
-    int isplit, lockIndex;
+    int isplit;
     MetaData _DF;
     size_t id;
     size_t order_number;
@@ -402,7 +282,6 @@ void MpiProgAngularClassAverage::mpi_process(double * Def_3Dref_2Dref_JobNo)
     defGroup     = ROUND(Def_3Dref_2Dref_JobNo[index_DefGroup]);
     ref3d        = ROUND(Def_3Dref_2Dref_JobNo[index_3DRef]);
     //std::cerr << "DEBUG_ROB: order_number: " << order_number << std::endl;
-    lockIndex    = ROUND(Def_3Dref_2Dref_JobNo[index_jobId]);
 
     if (fn_wien != "" && defGroup_last != defGroup)
     {
@@ -471,65 +350,38 @@ void MpiProgAngularClassAverage::mpi_process(double * Def_3Dref_2Dref_JobNo)
     pcaAnalyzerSplit2.clear();
 #endif
     // Loop over all images in the input docfile
+    classImgs.clear();
     FOR_ALL_OBJECTS_IN_METADATA(_DF)
     {
+        ClassAverageImage classImg;
         _DF.getValue(MDL_IMAGE, fn_img, __iter.objId);
         this_image++;
-        _DF.getValue(MDL_ANGLE_PSI, psi, __iter.objId);
-        _DF.getValue(MDL_SHIFT_X, xshift, __iter.objId);
-        _DF.getValue(MDL_SHIFT_Y, yshift, __iter.objId);
-        if (do_mirrors)
-            _DF.getValue(MDL_FLIP, mirror, __iter.objId);
-        _DF.getValue(MDL_SCALE, scale, __iter.objId);
-
-        img.read(fn_img);
-        img().setXmippOrigin();
-        img.setEulerAngles(0., 0., psi);
-        img.setShifts(-xshift, -yshift);
-
+        classImg.fn = fn_img;
+        _DF.getValue(MDL_ANGLE_PSI, classImg.psi, __iter.objId);
+        _DF.getValue(MDL_SHIFT_X, classImg.xshift, __iter.objId);
+        _DF.getValue(MDL_SHIFT_Y, classImg.yshift, __iter.objId);
+        classImg.mirror = false;
         if (do_mirrors)
-            img.setFlip(mirror);
-        img.setScale(scale);
+            _DF.getValue(MDL_FLIP, classImg.mirror, __iter.objId);
+        _DF.getValue(MDL_SCALE, classImg.scale, __iter.objId);
 
         if (do_split)
             isplit = ROUND(rnd_unif());
         else
             isplit = 0;
+        classImg.split = isplit;
+        classImgs.push_back(classImg);
+
         // For re-alignment of class: store all images in memory
         if (nr_iter > 0)
         {
-            exp_imgs.push_back(img);
             exp_number.push_back(this_image);
-        }
-
-        if ( (nr_iter > 0))
-#ifdef NEVERDEFINED
-|| do_pcaSorting)
-#endif
-		{
             exp_split.push_back(isplit);
         }
 
-        // Apply in-plane transformation
-        img.getTransformationMatrix(A);
-        if (!A.isIdentity())
-            selfApplyGeometry(BSPLINE3, img(), A, IS_INV, DONT_WRAP);
-
-        MultidimArray<float> auxImg(img().nzyxdim);
-        const MultidimArray<double> &mImg=img();
-        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mImg)
-        DIRECT_MULTIDIM_ELEM(auxImg,n)=(float)DIRECT_MULTIDIM_ELEM(mImg,n);
-
-#ifdef NEVERDEFINED
-        if (do_pcaSorting)
-        {
-            pcaAnalyzer.addVector(auxImg);
-        }
-#endif
         // Add to average
         if (isplit == 0)
         {
-            avg1() += img();
             w1 += 1.;
             id = SFclass1.addObject();
             SFclass1.setValue(MDL_IMAGE, fn_img, id);
@@ -539,16 +391,9 @@ void MpiProgAngularClassAverage::mpi_process(double * Def_3Dref_2Dref_JobNo)
             SFclass1.setValue(MDL_REF3D, ref3d, id);
             SFclass1.setValue(MDL_DEFGROUP, defGroup, id);
             SFclass1.setValue(MDL_ORDER, order_number, id);
-#ifdef NEVERDEFINED
-            if (do_pcaSorting)
-            {
-                pcaAnalyzerSplit1.addVector(auxImg);
-            }
-#endif
         }
         else
         {
-            avg2() += img();
             w2 += 1.;
             id = SFclass2.addObject();
             SFclass2.setValue(MDL_IMAGE, fn_img, id);
@@ -558,38 +403,15 @@ void MpiProgAngularClassAverage::mpi_process(double * Def_3Dref_2Dref_JobNo)
             SFclass2.setValue(MDL_REF3D, ref3d, id);
             SFclass2.setValue(MDL_DEFGROUP, defGroup, id);
             SFclass2.setValue(MDL_ORDER, order_number, id);
-#ifdef NEVERDEFINED
-            if (do_pcaSorting)
-            {
-                pcaAnalyzerSplit2.addVector(auxImg);
-            }
-#endif
-        }
-
-        //#define DEBUG
-#ifdef DEBUG
-        //WRITE IMAGES TO AVERAGE
-        FileName fn_tmp1;
-        int static static_i=0;
-        static_i++;
-        formatStringFast(fn_tmp1, "test_img_%06d.spi", static_i);
-        img.write(fn_tmp1);
-        formatStringFast(fn_tmp1, "test_avg_%06d.spi", static_i);
-        avg1.write(fn_tmp1);
-        std::cout << fn_img
-        << psi
-        << A <<std::endl;
-        if (static_i> 25)
-        {
-            std::cerr << "static_i:" << static_i << std::endl;
-            _DF.write("DF.xmd");
-            exit(1);
         }
-#endif
-#undef DEBUG
-
     }
 
+    // Read, align and add the images with all threads
+    if (nr_iter > 0)
+        exp_imgs.resize(classImgs.size());
+    classExpImgs = (nr_iter > 0) ? &exp_imgs : NULL;
+    averageClassImages(avg1(), avg2());
+
     //this_image = 0;
 #ifdef NEVERDEFINED
     if (do_pcaSorting)
@@ -784,6 +606,23 @@ void MpiProgAngularClassAverage::mpi_process(double * Def_3Dref_2Dref_JobNo)
         if (w2 > 0)
             applyWienerFilter(avg2());
     }
+    else if (fn_ctf != "")
+    {
+        // The class is Wiener filtered once all its defocus groups are added
+        if (ctfGroupLast != defGroup)
+        {
+            FileName fn_ctfGroup;
+            Image<double> auxImg;
+            fn_ctfGroup.compose(defGroup, fn_ctf);
+            auxImg.read(fn_ctfGroup);
+            Mctf = auxImg();
+            ctfGroupLast = defGroup;
+        }
+        if (w1 > 0)
+            wienAvg1.add(avg1(), w1, Mctf);
+        if (w2 > 0)
+            wienAvg2.add(avg2(), w2, Mctf);
+    }
 
     // Output total and split averages and selfiles to disc
     SFclass = SFclass1;
@@ -846,7 +685,7 @@ void MpiProgAngularClassAverage::mpi_process(double * Def_3Dref_2Dref_JobNo)
     //TODO ROB may I drop DFSCOre
     DFscore.unionAll(_DF);
     mpi_writeController(order_number, avg, avg1, avg2, SFclass, SFclass1, SFclass2,
-                        SFclassDiscarded,_DF, w1, w2, w, lockIndex);
+                        SFclassDiscarded,_DF, w1, w2, w, ref3d);
 
 }
 
@@ -870,20 +709,20 @@ void MpiProgAngularClassAverage::mpi_write(
 {
     FileName fileNameXmd, fileNameStk;
 
-    formatStringFast(fileNameStk, "%s_Ref3D_%03lu.stk", fn_out.c_str(), ref3dIndex);
+    formatStringFast(fileNameStk, "%s_Ref3D_%03d.stk", fn_out.c_str(), ref3dIndex);
     mpi_writeFile(avg, dirno, fileNameStk, old_w);
 
     if (do_split)
     {
         if (w1 > 0)
         {
-            formatStringFast(fileNameStk, "%s_Ref3D_%03lu.stk",
+            formatStringFast(fileNameStk, "%s_Ref3D_%03d.stk",
                              fn_out1.c_str(), ref3dIndex);
             mpi_writeFile(avg1, dirno, fileNameStk, old_w1);
         }
         if (w2 > 0)
         {
-            formatStringFast(fileNameStk, "%s_Ref3D_%03lu.stk",
+            formatStringFast(fileNameStk, "%s_Ref3D_%03d.stk",
                              fn_out2.c_str(), ref3dIndex);
             mpi_writeFile(avg2, dirno, fileNameStk, old_w2);
         }
@@ -904,68 +743,19 @@ void MpiProgAngularClassAverage::mpi_writeController(
     double w1,
     double w2,
     double w,
-    int lockIndex)
+    int ref3dIndex)
 {
+    // This node is the only one averaging this class
+    double &weight_old   = dAkij(weightArray,0,dirno,ref3dIndex);
+    double &weights1_old = dAkij(weightArrays1,0,dirno,ref3dIndex);
+    double &weights2_old = dAkij(weightArrays2,0,dirno,ref3dIndex);
 
-    double weight_old, weights1_old, weights2_old;
-    double lockWeightIndexes[lockWeightIndexesSize];
-    int ref3dIndex;
-    bool whileLoop = true;
-    while (whileLoop)
-    {
-#ifdef DEBUG_MPI
-        std::cerr << "[" << node->rank << "] May I write. lockIndex: " << lockIndex <<std::endl;
-#endif
-
-        MPI_Send(&lockIndex, 1, MPI_INT, 0, TAG_MAY_I_WRITE, MPI_COMM_WORLD);
-        MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
-        switch (status.MPI_TAG)
-        {
-        case TAG_DO_NOT_DARE_TO_WRITE://I am free
-            MPI_Recv(0, 0, MPI_INT, 0, MPI_ANY_TAG,
-                     MPI_COMM_WORLD, &status);
-            //usleep(100000);//microsecond
-            break;
-        case TAG_YES_YOU_MAY_WRITE://I am free
-
-            MPI_Recv(lockWeightIndexes, lockWeightIndexesSize, MPI_DOUBLE, 0, MPI_ANY_TAG,
-                     MPI_COMM_WORLD, &status);
-
-            lockIndex = ROUND(lockWeightIndexes[index_lockIndex]);
-
-#ifdef DEBUG_MPI
-
-            std::cerr << "[" << node->rank << "] TAG_YES_YOU_MAY_WRITE.lockIndex: " << lockIndex <<std::endl;
-            std::cerr <<  "lockWeightIndexes[index_weight]" << lockWeightIndexes[index_weight]<<std::endl;
-#endif
-
-            weight_old   = lockWeightIndexes[index_weight];
-            weights1_old = lockWeightIndexes[index_weights1];
-            weights2_old = lockWeightIndexes[index_weights2];
-            ref3dIndex = ROUND(lockWeightIndexes[index_ref3d]);
-
-            mpi_write(dirno, ref3dIndex, avg, avg1, avg2, SFclass, SFclass1, SFclass2,
-                      SFclassDiscarded, w1, w2, weight_old, weights1_old, weights2_old);
-            whileLoop=false;
-            break;
-        default:
-            std::cerr << "process WRONG TAG RECEIVED at " << node->rank << std::endl;
-            break;
-        }
-    }
-#ifdef DEBUG_MPI
-    std::cerr << "[" << node->rank << "] Finish writer " <<std::endl;
-#endif
-
-    lockWeightIndexes[index_lockIndex] = lockIndex;
-    //lockWeightIndexes[index_weight]= w1 + w2;
-    lockWeightIndexes[index_weight]=    w;
-    lockWeightIndexes[index_weights1] = w1;
-    lockWeightIndexes[index_weights2] = w2;
-    lockWeightIndexes[index_ref3d] = ref3dIndex;
-
-    MPI_Send(lockWeightIndexes, lockWeightIndexesSize, MPI_DOUBLE, 0, TAG_I_FINISH_WRITTING, MPI_COMM_WORLD);
+    mpi_write(dirno, ref3dIndex, avg, avg1, avg2, SFclass, SFclass1, SFclass2,
+              SFclassDiscarded, w1, w2, weight_old, weights1_old, weights2_old);
 
+    weight_old   += w;
+    weights1_old += w1;
+    weights2_old += w2;
 }
 
 
@@ -975,47 +765,59 @@ void MpiProgAngularClassAverage::mpi_writeFile(
     FileName fileNameStk,
     double w_old)
 {
-    FileName fn_tmp;
     double w = avg.weight();
-    Image<double> old;
 
     if (w > 0.)
     {
-        if (fileNameStk.exists())
+        PreallocatedStack stack;
+        stack.open(fileNameStk);
+        if (w_old > 0.)
         {
-
-            //std::cerr << "DEBUG_JM: Composing"     << std::endl;
-            //std::cerr << "DEBUG_JM: dirno: "       << dirno << std::endl;
-            //std::cerr << "DEBUG_JM: fileNameStk: " << fileNameStk << std::endl;
-            fn_tmp.compose(dirno, fileNameStk);
-            //std::cerr << "DEBUG_JM: fn_tmp: "      << fn_tmp << std::endl;
-            old.read(fn_tmp);
-
-            //w_old = old.weight();
-            //std::cerr << "DEBUG_JM: SECOND Imagew dirno old  new master branch: " <<  fn_tmp << " " << dirno << " "
-            //                                      <<  w_old << " "
-            //                                      << w << " "
-            //                                      << std::endl;
+            Image<double> old;
+            stack.read(old, dirno);
             FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(old())
             {
                 dAij(old(),i,j) = (w_old * dAij(old(),i,j) + dAij(avg(),i,j)) / (w_old + w);
             }
             old.setWeight(w_old + w);
-            old.write(fileNameStk, dirno, true, WRITE_REPLACE);
+            stack.write(old, dirno);
         }
         else
         {
-            //std::cerr << "DEBUG_JM: FIRST Imagew dirno old  new master branch: " <<  fn_tmp << " " << dirno << " "
-            //                                      <<  w_old << " "
-            //                                      << w << " "
-            //                                      << std::endl;
             if (w != 1.)
                 avg() /= w;
-            avg.write(fileNameStk, dirno, true, WRITE_REPLACE);
+            stack.write(avg, dirno);
         }
     }
 }
 
+void MpiProgAngularClassAverage::writeWienerAverages(double * Def_3Dref_2Dref_JobNo)
+{
+    size_t dirno = ROUND(Def_3Dref_2Dref_JobNo[index_Order]);
+    int ref3d = ROUND(Def_3Dref_2Dref_JobNo[index_3DRef]);
+    CTFWienerAccumulator *wiens[3] = {&wienAvg1, &wienAvg2, NULL};
+    CTFWienerAccumulator wienAvg;
+    wienAvg.initialize(paddim);
+    wienAvg.add(wienAvg1);
+    wienAvg.add(wienAvg2);
+    wiens[2] = &wienAvg;
+    FileName *roots[3] = {&fn_out1, &fn_out2, &fn_out};
+
+    // The partial averages written by mpi_writeFile keep their headers
+    FileName fileNameStk;
+    Image<double> avg;
+    for (int k = 0; k < 3; k++)
+    {
+        if ((k < 2 && !do_split) || wiens[k]->weight <= 0)
+            continue;
+        formatStringFast(fileNameStk, "%s_Ref3D_%03d.stk", roots[k]->c_str(), ref3d);
+        PreallocatedStack stack;
+        stack.open(fileNameStk);
+        stack.read(avg, dirno);
+        wiens[k]->getAverage(wiener_constant, Xdim, avg());
+        stack.write(avg, dirno);
+    }
+}
 
 void MpiProgAngularClassAverage::mpi_produceSideInfo()
 {
@@ -1054,6 +856,11 @@ void MpiProgAngularClassAverage::mpi_produceSideInfo()
         Ri = 1;
     if (Ro < 0)
         Ro = (Xdim / 2) - 1;
+
+    // Fourier space averaging is only implemented for square images
+    if (Xdim != Ydim)
+        do_real_space = true;
+    thMgr = new ThreadManager(nThreads, this);
 }
 
 void MpiProgAngularClassAverage::mpi_preprocess()
@@ -1067,7 +874,10 @@ void MpiProgAngularClassAverage::mpi_preprocess()
     MPI_Bcast(&master_seed,1,MPI_UNSIGNED ,0,MPI_COMM_WORLD);
     init_random_generator(master_seed);
 
-    filterInputMetadata();
+    // The master filters the input metadata and sends it to the workers
+    if (node->rank==0)
+        filterInputMetadata();
+    node->broadcastMetadata(DF);
 
     if (node->rank==0)
     {
@@ -1077,8 +887,6 @@ void MpiProgAngularClassAverage::mpi_preprocess()
         createJobList();
         //std::cerr << "DEBUG_JM: initDimentions" <<std::endl;
         initDimentions();
-        //std::cerr << "DEBUG_JM: initWeights" <<std::endl;
-        initWeights();
         //std::cerr << "DEBUG_JM: initOutputFiles" <<std::endl;
         initOutputFiles();
     }
@@ -1088,9 +896,14 @@ void MpiProgAngularClassAverage::mpi_preprocess()
     MPI_Bcast(&Zdim,1,XMIPP_MPI_SIZE_T,0,MPI_COMM_WORLD);
     MPI_Bcast(&Ndim,1,XMIPP_MPI_SIZE_T,0,MPI_COMM_WORLD);
     MPI_Bcast(&numberOfJobs,1,XMIPP_MPI_SIZE_T,0,MPI_COMM_WORLD);
-    MPI_Bcast(&ref3dNum,1,XMIPP_MPI_SIZE_T,0,MPI_COMM_WORLD);
+    MPI_Bcast(&ref3dNum,1,MPI_INT,0,MPI_COMM_WORLD);
     MPI_Bcast(&ctfNum,1,MPI_INT,0,MPI_COMM_WORLD);
     MPI_Bcast(&paddim,1,XMIPP_MPI_SIZE_T,0,MPI_COMM_WORLD);
+    jobRows.resize(numberOfJobs * ArraySize);
+    if (!jobRows.empty())
+        MPI_Bcast(&jobRows[0],jobRows.size(),MPI_DOUBLE,0,MPI_COMM_WORLD);
+    initClassJobs();
+    initWeights();
 
     mpi_produceSideInfo();
 
@@ -1301,11 +1114,11 @@ void MpiProgAngularClassAverage::initDimentions()
     mdJobList.aggregateSingleInt(mdValueOut3, AGGR_MAX ,MDL_REF3D);
     mdValueOut3.getValue(ref3dNum);
 
-    //Check Wiener filter image has correct size
-    if (fn_wien != "")
+    //Check Wiener filter or CTF images have correct size
+    if (fn_wien != "" || fn_ctf != "")
     {
         size_t x,y,z, n;
-        getImageSize(fn_wien,x,y,z,n);
+        getImageSize(fn_wien != "" ? fn_wien : fn_ctf,x,y,z,n);
 
         // Get and check padding dimensions
         paddim = ROUND(pad * Xdim);
@@ -1318,7 +1131,6 @@ void MpiProgAngularClassAverage::initDimentions()
 
 void MpiProgAngularClassAverage::initWeights()
 {
-    lockArray.initZeros(Ndim+1,ref3dNum+1);//this should be 3D or 2D is enought ROB
     weightArray.initZeros(ctfNum+1,Ndim+1,ref3dNum+1);
     weightArrays1.initZeros(ctfNum+1,Ndim+1,ref3dNum+1);
     weightArrays2.initZeros(ctfNum+1,Ndim+1,ref3dNum+1);
@@ -1330,24 +1142,21 @@ void MpiProgAngularClassAverage::initOutputFiles()
     //alloc space for output files
     FileName fn_tmp;
 
-    for (int i = 1; i <= ref3dNum; i++)
+    for (size_t i = 1; i <= (size_t)ref3dNum; i++)
     {
         formatStringFast(fn_tmp, "_Ref3D_%03lu", i);
 
         unlink((fn_out + fn_tmp + ".xmd").c_str());
         unlink((fn_out + fn_tmp + ".stk").c_str());
-        createEmptyFile(fn_out + fn_tmp + ".stk", Xdim, Ydim, Zdim, Ndim, true,
-                        WRITE_OVERWRITE);
+        PreallocatedStack::create(fn_out + fn_tmp + ".stk", Xdim, Ydim, Zdim, Ndim);
         if (do_split)
         {
             unlink((fn_out1 + fn_tmp + ".xmd").c_str());
             unlink((fn_out1 + fn_tmp + ".stk").c_str());
-            createEmptyFile(fn_out1 + fn_tmp + ".stk", Xdim, Ydim, Zdim, Ndim,
-                            true, WRITE_OVERWRITE);
+            PreallocatedStack::create(fn_out1 + fn_tmp + ".stk", Xdim, Ydim, Zdim, Ndim);
             unlink((fn_out2 + fn_tmp + ".xmd").c_str());
             unlink((fn_out2 + fn_tmp + ".stk").c_str());
-            createEmptyFile(fn_out2 + fn_tmp + ".stk", Xdim, Ydim, Zdim, Ndim,
-                            true, WRITE_OVERWRITE);
+            PreallocatedStack::create(fn_out2 + fn_tmp + ".stk", Xdim, Ydim, Zdim, Ndim);
         }
         unlink((fn_out + fn_tmp + "_discarded.xmd").c_str());
     }
@@ -1355,6 +1164,28 @@ void MpiProgAngularClassAverage::initOutputFiles()
 }
 
 
+void MpiProgAngularClassAverage::finalizeOutputFiles()
+{
+    FileName fn_tmp;
+    PreallocatedStack stack;
+
+    for (size_t i = 1; i <= (size_t)ref3dNum; i++)
+    {
+        formatStringFast(fn_tmp, "_Ref3D_%03lu.stk", i);
+        stack.open(fn_out + fn_tmp);
+        stack.finalize();
+        if (do_split)
+        {
+            stack.open(fn_out1 + fn_tmp);
+            stack.finalize();
+            stack.open(fn_out2 + fn_tmp);
+            stack.finalize();
+        }
+    }
+    stack.close();
+}
+
+
 void MpiProgAngularClassAverage::mpi_postprocess()
 {
     // Write class selfile to disc (even if its empty)
@@ -1381,7 +1212,7 @@ void MpiProgAngularClassAverage::mpi_postprocess()
         auxMd2.clear();
 
         formatStringFast(fileNameXmd,
-                         "Ref3D_%03lu@%s_Ref3D_%03lu.xmd", i, fn_out.c_str(), i);
+                         "Ref3D_%03d@%s_Ref3D_%03d.xmd", i, fn_out.c_str(), i);
 
 
 
@@ -1401,7 +1232,7 @@ void MpiProgAngularClassAverage::mpi_postprocess()
         FOR_ALL_OBJECTS_IN_METADATA(auxMd2)
         {
             auxMd2.getValue(MDL_ORDER, order_number,__iter.objId);
-            formatStringFast(imageName, "%06lu@%s_Ref3D_%03lu.stk", order_number,  fn_out.c_str(), i);
+            formatStringFast(imageName, "%06lu@%s_Ref3D_%03d.stk", order_number,  fn_out.c_str(), i);
             auxMd2.setValue(MDL_IMAGE, imageName,__iter.objId);
             weights = 0.;
             weights += dAkij(weightArray,0,order_number, i);
@@ -1445,10 +1276,10 @@ void MpiProgAngularClassAverage::mpi_postprocess()
             MetaData auxMds2(auxMd2);
 
             formatStringFast(fileNameXmds1,
-                             "Ref3D_%03lu@%s_Ref3D_%03lu.xmd", i, fn_out1.c_str(), i);
+                             "Ref3D_%03d@%s_Ref3D_%03d.xmd", i, fn_out1.c_str(), i);
 
             formatStringFast(fileNameXmds2,
-                             "Ref3D_%03lu@%s_Ref3D_%03lu.xmd", i, fn_out2.c_str(), i);
+                             "Ref3D_%03d@%s_Ref3D_%03d.xmd", i, fn_out2.c_str(), i);
 
             FOR_ALL_OBJECTS_IN_METADATA2(auxMds1, auxMds2)
             {
@@ -1470,7 +1301,7 @@ void MpiProgAngularClassAverage::mpi_postprocess()
                 else
                 {
                     auxMds1.setValue(MDL_WEIGHT, weights1,__iter.objId);
-                    formatStringFast(imageName, "%06lu@%s_Ref3D_%03lu.stk", order_number,  fn_out1.c_str(), i);
+                    formatStringFast(imageName, "%06lu@%s_Ref3D_%03d.stk", order_number,  fn_out1.c_str(), i);
                     auxMds1.setValue(MDL_IMAGE, imageName,__iter.objId);
                 }
 
@@ -1480,7 +1311,7 @@ void MpiProgAngularClassAverage::mpi_postprocess()
                 else
                 {
                     auxMds2.setValue(MDL_WEIGHT, weights2,__iter2.objId);
-                    formatStringFast(imageName, "%06lu@%s_Ref3D_%03lu.stk", order_number,  fn_out2.c_str(), i);
+                    formatStringFast(imageName, "%06lu@%s_Ref3D_%03d.stk", order_number,  fn_out2.c_str(), i);
                     auxMds2.setValue(MDL_IMAGE, imageName,__iter2.objId);
                 }
 
@@ -1494,6 +1325,24 @@ void MpiProgAngularClassAverage::mpi_postprocess()
     }
 }
 
+/* Order of the jobs by 3D reference and projection direction, and by
+ * defocus group inside each class so that its Wiener filter is read once */
+struct JobClassLess
+{
+    const double *rows;
+    JobClassLess(const double *_rows): rows(_rows)
+    {}
+    bool operator()(size_t a, size_t b) const
+    {
+        const double *rowA = rows + a * ArraySize, *rowB = rows + b * ArraySize;
+        if (rowA[index_3DRef] != rowB[index_3DRef])
+            return rowA[index_3DRef] < rowB[index_3DRef];
+        if (rowA[index_Order] != rowB[index_Order])
+            return rowA[index_Order] < rowB[index_Order];
+        return rowA[index_DefGroup] < rowB[index_DefGroup];
+    }
+};
+
 void MpiProgAngularClassAverage::createJobList()
 {
     const MDLabel myGroupByLabels[] =
@@ -1510,6 +1359,54 @@ void MpiProgAngularClassAverage::createJobList()
 #undef DEBUG
 
     numberOfJobs = mdJobList.size();
+
+    // Pack the jobs for all the nodes:
+    // defocus, 3D reference, projection direction and job number
+    jobRows.resize(numberOfJobs * ArraySize);
+    size_t order, count;
+    int ctfGroup, ref3d, ref2d;
+    double *row = &jobRows[0];
+    FOR_ALL_OBJECTS_IN_METADATA(mdJobList)
+    {
+        mdJobList.getValue(MDL_REF3D, ref3d, __iter.objId);
+        row[index_3DRef] = (double) ref3d;
+        mdJobList.getValue(MDL_DEFGROUP, ctfGroup, __iter.objId);
+        row[index_DefGroup] = (double) ctfGroup;
+        mdJobList.getValue(MDL_ORDER, order, __iter.objId);
+        row[index_Order] = (double) order;
+        mdJobList.getValue(MDL_COUNT, count, __iter.objId);
+        row[index_Count] = (double) count;
+        mdJobList.getValue(MDL_REF, ref2d, __iter.objId);
+        row[index_2DRef] = (double) ref2d;
+        row[index_jobId] = (double) __iter.objId;
+        mdJobList.getValue(MDL_ANGLE_ROT, row[index_Rot], __iter.objId);
+        mdJobList.getValue(MDL_ANGLE_TILT, row[index_Tilt], __iter.objId);
+        row += ArraySize;
+    }
+
+    // Jobs of the same class together
+    std::vector<size_t> idx(numberOfJobs);
+    for (size_t i = 0; i < numberOfJobs; ++i)
+        idx[i] = i;
+    std::stable_sort(idx.begin(), idx.end(), JobClassLess(&jobRows[0]));
+    std::vector<double> sortedRows(jobRows.size());
+    for (size_t i = 0; i < numberOfJobs; ++i)
+        memcpy(&sortedRows[i * ArraySize], &jobRows[idx[i] * ArraySize],
+               ArraySize * sizeof(double));
+    jobRows.swap(sortedRows);
+}
+
+void MpiProgAngularClassAverage::initClassJobs()
+{
+    classJobs.clear();
+    for (size_t i = 0; i < numberOfJobs; ++i)
+    {
+        const double *row = &jobRows[i * ArraySize];
+        if (i == 0 || row[index_3DRef] != row[index_3DRef - ArraySize] ||
+            row[index_Order] != row[index_Order - ArraySize])
+            classJobs.push_back(i);
+    }
+    classJobs.push_back(numberOfJobs);
 }
 
 
@@ -1704,3 +1601,160 @@ void MpiProgAngularClassAverage::applyWienerFilter(MultidimArray<double> &img)
     }
 }
 
+void MpiProgAngularClassAverage::readClassImage(size_t n, Image<double> &img)
+{
+    const ClassAverageImage &classImg = classImgs[n];
+    img.read(classImg.fn);
+    img().setXmippOrigin();
+    img.setEulerAngles(0., 0., classImg.psi);
+    img.setShifts(-classImg.xshift, -classImg.yshift);
+    if (do_mirrors)
+        img.setFlip(classImg.mirror);
+    img.setScale(classImg.scale);
+}
+
+void MpiProgAngularClassAverage::averageClassImages(MultidimArray<double> &avg1,
+        MultidimArray<double> &avg2)
+{
+    if (classImgs.empty())
+        return;
+
+    // Per thread accumulators, so that threads never wait for each other
+    if (do_real_space)
+    {
+        threadAvg1.resize(nThreads);
+        threadAvg2.resize(nThreads);
+        for (int t = 0; t < nThreads; t++)
+        {
+            threadAvg1[t].initZeros(Ydim, Xdim);
+            threadAvg1[t].setXmippOrigin();
+            threadAvg2[t].initZeros(threadAvg1[t]);
+        }
+    }
+    else
+    {
+        threadFavg1.resize(nThreads);
+        threadFavg2.resize(nThreads);
+        for (int t = 0; t < nThreads; t++)
+        {
+            threadFavg1[t].initZeros(Ydim, Xdim / 2 + 1);
+            threadFavg2[t].initZeros(threadFavg1[t]);
+        }
+    }
+
+    classTd = new ThreadTaskDistributor(classImgs.size(), 1);
+    thMgr->run(threadClassAverage);
+    delete classTd;
+    classTd = NULL;
+
+    // Reduce the accumulators
+    if (do_real_space)
+    {
+        for (int t = 0; t < nThreads; t++)
+        {
+            avg1 += threadAvg1[t];
+            avg2 += threadAvg2[t];
+        }
+    }
+    else
+    {
+        for (int t = 1; t < nThreads; t++)
+        {
+            threadFavg1[0] += threadFavg1[t];
+            threadFavg2[0] += threadFavg2[t];
+        }
+        MultidimArray<double> Maux;
+        fourierAverageToImage(threadFavg1[0], Maux);
+        avg1 += Maux;
+        fourierAverageToImage(threadFavg2[0], Maux);
+        avg2 += Maux;
+    }
+}
+
+void MpiProgAngularClassAverage::addToFourierAverage(MultidimArray<double> &img,
+        const Matrix2D<double> &A, MultidimArray< std::complex<double> > &Favg,
+        FourierTransformer &transformer, MultidimArray<double> &Mpad)
+{
+    // Transform of the padded image with the phase origin at its center
+    int pdim = FOURIER_AVERAGE_PAD * Xdim;
+    img.window(Mpad, FIRST_XMIPP_INDEX(pdim), FIRST_XMIPP_INDEX(pdim),
+               LAST_XMIPP_INDEX(pdim), LAST_XMIPP_INDEX(pdim));
+    CenterFFT(Mpad, false);
+    MultidimArray< std::complex<double> > Fpad;
+    transformer.FourierTransform(Mpad, Fpad, false);
+
+    // If out(r)=in(M r+t) then Out(k)=exp(2 pi i q.t/N) In(q)/|det M|,
+    // with q=M^-t k. The padded transform is sampled at FOURIER_AVERAGE_PAD*q
+    // and its normalization is compensated.
+    double a00 = MAT_ELEM(A, 0, 0), a01 = MAT_ELEM(A, 0, 1);
+    double a10 = MAT_ELEM(A, 1, 0), a11 = MAT_ELEM(A, 1, 1);
+    double det = a00 * a11 - a01 * a10;
+    double tx = MAT_ELEM(A, 0, 2), ty = MAT_ELEM(A, 1, 2);
+    double m00 = a11 / det, m01 = -a10 / det;
+    double m10 = -a01 / det, m11 = a00 / det;
+    double K = FOURIER_AVERAGE_PAD * FOURIER_AVERAGE_PAD / fabs(det);
+    double iXdim = 1.0 / Xdim;
+    for (size_t i = 0; i < YSIZE(Favg); i++)
+    {
+        int ky = (i <= Ydim / 2) ? i : (int)i - (int)Ydim;
+        for (size_t j = 0; j < XSIZE(Favg); j++)
+        {
+            int kx = j;
+            double qx = m00 * kx + m01 * ky;
+            double qy = m10 * kx + m11 * ky;
+            std::complex<double> val = interpolatedHalfFourierValue(Fpad, pdim,
+                                       FOURIER_AVERAGE_PAD * qx, FOURIER_AVERAGE_PAD * qy);
+            double s, c;
+            sincos(2 * PI * (qx * tx + qy * ty) * iXdim, &s, &c);
+            DIRECT_A2D_ELEM(Favg, i, j) += K * val * std::complex<double>(c, s);
+        }
+    }
+}
+
+void MpiProgAngularClassAverage::fourierAverageToImage(MultidimArray< std::complex<double> > &Favg,
+        MultidimArray<double> &avg)
+{
+    FourierTransformer transformer;
+    avg.initZeros(Ydim, Xdim);
+    transformer.setReal(avg);
+    transformer.setFourier(Favg);
+    transformer.inverseFourierTransform();
+    CenterFFT(avg, true);
+    avg.setXmippOrigin();
+}
+
+void threadClassAverage(ThreadArgument &thArg)
+{
+    MpiProgAngularClassAverage *self = (MpiProgAngularClassAverage *) thArg.workClass;
+    int id = thArg.thread_id;
+    Image<double> img;
+    Matrix2D<double> A(3, 3);
+    FourierTransformer transformer;
+    MultidimArray<double> Mpad;
+
+    size_t first, last;
+    while (self->classTd->getTasks(first, last))
+        for (size_t n = first; n <= last; n++)
+        {
+            self->readClassImage(n, img);
+            if (self->classExpImgs != NULL)
+                (*self->classExpImgs)[n] = img;
+
+            // Apply in-plane transformation and add to the average
+            bool split = (self->classImgs[n].split != 0);
+            img.getTransformationMatrix(A);
+            if (self->do_real_space)
+            {
+                if (!A.isIdentity())
+                    selfApplyGeometry(BSPLINE3, img(), A, IS_INV, DONT_WRAP);
+                if (split)
+                    self->threadAvg2[id] += img();
+                else
+                    self->threadAvg1[id] += img();
+            }
+            else
+                self->addToFourierAverage(img(), A,
+                                          split ? self->threadFavg2[id] : self->threadFavg1[id],
+                                          transformer, Mpad);
+        }
+}
@@ -35,27 +35,13 @@
 #include <data/xmipp_fftw.h>
 #include <data/args.h>
 #include <data/xmipp_image.h>
+#include <data/xmipp_image_stack.h>
 #include <data/filters.h>
 #include <data/mask.h>
 #include <data/polar.h>
 #include <data/basic_pca.h>
 #include <data/sampling.h>
-
-//Tags already defined in xmipp
-//#define TAG_WORK                     0
-//#define TAG_STOP                     1
-#define TAG_I_FINISH_WRITTING        12
-#define TAG_MAY_I_WRITE              13
-#define TAG_YES_YOU_MAY_WRITE        14
-#define TAG_DO_NOT_DARE_TO_WRITE     15
-#define TAG_I_AM_FREE                16
-
-#define lockWeightIndexesSize 5
-#define index_lockIndex 0
-#define index_weight 1
-#define index_weights1 2
-#define index_weights2 3
-#define index_ref3d 4
+#include <data/ctf.h>
 
 #define ArraySize 8
 #define index_DefGroup 0
@@ -73,6 +59,18 @@
 #define split1 1
 #define split2 2
 
+/** Padding factor of the images averaged in Fourier space */
+#define FOURIER_AVERAGE_PAD 2
+
+/** Image to be added to a class average */
+struct ClassAverageImage
+{
+    FileName fn;
+    double psi, xshift, yshift, scale;
+    bool mirror;
+    int split;
+};
+
 class MpiProgAngularClassAverage : public XmippMpiProgram
 {
 public:
@@ -88,6 +86,10 @@ public:
     MetaData         DFclassesExp;
     /** Output rootnames */
     FileName         fn_out, fn_out1, fn_out2, fn_wien, fn_ref;
+    /** CTFs of the defocus groups (Wiener filtering of whole classes) */
+    FileName         fn_ctf;
+    /** Wiener constant for the CTFs of the defocus groups */
+    double           wiener_constant;
     /** Column numbers */
     std::string      col_select;
     /** Upper and lower absolute and relative selection limits */
@@ -112,6 +114,12 @@ public:
     bool             do_pcaSorting;
     /** Wiener filter image */
     MultidimArray<double> Mwien;
+    /** CTF image of the current defocus group */
+    MultidimArray<double> Mctf;
+    /** Defocus group of Mctf */
+    int ctfGroupLast;
+    /** CTF weighted accumulators of the current class for both halves */
+    CTFWienerAccumulator wienAvg1, wienAvg2;
     /** Selfiles containing all class averages */
     MetaData         SFclasses, SFclasses1, SFclasses2;
 
@@ -143,17 +151,39 @@ public:
 
     /** Divide the job in this number block with this number of images */
     size_t mpi_job_size;
+    /** Jobs packed in rows of ArraySize values (see createJobList) */
+    std::vector<double> jobRows;
+    /** First job of each class (and numberOfJobs at the end) */
+    std::vector<size_t> classJobs;
 
-    //Lock structure
-    MultidimArray<bool> lockArray;
+    //Weights of the class averages
     MultidimArray<double> weightArray;
     MultidimArray<double> weightArrays1;
     MultidimArray<double> weightArrays2;
 
+    /** Average the images in real space instead of Fourier space */
+    bool do_real_space;
+    /** Number of threads to average each class */
+    int nThreads;
+    /** Thread manager */
+    ThreadManager *thMgr;
+    /** Distributor of the images of the current class among threads */
+    ThreadTaskDistributor *classTd;
+    /** Images of the current class */
+    std::vector<ClassAverageImage> classImgs;
+    /** Images of the current class kept for re-alignment (NULL if not needed) */
+    std::vector<Image<double> > *classExpImgs;
+    /** Real space accumulators of each thread for both halves */
+    std::vector< MultidimArray<double> > threadAvg1, threadAvg2;
+    /** Fourier accumulators of each thread for both halves */
+    std::vector< MultidimArray< std::complex<double> > > threadFavg1, threadFavg2;
+
     MpiProgAngularClassAverage();
 
     MpiProgAngularClassAverage(int argc, char **argv);
 
+    ~MpiProgAngularClassAverage();
+
     /** Redefine read */
 //    void read(int argc, char** argv);
 
@@ -163,14 +193,19 @@ public:
 
     void run();
 
-    /** Process a job list (ref3d - ctfGroup - ref2d)
+    /** Process the jobs of the classes from first to last (ref3d - ctfGroup - ref2d)
          */
-    void mpi_process_loop(double * Def_3Dref_2Dref_JobNo);
+    void mpi_process_loop(size_t first, size_t last);
 
     /** Process a single job (ref3d - ctfGroup - ref2d)
          */
     void mpi_process(double * Def_3Dref_2Dref_JobNo);
 
+    /** Replace the averages of a class by its Wiener average with the CTFs
+        of all its defocus groups (only with --ctf)
+         */
+    void writeWienerAverages(double * Def_3Dref_2Dref_JobNo);
+
     /** Initialize
          */
     void mpi_produceSideInfo();
@@ -203,6 +238,10 @@ public:
          */
     void initOutputFiles();
 
+    /** Write the statistics of the output stacks.
+         */
+    void finalizeOutputFiles();
+
     /**
          */
     void mpi_postprocess();
@@ -211,6 +250,10 @@ public:
              */
     void createJobList();
 
+    /** Find the first job of each class in jobRows
+             */
+    void initClassJobs();
+
     /** Write output files
          */
     void mpi_write(
@@ -229,7 +272,7 @@ public:
         double old_w1,
         double old_w2);
 
-    /** Block output file to avoid concurrent writing
+    /** Write the averages of a class and update its weights
          */
     void mpi_writeController(
             size_t dirno,
@@ -244,7 +287,7 @@ public:
             double w1,
             double w2,
 	    double w,
-            int lockIndex);
+            int ref3dIndex);
 
     /** Called by mpi_write does the actual writing
          */
@@ -280,8 +323,33 @@ public:
          */
     void applyWienerFilter(MultidimArray<double> &img);
 
+    /** Read image n of the current class and set its alignment
+         */
+    void readClassImage(size_t n, Image<double> &img);
+
+    /** Average the images of the current class with all threads
+         */
+    void averageClassImages(MultidimArray<double> &avg1, MultidimArray<double> &avg2);
+
+    /** Add an aligned image to a Fourier accumulator.
+     * The image is transformed by A as applyGeometry(..., A, IS_INV, ...),
+     * by resampling its padded Fourier transform on the accumulator grid.
+     * The accumulator has the phase origin at the image center.
+         */
+    void addToFourierAverage(MultidimArray<double> &img, const Matrix2D<double> &A,
+                             MultidimArray< std::complex<double> > &Favg,
+                             FourierTransformer &transformer, MultidimArray<double> &Mpad);
+
+    /** Real space image of a Fourier accumulator
+         */
+    void fourierAverageToImage(MultidimArray< std::complex<double> > &Favg,
+                               MultidimArray<double> &avg);
+
 };
 
+/** Thread function to average the images of a class */
+void threadClassAverage(ThreadArgument &thArg);
+
 #endif /* MPI_ANGULAR_CLASS_AVERAGE_H_ */
 
 
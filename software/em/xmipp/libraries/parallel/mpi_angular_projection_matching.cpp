@@ -25,24 +25,21 @@
 
 #include "mpi_angular_projection_matching.h"
 
-/*Some constast to message passing tags */
-#define TAG_JOB_REQUEST 1
-#define TAG_JOB_REPLY 2
-
 /*Constructor */
 MpiProgAngularProjectionMatching::MpiProgAngularProjectionMatching()
 {
-    imagesBuffer = NULL;
-    last_chunk = NULL;
+    distributor = NULL;
+    host_comm = MPI_COMM_NULL;
+    gallery_win = MPI_WIN_NULL;
 }
 /* Destructor */
 MpiProgAngularProjectionMatching::~MpiProgAngularProjectionMatching()
 {
-    if (node->isMaster())
-    {
-        delete[] imagesBuffer;
-        delete[] last_chunk;
-    }
+    delete distributor;
+    if (gallery_win != MPI_WIN_NULL)
+        MPI_Win_free(&gallery_win);
+    if (host_comm != MPI_COMM_NULL)
+        MPI_Comm_free(&host_comm);
     delete node; //this calls MPI_Finalize
 }
 
@@ -86,6 +83,12 @@ void MpiProgAngularProjectionMatching::defineParams()
         "                                 :i1h (default MDB), i2h, i3h, i4h");
     addParamsLine(
         "                                : where n may change from 1 to 99");
+    addParamsLine(
+        "  [--no_shared_gallery]          : Do not share the references among the nodes of a host");
+    addParamsLine(
+        "                                 :by default they are prepared once per host in shared memory");
+    addParamsLine(
+        "                                 :if they fit in the memory of all its nodes (see --mem)");
 }
 
 /* Read parameters --------------------------------------------------------- */
@@ -93,131 +96,40 @@ void MpiProgAngularProjectionMatching::readParams()
 {
     ProgAngularProjectionMatching::readParams();
     mpi_job_size = getIntParam("--mpi_job_size");
-    imagesBuffer = new size_t[mpi_job_size + 1];
     chunk_angular_distance = getDoubleParam("--chunk_angular_distance");
     fn_sym = getParam("--sym");
+    shared_gallery = !checkParam("--no_shared_gallery");
 }
 
 void MpiProgAngularProjectionMatching::processAllImages()
 {
-    if (node->isMaster())    //master distribute jobs
-    {
-
-        size_t finishingWorkers = 0;
-        size_t processedImages = 0, finishedImages = 0, totalImages = DFexp.size();
-        MPI_Status status;
-
-        if (verbose)
-        {
-            progress_bar_step = XMIPP_MAX(1, totalImages / 80);
-            init_progress_bar(totalImages);
-        }
-
-        while (finishingWorkers < node->size - 1)
-        {
-            //Receive a request of job from a worker
-            //the number of images processed should be sent in imagesBuffer[0]
-            MPI_Recv(&processedImages, 1, XMIPP_MPI_SIZE_T, MPI_ANY_SOURCE,
-                     TAG_JOB_REQUEST, MPI_COMM_WORLD, &status);
-            finishedImages += processedImages;
-
-            if (!distributeJobs(imagesBuffer, status.MPI_SOURCE))
-            {
-                ++finishingWorkers;
-            }
-            MPI_Send(imagesBuffer, imagesBuffer[0] + 1, XMIPP_MPI_SIZE_T,
-                     status.MPI_SOURCE, TAG_JOB_REPLY, MPI_COMM_WORLD);
-
-            if (verbose && processedImages > 0)
-                progress_bar(finishedImages);
-        }
-
-    } else            //slaves really work
-    {
-        std::vector<size_t> imagesToProcess;
-        while (requestJobs (imagesToProcess))
-        {
-            processSomeImages(imagesToProcess);
-        }
-    }
-
-}
-
-bool MpiProgAngularProjectionMatching::distributeJobs(size_t * imagesToSent,
-        int node)
-{
-    int node_index = last_chunk[node];
-    static bool reached_last_chunk = false;
-
-    if (node_index == -1
-        || chunk_mysampling.my_exp_img_per_sampling_point[node_index].empty())
+    // No distributor is created by any node if there are no images
+    if (distributor == NULL)
+        return;
+    size_t totalImages = imagesOrder.size();
+    int verboseAux = verbose;
+    if (verbose)
     {
-
-        if (!reached_last_chunk)
-        {
-            node_index = chunk_index;
-            chunk_index = (chunk_index + 1) % chunk_number;
-            reached_last_chunk = (chunk_index == 0);
-        }
-        else
-        {
-            int i = 0;
-            for (;
-                 i < chunk_number
-                 && chunk_mysampling.my_exp_img_per_sampling_point[chunk_index].empty();
-                 ++i, chunk_index = (chunk_index + 1) % chunk_number)
-                ;
-
-            //            std::cerr << formatString("DEBUG: master: assigned %d chuck to node %d, i = %d", chunk_index, node, i);
-            if (i == chunk_number)
-            {
-                imagesToSent[0] = 0;
-                return false;
-            }
-            last_chunk[node] = node_index = chunk_index;
-            chunk_index = (chunk_index + 1) % chunk_number;
-        }
+        progress_bar_step = XMIPP_MAX(1, totalImages / 80);
+        init_progress_bar(totalImages);
     }
 
-    size_t assigned_images = std::min((size_t)mpi_job_size, chunk_mysampling.my_exp_img_per_sampling_point[node_index].size());
-    imagesToSent[0] = assigned_images;
-
-    //std::cerr << formatString("DEBUG: master: assigned %lu images to node %d\n", assigned_images, node);
-
-    for (size_t i = 1; i <= assigned_images; ++i)
+    // Only the global progress is shown
+    verbose = 0;
+    size_t first, last;
+    std::vector<size_t> imagesToProcess;
+    while (distributor->getTasks(first, last))
     {
-        imagesToSent[i] =
-            chunk_mysampling.my_exp_img_per_sampling_point[node_index].back() + FIRST_IMAGE;
-        //        std::cerr << " " << imagesToSent[i];
-        chunk_mysampling.my_exp_img_per_sampling_point[node_index].pop_back();
+        imagesToProcess.assign(imagesOrder.begin() + first,
+                               imagesOrder.begin() + last + 1);
+        processSomeImages(imagesToProcess);
+        if (verboseAux)
+            progress_bar(last + 1);
     }
-
-    //    std::cerr << std::endl;
-
-    return true;
-}
-
-bool MpiProgAngularProjectionMatching::requestJobs(
-    std::vector<size_t> &imagesToProcess)
-{
-    static size_t numberOfImages = 0;
-    MPI_Status status;
-
-    //Sent last receveiced numberOfImages, which should be processed by this worker
-    MPI_Send(&numberOfImages, 1, XMIPP_MPI_SIZE_T, 0, TAG_JOB_REQUEST,
-             MPI_COMM_WORLD);
-    //Get new job to do
-    MPI_Recv(imagesBuffer, mpi_job_size + 1, XMIPP_MPI_SIZE_T, 0,
-             TAG_JOB_REPLY, MPI_COMM_WORLD, &status);
-    numberOfImages = imagesBuffer[0];
-
-    if (numberOfImages == 0)
-        return false;
-
-    imagesToProcess.clear();
-    for (size_t i = 1; i <= numberOfImages; ++i)
-        imagesToProcess.push_back(imagesBuffer[i]);
-    return true;
+    verbose = verboseAux;
+    distributor->wait();
+    if (verbose)
+        progress_bar(totalImages);
 }
 
 void MpiProgAngularProjectionMatching::writeOutputFiles()
@@ -235,9 +147,78 @@ void MpiProgAngularProjectionMatching::produceSideInfo()
 {
     ProgAngularProjectionMatching::produceSideInfo();
 
+    if (shared_gallery)
+        shared_gallery = produceSharedGallery();
+
     if (node->isMaster())
         computeChunks();
-    node->barrierWait();
+
+    // All the nodes take their images from the sorted list of the master
+    size_t aux[2];
+    aux[0] = imagesOrder.size();
+    aux[1] = mpi_job_size;
+    MPI_Bcast(aux, 2, XMIPP_MPI_SIZE_T, 0, MPI_COMM_WORLD);
+    imagesOrder.resize(aux[0]);
+    mpi_job_size = aux[1];
+    if (aux[0] > 0)
+    {
+        MPI_Bcast(&imagesOrder[0], aux[0], XMIPP_MPI_SIZE_T, 0, MPI_COMM_WORLD);
+        distributor = new MpiRmaTaskDistributor(aux[0],
+                                                XMIPP_MIN(aux[0], (size_t)mpi_job_size), node);
+    }
+}
+
+bool MpiProgAngularProjectionMatching::produceSharedGallery()
+{
+#if MPI_VERSION >= 3
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, node->rank,
+                        MPI_INFO_NULL, &host_comm);
+    int host_rank, host_size;
+    MPI_Comm_rank(host_comm, &host_rank);
+    MPI_Comm_size(host_comm, &host_size);
+
+    // The gallery must fit in the memory given to all nodes in this host.
+    // All nodes must take the same decision, so use the smallest host
+    size_t refSize = getGalleryReferenceSize();
+    double gallery_gb = (double)total_nr_refs * refSize * sizeof(double) / (1024 * 1024 * 1024);
+    int min_host_size;
+    MPI_Allreduce(&host_size, &min_host_size, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (gallery_gb > avail_memory * min_host_size)
+    {
+        if (verbose)
+            std::cerr << "WARNING: The gallery (" << gallery_gb
+            << " Gb) does not fit in the memory of a host, it will not be shared" << std::endl;
+        MPI_Comm_free(&host_comm);
+        return false;
+    }
+
+    // The first node of the host allocates the whole gallery
+    double *gallery;
+    MPI_Aint winSize = (host_rank == 0) ? (MPI_Aint)(total_nr_refs * refSize * sizeof(double)) : 0;
+    MPI_Win_allocate_shared(winSize, sizeof(double), MPI_INFO_NULL, host_comm,
+                            &gallery, &gallery_win);
+    if (host_rank != 0)
+    {
+        int dispUnit;
+        MPI_Win_shared_query(gallery_win, 0, &winSize, &dispUnit, &gallery);
+    }
+
+    // Prepare the references in turns
+    MPI_Win_fence(0, gallery_win);
+    for (int pos = host_rank; pos < total_nr_refs; pos += host_size)
+        storeReferenceInGallery(pos, gallery, global_plans);
+    MPI_Win_fence(0, gallery_win);
+
+    aliasGallery(gallery);
+    max_nr_imgs_in_memory = total_nr_refs;
+    if (verbose)
+        std::cout << "References shared by " << host_size << " nodes per host ("
+        << gallery_gb << " Gb)" << std::endl;
+    return true;
+#else
+
+    return false;
+#endif
 }
 
 void MpiProgAngularProjectionMatching::computeChunks()
@@ -287,7 +268,7 @@ void MpiProgAngularProjectionMatching::computeChunks()
     //closer to that point than to any other
     chunk_mysampling.findClosestExperimentalPoint();
     //print number of points per node
-    chunk_number = chunk_mysampling.my_exp_img_per_sampling_point.size();
+    int chunk_number = chunk_mysampling.my_exp_img_per_sampling_point.size();
     for (int j = 0; j < chunk_number; j++)
     {
         if (max_number_of_images_in_around_a_sampling_point
@@ -303,15 +284,17 @@ void MpiProgAngularProjectionMatching::computeChunks()
         << "maximun number of references in memory: "
         << max_nr_refs_in_memory << std::endl;
     }
-    //alloc memory for buffer
     if (mpi_job_size == -1)
-        mpi_job_size = (int)ceil((double)DFexp.size()/(node->size - 1));
+        mpi_job_size = (int)ceil((double)DFexp.size()/node->size);
 
-    //Distribution related variables
-    chunk_index = 0;
-    last_chunk = new int[node->size];
-    for (size_t i = 1; i < node->size; ++i)
-        last_chunk[i] = -1;//by default no chunk assigned yet
+    //images of the same chunk are consecutive
+    imagesOrder.clear();
+    for (int j = 0; j < chunk_number; j++)
+    {
+        std::vector<size_t> &chunk = chunk_mysampling.my_exp_img_per_sampling_point[j];
+        for (size_t i = 0; i < chunk.size(); ++i)
+            imagesOrder.push_back(chunk[i] + FIRST_IMAGE);
+    }
 }
 
 void MpiProgAngularProjectionMatching::computeChunkAngularDistance(int symmetry,
@@ -320,7 +303,7 @@ void MpiProgAngularProjectionMatching::computeChunkAngularDistance(int symmetry,
     double non_reduntant_area_of_sphere =
         chunk_mysampling.SL.nonRedundantProjectionSphere(symmetry,
                 sym_order);
-    double number_cpus = (double) node->size - 1;
+    double number_cpus = (double) node->size;
     //NEXT ONE IS SAMPLING NOT ANOTHERSAMPLING
     double neighborhood_radius = fabs(acos(mysampling.cos_neighborhood_radius));
     //NEXT ONE IS SAMPLING NOT ANOTHERSAMPLING
@@ -40,11 +40,10 @@ private:
 
     /** Dvide the job in this number block with this number of images */
     int mpi_job_size;
-    /** Buffer to send and receive images ids */
-    size_t * imagesBuffer;
-    /** Indexes to distribute jobs to slaves */
-    int chunk_index, chunk_number; //will keep the next chunk to assign and the total number of chunks
-    int *last_chunk; //store the last chunk assigned to each node
+    /** Image ids sorted by chunk, so that neighbour images go together */
+    std::vector<size_t> imagesOrder;
+    /** Distributor of imagesOrder among all the nodes */
+    MpiRmaTaskDistributor *distributor;
 
 
     /** classify the experimental data making voronoi regions
@@ -65,6 +64,13 @@ private:
     /** For infinite groups symmetry order*/
     int sym_order;
 
+    /** Share one reference gallery among the nodes of each host */
+    bool shared_gallery;
+    /** Communicator with the nodes of this host */
+    MPI_Comm host_comm;
+    /** Shared memory window holding the gallery */
+    MPI_Win gallery_win;
+
 public:
     /** Redefine read */
     void read(int argc, char** argv);
@@ -73,18 +79,12 @@ public:
     /** Destructor */
     ~MpiProgAngularProjectionMatching();
 
-    /** Override virtual function implementations */
+    /** Override virtual function implementations.
+     * All the nodes (also the master) take consecutive blocks of
+     * imagesOrder, so neighbour images are processed by the same node.
+     */
     void processAllImages();
     void writeOutputFiles();
-    /** Function to distribute jobs to slaves.
-     * will return false if no more images to process.
-     * Will try to sent neighbours images to same node.
-     */
-    bool distributeJobs(size_t * imagesToSent, int node);
-    /** Function of slaves nodes to ask jobs to master.
-     * will return false if no more images to process.
-     */
-    bool requestJobs(std::vector<size_t> &imagesToProcess);
 
     /* Define accepted params ------------------------------------------------------------------- */
     void defineParams();
@@ -93,6 +93,11 @@ public:
 
     /** Redefine produceSideInfo */
     void produceSideInfo();
+    /** Prepare the references once per host in shared memory.
+     * Each node of the host prepares a part of the gallery.
+     * Return false if the gallery cannot be shared.
+     */
+    bool produceSharedGallery();
     /** These two function will be executed only by master */
     void computeChunks();
     void computeChunkAngularDistance(int symmetry, int sym_order);
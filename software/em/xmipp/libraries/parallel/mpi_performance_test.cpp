@@ -49,6 +49,9 @@ ProgPerformanceTest::~ProgPerformanceTest()
 void ProgPerformanceTest::readParams()
 {
     fnIn = getParam("-i");
+    nTasks = getIntParam("--tasks");
+    taskTime = getDoubleParam("--task_time");
+    blockSize = getIntParam("--block");
 }
 
 // Show ====================================================================
@@ -58,6 +61,9 @@ void ProgPerformanceTest::show()
         return;
     std::cout
     << "Input:               " << fnIn << std::endl
+    << "Tasks:               " << nTasks << std::endl
+    << "Task time (us):      " << taskTime << std::endl
+    << "Block size:          " << blockSize << std::endl
     ;
 }
 
@@ -65,19 +71,64 @@ void ProgPerformanceTest::show()
 void ProgPerformanceTest::defineParams()
 {
     addUsageLine("Makes a rotational invariant representation of the image collection");
-    addParamsLine("    -i <selfile>               : Selfile with experimental images");
+    addParamsLine("   [-i <selfile=\"\">]            : Selfile with experimental images");
+    addParamsLine("   [--tasks <N=10000>]         : Number of tasks to distribute among the nodes");
+    addParamsLine("   [--task_time <t=100>]       : Time of each task (microseconds)");
+    addParamsLine("   [--block <size=10>]         : Tasks given in each request (minimum in guided mode)");
     addExampleLine("mpirun -np 4 `which xmipp_mpi_image_rotational_pca` -i images.stk --oroot images_eigen --thr 4");
+    addExampleLine("Compare the task distributors with 100000 tasks of 20 microseconds:",false);
+    addExampleLine("mpirun -np 8 `which xmipp_mpi_performance_test` --tasks 100000 --task_time 20 --block 5");
 }
 
 // Produce side info =====================================================
 void ProgPerformanceTest::produceSideInfo()
 {
+    if (fnIn.empty())
+        return;
     TimeStamp t0;
     annotate_time(&t0);
     MetaData MDin(fnIn);
     print_elapsed_time(t0,false);
 }
 
+// Distribution benchmark ================================================
+void ProgPerformanceTest::benchmarkDistributor(MpiTaskDistributor &distributor,
+        const String &name)
+{
+    size_t first, last, done = 0, requests = 0;
+    node->barrierWait();
+    double t0 = MPI_Wtime();
+    while (distributor.getTasks(first, last))
+    {
+        ++requests;
+        for (size_t i = first; i <= last; ++i)
+        {
+            // Keep the processor busy as a real task would do
+            double tEnd = MPI_Wtime() + taskTime * 1e-6;
+            while (MPI_Wtime() < tEnd)
+                ;
+            ++done;
+        }
+    }
+    double elapsed = MPI_Wtime() - t0;
+    distributor.wait();
+
+    double maxElapsed;
+    unsigned long counts[2] = {done, requests}, totalCounts[2];
+    MPI_Reduce(&elapsed, &maxElapsed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(counts, totalCounts, 2, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (verbose)
+    {
+        double ideal = nTasks * taskTime * 1e-6 / node->size;
+        std::cout << formatString("%-16s time: %8.4f s  efficiency: %5.1f%%  requests: %6lu  tasks in master: %lu",
+                                  name.c_str(), maxElapsed, 100 * ideal / maxElapsed,
+                                  totalCounts[1], done) << std::endl;
+        if (totalCounts[0] != nTasks)
+            REPORT_ERROR(ERR_UNCLASSIFIED, formatString("%s distributed %lu tasks instead of %lu",
+                         name.c_str(), totalCounts[0], nTasks));
+    }
+}
+
 // Run ====================================================================
 void ProgPerformanceTest::run()
 {
@@ -85,4 +136,18 @@ void ProgPerformanceTest::run()
     if (system("hostname")==-1)
     	REPORT_ERROR(ERR_UNCLASSIFIED,"Cannot open shell");
     produceSideInfo();
+
+    if (nTasks == 0)
+        return;
+    size_t bSize = XMIPP_MIN(blockSize, nTasks);
+    if (node->size > 1)
+    {
+        // The master only serves the tasks to the workers
+        MpiTaskDistributor master(nTasks, bSize, node);
+        benchmarkDistributor(master, "master");
+    }
+    MpiRmaTaskDistributor rma(nTasks, bSize, node);
+    benchmarkDistributor(rma, "rma");
+    MpiRmaTaskDistributor guided(nTasks, bSize, node, true);
+    benchmarkDistributor(guided, "rma guided");
 }
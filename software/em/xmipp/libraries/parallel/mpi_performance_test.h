@@ -35,6 +35,12 @@ class ProgPerformanceTest: public XmippProgram
 public:
 	/** Input selfile */
 	FileName fnIn;
+	/** Number of tasks of the distribution benchmark */
+	size_t nTasks;
+	/** Time of each task (microseconds) */
+	double taskTime;
+	/** Tasks given in each request */
+	size_t blockSize;
 public:
     // Mpi node
     MpiNode *node;
@@ -57,6 +63,11 @@ public:
     /// Produce side info
     void produceSideInfo();
 
+    /** Time the distribution of nTasks with this distributor.
+     * Each task keeps the processor busy for taskTime microseconds.
+     */
+    void benchmarkDistributor(MpiTaskDistributor &distributor, const String &name);
+
     /** Run. */
     void run();
 };
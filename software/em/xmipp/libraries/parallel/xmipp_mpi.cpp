@@ -23,6 +23,7 @@
  *  e-mail address 'xmipp@cnb.csic.es'
  ***************************************************************************/
 
+#include <climits>
 #include "xmipp_mpi.h"
 #include "data/xmipp_log.h"
 
@@ -85,6 +86,84 @@ void MpiTaskDistributor::wait()
     node->barrierWait();
 }
 
+// ================= RMA TASK DISTRIBUTOR ==========================
+MpiRmaTaskDistributor::MpiRmaTaskDistributor(size_t nTasks, size_t bSize,
+        MpiNode *node, bool guided) :
+        MpiTaskDistributor(nTasks, bSize, node)
+{
+    this->guided = guided;
+    if (guided)
+        computeGuidedBlocks();
+    MPI_Aint winSize = node->isMaster() ? sizeof(unsigned long long) : 0;
+    MPI_Win_allocate(winSize, sizeof(unsigned long long), MPI_INFO_NULL,
+                     MPI_COMM_WORLD, &counter, &win);
+    // Passive target epoch for the whole life of the distributor
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+    reset();
+}
+
+MpiRmaTaskDistributor::~MpiRmaTaskDistributor()
+{
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+}
+
+void MpiRmaTaskDistributor::reset()
+{
+    node->barrierWait();
+    if (node->isMaster())
+    {
+        unsigned long long zero = 0, previous;
+        MPI_Fetch_and_op(&zero, &previous, MPI_UNSIGNED_LONG_LONG, 0, 0,
+                         MPI_REPLACE, win);
+        MPI_Win_flush(0, win);
+    }
+    assignedTasks = 0;
+    node->barrierWait();
+}
+
+void MpiRmaTaskDistributor::computeGuidedBlocks()
+{
+    // Half of the remaining tasks are given in each round of requests
+    size_t start = 0, size, remaining;
+    blockStart.clear();
+    while (start < numberOfTasks)
+    {
+        blockStart.push_back(start);
+        remaining = numberOfTasks - start;
+        size = (remaining + 2 * node->size - 1) / (2 * node->size);
+        start += XMIPP_MAX(size, blockSize);
+    }
+    blockStart.push_back(numberOfTasks);
+}
+
+bool MpiRmaTaskDistributor::distribute(size_t &first, size_t &last)
+{
+    // The counter is the number of blocks already given
+    unsigned long long one = 1, block;
+    MPI_Fetch_and_op(&one, &block, MPI_UNSIGNED_LONG_LONG, 0, 0,
+                     MPI_SUM, win);
+    MPI_Win_flush(0, win);
+
+    first = last = 0;
+    if (guided)
+    {
+        if (block + 1 >= blockStart.size())
+            return false;
+        first = blockStart[block];
+        last = blockStart[block + 1] - 1;
+    }
+    else
+    {
+        if (block >= (numberOfTasks + blockSize - 1) / blockSize)
+            return false;
+        first = block * blockSize;
+        last = XMIPP_MIN(first + blockSize, numberOfTasks) - 1;
+    }
+    assignedTasks = last + 1;
+    return true;
+}
+
 // ================= FILE MUTEX ==========================
 MpiFileMutex::MpiFileMutex(MpiNode * node)
 {
@@ -198,35 +277,89 @@ void MpiNode::gatherMetadatas(MetaData &MD, const FileName &rootname)
     if (size == 1)
         return;
 
-    FileName fn;
+    std::vector<char> buffer;
+    if (!isMaster()) //workers just serialize their partial results
+        MD.serialize(buffer);
+
+    unsigned long long bufferSize = buffer.size();
+    std::vector<unsigned long long> bufferSizes(size);
+    MPI_Gather(&bufferSize, 1, MPI_UNSIGNED_LONG_LONG, &bufferSizes[0], 1,
+               MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
 
-    if (!isMaster()) //workers just write down partial results
+    // All the buffers are gathered at once if they fit in a single call
+    int fitsGatherv = 1;
+    if (isMaster())
     {
-        fn = formatString("%s_node%d.xmd", rootname.c_str(), rank);
-        MD.write(fn);
+        unsigned long long total = 0;
+        for (size_t nodeRank = 1; nodeRank < size; nodeRank++)
+            total += bufferSizes[nodeRank];
+        fitsGatherv = total <= (unsigned long long) INT_MAX;
     }
-    ///Wait for all workers write results
-    barrierWait();
-    if (isMaster()) //master should collect and join workers results
+    MPI_Bcast(&fitsGatherv, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    MetaData mdSlave;
+    if (fitsGatherv)
     {
-        MetaData mdAll(MD), mdSlave;
+        std::vector<char> allBuffers;
+        std::vector<int> counts(size, 0), displs(size, 0);
+        if (isMaster())
+        {
+            for (size_t nodeRank = 1; nodeRank < size; nodeRank++)
+            {
+                counts[nodeRank] = (int) bufferSizes[nodeRank];
+                displs[nodeRank] = displs[nodeRank - 1] + counts[nodeRank - 1];
+            }
+            allBuffers.resize(displs[size - 1] + counts[size - 1] + 1);
+        }
+        MPI_Gatherv(buffer.empty() ? NULL : &buffer[0], (int) bufferSize, MPI_CHAR,
+                    isMaster() ? &allBuffers[0] : NULL, &counts[0], &displs[0], MPI_CHAR,
+                    0, MPI_COMM_WORLD);
+        if (isMaster()) //master should collect and join workers results
+            for (size_t nodeRank = 1; nodeRank < size; nodeRank++)
+            {
+                mdSlave.deserialize(&allBuffers[displs[nodeRank]], counts[nodeRank]);
+                //make sure metadata is not empty
+                if (!mdSlave.isEmpty())
+                    MD.unionAll(mdSlave);
+            }
+    }
+    else if (isMaster())
+    {
+        // Too large for a single call, receive and join one worker at a time
+        MPI_Status status;
         for (size_t nodeRank = 1; nodeRank < size; nodeRank++)
         {
-            fn = formatString("%s_node%d.xmd", rootname.c_str(), nodeRank);
-            mdSlave.read(fn);
-            //make sure file is not empty
+            buffer.resize(bufferSizes[nodeRank]);
+            for (size_t offset = 0; offset < buffer.size(); offset += XMIPP_MPI_MAX_CHUNK)
+                MPI_Recv(&buffer[offset], (int) XMIPP_MIN((size_t) XMIPP_MPI_MAX_CHUNK, buffer.size() - offset),
+                         MPI_CHAR, nodeRank, TAG_METADATA, MPI_COMM_WORLD, &status);
+            mdSlave.deserialize(&buffer[0], buffer.size());
             if (!mdSlave.isEmpty())
-                mdAll.unionAll(mdSlave);
-            //Remove blockname
-            fn = fn.removeBlockName();
-            remove(fn.c_str());
+                MD.unionAll(mdSlave);
         }
-        //remove first metadata
-        fn = formatString("%s_node%d.xmd", rootname.c_str(), 1);
-        fn = fn.removeBlockName();
-        remove(fn.c_str());
-        MD=mdAll;
     }
+    else
+        for (size_t offset = 0; offset < buffer.size(); offset += XMIPP_MPI_MAX_CHUNK)
+            MPI_Send(&buffer[offset], (int) XMIPP_MIN((size_t) XMIPP_MPI_MAX_CHUNK, buffer.size() - offset),
+                     MPI_CHAR, 0, TAG_METADATA, MPI_COMM_WORLD);
+}
+
+void MpiNode::broadcastMetadata(MetaData &MD)
+{
+    if (size == 1)
+        return;
+
+    std::vector<char> buffer;
+    if (isMaster())
+        MD.serialize(buffer);
+    unsigned long long bufferSize = buffer.size();
+    MPI_Bcast(&bufferSize, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+    buffer.resize(bufferSize);
+    for (size_t offset = 0; offset < buffer.size(); offset += XMIPP_MPI_MAX_CHUNK)
+        MPI_Bcast(&buffer[offset], (int) XMIPP_MIN((size_t) XMIPP_MPI_MAX_CHUNK, buffer.size() - offset),
+                  MPI_CHAR, 0, MPI_COMM_WORLD);
+    if (!isMaster())
+        MD.deserialize(&buffer[0], buffer.size());
 }
 
 /* -------------------- XmippMPIProgram ---------------------- */
@@ -305,6 +438,7 @@ void MpiMetadataProgram::defineParams()
 {
     addParamsLine("== MPI ==");
     addParamsLine(" [--mpi_job_size <size=0>]     : Number of images sent simultaneously to a mpi node");
+    addParamsLine("                               : 0 gives decreasing blocks with the remaining images");
 }
 
 void MpiMetadataProgram::readParams()
@@ -316,18 +450,25 @@ void MpiMetadataProgram::createTaskDistributor(MetaData &mdIn,
         size_t blockSize)
 {
     size_t size = mdIn.size();
-    if (blockSize < 1)
-        blockSize = XMIPP_MAX(1, size/(node->size * 5));
+    // Without a given block size, blocks decrease with the remaining images
+    bool guided = blockSize < 1;
+    if (guided)
+        blockSize = XMIPP_MAX(1, size/(node->size * 20));
     else if (blockSize > size)
         blockSize = size;
 
     mdIn.findObjects(imgsId);
-    distributor = new MpiTaskDistributor(size, blockSize, node);
+    // All the nodes have the same metadata, so none of them creates the
+    // distributor if it is empty
+    if (size > 0)
+        distributor = new MpiRmaTaskDistributor(size, blockSize, node, guided);
 }
 
 //Now use the distributor to grasp images
 bool MpiMetadataProgram::getTaskToProcess(size_t &objId, size_t &objIndex)
 {
+    if (distributor == NULL)
+        return false;
     bool moreTasks = true;
     if (first > last)
         moreTasks = distributor->getTasks(first, last);
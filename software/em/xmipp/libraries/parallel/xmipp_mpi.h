@@ -61,9 +61,18 @@ public:
     /** Wait on a barrier for the other MPI nodes */
     void barrierWait();
 
-    /** Gather metadatas */
+    /** Gather metadatas.
+     * The metadatas of the workers are serialized in memory, gathered in
+     * the master and joined (in rank order) to the master metadata.
+     * rootName is not used, no file is written.
+     */
     void gatherMetadatas(MetaData &MD, const FileName &rootName);
 
+    /** Broadcast a metadata from the master to all the other nodes.
+     * The metadata of the workers is replaced by the one of the master.
+     */
+    void broadcastMetadata(MetaData &MD);
+
     /** Update the MPI communicator to connect the currently active nodes */
 //    void updateComm();
 
@@ -80,6 +89,10 @@ protected:
 
 #define TAG_WORK_REQUEST 100
 #define TAG_WORK_RESPONSE 101
+#define TAG_METADATA 102
+
+/** Maximum number of bytes sent in a single MPI call */
+#define XMIPP_MPI_MAX_CHUNK (1 << 30)
 
 /** This class is another implementation of ParallelTaskDistributor with MPI workers.
  * It extends from ThreadTaskDistributor and adds the MPI call
@@ -111,6 +124,59 @@ private:
 }
 ;//end of class MpiTaskDistributor
 
+/** Decentralised MPI task distributor.
+ * The assigned tasks are counted by an atomic counter kept in an MPI-3 RMA
+ * window of the master. Each node takes its tasks with a fetch-and-add
+ * on that counter, so no node serves the requests of the others and the
+ * master also computes. Tasks are given in blocks of blockSize or, in
+ * guided mode, in decreasing blocks proportional to the remaining tasks
+ * (never smaller than blockSize). The counter holds the number of blocks
+ * already given and all nodes know where each block starts, so a single
+ * atomic operation is needed per request.
+ *
+ * The constructor, the destructor and reset() are collective, they must
+ * be called by all the nodes. Inside a node getTasks may be called by
+ * several threads.
+ * @code
+ * MpiRmaTaskDistributor td(nImgs, 10, node, true);
+ * size_t first, last;
+ * while (td.getTasks(first, last))
+ *     for (size_t i = first; i <= last; ++i)
+ *         processImage(i);
+ * td.wait();
+ * @endcode
+ */
+class MpiRmaTaskDistributor: public MpiTaskDistributor
+{
+protected:
+    /// Window with the task counter (only allocated in the master)
+    MPI_Win win;
+    /// Counter of assigned blocks (only in the master)
+    unsigned long long *counter;
+    /// Decrease the block size with the remaining tasks
+    bool guided;
+    /// First task of each block in guided mode (and numberOfTasks at the end)
+    std::vector<size_t> blockStart;
+
+    virtual bool distribute(size_t &first, size_t &last);
+
+public:
+    /** Constructor.
+     * If guided, bSize is the minimum block size.
+     */
+    MpiRmaTaskDistributor(size_t nTasks, size_t bSize, MpiNode *node,
+                          bool guided = false);
+    /** Destructor */
+    virtual ~MpiRmaTaskDistributor();
+    /** Start the distribution again. All nodes should call it. */
+    virtual void reset();
+
+protected:
+    /** Compute the blocks of the guided mode */
+    void computeGuidedBlocks();
+}
+;//end of class MpiRmaTaskDistributor
+
 /** Mutex on files.
  * This class extends threads mutex to also provide file locking.
  */
@@ -274,7 +340,9 @@ public:\
     }\
     void wait()\
     {\
-		distributor->wait();\
+        baseClassName::wait();\
+        if (distributor != NULL)\
+            distributor->wait();\
     }\
 };\
 
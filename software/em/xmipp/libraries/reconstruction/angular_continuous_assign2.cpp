@@ -34,11 +34,14 @@ ProgAngularContinuousAssign2::ProgAngularContinuousAssign2()
     produces_a_metadata = true;
     each_image_produces_an_output = true;
     projector = NULL;
+    Npending = 0;
 }
 
 ProgAngularContinuousAssign2::~ProgAngularContinuousAssign2()
 {
 	delete projector;
+	for (size_t i=0; i<images.size(); i++)
+		delete images[i];
 }
 
 // Read arguments ==========================================================
@@ -63,6 +66,7 @@ void ProgAngularContinuousAssign2::readParams()
     phaseFlipped = checkParam("--phaseFlipped");
     penalization = getDoubleParam("--penalization");
     fnResiduals = getParam("--oresiduals");
+    nThreads = getIntParam("--thr");
 }
 
 // Show ====================================================================
@@ -90,6 +94,7 @@ void ProgAngularContinuousAssign2::show()
     << "Phase flipped:       " << phaseFlipped       << std::endl
     << "Penalization:        " << penalization       << std::endl
     << "Output residuals:    " << fnResiduals        << std::endl
+    << "Threads:             " << nThreads           << std::endl
     ;
 }
 
@@ -120,6 +125,7 @@ void ProgAngularContinuousAssign2::defineParams()
     addParamsLine("  [--phaseFlipped]             : Input images have been phase flipped");
     addParamsLine("  [--penalization <l=100>]     : Penalization for the average term");
     addParamsLine("  [--oresiduals <stack=\"\">]  : Output stack for the residuals");
+    addParamsLine("  [--thr <N=1>]                : Number of threads. Several images are optimized at the same time");
     addExampleLine("A typical use is:",false);
     addExampleLine("xmipp_angular_continuous_assign2 -i anglesFromDiscreteAssignment.xmd --ref reference.vol -o assigned_angles.xmd");
 }
@@ -131,6 +137,9 @@ void ProgAngularContinuousAssign2::startProcessing()
 		createEmptyFile(fnResiduals, xdimOut, ydimOut, zdimOut, mdInSize, true, WRITE_OVERWRITE);
 }
 
+// Number of images given to each thread in a batch
+#define CONTINUOUS2_IMAGES_PER_THREAD 4
+
 // Produce side information ================================================
 void ProgAngularContinuousAssign2::preProcess()
 {
@@ -139,11 +148,6 @@ void ProgAngularContinuousAssign2::preProcess()
     V().setXmippOrigin();
     Xdim=XSIZE(V());
 
-    Ip().initZeros(Xdim,Xdim);
-    E().initZeros(Xdim,Xdim);
-    Ifilteredp().initZeros(Xdim,Xdim);
-    Ifilteredp().setXmippOrigin();
-
     // Construct mask
     if (Rmax<0)
     	Rmax=Xdim/2;
@@ -156,10 +160,12 @@ void ProgAngularContinuousAssign2::preProcess()
     iMask2Dsum=1.0/mask2D.sum();
 
     // Construct reference covariance
+    MultidimArray<double> E;
+    E.initZeros(Xdim,Xdim);
     FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mask2D)
     if (DIRECT_MULTIDIM_ELEM(mask2D,n))
-    	DIRECT_MULTIDIM_ELEM(E(),n)=rnd_gaus(0,1);
-    covarianceMatrix(E(),C0);
+    	DIRECT_MULTIDIM_ELEM(E,n)=rnd_gaus(0,1);
+    covarianceMatrix(E,C0);
     FOR_ALL_ELEMENTS_IN_MATRIX2D(C0)
     {
     	double val=MAT_ELEM(C0,i,j);
@@ -177,95 +183,96 @@ void ProgAngularContinuousAssign2::preProcess()
     filter.w1=Ts/maxResol;
     filter.raised_w=0.02;
 
-    // Transformation matrix
-    A.initIdentity(3);
+    // Images optimized at the same time
+    size_t batchSize=(nThreads==1) ? 1 : nThreads*CONTINUOUS2_IMAGES_PER_THREAD;
+    images.resize(batchSize);
+    for (size_t i=0; i<batchSize; i++)
+    {
+    	ContinuousAssign2Image *img=new ContinuousAssign2Image;
+    	img->prm=this;
+    	img->Ip().initZeros(Xdim,Xdim);
+    	img->E().initZeros(Xdim,Xdim);
+    	img->Ifilteredp().initZeros(Xdim,Xdim);
+    	img->Ifilteredp().setXmippOrigin();
+    	img->P().initZeros(Xdim,Xdim);
+    	img->P().setXmippOrigin();
+    	img->transformer.FourierTransform(img->P(),img->projectionFourier,false);
+    	img->A.initIdentity(3);
+    	images[i]=img;
+    }
+    Npending=0;
 }
 
 //#define DEBUG
-double tranformImage(ProgAngularContinuousAssign2 *prm, double rot, double tilt, double psi,
+double tranformImage(ContinuousAssign2Image *img, double rot, double tilt, double psi,
 		double a, double b, Matrix2D<double> &A, double deltaDefocusU, double deltaDefocusV, double deltaDefocusAngle, int degree)
 {
-	projectVolume(*(prm->projector), prm->P, (int)XSIZE(prm->I()), (int)XSIZE(prm->I()),  rot, tilt, psi);
-    if (prm->hasCTF)
+	// The projector is only read, so that several images can be projected at the same time
+	const ProgAngularContinuousAssign2 *prm=img->prm;
+	Euler_angles2matrix(rot,tilt,psi,img->Euler);
+	prm->projector->projectFourier(img->Euler,img->projectionFourier);
+    if (img->hasCTF)
     {
-    	prm->ctf.DeltafU=prm->old_defocusU+deltaDefocusU;
-    	prm->ctf.DeltafV=prm->old_defocusV+deltaDefocusV;
-    	prm->ctf.azimuthal_angle=prm->old_defocusAngle+deltaDefocusAngle;
-    	prm->ctf.produceSideInfo();
-    	prm->ctf.applyCTF(prm->P(),prm->Ts,prm->phaseFlipped);
+    	img->ctf.DeltafU=img->old_defocusU+deltaDefocusU;
+    	img->ctf.DeltafV=img->old_defocusV+deltaDefocusV;
+    	img->ctf.azimuthal_angle=img->old_defocusAngle+deltaDefocusAngle;
+    	img->ctf.produceSideInfo();
+    	img->ctf.applyCTF(img->projectionFourier,prm->Ts,prm->phaseFlipped);
     }
+	img->transformer.inverseFourierTransform();
 
-    double cost=0, avg=0;
-	if (prm->old_flip)
+    double cost=0;
+	if (img->old_flip)
 	{
 		MAT_ELEM(A,0,0)*=-1;
 		MAT_ELEM(A,0,1)*=-1;
 		MAT_ELEM(A,0,2)*=-1;
 	}
 
-	//applyGeometry(degree,prm->Ip(),prm->I(),A,IS_NOT_INV,DONT_WRAP,0.);
-	applyGeometry(degree,prm->Ifilteredp(),prm->Ifiltered(),A,IS_NOT_INV,DONT_WRAP,0.);
-	const MultidimArray<double> &mP=prm->P();
-	//const MultidimArray<double> &mI=prm->I();
+	applyGeometry(degree,img->Ifilteredp(),img->Ifiltered(),A,IS_NOT_INV,DONT_WRAP,0.);
+	const MultidimArray<double> &mP=img->P();
 	const MultidimArray<int> &mMask2D=prm->mask2D;
-	//MultidimArray<double> &mIp=prm->Ip();
-	MultidimArray<double> &mIfilteredp=prm->Ifilteredp();
-	MultidimArray<double> &mE=prm->E();
+	MultidimArray<double> &mIfilteredp=img->Ifilteredp();
+	MultidimArray<double> &mE=img->E();
 	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mMask2D)
 	{
 		if (DIRECT_MULTIDIM_ELEM(mMask2D,n))
 		{
-			//DIRECT_MULTIDIM_ELEM(mIp,n)=a*DIRECT_MULTIDIM_ELEM(mIp,n)+b;
 			DIRECT_MULTIDIM_ELEM(mIfilteredp,n)=a*DIRECT_MULTIDIM_ELEM(mIfilteredp,n)+b;
 			double val=DIRECT_MULTIDIM_ELEM(mP,n)-DIRECT_MULTIDIM_ELEM(mIfilteredp,n);
 			DIRECT_MULTIDIM_ELEM(mE,n)=val;
 			cost+=fabs(val);
-			//avg+=val;
 		}
 		else
 		{
-			//DIRECT_MULTIDIM_ELEM(mIp,n)=0;
 			DIRECT_MULTIDIM_ELEM(mIfilteredp,n)=0;
 			DIRECT_MULTIDIM_ELEM(mE,n)=0;
 		}
 	}
 	cost*=prm->iMask2Dsum;
 
-	//double corr=correlationIndex(mIfilteredp,mP);
 	double corr=correlationIndex(mIfilteredp,mP,&mMask2D);
-	//avg*=prm->iMask2Dsum;
-
-	//covarianceMatrix(mE, prm->C);
-	//double div=computeCovarianceMatrixDivergence(prm->C0,prm->C)/MAT_XSIZE(prm->C);
 #ifdef DEBUG
 	std::cout << "A=" << A << std::endl;
 	Image<double> save;
-	save()=prm->P();
+	save()=img->P();
 	save.write("PPPtheo.xmp");
-	save()=prm->Ifilteredp();
+	save()=img->Ifilteredp();
 	save.write("PPPfilteredp.xmp");
-	save()=prm->Ifiltered();
+	save()=img->Ifiltered();
 	save.write("PPPfiltered.xmp");
-	save()=prm->E();
+	save()=img->E();
 	save.write("PPPe.xmp");
-	//save()=prm->C;
-	//save.write("PPPc.xmp");
-	//save()=prm->C0;
-	//save.write("PPPc0.xmp");
-	//std::cout << "Cost=" << cost << " Div=" << div << " avg=" << avg << std::endl;
+	std::cout << "Cost=" << cost << std::endl;
 	std::cout << "Corr=" << corr << std::endl;
 	std::cout << "Press any key" << std::endl;
 	char c; std::cin >> c;
 #endif
-	//return cost;
-	//return div+prm->penalization*fabs(avg);
-	//return cost+prm->penalization*fabs(avg);
-	//return div;
 	return -corr;
 }
+#undef DEBUG
 
-
-double continuous2cost(double *x, void *_prm)
+double ContinuousAssign2Image::evaluate(double *x)
 {
 	double a=x[1];
 	double b=x[2];
@@ -279,7 +286,6 @@ double continuous2cost(double *x, void *_prm)
 	double deltaDefocusU=x[10];
 	double deltaDefocusV=x[11];
 	double deltaDefocusAngle=x[12];
-	ProgAngularContinuousAssign2 *prm=(ProgAngularContinuousAssign2 *)_prm;
 	if (prm->maxShift>0 && deltax*deltax+deltay*deltay>prm->maxShift*prm->maxShift)
 		return 1e38;
 	if (fabs(scalex)>prm->maxScale || fabs(scaley)>prm->maxScale)
@@ -290,31 +296,45 @@ double continuous2cost(double *x, void *_prm)
 //		return 1e38;
 	if (fabs(deltaDefocusU)>prm->maxDefocusChange || fabs(deltaDefocusV)>prm->maxDefocusChange)
 		return 1e38;
-	MAT_ELEM(prm->A,0,0)=1+scalex;
-	MAT_ELEM(prm->A,1,1)=1+scaley;
-	MAT_ELEM(prm->A,0,2)=prm->old_shiftX+deltax;
-	MAT_ELEM(prm->A,1,2)=prm->old_shiftY+deltay;
-	return tranformImage(prm,prm->old_rot+deltaRot, prm->old_tilt+deltaTilt, prm->old_psi+deltaPsi,
-			a, b, prm->A, deltaDefocusU, deltaDefocusV, deltaDefocusAngle, LINEAR);
+	MAT_ELEM(A,0,0)=1+scalex;
+	MAT_ELEM(A,1,1)=1+scaley;
+	MAT_ELEM(A,0,2)=old_shiftX+deltax;
+	MAT_ELEM(A,1,2)=old_shiftY+deltay;
+	return tranformImage(this,old_rot+deltaRot, old_tilt+deltaTilt, old_psi+deltaPsi,
+			a, b, A, deltaDefocusU, deltaDefocusV, deltaDefocusAngle, LINEAR);
 }
 
 // Predict =================================================================
-//#define DEBUG
 void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn, MDRow &rowOut)
 {
-    rowOut=rowIn;
+	// The row of the previous image was added to the output metadata after
+	// its processImage
+	if (Npending>0)
+		images[Npending-1]->rowId=getOutputMd()->lastObject();
+
+	ContinuousAssign2Image &img=*images[Npending];
+	img.fnImg=fnImg;
+	img.fnImgOut=fnImgOut;
+	prepareImage(img,rowIn);
+	Npending++;
+
+	if (Npending==images.size())
+		optimizePendingImages(&rowOut);
+	else
+		rowOut=img.rowOut;
+}
+
+void ProgAngularContinuousAssign2::prepareImage(ContinuousAssign2Image &img, const MDRow &rowIn)
+{
+    img.rowOut=rowIn;
 
     // Read input image and initial parameters
-//  ApplyGeoParams geoParams;
-//	geoParams.only_apply_shifts=false;
-//	geoParams.wrap=DONT_WRAP;
-
-	rowIn.getValue(MDL_ANGLE_ROT,old_rot);
-	rowIn.getValue(MDL_ANGLE_TILT,old_tilt);
-	rowIn.getValue(MDL_ANGLE_PSI,old_psi);
-	rowIn.getValue(MDL_SHIFT_X,old_shiftX);
-	rowIn.getValue(MDL_SHIFT_Y,old_shiftY);
-	rowIn.getValue(MDL_FLIP,old_flip);
+	rowIn.getValue(MDL_ANGLE_ROT,img.old_rot);
+	rowIn.getValue(MDL_ANGLE_TILT,img.old_tilt);
+	rowIn.getValue(MDL_ANGLE_PSI,img.old_psi);
+	rowIn.getValue(MDL_SHIFT_X,img.old_shiftX);
+	rowIn.getValue(MDL_SHIFT_Y,img.old_shiftY);
+	rowIn.getValue(MDL_FLIP,img.old_flip);
 	double old_scaleX=0, old_scaleY=0, old_grayA=1, old_grayB=0;
 	if (rowIn.containsLabel(MDL_CONTINUOUS_GRAY_A))
 	{
@@ -322,76 +342,118 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
 		rowIn.getValue(MDL_CONTINUOUS_GRAY_B,old_grayB);
 		rowIn.getValue(MDL_CONTINUOUS_SCALE_X,old_scaleX);
 		rowIn.getValue(MDL_CONTINUOUS_SCALE_Y,old_scaleY);
-		rowIn.getValue(MDL_CONTINUOUS_X,old_shiftX);
-		rowIn.getValue(MDL_CONTINUOUS_Y,old_shiftY);
-		rowIn.getValue(MDL_CONTINUOUS_FLIP,old_flip);
+		rowIn.getValue(MDL_CONTINUOUS_X,img.old_shiftX);
+		rowIn.getValue(MDL_CONTINUOUS_Y,img.old_shiftY);
+		rowIn.getValue(MDL_CONTINUOUS_FLIP,img.old_flip);
 	}
 
 	if (rowIn.containsLabel(MDL_CTF_DEFOCUSU) || rowIn.containsLabel(MDL_CTF_MODEL))
 	{
-		hasCTF=true;
-		ctf.readFromMdRow(rowIn);
-		ctf.produceSideInfo();
-		old_defocusU=ctf.DeltafU;
-		old_defocusV=ctf.DeltafV;
-		old_defocusAngle=ctf.azimuthal_angle;
+		img.hasCTF=true;
+		img.ctf.readFromMdRow(rowIn);
+		img.ctf.produceSideInfo();
+		img.old_defocusU=img.ctf.DeltafU;
+		img.old_defocusV=img.ctf.DeltafV;
+		img.old_defocusAngle=img.ctf.azimuthal_angle;
 	}
 	else
-		hasCTF=false;
+		img.hasCTF=false;
 
 	if (verbose>=2)
-		std::cout << "Processing " << fnImg << std::endl;
-	I.read(fnImg);
-	I().setXmippOrigin();
+		std::cout << "Processing " << img.fnImg << std::endl;
+	img.I.read(img.fnImg);
+	img.I().setXmippOrigin();
 
-    Ifiltered()=I();
-    filter.applyMaskSpace(Ifiltered());
+    img.Ifiltered()=img.I();
+    filter.applyMaskSpace(img.Ifiltered());
 
-    Matrix1D<double> p(12), steps(12);
+    Matrix1D<double> &p=img.p;
+    p.initZeros(12);
     p(0)=old_grayA; // a in I'=a*I+b
     p(1)=old_grayB; // b in I'=a*I+b
     p(4)=old_scaleX;
     p(5)=old_scaleY;
 
-    // Optimize
-	double cost=-1;
+	img.cost=-1;
+	img.problem=-1;
 	if (fabs(old_scaleX)>maxScale || fabs(old_scaleY)>maxScale)
-    	rowOut.setValue(MDL_ENABLED,-1);
+    	img.rowOut.setValue(MDL_ENABLED,-1);
 	else
 	{
+		PowellProblem problem;
+		problem.f=&img;
+		problem.p=p;
+		problem.steps.initZeros(12);
+		Matrix1D<double> &steps=problem.steps;
+		if (optimizeGrayValues)
+			steps(0)=steps(1)=1.;
+		if (optimizeShift)
+			steps(2)=steps(3)=1.;
+		if (optimizeScale)
+			steps(4)=steps(5)=1.;
+		if (optimizeAngles)
+			steps(6)=steps(7)=steps(8)=1.;
+		if (optimizeDefocus)
+			steps(9)=steps(10)=steps(11)=1.;
+		problem.i0=1;
+		problem.n=12;
+		problem.ftol=0.01;
+		img.problem=(int)problems.size();
+		problems.push_back(problem);
+	}
+}
+
+void ProgAngularContinuousAssign2::optimizePendingImages(MDRow *rowOut)
+{
+	powellOptimizerBatch(problems,nThreads);
+	MetaData &mdOut=*getOutputMd();
+	for (size_t i=0; i<Npending; i++)
+	{
+		ContinuousAssign2Image &img=*images[i];
+		finishImage(img);
+		if (rowOut!=NULL && i==Npending-1)
+			*rowOut=img.rowOut;
+		else
+			mdOut.setRow(img.rowOut,img.rowId);
+	}
+	problems.clear();
+	Npending=0;
+}
+
+void ProgAngularContinuousAssign2::wait()
+{
+	if (Npending>0)
+	{
+		images[Npending-1]->rowId=getOutputMd()->lastObject();
+		optimizePendingImages(NULL);
+	}
+}
+
+//#define DEBUG
+void ProgAngularContinuousAssign2::finishImage(ContinuousAssign2Image &img)
+{
+	MDRow &rowOut=img.rowOut;
+	Matrix1D<double> p=img.p;
+	double &cost=img.cost;
+	if (img.problem>=0)
+	{
+		const PowellProblem &problem=problems[img.problem];
 		try
 		{
 			cost=1e38;
-			int iter;
-			steps.initZeros();
-			if (optimizeGrayValues)
-				steps(0)=steps(1)=1.;
-			if (optimizeShift)
-				steps(2)=steps(3)=1.;
-			if (optimizeScale)
-				steps(4)=steps(5)=1.;
-			if (optimizeAngles)
-				steps(6)=steps(7)=steps(8)=1.;
-			if (optimizeDefocus)
-				steps(9)=steps(10)=steps(11)=1.;
-			powellOptimizer(p, 1, 12, &continuous2cost, this, 0.01, cost, iter, steps, verbose>=2);
+			if (problem.failed)
+				REPORT_ERROR(ERR_NUMERICAL,problem.errorMsg);
+			cost=problem.fret;
 			if (cost>1e30 || cost>0)
-			{
 				rowOut.setValue(MDL_ENABLED,-1);
-				p.initZeros();
-			    p(0)=old_grayA; // a in I'=a*I+b
-			    p(1)=old_grayB; // b in I'=a*I+b
-			    p(4)=old_scaleX;
-			    p(5)=old_scaleY;
-			}
 			else
 			{
-				//continuous2cost(p.adaptForNumericalRecipes(),this);
+				p=problem.p;
 				if (fnResiduals!="")
 				{
 					FileName fnResidual;
-					fnResidual.compose(fnImgOut.getPrefixNumber(),fnResiduals);
-					E.write(fnResidual);
+					fnResidual.compose(img.fnImgOut.getPrefixNumber(),fnResiduals);
+					img.E.write(fnResidual);
 					rowOut.setValue(MDL_IMAGE_RESIDUAL,fnResidual);
 				}
 			}
@@ -401,20 +463,21 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
 				          << "scale=(" << 1+p(4) << "," << 1+p(5) << ") Drot=" << p(6) << " Dtilt=" << p(7)
 				          << " Dpsi=" << p(8) << " DU=" << p(9) << " DV=" << p(10) << " Dalpha=" << p(11) << std::endl;
 			// Apply
-			FileName fnOrig;
-			rowIn.getValue(MDL::str2Label(originalImageLabel),fnOrig);
-			I.read(fnImg);
+			Image<double> &I=img.I, &Ip=img.Ip;
+			Matrix2D<double> &A=img.A;
+			I.read(img.fnImg);
 			if (XSIZE(Ip())!=XSIZE(I()))
 			{
 				scaleToSize(BSPLINE3,Ip(),I(),XSIZE(Ip()),YSIZE(Ip()));
 				I()=Ip();
 			}
-			A(0,2)=p(2)+old_shiftX;
-			A(1,2)=p(3)+old_shiftY;
+			A.initIdentity(3);
+			A(0,2)=p(2)+img.old_shiftX;
+			A(1,2)=p(3)+img.old_shiftY;
 			A(0,0)=1+p(4);
 			A(1,1)=1+p(5);
 
-			if (old_flip)
+			if (img.old_flip)
 			{
 				MAT_ELEM(A,0,0)*=-1;
 				MAT_ELEM(A,0,1)*=-1;
@@ -426,20 +489,20 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
 			double b=p(1);
 			FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mIp)
 				DIRECT_MULTIDIM_ELEM(mIp,n)=a*DIRECT_MULTIDIM_ELEM(mIp,n)+b;
-			Ip.write(fnImgOut);
+			Ip.write(img.fnImgOut);
 		}
 		catch (XmippError XE)
 		{
 			std::cerr << XE << std::endl;
-			std::cerr << "Warning: Cannot refine " << fnImg << std::endl;
+			std::cerr << "Warning: Cannot refine " << img.fnImg << std::endl;
 			rowOut.setValue(MDL_ENABLED,-1);
 		}
 	}
-    rowOut.setValue(MDL_IMAGE_ORIGINAL, fnImg);
-    rowOut.setValue(MDL_IMAGE, fnImgOut);
-    rowOut.setValue(MDL_ANGLE_ROT,  old_rot+p(6));
-    rowOut.setValue(MDL_ANGLE_TILT, old_tilt+p(7));
-    rowOut.setValue(MDL_ANGLE_PSI,  old_psi+p(8));
+    rowOut.setValue(MDL_IMAGE_ORIGINAL, img.fnImg);
+    rowOut.setValue(MDL_IMAGE, img.fnImgOut);
+    rowOut.setValue(MDL_ANGLE_ROT,  img.old_rot+p(6));
+    rowOut.setValue(MDL_ANGLE_TILT, img.old_tilt+p(7));
+    rowOut.setValue(MDL_ANGLE_PSI,  img.old_psi+p(8));
     rowOut.setValue(MDL_SHIFT_X,    0.);
     rowOut.setValue(MDL_SHIFT_Y,    0.);
     rowOut.setValue(MDL_FLIP,       false);
@@ -448,15 +511,15 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
     rowOut.setValue(MDL_CONTINUOUS_GRAY_B,p(1));
     rowOut.setValue(MDL_CONTINUOUS_SCALE_X,p(4));
     rowOut.setValue(MDL_CONTINUOUS_SCALE_Y,p(5));
-    rowOut.setValue(MDL_CONTINUOUS_X,p(2)+old_shiftX);
-    rowOut.setValue(MDL_CONTINUOUS_Y,p(3)+old_shiftY);
-    rowOut.setValue(MDL_CONTINUOUS_FLIP,old_flip);
-    if (hasCTF)
+    rowOut.setValue(MDL_CONTINUOUS_X,p(2)+img.old_shiftX);
+    rowOut.setValue(MDL_CONTINUOUS_Y,p(3)+img.old_shiftY);
+    rowOut.setValue(MDL_CONTINUOUS_FLIP,img.old_flip);
+    if (img.hasCTF)
     {
-    	rowOut.setValue(MDL_CTF_DEFOCUSU,old_defocusU+p(9));
-    	rowOut.setValue(MDL_CTF_DEFOCUSV,old_defocusV+p(10));
-    	rowOut.setValue(MDL_CTF_DEFOCUS_ANGLE,old_defocusAngle+p(11));
-    	if (old_defocusU+p(9)<0 || old_defocusU+p(10)<0)
+    	rowOut.setValue(MDL_CTF_DEFOCUSU,img.old_defocusU+p(9));
+    	rowOut.setValue(MDL_CTF_DEFOCUSV,img.old_defocusV+p(10));
+    	rowOut.setValue(MDL_CTF_DEFOCUS_ANGLE,img.old_defocusAngle+p(11));
+    	if (img.old_defocusU+p(9)<0 || img.old_defocusU+p(10)<0)
     		rowOut.setValue(MDL_ENABLED,-1);
     }
 
@@ -466,24 +529,23 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
     MDaux.addRow(rowOut);
     MDaux.write("PPPmd.xmd");
     Image<double> save;
-    save()=P();
+    save()=img.P();
     save.write("PPPprojection.xmp");
-    save()=I();
+    save()=img.I();
     save.write("PPPexperimental.xmp");
-    //save()=C;
-    //save.write("PPPC.xmp");
-    Ip.write("PPPexperimentalp.xmp");
-    Ifiltered.write("PPPexperimentalFiltered.xmp");
-    Ifilteredp.write("PPPexperimentalFilteredp.xmp");
-    E.write("PPPresidual.xmp");
-    std::cout << A << std::endl;
-    std::cout << fnImgOut << " rewritten\n";
+    img.Ip.write("PPPexperimentalp.xmp");
+    img.Ifiltered.write("PPPexperimentalFiltered.xmp");
+    img.Ifilteredp.write("PPPexperimentalFilteredp.xmp");
+    img.E.write("PPPresidual.xmp");
+    std::cout << img.A << std::endl;
+    std::cout << img.fnImgOut << " rewritten\n";
     std::cout << "Press any key" << std::endl;
     char c; std::cin >> c;
 #endif
 }
 #undef DEBUG
 
+
 void ProgAngularContinuousAssign2::postProcess()
 {
 	/*
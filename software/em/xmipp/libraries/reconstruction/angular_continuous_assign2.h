@@ -28,12 +28,62 @@
 
 #include <data/xmipp_program.h>
 #include <data/ctf.h>
+#include <data/numerical_tools.h>
 #include "fourier_projection.h"
 #include "fourier_filter.h"
 
 /**@defgroup AngularPredictContinuous2 angular_continuous_assign2 (Continuous angular assignment)
    @ingroup ReconsLibrary */
 //@{
+class ProgAngularContinuousAssign2;
+
+/** Continuous assignment of one image.
+    It keeps all the data of the image, so that several images can be
+    optimized at the same time by powellOptimizerBatch. */
+class ContinuousAssign2Image: public OptimizationObjective
+{
+public:
+    // Program with the data shared by all images
+    const ProgAngularContinuousAssign2 *prm;
+    // Input and output image filenames
+    FileName fnImg, fnImgOut;
+    // Output row
+    MDRow rowOut;
+    // Id of the output row in the output metadata
+    size_t rowId;
+    // Parameters and cost
+    Matrix1D<double> p;
+    double cost;
+    // Index of the problem in the batch (-1 if the image is not optimized)
+    int problem;
+    // Input image
+	Image<double> I, Ip, E, Ifiltered, Ifilteredp;
+	// Theoretical projection
+	Projection P;
+	// Fourier transform of the theoretical projection
+	MultidimArray< std::complex<double> > projectionFourier;
+	FourierTransformer transformer;
+	// Euler matrix of the projection
+	Matrix2D<double> Euler;
+    // Transformation matrix
+    Matrix2D<double> A;
+    // Original angles
+    double old_rot, old_tilt, old_psi;
+    // Original shift
+	double old_shiftX, old_shiftY;
+	// Original flip
+	bool old_flip;
+	// Has CTF
+	bool hasCTF;
+	// Original defocus
+	double old_defocusU, old_defocusV, old_defocusAngle;
+	// CTF
+	CTFDescription ctf;
+public:
+    /// Cost of the parameters in x[1]...x[12] (minus the correlation)
+    double evaluate(double *x);
+};
+
 /** Predict Continuous Parameters. */
 class ProgAngularContinuousAssign2: public XmippMetadataProgram
 {
@@ -74,6 +124,8 @@ public:
     bool phaseFlipped;
     // Penalization for the average
     double penalization;
+    // Number of threads
+    int nThreads;
 public:
     // 2D mask in real space
     MultidimArray<int> mask2D;
@@ -85,28 +137,16 @@ public:
     Image<double> V;
     // Volume size
     size_t Xdim;
-    // Input image
-	Image<double> I, Ip, E, Ifiltered, Ifilteredp;
-	// Theoretical projection
-	Projection P;
 	// Filter
     FourierFilter filter;
-    // Transformation matrix
-    Matrix2D<double> A;
-    // Original angles
-    double old_rot, old_tilt, old_psi;
-    // Original shift
-	double old_shiftX, old_shiftY;
-	// Original flip
-	bool old_flip;
-	// Has CTF
-	bool hasCTF;
-	// Original defocus
-	double old_defocusU, old_defocusV, old_defocusAngle;
-	// CTF
-	CTFDescription ctf;
 	// Covariance matrices
 	Matrix2D<double> C0, C;
+	// Images optimized at the same time
+	std::vector<ContinuousAssign2Image *> images;
+	// Number of images waiting to be optimized
+	size_t Npending;
+	// Optimization problems of the pending images
+	std::vector<PowellProblem> problems;
 public:
     /// Empty constructor
     ProgAngularContinuousAssign2();
@@ -132,9 +172,26 @@ public:
 
     /** Predict angles and shift.
         At the input the pose parameters must have an initial guess of the
-        parameters. At the output they have the estimated pose.*/
+        parameters. At the output they have the estimated pose.
+        The images are optimized in batches by several threads, so the
+        output row of an image may be written to the output metadata when
+        a later image is processed. */
     void processImage(const FileName &fnImg, const FileName &fnImgOut, const MDRow &rowIn, MDRow &rowOut);
 
+    /// Read an image and its initial parameters
+    void prepareImage(ContinuousAssign2Image &img, const MDRow &rowIn);
+
+    /// Write the result of an optimized image
+    void finishImage(ContinuousAssign2Image &img);
+
+    /** Optimize the pending images.
+        The output row of the last image is returned in rowOut (if given),
+        the rest are written to the output metadata. */
+    void optimizePendingImages(MDRow *rowOut);
+
+    /// Optimize the images of the last batch
+    void wait();
+
     /** Post process */
     void postProcess();
 };
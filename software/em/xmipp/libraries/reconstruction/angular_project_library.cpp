@@ -83,6 +83,10 @@ void ProgAngularProjectLibrary::readParams()
         else
             REPORT_ERROR(ERR_ARG_BADCMDLINE, "The interpolation kernel can be : nearest, linear, bspline");
     }
+    numThreads = getIntParam("--thr");
+    outputSize = getIntParam("--output_size");
+    if (outputSize > 0 && projType != FOURIER)
+        REPORT_ERROR(ERR_ARG_INCORRECT, "--output_size can only be used with the Fourier method");
 
     //NOTE perturb in computed after the even sampling is computes
     //     and max tilt min tilt applied
@@ -134,6 +138,9 @@ void ProgAngularProjectLibrary::defineParams()
     addParamsLine("                                              : nearest:          Nearest Neighborhood  ");
     addParamsLine("                                              : linear:           Linear  ");
     addParamsLine("                                              : bspline:          Cubic BSpline  ");
+    addParamsLine("  [--thr <N=1>]                 : Number of threads for the Fourier projection");
+    addParamsLine("  [--output_size <Xdim=-1>]     : Size of the projections with the Fourier method (neg= volume size).");
+    addParamsLine("                                : Smaller projections are the full size ones cropped in Fourier");
     addParamsLine("  [--perturb <sigma=0.0>]       : gaussian noise projection unit vectors ");
     addParamsLine("                                : a value=sin(sampling_rate)/4  ");
     addParamsLine("                                : may be a good starting point ");
@@ -169,6 +176,9 @@ void ProgAngularProjectLibrary::show()
         std::cout << " fourier " <<std::endl;
         std::cout << "     pad factor: "   << paddFactor <<std::endl;
         std::cout << "     maxFrequency: " << maxFrequency <<std::endl;
+        std::cout << "     threads: " << numThreads <<std::endl;
+        if (outputSize > 0)
+            std::cout << "     output size: " << outputSize <<std::endl;
         std::cout << "     interpolator: ";
         if (BSplineDeg == NEAREST)
             std::cout << " nearest" <<std::endl;
@@ -226,6 +236,37 @@ void ProgAngularProjectLibrary::project_angle_vector (int my_init, int my_end, b
 
     for (double mypsi=0;mypsi<360;mypsi += psi_sampling)
     {
+        if (projType == FOURIER)
+        {
+            // The projections are computed in batches by several threads
+            const int batchSize = 32 * numThreads;
+            Matrix2D<double> angles;
+            MultidimArray<double> gallery;
+            for (int i0=my_init;i0<=my_end;i0+=batchSize)
+            {
+                int n = XMIPP_MIN(batchSize, my_end-i0+1);
+                angles.initZeros(n,3);
+                for (int k=0;k<n;k++)
+                {
+                    const Matrix1D<double> &direction = mysampling.no_redundant_sampling_points_angles[i0+k];
+                    MAT_ELEM(angles,k,0) = XX(direction);
+                    MAT_ELEM(angles,k,1) = YY(direction);
+                    MAT_ELEM(angles,k,2) = mypsi+ZZ(direction);
+                }
+                Vfourier->project(angles, gallery, numThreads, outputSize);
+                P().resizeNoCopy(YSIZE(gallery),XSIZE(gallery));
+                for (int k=0;k<n;k++)
+                {
+                    gallery.getImage(k, P());
+                    P.setEulerAngles(MAT_ELEM(angles,k,0),MAT_ELEM(angles,k,1),MAT_ELEM(angles,k,2));
+                    P.setDataMode(_DATA_ALL);
+                    P.write(output_file,(size_t) (numberStepsPsi * (i0+k) + mypsi +1),true,WRITE_REPLACE);
+                }
+                if (verbose)
+                    progress_bar(i0+n-my_init);
+            }
+            continue;
+        }
         for (int i=my_init;i<=my_end;i++)
         {
             if (verbose)
@@ -240,8 +281,6 @@ void ProgAngularProjectLibrary::project_angle_vector (int my_init, int my_end, b
 //                projectVolume(inputVol(), P, Ydim, Xdim, rot,tilt,psi);
             if (projType == SHEARS)
                 projectVolume(*Vshears, P, Ydim, Xdim,   rot, tilt, psi);
-            else if (projType == FOURIER)
-                projectVolume(*Vfourier, P, Ydim, Xdim,  rot, tilt, psi);
             else if (projType == REALSPACE)
                 projectVolume(inputVol(), P, Ydim, Xdim, rot, tilt, psi);
 
@@ -82,6 +82,10 @@ public:
     double maxFrequency;
     /// The type of interpolation (NEAR
     int BSplineDeg;
+    /// Number of threads for Fourier projection
+    int numThreads;
+    /// Size of the Fourier projections (<=0 for the volume size)
+    int outputSize;
 
 #ifdef NEVERDEFINED
     /** vector with valid proyection directions after looking for 
@@ -56,6 +56,8 @@ void ProgAngularProjectionMatching::readParams()
         fn_ctf  = getParam("--ctf");
     phase_flipped = checkParam("--phase_flipped");
     threads = getIntParam("--thr");
+    maxResol = getDoubleParam("--max_resolution");
+    Ts = getDoubleParam("--sampling");
 
     do_scale = checkParam("--scale");
     if (checkParam("--append"))
@@ -110,6 +112,10 @@ void ProgAngularProjectionMatching::defineParams()
     addParamsLine("  [--pad <pad=1>]             : Padding factor (for CTF correction only)");
     addParamsLine("  [--phase_flipped]            : Use this if the experimental images have been phase flipped");
     addParamsLine("  [--thr <threads=1>]           : Number of concurrent threads");
+    addParamsLine("  [--max_resolution <f=-1>]     : Resolution (A) up to which images are compared (neg= full size).");
+    addParamsLine("                               : Images and references are Fourier-cropped to a smaller box for the");
+    addParamsLine("                               : matching, shifts are given in the original pixels");
+    addParamsLine("  [--sampling <Ts=1>]           : Sampling rate (A/pixel), only used with --max_resolution");
     addParamsLine("  [--append]                : Append (versus overwrite) data to the output file");
 }
 
@@ -138,6 +144,11 @@ void ProgAngularProjectionMatching::show()
         std::cout << "  Number of references    : " << total_nr_refs << " (all stored in memory)" << std::endl;
     }
     std::cout << "  Max. allowed shift      : +/- " <<max_shift<<" pixels"<<std::endl;
+    if (workdim < dim)
+    {
+        std::cout << "  Working size            : " << workdim << " pixels (up to " << maxResol << " A)" << std::endl
+        << "    + Rings and 5D-search offsets in working pixels" << std::endl;
+    }
     if (search5d_shift > 0)
     {
         std::cout << "  5D-search shift range   : "<<search5d_shift<<" pixels (sampled "<<nr_trans<<" times)"<<std::endl;
@@ -261,17 +272,37 @@ void ProgAngularProjectionMatching::produceSideInfo()
     if (Ro<0)
         Ro=(dim/2)-1;
 
+    // Working size. The maximum resolution is placed at 0.9 of the new
+    // Nyquist frequency, and rings and 5D-search offsets are scaled to it
+    workdim = dim;
+    if (maxResol > 0)
+    {
+        double newTs = 0.9 * maxResol / 2;
+        if (newTs > Ts)
+            workdim = XMIPP_MIN(dim, 2 * (size_t)ROUND(0.5 * dim * Ts / newTs));
+    }
+    workScale = (double)workdim / dim;
+    if (workdim < dim)
+    {
+        Ri = XMIPP_MAX(1, ROUND(Ri * workScale));
+        Ro = XMIPP_MIN((int)workdim / 2 - 1, ROUND(Ro * workScale));
+        search5d_shift = ROUND(search5d_shift * workScale);
+        search5d_step = XMIPP_MAX(1, ROUND(search5d_step * workScale));
+    }
+    cropToWorkingSize(img());
+
     // Calculate necessary memory per image
     produceSplineCoefficients(BSPLINE3,Maux,img());
     P.getPolarFromCartesianBSpline(Maux,Ri,Ro);
     P.calculateFftwPlans(global_plans);
     fourierTransformRings(P,fP,global_plans,false);
+    fP_layout = fP;
     double memory_per_ref = 0.;
     for (int i = 0; i < fP.getRingNo(); i++)
     {
         memory_per_ref += (double) fP.getSampleNo(i) * 2 * sizeof(double);
     }
-    memory_per_ref += dim * dim * sizeof(double);
+    memory_per_ref += workdim * workdim * sizeof(double);
     max_nr_imgs_in_memory = ROUND( 1024 * 1024 * 1024 * avail_memory / memory_per_ref);
 
     // Set up angular sampling
@@ -393,15 +424,15 @@ void ProgAngularProjectionMatching::produceSideInfo()
     DFexp.findObjects(ids);
 }
 
-void ProgAngularProjectionMatching::getCurrentReference(int refno,
-        Polar_fftw_plans &local_plans)
+void ProgAngularProjectionMatching::prepareReference(int refno,
+        Polar_fftw_plans &local_plans, MultidimArray<double> &Mref,
+        Polar<std::complex <double> > &fP, double &stddev)
 {
     FileName                      fnt;
     Image<double>                 img;
-    double                        mean,stddev;
+    double                        mean;
     MultidimArray<double>         Maux;
     Polar<double>                 P;
-    Polar<std::complex <double> > fP;
     FourierTransformer                     local_transformer;
 
     // Image was not stored yet: read it from disc and store
@@ -468,12 +499,25 @@ void ProgAngularProjectionMatching::getCurrentReference(int refno,
         }
     }
 
+    cropToWorkingSize(img());
+
     // Calculate FTs of polar rings and its stddev
     produceSplineCoefficients(BSPLINE3,Maux,img());
     P.getPolarFromCartesianBSpline(Maux,Ri,Ro);
     P.computeAverageAndStddev(mean,stddev);
     P -= mean;
     fourierTransformRings(P,fP,local_plans,true);
+    Mref = img();
+}
+
+void ProgAngularProjectionMatching::getCurrentReference(int refno,
+        Polar_fftw_plans &local_plans)
+{
+    MultidimArray<double>         Mref;
+    Polar<std::complex <double> > fP;
+    double                        stddev;
+
+    prepareReference(refno, local_plans, Mref, fP, stddev);
 
     pthread_mutex_lock(  &update_refs_in_memory_mutex );
 
@@ -489,7 +533,7 @@ void ProgAngularProjectionMatching::getCurrentReference(int refno,
     pointer_refsinmem2allrefs[counter] = refno;
     fP_ref[counter] = fP;
     stddev_ref[counter] = stddev;
-    proj_ref[counter] = img();
+    proj_ref[counter] = Mref;
     //#define DEBUG
 #ifdef DEBUG
 
@@ -515,6 +559,93 @@ void ProgAngularProjectionMatching::getCurrentReference(int refno,
     //    local_transformer.cleanup();
 }
 
+size_t ProgAngularProjectionMatching::getGalleryReferenceSize() const
+{
+    // stddev + projection + FTs of the polar rings
+    size_t refSize = 1 + workdim * workdim;
+    for (int i = 0; i < fP_layout.getRingNo(); i++)
+        refSize += 2 * fP_layout.getSampleNo(i);
+    return refSize;
+}
+
+void ProgAngularProjectionMatching::storeReferenceInGallery(size_t pos,
+        double *gallery, Polar_fftw_plans &local_plans)
+{
+    MultidimArray<double>         Mref;
+    Polar<std::complex <double> > fP;
+    double                        stddev;
+
+    prepareReference(mysampling.no_redundant_sampling_points_index[pos],
+                     local_plans, Mref, fP, stddev);
+
+    double *ptr = gallery + pos * getGalleryReferenceSize();
+    *ptr++ = stddev;
+    memcpy(ptr, MULTIDIM_ARRAY(Mref), workdim * workdim * sizeof(double));
+    ptr += workdim * workdim;
+    for (int i = 0; i < fP.getRingNo(); i++)
+    {
+        size_t n = fP.getSampleNo(i);
+        memcpy(ptr, MULTIDIM_ARRAY(fP.rings[i]), n * 2 * sizeof(double));
+        ptr += 2 * n;
+    }
+}
+
+void ProgAngularProjectionMatching::aliasGallery(double *gallery)
+{
+    delete [] fP_ref;
+    delete [] proj_ref;
+    delete [] stddev_ref;
+    try
+    {
+        fP_ref = new Polar<std::complex<double> >[total_nr_refs];
+        proj_ref = new MultidimArray<double>[total_nr_refs];
+        stddev_ref = new double[total_nr_refs];
+    }
+    catch (std::bad_alloc&)
+    {
+        REPORT_ERROR(ERR_MEM_BADREQUEST,"Error allocating memory in aliasGallery");
+    }
+
+    // All references are in memory from now on, so getCurrentReference
+    // is never called and the gallery is only read
+    max_nr_refs_in_memory = total_nr_refs;
+    pointer_refsinmem2allrefs.resize(total_nr_refs);
+    size_t refSize = getGalleryReferenceSize();
+    for (int pos = 0; pos < total_nr_refs; pos++)
+    {
+        double *ptr = gallery + pos * refSize;
+        stddev_ref[pos] = *ptr++;
+
+        MultidimArray<double> &Mref = proj_ref[pos];
+        Mref.setDimensions(workdim, workdim, 1, 1);
+        Mref.data = ptr;
+        Mref.nzyxdimAlloc = Mref.nzyxdim;
+        Mref.destroyData = false;
+        Mref.setXmippOrigin();
+        ptr += workdim * workdim;
+
+        Polar<std::complex<double> > &fP = fP_ref[pos];
+        fP.mode = fP_layout.mode;
+        fP.oversample = fP_layout.oversample;
+        fP.ring_radius = fP_layout.ring_radius;
+        fP.rings.resize(fP_layout.getRingNo());
+        for (int i = 0; i < fP_layout.getRingNo(); i++)
+        {
+            MultidimArray<std::complex<double> > &ring = fP.rings[i];
+            ring.setDimensions(fP_layout.getSampleNo(i), 1, 1, 1);
+            ring.data = (std::complex<double> *)ptr;
+            ring.nzyxdimAlloc = ring.nzyxdim;
+            ring.destroyData = false;
+            ptr += 2 * ring.nzyxdim;
+        }
+
+        int refno = mysampling.no_redundant_sampling_points_index[pos];
+        pointer_allrefs2refsinmem[refno] = pos;
+        pointer_refsinmem2allrefs[pos] = refno;
+    }
+    counter_refs_in_memory = total_nr_refs;
+}
+
 void * threadRotationallyAlignOneImage( void * data )
 {
     structThreadRotationallyAlignOneImage * thread_data = (structThreadRotationallyAlignOneImage *) data;
@@ -811,7 +942,8 @@ void ProgAngularProjectionMatching::translationallyAlignOneImage(MultidimArray<d
     }
     else
         opt_xoff = opt_yoff = 0.;
-    if (opt_xoff * opt_xoff + opt_yoff * opt_yoff > max_shift * max_shift)
+    double work_max_shift = max_shift * workScale;
+    if (opt_xoff * opt_xoff + opt_yoff * opt_yoff > work_max_shift * work_max_shift)
         opt_xoff = opt_yoff = 0.;
     //#define DEBUG
 #ifdef DEBUG
@@ -1067,6 +1199,10 @@ void ProgAngularProjectionMatching::processSomeImages(const std::vector<size_t>
         //!a
         // Divide opt_shifts by old_scale
 
+        // Shifts back to the original pixel size
+        opt_xoff /= workScale;
+        opt_yoff /= workScale;
+
         // Add previously applied translation to the newly found one
         opt_xoff += img.Xoff();
         opt_yoff += img.Yoff();
@@ -1140,6 +1276,15 @@ void ProgAngularProjectionMatching::getCurrentImage(size_t imgid, Image<double>
         selfApplyGeometry(BSPLINE3, img(), A, IS_INV, WRAP);
     //img.write("after.spi");
     //exit(0);
+    cropToWorkingSize(img());
+}
+
+void ProgAngularProjectionMatching::cropToWorkingSize(MultidimArray<double> &I) const
+{
+    if (workdim == dim)
+        return;
+    selfScaleToSizeFourier(workdim, workdim, I);
+    I.setXmippOrigin();
 }
 
 void ProgAngularProjectionMatching::writeOutputFiles()
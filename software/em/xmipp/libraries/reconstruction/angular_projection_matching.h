@@ -87,6 +87,14 @@ public:
     double max_shift;
     /** Inner and outer radii to limit the rotational search */
     int Ri, Ro;
+    /** Resolution (A) up to which images are compared and sampling rate
+        (A/pixel). If maxResol is positive, images and references are
+        Fourier-cropped to workdim before the matching */
+    double maxResol, Ts;
+    /** Size of the images during the matching (dim if not cropped) */
+    size_t workdim;
+    /** Ratio between the working size and the original one */
+    double workScale;
     /** Available memory for storage of all references (in Gb) */
     double avail_memory;
     /** Maximum number of references to store in memory */
@@ -111,6 +119,8 @@ public:
     Polar<std::complex<double> >   *fP_ref, *fP_img, *fPm_img;
     /** Array with reference images */
     MultidimArray<double> *proj_ref;
+    /** Polar FT with the ring sizes of all references */
+    Polar<std::complex<double> > fP_layout;
     /** Global plans for fftw transformers of all polar rings */
     Polar_fftw_plans global_plans;
     /** vector with stddevs for all reference projections */
@@ -187,6 +197,26 @@ public:
       store FT of the polar transform as well as the original image */
     void getCurrentReference(int refno, Polar_fftw_plans &local_plans);
 
+    /** Read a reference from disc, apply the CTF and compute the FT of its
+      polar transform and its stddev */
+    void prepareReference(int refno, Polar_fftw_plans &local_plans,
+                          MultidimArray<double> &Mref,
+                          Polar<std::complex <double> > &fP, double &stddev);
+
+    /** Number of doubles used by one reference in a gallery buffer.
+      Each reference is stored as its stddev, the projection and the FTs
+      of its polar rings. */
+    size_t getGalleryReferenceSize() const;
+
+    /** Prepare the reference at stack position pos and store it in a
+      gallery buffer with room for all references */
+    void storeReferenceInGallery(size_t pos, double *gallery, Polar_fftw_plans &local_plans);
+
+    /** Use a gallery buffer with all the references instead of reading them
+      when needed. The references alias the buffer, which must not be
+      freed while they are in use. */
+    void aliasGallery(double *gallery);
+
     /** Get images to process.
      * This function will return the id's of images to process.
      * It will be specially useful for MPI case when images will be distributed
@@ -202,6 +232,9 @@ public:
       previous optimal Xoff and Yoff */
     void getCurrentImage(size_t imgid, Image<double> &img);
 
+    /** Fourier-crop an image of size dim to the working size */
+    void cropToWorkingSize(MultidimArray<double> &I) const;
+
     /** Write out results to disk
      * This function should be override in MPI class, only master should write.
      */
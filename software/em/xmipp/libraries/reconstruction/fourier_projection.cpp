@@ -38,18 +38,28 @@ FourierProjector::FourierProjector(MultidimArray<double> &V, double paddFactor,
 
 void FourierProjector::project(double rot, double tilt, double psi)
 {
-    double freqy, freqx;
-    std::complex< double > f;
     Euler_angles2matrix(rot,tilt,psi,E);
+    projectFourier(E, projectionFourier);
+    transformer2D.inverseFourierTransform();
+}
 
-    projectionFourier.initZeros();
-    double shift=-FIRST_XMIPP_INDEX(volumeSize);
-    double xxshift = -2 * PI * shift / volumeSize;
+void FourierProjector::projectFourier(const Matrix2D<double> &E,
+                                      MultidimArray< std::complex<double> > &projectionFourier,
+                                      int outputSize) const
+{
+    double freqy, freqx;
+    int Xdim=(outputSize>0) ? outputSize : volumeSize;
+    projectionFourier.initZeros(Xdim, Xdim/2+1);
+    double shift=-FIRST_XMIPP_INDEX(Xdim);
+    double xxshift = -2 * PI * shift / Xdim;
+    // Frequencies of the output image in digital units of the volume
+    double freqScale=(double)Xdim/volumeSize;
     double maxFreq2=maxFrequency*maxFrequency;
     double volumePaddedSize=XSIZE(VfourierRealCoefs);
     for (size_t i=0; i<YSIZE(projectionFourier); ++i)
     {
-        FFT_IDX2DIGFREQ(i,volumeSize,freqy);
+        FFT_IDX2DIGFREQ(i,Xdim,freqy);
+        freqy*=freqScale;
         double freqy2=freqy*freqy;
         double phasey=(double)(i) * xxshift;
 
@@ -59,7 +69,8 @@ void FourierProjector::project(double rot, double tilt, double psi)
         for (size_t j=0; j<XSIZE(projectionFourier); ++j)
         {
             // The frequency of pairs (i,j) in 2D
-            FFT_IDX2DIGFREQ(j,volumeSize,freqx);
+            FFT_IDX2DIGFREQ(j,Xdim,freqx);
+            freqx*=freqScale;
 
             // Do not consider pixels with high frequency
             if ((freqy2+freqx*freqx)>maxFreq2)
@@ -118,7 +129,99 @@ void FourierProjector::project(double rot, double tilt, double psi)
     }
     //VfourierRealCoefs.clear();
     //VfourierImagCoefs.clear();
-    transformer2D.inverseFourierTransform();
+}
+
+/* Data shared by the threads of a batch */
+struct FourierProjectorBatch
+{
+    const FourierProjector *projector;
+    const Matrix2D<double> *angles;
+    MultidimArray<double> *projections;
+    std::vector< MultidimArray< std::complex<double> > > *projectionsFourier;
+    int outputSize;
+    ThreadTaskDistributor *td;
+};
+
+void threadFourierProjectorBatch(ThreadArgument &thArg)
+{
+    FourierProjectorBatch *batch = (FourierProjectorBatch *) thArg.workClass;
+    const Matrix2D<double> &angles = *(batch->angles);
+    int Xdim = batch->outputSize;
+
+    // Each thread inverts its projections with its own transformer
+    MultidimArray<double> I;
+    MultidimArray< std::complex<double> > Ifourier;
+    FourierTransformer transformer;
+    if (batch->projections != NULL)
+    {
+        I.initZeros(Xdim, Xdim);
+        transformer.FourierTransform(I, Ifourier, false);
+    }
+
+    Matrix2D<double> E;
+    size_t first, last;
+    while (batch->td->getTasks(first, last))
+        for (size_t n = first; n <= last; ++n)
+        {
+            Euler_angles2matrix(MAT_ELEM(angles, n, 0), MAT_ELEM(angles, n, 1),
+                                MAT_ELEM(angles, n, 2), E);
+            if (batch->projections != NULL)
+            {
+                batch->projector->projectFourier(E, Ifourier, Xdim);
+                transformer.inverseFourierTransform();
+                memcpy(&DIRECT_NZYX_ELEM(*(batch->projections), n, 0, 0, 0),
+                       MULTIDIM_ARRAY(I), MULTIDIM_SIZE(I) * sizeof(double));
+            }
+            else
+                batch->projector->projectFourier(E, (*(batch->projectionsFourier))[n], Xdim);
+        }
+}
+
+void FourierProjector::projectBatch(const Matrix2D<double> &angles, MultidimArray<double> *projections,
+                                    std::vector< MultidimArray< std::complex<double> > > *projectionsFourier,
+                                    int numberOfThreads, int outputSize) const
+{
+    size_t nProjections = MAT_YSIZE(angles);
+    if (nProjections > 0 && MAT_XSIZE(angles) < 3)
+        REPORT_ERROR(ERR_MATRIX_SIZE, "FourierProjector::project: angles should have rot, tilt and psi columns");
+    if (outputSize > volumeSize)
+        REPORT_ERROR(ERR_ARG_INCORRECT, "FourierProjector::project: the output cannot be larger than the volume");
+
+    FourierProjectorBatch batch;
+    batch.projector = this;
+    batch.angles = &angles;
+    batch.projections = projections;
+    batch.projectionsFourier = projectionsFourier;
+    batch.outputSize = (outputSize > 0) ? outputSize : volumeSize;
+    if (projections != NULL)
+    {
+        projections->resizeNoCopy(nProjections, 1, batch.outputSize, batch.outputSize);
+        projections->setXmippOrigin();
+    }
+    else
+        projectionsFourier->resize(nProjections);
+    if (nProjections == 0)
+        return;
+
+    numberOfThreads = XMIPP_MAX(1, XMIPP_MIN(numberOfThreads, (int)nProjections));
+    size_t blockSize = XMIPP_MAX(1, nProjections / (4 * numberOfThreads));
+    ThreadTaskDistributor td(nProjections, blockSize);
+    batch.td = &td;
+    ThreadManager thMgr(numberOfThreads, &batch);
+    thMgr.run(threadFourierProjectorBatch);
+}
+
+void FourierProjector::project(const Matrix2D<double> &angles, MultidimArray<double> &projections,
+                               int numberOfThreads, int outputSize) const
+{
+    projectBatch(angles, &projections, NULL, numberOfThreads, outputSize);
+}
+
+void FourierProjector::projectFourier(const Matrix2D<double> &angles,
+                                      std::vector< MultidimArray< std::complex<double> > > &projectionsFourier,
+                                      int numberOfThreads, int outputSize) const
+{
+    projectBatch(angles, NULL, &projectionsFourier, numberOfThreads, outputSize);
 }
 
 void FourierProjector::produceSideInfo()
@@ -30,6 +30,7 @@
 #include <data/filters.h>
 #include <data/xmipp_fftw.h>
 #include <data/projection.h>
+#include <data/xmipp_threads.h>
 
 /**@defgroup FourierProjection Fourier projection
    @ingroup ReconsLibrary */
@@ -76,11 +77,52 @@ public:
      * This method gets the volume's Fourier and the Euler's angles as the inputs and interpolates the related projection
      */
     void project(double rot, double tilt, double psi);
+
+    /**
+     * Interpolate the Fourier transform (FFTW half format) of the projection
+     * for the Euler matrix E. This method does not modify the projector, so it
+     * can be called from several threads at the same time.
+     * If outputSize is given (smaller than the volume size), the transform of
+     * an outputSize x outputSize projection is computed, this is the same as
+     * the full size projection downsampled in Fourier.
+     */
+    void projectFourier(const Matrix2D<double> &E,
+                        MultidimArray< std::complex<double> > &projectionFourier,
+                        int outputSize = 0) const;
+
+    /**
+     * Project a batch of directions with several threads.
+     * angles has a row (rot, tilt, psi) per projection and the projections
+     * are returned in a stack with an image per row. outputSize is as in
+     * projectFourier. The projector is only read, so this method can be
+     * called while other threads are using the projector.
+     * @code
+     * Matrix2D<double> angles(nDirs, 3);
+     * ...
+     * MultidimArray<double> gallery;
+     * projector.project(angles, gallery, nThreads, 64);
+     * @endcode
+     */
+    void project(const Matrix2D<double> &angles, MultidimArray<double> &projections,
+                 int numberOfThreads = 1, int outputSize = 0) const;
+
+    /**
+     * Same as the batch project but the Fourier transforms of the
+     * projections (FFTW half format) are returned.
+     */
+    void projectFourier(const Matrix2D<double> &angles,
+                        std::vector< MultidimArray< std::complex<double> > > &projectionsFourier,
+                        int numberOfThreads = 1, int outputSize = 0) const;
 private:
     /*
      * This is a private method which provides the values for the class variable
      */
     void produceSideInfo();
+
+    /* Project a batch into real or Fourier space (one of the outputs is NULL) */
+    void projectBatch(const Matrix2D<double> &angles, MultidimArray<double> *projections,
+                      std::vector< MultidimArray< std::complex<double> > > *projectionsFourier,
+                      int numberOfThreads, int outputSize) const;
 };
 
 /*
@@ -63,6 +63,7 @@ void ProgMLF2D::defineAdditionalParams(XmippProgram * prog, const char * section
     prog->addParamsLine("                               : Second is the highest in following iterations and third is lowest");
     prog->addParamsLine(" [ --fix_high <float=-1>]       : ");
     prog->addParamsLine(" [ --include_allfreqs ] ");
+    prog->addParamsLine(" [ --real_space_rotations ]     : Rotate the references in real space instead of resampling their Fourier transforms");
 }
 
 // Fourier mode usage ==============================================================
@@ -160,6 +161,7 @@ void ProgMLF2D::readParams()
     //fn_doc = getParam("--doc");
     do_include_allfreqs = checkParam("--include_allfreqs");
     fix_high = getDoubleParam("--fix_high");
+    do_real_space_rotations = checkParam("--real_space_rotations");
 
     search_rot = getDoubleParam("--search_rot");
 
@@ -1326,6 +1328,81 @@ void ProgMLF2D::getFTfromVector(const std::vector<double> &in,
 
 }
 
+void ProgMLF2D::appendRotatedFTtoVector(const MultidimArray<std::complex<double> > &Fpad,
+                                        int pdim, double psi, std::vector<double> &out)
+{
+    // rotate(..., -psi, ...) takes the output pixel r from the input at A^t r,
+    // so the rotated transform at k is the original one at A^t k
+    Matrix2D<double> A;
+    rotation2DMatrix(-psi, A, false);
+    double scale = (double)pdim / dim;
+    double a00 = scale * MAT_ELEM(A, 0, 0), a01 = scale * MAT_ELEM(A, 0, 1);
+    double a10 = scale * MAT_ELEM(A, 1, 0), a11 = scale * MAT_ELEM(A, 1, 1);
+    // Both transforms are normalized by the number of pixels
+    double norm = scale * scale;
+    int idim = (int)dim, ihdim = (int)hdim;
+    int origin = -FIRST_XMIPP_INDEX(idim);
+
+    for (size_t ipoint = 0; ipoint < nr_points_2d; ipoint++)
+    {
+        int ky = pointer_i[ipoint];
+        int kx = pointer_j[ipoint];
+        if (kx > ihdim)
+            kx -= idim;
+
+        // Bilinear interpolation in the padded transform
+        double qx = a00 * kx + a10 * ky;
+        double qy = a01 * kx + a11 * ky;
+        std::complex<double> val = norm * interpolatedHalfFourierValue(Fpad, pdim, qx, qy);
+
+        // Fourier transforms in the vectors have their phase origin at the first pixel
+        if (idim % 2 == 0)
+        {
+            if ((kx + ky) & 1)
+                val = -val;
+        }
+        else
+        {
+            double arg = -2 * PI * origin * (kx + ky) / (double)idim;
+            val *= std::complex<double>(cos(arg), sin(arg));
+        }
+        out.push_back(val.real());
+        out.push_back(val.imag());
+    }
+}
+
+void ProgMLF2D::appendFlippedFTtoVector(const MultidimArray<std::complex<double> > &Fin,
+                                        const Matrix2D<double> &A, int origin,
+                                        std::vector<double> &out)
+{
+    // applyGeometry(..., A, IS_INV, WRAP) takes the output pixel r from the
+    // input at A r, so the flipped transform at k is the original one at A k
+    int a00 = ROUND(MAT_ELEM(A, 0, 0)), a01 = ROUND(MAT_ELEM(A, 0, 1));
+    int a10 = ROUND(MAT_ELEM(A, 1, 0)), a11 = ROUND(MAT_ELEM(A, 1, 1));
+    int idim = (int)dim, ihdim = (int)hdim;
+
+    for (size_t ipoint = 0; ipoint < nr_points_2d; ipoint++)
+    {
+        int ky = pointer_i[ipoint];
+        int kx = pointer_j[ipoint];
+        if (kx > ihdim)
+            kx -= idim;
+        int qx = a00 * kx + a01 * ky;
+        int qy = a10 * kx + a11 * ky;
+        std::complex<double> val = dAij(Fin, intWRAP(qy, 0, idim - 1), intWRAP(qx, 0, idim - 1));
+
+        // Correct the phase origin, which is at the first pixel
+        // (for even sizes kx+ky and qx+qy have the same parity)
+        if (idim % 2 != 0)
+        {
+            double arg = -2 * PI * origin * (kx + ky - qx - qy) / (double)idim;
+            val *= std::complex<double>(cos(arg), sin(arg));
+        }
+        out.push_back(val.real());
+        out.push_back(val.imag());
+    }
+}
+
 // Rotate reference for all models and rotations and fill Fref vectors =============
 void ProgMLF2D::rotateReference(std::vector<double> &out)
 {
@@ -1335,6 +1412,47 @@ void ProgMLF2D::rotateReference(std::vector<double> &out)
     MultidimArray<double> Maux;
     MultidimArray<std::complex<double> > Faux;
 
+    if (!do_real_space_rotations)
+    {
+        // Transform each reference once (padded for a finer sampling) and
+        // interpolate the rotated transforms only at the current Fourier points
+        int pdim = 2 * dim;
+        FourierTransformer transformer;
+        FOR_ALL_MODELS()
+        {
+            model.Iref[refno]().setXmippOrigin();
+            model.Iref[refno]().window(Maux, FIRST_XMIPP_INDEX(pdim), FIRST_XMIPP_INDEX(pdim),
+                                       LAST_XMIPP_INDEX(pdim), LAST_XMIPP_INDEX(pdim));
+            CenterFFT(Maux, false);
+            transformer.FourierTransform(Maux, Faux, false);
+
+            FOR_ALL_ROTATIONS()
+            {
+                // Add arbitrary number (small_angle) to avoid 0-degree rotation (lacking interpolation)
+                psi = (double)(ipsi * psi_max / nr_psi) + SMALLANGLE;
+                size_t istart = out.size();
+                appendRotatedFTtoVector(Faux, pdim, psi, out);
+
+                // Normalize the magnitude of the rotated references to 1st rot of that ref
+                // This is necessary because interpolation can lead to lower overall Fref
+                AA = 0.;
+                for (size_t n = istart; n < out.size(); n++)
+                    AA += out[n] * out[n];
+                if (ipsi == 0)
+                    stdAA = AA;
+                if (AA > 0)
+                {
+                    double sqrtVal = sqrt(stdAA/AA);
+                    for (size_t n = istart; n < out.size(); n++)
+                        out[n] *= sqrtVal;
+                }
+            }
+            // Free memory
+            model.Iref[refno]().resize(0,0);
+        }
+        return;
+    }
+
     Maux.initZeros(dim, dim);
     Maux.setXmippOrigin();
 
@@ -1486,7 +1604,7 @@ void ProgMLF2D::calculateFourierOffsets(const MultidimArray<double> &Mimg,
     std::vector<double> Fimg_flip;
     MultidimArray<std::complex<double> > Fimg;
     MultidimArray<double> trans(2);
-    MultidimArray<double> Maux2, Maux;
+    MultidimArray<double> Maux2;
 
     Moffsets.resize(dim, dim);
     Moffsets.setXmippOrigin();
@@ -1494,21 +1612,17 @@ void ProgMLF2D::calculateFourierOffsets(const MultidimArray<double> &Mimg,
     Moffsets_mirror.resize(dim, dim);
     Moffsets_mirror.setXmippOrigin();
     Moffsets_mirror.initConstant(-1);
-    Maux.resize(dim, dim);
-    Maux.setXmippOrigin();
     Maux2.resize(dim, dim);
     Maux2.setXmippOrigin();
 
     // Flip images and store the precalculates Fourier Transforms in Fimg_flip
+    // Flips are multiples of 90 degrees and mirrors, so they are applied
+    // by reindexing a single Fourier transform of the image. This transform
+    // is full size, only its coefficients at the current points are used
     out.clear();
+    FourierTransform(Mimg, Fimg);
     FOR_ALL_FLIPS()
-    {
-        Maux.setXmippOrigin();
-        applyGeometry(LINEAR, Maux, Mimg, F[iflip], IS_INV, WRAP);
-
-        FourierTransformHalf(Maux, Fimg);
-        appendFTtoVector(Fimg,Fimg_flip);
-    }
+    appendFlippedFTtoVector(Fimg, F[iflip], -STARTINGX(Mimg), Fimg_flip);
 
     // Now for all relevant offsets calculate the Fourier transforms
     // Matrices Moffsets & Moffsets_mirror contain pointers for the
@@ -127,6 +127,8 @@ public:
     size_t nr_points_prob, nr_points_2d, dnr_points_2d;
     /** Current highest resolution shell */
     size_t current_highres_limit;
+    /** Rotate references in real space instead of resampling their Fourier transform */
+    bool do_real_space_rotations;
 
     /// IN DEVELOPMENT
 
@@ -216,6 +218,20 @@ public:
                          MultidimArray<std::complex<double> > &out,
                          bool only_real = false);
 
+    // Append the Fourier transform (in half format!) of an image rotated by psi
+    // to a vector. Fpad is the transform of the image padded to pdim and with its
+    // phase origin at the image center. Only the current Fourier points are
+    // interpolated, so the cost depends on the current resolution limit.
+    void appendRotatedFTtoVector(const MultidimArray<std::complex<double> > &Fpad,
+                                 int pdim, double psi, std::vector<double> &out);
+
+    // Append the Fourier transform (in half format!) of a flipped image to a vector.
+    // Fin is the whole transform of the image, flips map the Fourier grid onto
+    // itself and are applied by reindexing the current Fourier points.
+    void appendFlippedFTtoVector(const MultidimArray<std::complex<double> > &Fin,
+                                 const Matrix2D<double> &A, int origin,
+                                 std::vector<double> &out);
+
     /// Fill vector of matrices with all rotations of reference
     void rotateReference(std::vector<double> &out);
 
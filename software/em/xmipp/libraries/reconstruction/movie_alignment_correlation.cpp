@@ -45,6 +45,7 @@ void ProgMovieAlignmentCorrelation::readParams()
     yLTcorner= getIntParam("--cropULCorner",1);
     xDRcorner = getIntParam("--cropDRCorner",0);
     yDRcorner = getIntParam("--cropDRCorner",1);
+    nThreads = getIntParam("--thr");
     show();
 }
 
@@ -64,7 +65,8 @@ void ProgMovieAlignmentCorrelation::show()
     << "Aligned micrograph:  " << fnAvg              << std::endl
     << "Frame range:         " << nfirst << " " << nlast << std::endl
     << "Crop corners  " << "(" << xLTcorner << ", " << yLTcorner << ") "
-    << "(" << xDRcorner << ", " << yDRcorner << ") "
+    << "(" << xDRcorner << ", " << yDRcorner << ") " << std::endl
+    << "Threads:             " << nThreads           << std::endl
     ;
 }
 
@@ -84,11 +86,24 @@ void ProgMovieAlignmentCorrelation::defineParams()
     addParamsLine("  [--frameRange <n0=-1> <nF=-1>]  : First and last frame to process, frame numbers start at 0");
     addParamsLine("  [--cropULCorner <x=0> <y=0>]    : crop up left corner (unit=px, index starts at 0)");
     addParamsLine("  [--cropDRCorner <x=-1> <y=-1>]    : crop down right corner (unit=px, index starts at 0), -1 -> no crop");
+    addParamsLine("  [--thr <N=1>]                : Number of threads used to decode the frames of TIFF movies");
     addExampleLine("A typical example",false);
     addExampleLine("xmipp_movie_alignment_correlation -i movie.xmd --oaligned alignedMovie.stk --oavg alignedMicrograph.mrc");
     addSeeAlsoLine("xmipp_movie_optical_alignment_cpu");
 }
 
+void ProgMovieAlignmentCorrelation::readFrame(const FileName &fnFrame, Image<double> &I)
+{
+    size_t idx;
+    String fnStack;
+    fnFrame.decompose(idx, fnStack);
+    // TIFF frames are decoded in parallel, only the requested directory is read
+    if (idx != ALL_IMAGES && FileName(fnFrame.getFileFormat()).contains("tif"))
+        I.readRange(fnStack, idx, idx, nThreads);
+    else
+        I.read(fnFrame);
+}
+
 void computeTotalShift(int iref, int j, const Matrix1D<double> &shiftX, const Matrix1D<double> &shiftY,
                        double &totalShiftX, double &totalShiftY)
 {
@@ -189,10 +204,10 @@ void ProgMovieAlignmentCorrelation::run()
         {
             movie.getValue(MDL_IMAGE,fnFrame,__iter.objId);
             if (yDRcorner==-1)
-                cropedFrame.read(fnFrame);
+                readFrame(fnFrame, cropedFrame);
             else
             {
-                frame.read(fnFrame);
+                readFrame(fnFrame, frame);
                 frame().window(cropedFrame(), yLTcorner, xLTcorner, yDRcorner, xDRcorner);
             }
 
@@ -239,11 +254,17 @@ void ProgMovieAlignmentCorrelation::run()
     Mcorr.resizeNoCopy(newYdim,newXdim);
     Mcorr.setXmippOrigin();
     CorrelationAux aux;
+    WindowedShiftAux windowAux;
     for (size_t i=0; i<N-1; ++i)
     {
         for (size_t j=i+1; j<N; ++j)
         {
-            bestShift(*frameFourier[i],*frameFourier[j],Mcorr,bX(idx),bY(idx),aux,NULL,maxShift);
+            // With a maximum shift only the correlation within it is computed
+            if (maxShift>=0)
+                bestShiftInWindow(*frameFourier[i],*frameFourier[j],newXdim,newYdim,
+                                  bX(idx),bY(idx),(int)maxShift,windowAux);
+            else
+                bestShift(*frameFourier[i],*frameFourier[j],Mcorr,bX(idx),bY(idx),aux,NULL);
             if (verbose)
                 std::cerr << "Frame " << i+nfirst << " to Frame " << j+nfirst << " -> (" << bX(idx) << "," << bY(idx) << ")\n";
             for (int ij=i; ij<j; ij++)
@@ -350,10 +371,10 @@ void ProgMovieAlignmentCorrelation::run()
             movie.getValue(MDL_IMAGE,fnFrame,__iter.objId);
             //frame.read(fnFrame);
             if (yDRcorner==-1)
-                cropedFrame.read(fnFrame);
+                readFrame(fnFrame, cropedFrame);
             else
             {
-                frame.read(fnFrame);
+                readFrame(fnFrame, frame);
                 frame().window(cropedFrame(), yLTcorner, xLTcorner, yDRcorner, xDRcorner);
             }
 
@@ -27,6 +27,7 @@
 #define _PROG_MOVIE_ALIGNMENT_CORRELATION
 
 #include <data/xmipp_program.h>
+#include <data/xmipp_image.h>
 
 /**@defgroup MovieAlignmentCorrelation Movie alignment by correlation
    @ingroup ReconsLibrary */
@@ -64,6 +65,8 @@ public:
     int xDRcorner;
     /** y right down corner **/
     int yDRcorner;
+    /** Number of threads to decode the frames */
+    int nThreads;
 
 public:
     // Fourier transforms of the input images
@@ -84,6 +87,9 @@ public:
     /// Define parameters
     void defineParams();
 
+    /// Read a frame, decoding TIFF frames with nThreads
+    void readFrame(const FileName &fnFrame, Image<double> &I);
+
     /// Run
     void run();
 
@@ -0,0 +1,328 @@
+/***************************************************************************
+ *
+ * Authors:     Xmipp team (xmipp@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#include "phantom_simulate_particles.h"
+#include <data/xmipp_image_generic.h>
+#include <data/metadata_extension.h>
+
+// Gaussian random number from a reentrant generator
+inline double rndGaussian(unsigned short xsubi[3])
+{
+    double u1 = erand48(xsubi);
+    double u2 = erand48(xsubi);
+    if (u1 < 1e-300)
+        u1 = 1e-300;
+    return sqrt(-2 * log(u1)) * cos(2 * PI * u2);
+}
+
+/* Constructor ------------------------------------------------------------- */
+ProgSimulateParticles::ProgSimulateParticles()
+{
+    projector = NULL;
+    td = NULL;
+}
+
+ProgSimulateParticles::~ProgSimulateParticles()
+{
+    delete projector;
+    delete td;
+}
+
+/* Read parameters --------------------------------------------------------- */
+void ProgSimulateParticles::readParams()
+{
+    fnVol = getParam("-i");
+    fnAngles = getParam("--md");
+    fnOut = getParam("-o");
+    fnCTF = getParam("--ctf");
+    Ts = getDoubleParam("--sampling");
+    sigma = getDoubleParam("--noise");
+    ctfNoise = checkParam("--ctf_noise");
+    paddFactor = getDoubleParam("--fourier", 0);
+    maxFrequency = getDoubleParam("--fourier", 1);
+    String degree = getParam("--fourier", 2);
+    if (degree == "nearest")
+        BSplineDeg = NEAREST;
+    else if (degree == "linear")
+        BSplineDeg = LINEAR;
+    else if (degree == "bspline")
+        BSplineDeg = BSPLINE3;
+    else
+        REPORT_ERROR(ERR_ARG_BADCMDLINE, "The values for interpolation can be : nearest, linear, bspline");
+    nThreads = getIntParam("--thr");
+    batchSize = XMIPP_MAX(1, getIntParam("--batch"));
+    seed = getIntParam("--seed");
+}
+
+/* Usage ------------------------------------------------------------------- */
+void ProgSimulateParticles::defineParams()
+{
+    addUsageLine("Simulate particles from a volume in a single pass.");
+    addUsageLine("+Every particle is projected in Fourier space, shifted, multiplied by its CTF and");
+    addUsageLine("+corrupted with noise. No intermediate image is written and the particles are");
+    addUsageLine("+written to the output stack in batches.");
+    addParamsLine("   -i <volume>                  : Volume to project");
+    addParamsLine("   --md <metadata>              : Metadata with the angles (rot, tilt, psi), shifts (shiftX, shiftY)");
+    addParamsLine("                                : and CTF (defocus labels or ctfModel) of each particle");
+    addParamsLine("   -o <stack>                   : Output stack. The particle metadata is written with the same rootname");
+    addParamsLine("  [--ctf <CTFdescr=\"\">]        : CTF description for all particles, if not given it may come in the metadata");
+    addParamsLine("  [--sampling <Ts=1>]           : Sampling rate (A/pixel)");
+    addParamsLine("  [--noise <stddev=0>]          : Standard deviation of the noise added after the CTF");
+    addParamsLine("  [--ctf_noise]                 : Shape the noise spectrum with the CTF background");
+    addParamsLine("  [--fourier <pad=2> <maxfreq=0.5> <interp=bspline>] : Fourier projection parameters");
+    addParamsLine("                                : pad is the volume padding factor, maxfreq the maximum digital frequency");
+    addParamsLine("                                : and interp one of nearest, linear or bspline");
+    addParamsLine("  [--thr <N=1>]                 : Number of threads");
+    addParamsLine("  [--batch <B=100>]             : Number of particles written at once");
+    addParamsLine("  [--seed <s=0>]                : Seed of the noise generator. The noise of a particle only");
+    addParamsLine("                                : depends on the seed and the particle number");
+    addExampleLine("Simulate the particles described in particles.xmd with 8 threads", false);
+    addExampleLine("xmipp_phantom_simulate_particles -i volume.vol --md particles.xmd -o particles.mrcs --sampling 1.5 --noise 10 --thr 8");
+}
+
+/* Show -------------------------------------------------------------------- */
+void ProgSimulateParticles::show()
+{
+    if (!verbose)
+        return;
+    std::cout
+    << "Input volume:      " << fnVol << std::endl
+    << "Input metadata:    " << fnAngles << std::endl
+    << "Output stack:      " << fnOut << std::endl
+    << "CTF:               " << fnCTF << std::endl
+    << "Sampling:          " << Ts << std::endl
+    << "Noise:             " << sigma << std::endl
+    << "CTF noise:         " << ctfNoise << std::endl
+    << "Padding factor:    " << paddFactor << std::endl
+    << "Max. frequency:    " << maxFrequency << std::endl
+    << "Threads:           " << nThreads << std::endl
+    << "Batch size:        " << batchSize << std::endl
+    ;
+}
+
+/* Produce side info ------------------------------------------------------- */
+void ProgSimulateParticles::produceSideInfo()
+{
+    mdParticles.read(fnAngles);
+    if (mdParticles.isEmpty())
+        REPORT_ERROR(ERR_MD_NOOBJ, "There are no particles to simulate");
+    if (fnCTF != "")
+    {
+        MDConstGenerator generator(fnCTF);
+        generator.label = MDL_CTF_MODEL;
+        generator.fill(mdParticles);
+    }
+    // Expand CTF files into labels so that they are not read for every particle
+    if (mdParticles.containsLabel(MDL_CTF_MODEL) && !mdParticles.containsLabel(MDL_CTF_DEFOCUSU))
+        mdParticles.fillExpand(MDL_CTF_MODEL);
+    hasCTF = mdParticles.containsLabel(MDL_CTF_DEFOCUSU);
+    if (ctfNoise && !mdParticles.containsLabel(MDL_CTF_BG_GAUSSIAN_K))
+        REPORT_ERROR(ERR_ARG_MISSING, "The CTF background is needed for shaping the noise");
+    mdParticles.findObjects(ids);
+
+    Image<double> V;
+    V.read(fnVol);
+    V().setXmippOrigin();
+    Xdim = XSIZE(V());
+    projector = new FourierProjector(V(), paddFactor, maxFrequency, BSplineDeg);
+
+    currentBatch = 0;
+}
+
+/* Simulate a particle ----------------------------------------------------- */
+void ProgSimulateParticles::simulateParticle(size_t n, MultidimArray<double> &I,
+        MultidimArray< std::complex<double> > &Fourier,
+        FourierTransformer &transformer,
+        CTFDescription &ctf, CTFDescription &ctfBackground)
+{
+    const MDRow &row = batchRows[n];
+    double rot, tilt, psi, shiftX, shiftY;
+    row.getValueOrDefault(MDL_ANGLE_ROT, rot, 0.);
+    row.getValueOrDefault(MDL_ANGLE_TILT, tilt, 0.);
+    row.getValueOrDefault(MDL_ANGLE_PSI, psi, 0.);
+    row.getValueOrDefault(MDL_SHIFT_X, shiftX, 0.);
+    row.getValueOrDefault(MDL_SHIFT_Y, shiftY, 0.);
+
+    Matrix2D<double> E;
+    Euler_angles2matrix(rot, tilt, psi, E);
+    projector->projectFourier(E, Fourier);
+
+    if (hasCTF)
+    {
+        ctf.enable_CTF = true;
+        ctf.enable_CTFnoise = false;
+        ctf.readFromMdRow(row);
+        ctf.produceSideInfo();
+    }
+    if (ctfNoise)
+    {
+        ctfBackground.enable_CTF = false;
+        ctfBackground.enable_CTFnoise = true;
+        ctfBackground.readFromMdRow(row);
+        ctfBackground.produceSideInfo();
+    }
+
+    // Noise power per Fourier coefficient (real and imaginary parts).
+    // With the CTF background, its shape is normalized to keep the total power.
+    double iTs = 1.0 / Ts;
+    double freqx, freqy;
+    size_t Xnyquist = (Xdim % 2 == 0) ? Xdim / 2 : XSIZE(Fourier);
+    double noiseScale = 0;
+    if (sigma > 0)
+    {
+        noiseScale = sigma / sqrt(2.0 * MULTIDIM_SIZE(I));
+        if (ctfNoise)
+        {
+            double sumBg = 0, sumW = 0;
+            for (size_t i = 0; i < YSIZE(Fourier); ++i)
+            {
+                FFT_IDX2DIGFREQ(i, Xdim, freqy);
+                for (size_t j = 0; j < XSIZE(Fourier); ++j)
+                {
+                    FFT_IDX2DIGFREQ(j, Xdim, freqx);
+                    ctfBackground.precomputeValues(freqx * iTs, freqy * iTs);
+                    double bg = ctfBackground.getValueAt();
+                    double w = (j == 0 || j == Xnyquist) ? 1 : 2;
+                    sumBg += w * bg * bg;
+                    sumW += w;
+                }
+            }
+            if (sumBg > 0)
+                noiseScale *= sqrt(sumW / sumBg);
+        }
+    }
+
+    // The metadata shift centers the particle, so the image is moved by -shift
+    bool shifted = (shiftX != 0 || shiftY != 0);
+    unsigned short xsubi[3];
+    size_t particle = batchStart + n;
+    xsubi[0] = (unsigned short)(seed & 0xFFFF);
+    xsubi[1] = (unsigned short)(particle & 0xFFFF);
+    xsubi[2] = (unsigned short)(((particle >> 16) ^ (seed >> 16)) & 0xFFFF);
+    for (size_t i = 0; i < YSIZE(Fourier); ++i)
+    {
+        FFT_IDX2DIGFREQ(i, Xdim, freqy);
+        for (size_t j = 0; j < XSIZE(Fourier); ++j)
+        {
+            FFT_IDX2DIGFREQ(j, Xdim, freqx);
+            std::complex<double> &F = DIRECT_A2D_ELEM(Fourier, i, j);
+            if (shifted)
+            {
+                double s, c;
+                sincos(2 * PI * (freqx * shiftX + freqy * shiftY), &s, &c);
+                F *= std::complex<double>(c, s);
+            }
+            if (hasCTF)
+            {
+                ctf.precomputeValues(freqx * iTs, freqy * iTs);
+                F *= ctf.getValueAt();
+            }
+            if (noiseScale > 0)
+            {
+                // Coefficients in the first and Nyquist columns are made
+                // Hermitian by the inverse transform, which halves their power
+                double K = noiseScale;
+                if (j == 0 || j == Xnyquist)
+                    K *= sqrt(2.0);
+                if (ctfNoise)
+                {
+                    ctfBackground.precomputeValues(freqx * iTs, freqy * iTs);
+                    K *= ctfBackground.getValueAt();
+                }
+                F += std::complex<double>(K * rndGaussian(xsubi), K * rndGaussian(xsubi));
+            }
+        }
+    }
+    transformer.inverseFourierTransform();
+}
+
+/* Thread function --------------------------------------------------------- */
+void threadSimulateParticles(ThreadArgument &thArg)
+{
+    ProgSimulateParticles *self = (ProgSimulateParticles *) thArg.workClass;
+    MultidimArray<double> I;
+    MultidimArray< std::complex<double> > Fourier;
+    FourierTransformer transformer;
+    CTFDescription ctf, ctfBackground;
+
+    I.initZeros(self->Xdim, self->Xdim);
+    transformer.FourierTransform(I, Fourier, false);
+    MultidimArray<double> &mBatch = self->batch[self->currentBatch]();
+    size_t imgSize = MULTIDIM_SIZE(I) * sizeof(double);
+
+    size_t first, last;
+    while (self->td->getTasks(first, last))
+        for (size_t n = first; n <= last; ++n)
+        {
+            self->simulateParticle(n, I, Fourier, transformer, ctf, ctfBackground);
+            memcpy(&DIRECT_NZYX_ELEM(mBatch, n, 0, 0, 0), MULTIDIM_ARRAY(I), imgSize);
+        }
+}
+
+/* Run --------------------------------------------------------------------- */
+void ProgSimulateParticles::run()
+{
+    show();
+    produceSideInfo();
+
+    size_t N = ids.size();
+    size_t Nbatches = (N + batchSize - 1) / batchSize;
+    createEmptyFile(fnOut, Xdim, Xdim, 1, N, true, WRITE_OVERWRITE);
+
+    // Threads compute a batch while the previous one is written
+    ThreadManager thMgr(nThreads, this);
+    if (verbose)
+        init_progress_bar(Nbatches);
+    for (size_t b = 0; b < Nbatches; ++b)
+    {
+        batchStart = b * batchSize;
+        size_t Nbatch = XMIPP_MIN(batchSize, N - batchStart);
+        batchRows.resize(Nbatch);
+        for (size_t n = 0; n < Nbatch; ++n)
+            mdParticles.getRow(batchRows[n], ids[batchStart + n]);
+        batch[currentBatch]().resizeNoCopy(Nbatch, 1, Xdim, Xdim);
+        delete td;
+        td = new ThreadTaskDistributor(Nbatch, 1);
+
+        thMgr.runAsync(threadSimulateParticles);
+        if (b > 0)
+            batch[1 - currentBatch].write(fnOut, batchStart - batchSize + FIRST_IMAGE, true, WRITE_REPLACE);
+        thMgr.wait();
+
+        currentBatch = 1 - currentBatch;
+        if (verbose)
+            progress_bar(b + 1);
+    }
+    batch[1 - currentBatch].write(fnOut, (Nbatches - 1) * batchSize + FIRST_IMAGE, true, WRITE_REPLACE);
+
+    // Particle metadata
+    FileName fnImg;
+    for (size_t n = 0; n < N; ++n)
+    {
+        fnImg.compose(n + FIRST_IMAGE, fnOut);
+        mdParticles.setValue(MDL_IMAGE, fnImg, ids[n]);
+    }
+    mdParticles.write(fnOut.withoutExtension().addExtension("xmd"));
+}
@@ -0,0 +1,130 @@
+/***************************************************************************
+ *
+ * Authors:     Xmipp team (xmipp@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#ifndef _PROG_SIMULATE_PARTICLES_HH
+#define _PROG_SIMULATE_PARTICLES_HH
+
+#include <data/xmipp_program.h>
+#include <data/xmipp_threads.h>
+#include <data/metadata.h>
+#include <data/ctf.h>
+#include "fourier_projection.h"
+
+/**@defgroup SimulateParticlesProgram phantom_simulate_particles (Synthetic particle generator)
+   @ingroup ReconsLibrary */
+//@{
+/** Simulate particles from a volume.
+    Each particle is projected in Fourier space, shifted, multiplied by its
+    CTF and corrupted with (white or CTF background) noise, without writing
+    intermediate images. Particles are generated by several threads in
+    batches and every batch is written to the output stack while the next
+    one is being computed. */
+class ProgSimulateParticles: public XmippProgram
+{
+public:
+    /// Input volume
+    FileName fnVol;
+    /// Metadata with the angles, shifts and CTF of each particle
+    FileName fnAngles;
+    /// Output stack
+    FileName fnOut;
+    /// CTF description for all particles (if not given in the metadata)
+    FileName fnCTF;
+    /// Sampling rate (A/pixel)
+    double Ts;
+    /// Noise standard deviation
+    double sigma;
+    /// Shape the noise with the CTF background
+    bool ctfNoise;
+    /// Padding factor for Fourier projection
+    double paddFactor;
+    /// Maximum digital frequency for Fourier projection
+    double maxFrequency;
+    /// B-spline degree for Fourier projection
+    int BSplineDeg;
+    /// Number of threads
+    int nThreads;
+    /// Number of particles per batch
+    size_t batchSize;
+    /// Random seed
+    int seed;
+
+public:
+    /// Particle metadata
+    MetaData mdParticles;
+    /// Object ids of the particles
+    std::vector<size_t> ids;
+    /// Fourier projector
+    FourierProjector *projector;
+    /// Particle size
+    size_t Xdim;
+    /// Whether the particles have a CTF
+    bool hasCTF;
+    /// Rows of the particles in the batch being computed
+    std::vector<MDRow> batchRows;
+    /// Batches being computed and written
+    Image<double> batch[2];
+    /// Batch being computed
+    int currentBatch;
+    /// Index of the first particle of the batch being computed
+    size_t batchStart;
+    /// Distributor of the particles of a batch among threads
+    ThreadTaskDistributor *td;
+
+public:
+    /// Constructor
+    ProgSimulateParticles();
+
+    /// Destructor
+    ~ProgSimulateParticles();
+
+    /// Read parameters
+    void readParams();
+
+    /// Define parameters
+    void defineParams();
+
+    /// Show parameters
+    void show();
+
+    /// Read the volume and the particles
+    void produceSideInfo();
+
+    /** Simulate one particle of the current batch.
+        Fourier, transformer, ctf and ctfBackground are workspace of the
+        calling thread. */
+    void simulateParticle(size_t n, MultidimArray<double> &I,
+                          MultidimArray< std::complex<double> > &Fourier,
+                          FourierTransformer &transformer,
+                          CTFDescription &ctf, CTFDescription &ctfBackground);
+
+    /// Run
+    void run();
+};
+
+/// Thread function to simulate the particles of a batch
+void threadSimulateParticles(ThreadArgument &thArg);
+//@}
+#endif
@@ -322,7 +322,7 @@ void XrayRotateAndProjectVolumeOffCentered(XrayProjPhantom &phantom, XRayPSF &ps
     double outside = 0; //phantom.iniVol.getPixel(0,0,0,0);
     MULTIDIM_ARRAY(phantom.iniVol).setXmippOrigin();
 
-    applyGeometry(1, phantom.rotVol, MULTIDIM_ARRAY(phantom.iniVol), T*R, IS_NOT_INV, DONT_WRAP, outside);
+    applyGeometry(1, phantom.rotVol, MULTIDIM_ARRAY(phantom.iniVol), T*R, IS_NOT_INV, DONT_WRAP, outside, psf.nThr);
 
     psf.adjustParam(phantom.rotVol);
 
@@ -26,7 +26,6 @@
 
 /* TODO:
  * - Default parameters
- * - Parallelization
  * - Symmetrize HtKH and Htb
  */
 
@@ -40,6 +39,14 @@ ProgReconsADMM::ProgReconsADMM(): XmippProgram()
 {
 	rank=0;
 	Nprocs=1;
+	numThreads=1;
+	thMgr=NULL;
+	batchNImgs=0;
+}
+
+ProgReconsADMM::~ProgReconsADMM()
+{
+	delete thMgr;
 }
 
 void ProgReconsADMM::defineParams()
@@ -67,6 +74,7 @@ void ProgReconsADMM::defineParams()
     addParamsLine(" [--positivity]: Positivity constraint");
     addParamsLine(" [--sym <s=c1>]: Symmetry constraint");
     addParamsLine(" [--saveIntermediate]: Save Htb and HtKH volumes for posterior calls");
+    addParamsLine(" [--thr <N=1>]: Number of threads");
 
     mask.defineParams(this,INT_MASK);
 }
@@ -96,6 +104,9 @@ void ProgReconsADMM::readParams()
 	Nadmmiter=getIntParam("--admmiter");
 	positivity=checkParam("--positivity");
 	saveIntermediate=checkParam("--saveIntermediate");
+	numThreads=getIntParam("--thr");
+	if (numThreads<1)
+		numThreads=1;
 
 	applyMask=checkParam("--mask");
 	if (applyMask)
@@ -103,6 +114,38 @@ void ProgReconsADMM::readParams()
 	SL.readSymmetryFile(getParam("--sym"));
 }
 
+/* Multiply the Fourier transform of a filter by the phase that centers
+ * (as CenterFFT(V,false)) the result of filtering a volume of the shape of V.
+ * CenterFFT moves the element (p+N/2)%N to p in each direction, that is a
+ * phase of exp(i*2*pi*(N/2)*f/N) for the frequency index f.
+ */
+void addCenteringPhase(MultidimArray< std::complex<double> > &fourierL, const MultidimArray<double> &V)
+{
+	double Kz=2*PI*(double)(ZSIZE(V)/2)/ZSIZE(V);
+	double Ky=2*PI*(double)(YSIZE(V)/2)/YSIZE(V);
+	double Kx=2*PI*(double)(XSIZE(V)/2)/XSIZE(V);
+	FOR_ALL_ELEMENTS_IN_ARRAY3D(fourierL)
+	{
+		double s, c;
+		sincos(Kz*k+Ky*i+Kx*j,&s,&c);
+		A3D_ELEM(fourierL,k,i,j)*=std::complex<double>(c,s);
+	}
+}
+
+void centeredCropIndexes(const MultidimArray<double> &padded, const MultidimArray<double> &V,
+                         std::vector<size_t> &cropZ, std::vector<size_t> &cropY, std::vector<size_t> &cropX)
+{
+	cropZ.resize(ZSIZE(V));
+	cropY.resize(YSIZE(V));
+	cropX.resize(XSIZE(V));
+	for (size_t n=0; n<cropZ.size(); ++n)
+		cropZ[n]=(n+STARTINGZ(V)-STARTINGZ(padded)+ZSIZE(padded)/2)%ZSIZE(padded);
+	for (size_t n=0; n<cropY.size(); ++n)
+		cropY[n]=(n+STARTINGY(V)-STARTINGY(padded)+YSIZE(padded)/2)%YSIZE(padded);
+	for (size_t n=0; n<cropX.size(); ++n)
+		cropX[n]=(n+STARTINGX(V)-STARTINGX(padded)+XSIZE(padded)/2)%XSIZE(padded);
+}
+
 void ProgReconsADMM::produceSideInfo()
 {
 	// Read input images
@@ -135,6 +178,10 @@ void ProgReconsADMM::produceSideInfo()
 	mdSym.clear();
 #endif
 
+	// Threads
+	if (numThreads>1 && thMgr==NULL)
+		thMgr=new ThreadManager(numThreads,this);
+
 	// Prepare kernel
 	if (kernelShape=="KaiserBessel")
 		kernel.initializeKernel(alpha,a,0.0001);
@@ -188,6 +235,22 @@ void ProgReconsADMM::produceSideInfo()
 	// Add regularization in Fourier space
 	addRegularizationTerms();
 
+	// The kernel is applied many times, include the FFT normalization once
+	double K=MULTIDIM_SIZE(kernelV());
+	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(fourierKernelV)
+		DIRECT_MULTIDIM_ELEM(fourierKernelV,n)*=K;
+	kernelV.clear();
+
+	// The padded volume and its plans are reused by all the CG iterations
+	paddedx.initZeros(2*ZSIZE(CHtb())-1,2*YSIZE(CHtb())-1,2*XSIZE(CHtb())-1);
+	paddedx.setXmippOrigin();
+	transformerPaddedx.setThreadsNumber(numThreads);
+	transformerPaddedx.setReal(paddedx);
+
+	// Instead of centering paddedx after the inverse transform, its central
+	// region is read directly at the positions CenterFFT would move it from
+	centeredCropIndexes(paddedx,CHtb(),cropZ,cropY,cropX);
+
 	// Resize u and d volumes
 	ux.initZeros(CHtb());
 	ux.setXmippOrigin();
@@ -206,8 +269,12 @@ void ProgReconsADMM::produceSideInfo()
 	transformer.FourierTransform(L,fourierLy);
 	kernel.computeGradient(L,'z');
 	transformer.FourierTransform(L,fourierLz);
+	addCenteringPhase(fourierLx,ux);
+	addCenteringPhase(fourierLy,ux);
+	addCenteringPhase(fourierLz,ux);
 
 	ud=ux;
+	transformerL.setThreadsNumber(numThreads);
 	transformerL.setReal(ud);
 
 	// Prepare mask
@@ -249,8 +316,19 @@ void ProgReconsADMM::constructHtb()
 	CHtb().initZeros(xdim,xdim,xdim);
 	CHtb().setXmippOrigin();
 
-	Image<double> I;
+	// Thread 0 accumulates on CHtb, the rest on their own volume
+	threadHtb.resize(numThreads-1);
+	for (size_t n=0; n<threadHtb.size(); ++n)
+		threadHtb[n].initZeros(CHtb());
+	size_t batchSize=4*numThreads;
+	batchImgs.resize(batchSize);
+	batchR1.resize(batchSize);
+	batchR2.resize(batchSize);
+	batchWeights.resize(batchSize);
+	batchNImgs=0;
+
 	double rot, tilt, psi;
+	Matrix2D<double> E;
 	size_t i=0;
 	if (rank==0)
 	{
@@ -265,6 +343,7 @@ void ProgReconsADMM::constructHtb()
 	{
 		if ((i+1)%Nprocs==rank)
 		{
+			Image<double> &I=batchImgs[batchNImgs];
 			I.readApplyGeo(mdIn,__iter.objId,geoParams);
 			I().setXmippOrigin();
 			mdIn.getValue(MDL_ANGLE_ROT,rot,__iter.objId);
@@ -272,16 +351,29 @@ void ProgReconsADMM::constructHtb()
 			mdIn.getValue(MDL_ANGLE_PSI,psi,__iter.objId);
 			if (useWeights && mdIn.containsLabel(MDL_WEIGHT))
 				mdIn.getValue(MDL_WEIGHT,weight,__iter.objId);
-
-			project(rot,tilt,psi,I(),true,weight);
+			Euler_angles2matrix(rot,tilt,psi,E,false);
+			batchR1[batchNImgs].resizeNoCopy(3);
+			batchR2[batchNImgs].resizeNoCopy(3);
+			E.getRow(0,batchR1[batchNImgs]);
+			E.getRow(1,batchR2[batchNImgs]);
+			batchWeights[batchNImgs]=weight;
+			if (++batchNImgs==batchSize)
+				backprojectBatch();
 		}
 		i++;
 		if (i%100==0 && rank==0)
 			progress_bar(i);
 	}
+	backprojectBatch();
 	if (rank==0)
 		progress_bar(mdIn.size());
 
+	// Add the accumulators of the threads
+	for (size_t n=0; n<threadHtb.size(); ++n)
+		CHtb()+=threadHtb[n];
+	threadHtb.clear();
+	batchImgs.clear();
+
 	// Symmetrize Htb
 #ifndef SYMMETRIZE_PROJECTIONS
 	MultidimArray<double> CHtbsym;
@@ -291,6 +383,27 @@ void ProgReconsADMM::constructHtb()
 	shareVolume(CHtb());
 }
 
+/* Each thread backprojects the images thread_id, thread_id+numThreads, ...
+ * of the batch, so the result does not depend on the scheduling */
+void threadBackprojectBatch(ThreadArgument &thArg)
+{
+	ProgReconsADMM *self=(ProgReconsADMM *) thArg.workClass;
+	int id=thArg.thread_id;
+	MultidimArray<double> &V=(id==0) ? self->CHtb() : self->threadHtb[id-1];
+	for (size_t n=id; n<self->batchNImgs; n+=self->numThreads)
+		self->project(self->batchR1[n],self->batchR2[n],self->batchImgs[n](),V,true,self->batchWeights[n]);
+}
+
+void ProgReconsADMM::backprojectBatch()
+{
+	if (thMgr!=NULL)
+		thMgr->run(threadBackprojectBatch);
+	else
+		for (size_t n=0; n<batchNImgs; ++n)
+			project(batchR1[n],batchR2[n],batchImgs[n](),CHtb(),true,batchWeights[n]);
+	batchNImgs=0;
+}
+
 void ProgReconsADMM::project(double rot, double tilt, double psi, MultidimArray<double> &P, bool adjoint, double weight)
 {
 	Matrix2D<double> E;
@@ -303,7 +416,12 @@ void ProgReconsADMM::project(double rot, double tilt, double psi, MultidimArray<
 
 void ProgReconsADMM::project(const Matrix1D<double> &r1, const Matrix1D<double> &r2, MultidimArray<double> &P, bool adjoint, double weight)
 {
-	const MultidimArray<double> &mV=CHtb();
+	project(r1,r2,P,CHtb(),adjoint,weight);
+}
+
+void ProgReconsADMM::project(const Matrix1D<double> &r1, const Matrix1D<double> &r2, MultidimArray<double> &P,
+		MultidimArray<double> &mV, bool adjoint, double weight)
+{
 	if (!adjoint)
 	{
 		P.initZeros(std::ceil(XSIZE(mV)/Tp),std::ceil(YSIZE(mV)/Tp));
@@ -366,6 +484,49 @@ void ProgReconsADMM::project(const Matrix1D<double> &r1, const Matrix1D<double>
     }
 }
 
+/** Data shared by the threads adding an image to H^t*K*H */
+struct HtKHThreadData
+{
+	ProgReconsADMM *parent;
+	MultidimArray<double> *kernelV;
+	const MultidimArray<double> *kernelAutocorr;
+	const Matrix1D<double> *r1, *r2;
+	double weight;
+	ThreadTaskDistributor *distributor;
+};
+
+void threadAddImageToHtKH(ThreadArgument &thArg)
+{
+	HtKHThreadData *data=(HtKHThreadData *) thArg.data;
+	int k0=STARTINGZ(*(data->kernelV));
+	size_t first, last;
+	while (data->distributor->getTasks(first,last))
+		data->parent->addImageToHtKH(*(data->kernelV),*(data->kernelAutocorr),*(data->r1),*(data->r2),
+				data->weight,k0+(int)first,k0+(int)last);
+}
+
+void ProgReconsADMM::addImageToHtKH(MultidimArray<double> &kernelV, const MultidimArray<double> &kernelAutocorr,
+		const Matrix1D<double> &r1, const Matrix1D<double> &r2, double weight, int k0, int kF)
+{
+	double iStep=1.0/kernel.autocorrStep;
+	for (int k=k0; k<=kF; ++k)
+	{
+		double r1_z=k*ZZ(r1);
+		double r2_z=k*ZZ(r2);
+		for (int i=((kernelV).yinit); i<=((kernelV).yinit + (int)(kernelV).ydim - 1); ++i)
+		{
+			double r1_yz=i*YY(r1)+r1_z;
+			double r2_yz=i*YY(r2)+r2_z;
+			for (int j=((kernelV).xinit); j<=((kernelV).xinit + (int)(kernelV).xdim - 1); ++j)
+			{
+				double r1_xyz=j*XX(r1)+r1_yz;
+				double r2_xyz=j*XX(r2)+r2_yz;
+				A3D_ELEM(kernelV,k,i,j)+=weight*kernelAutocorr.interpolatedElement2D(r1_xyz*iStep,r2_xyz*iStep);
+			}
+		}
+	}
+}
+
 void ProgReconsADMM::computeHtKH(MultidimArray<double> &kernelV)
 {
 	kernelV.initZeros(2*ZSIZE(CHtb())-1,2*YSIZE(CHtb())-1,2*XSIZE(CHtb())-1);
@@ -408,23 +569,21 @@ void ProgReconsADMM::computeHtKH(MultidimArray<double> &kernelV)
 			Euler_angles2matrix(rot,tilt,psi,E,false);
 			E.getRow(0,r1);
 			E.getRow(1,r2);
-			double iStep=1.0/kernel.autocorrStep;
-			for (int k=((kernelV).zinit); k<=((kernelV).zinit + (int)(kernelV).zdim - 1); ++k)
+			if (thMgr!=NULL)
 			{
-				double r1_z=k*ZZ(r1);
-				double r2_z=k*ZZ(r2);
-				for (int i=((kernelV).yinit); i<=((kernelV).yinit + (int)(kernelV).ydim - 1); ++i)
-				{
-					double r1_yz=i*YY(r1)+r1_z;
-					double r2_yz=i*YY(r2)+r2_z;
-					for (int j=((kernelV).xinit); j<=((kernelV).xinit + (int)(kernelV).xdim - 1); ++j)
-					{
-						double r1_xyz=j*XX(r1)+r1_yz;
-						double r2_xyz=j*XX(r2)+r2_yz;
-						A3D_ELEM(kernelV,k,i,j)+=weight*kernelAutocorr.interpolatedElement2D(r1_xyz*iStep,r2_xyz*iStep);
-					}
-				}
+				ThreadTaskDistributor distributor(ZSIZE(kernelV),1);
+				HtKHThreadData data;
+				data.parent=this;
+				data.kernelV=&kernelV;
+				data.kernelAutocorr=&kernelAutocorr;
+				data.r1=&r1;
+				data.r2=&r2;
+				data.weight=weight;
+				data.distributor=&distributor;
+				thMgr->run(threadAddImageToHtKH,&data);
 			}
+			else
+				addImageToHtKH(kernelV,kernelAutocorr,r1,r2,weight,STARTINGZ(kernelV),FINISHINGZ(kernelV));
 		}
 
 		i++;
@@ -491,44 +650,41 @@ void ProgReconsADMM::addRegularizationTerms()
 
 void ProgReconsADMM::applyKernel3D(MultidimArray<double> &x, MultidimArray<double> &AtAx)
 {
-	paddedx.initZeros(2*ZSIZE(x)-1,2*YSIZE(x)-1,2*XSIZE(x)-1);
-	paddedx.setXmippOrigin();
-
-	// Copy Vk into paddedx
+	// Copy x into the center of paddedx
+	paddedx.initZeros();
 	for (int k=STARTINGZ(x); k<=FINISHINGZ(x); ++k)
 		for (int i=STARTINGY(x); i<=FINISHINGY(x); ++i)
 			memcpy(&A3D_ELEM(paddedx,k,i,STARTINGX(x)),&A3D_ELEM(x,k,i,STARTINGX(x)),XSIZE(x)*sizeof(double));
 
 	// Compute Fourier transform of paddedx
-	transformerPaddedx.setReal(paddedx);
 	transformerPaddedx.FourierTransform();
 
 	// Apply kernel
-	double K=MULTIDIM_SIZE(paddedx);
 	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(transformerPaddedx.fFourier)
-	{
 		DIRECT_MULTIDIM_ELEM(transformerPaddedx.fFourier,n)*=DIRECT_MULTIDIM_ELEM(fourierKernelV,n);
-		DIRECT_MULTIDIM_ELEM(transformerPaddedx.fFourier,n)*=K;
-	}
 
 	// Inverse Fourier transform
 	transformerPaddedx.inverseFourierTransform();
-	CenterFFT(paddedx,false);
 
-	// Crop central region
+	// Crop central region (of the centered paddedx)
 	AtAx.resize(x);
-	for (int k=STARTINGZ(x); k<=FINISHINGZ(x); ++k)
-		for (int i=STARTINGY(x); i<=FINISHINGY(x); ++i)
-			memcpy(&A3D_ELEM(AtAx,k,i,STARTINGX(x)),&A3D_ELEM(paddedx,k,i,STARTINGX(x)),XSIZE(x)*sizeof(double));
+	double *ptrAtAx=MULTIDIM_ARRAY(AtAx);
+	for (size_t k=0; k<ZSIZE(x); ++k)
+		for (size_t i=0; i<YSIZE(x); ++i)
+		{
+			const double *ptrPaddedx=&DIRECT_A3D_ELEM(paddedx,cropZ[k],cropY[i],0);
+			for (size_t j=0; j<XSIZE(x); ++j)
+				*ptrAtAx++=ptrPaddedx[cropX[j]];
+		}
 }
 
 void ProgReconsADMM::applyLFilter(MultidimArray< std::complex<double> > &fourierL, bool adjoint)
 {
+	// fourierL already includes the centering phase
 	transformerL.FourierTransform();
 	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(fourierL)
 		DIRECT_MULTIDIM_ELEM(transformerL.fFourier,n)*=DIRECT_MULTIDIM_ELEM(fourierL,n);
 	transformerL.inverseFourierTransform();
-	CenterFFT(ud,false);
 	if (adjoint)
 		ud*=-1;
 }
@@ -32,6 +32,7 @@
 #include <data/ctf.h>
 #include <data/mask.h>
 #include <data/symmetries.h>
+#include <data/xmipp_threads.h>
 
 /**@defgroup ReconstructADMMProgram Reconstruct Alternating Direction Method of Multipliers
    @ingroup ReconsLibrary */
@@ -66,6 +67,17 @@ public:
 	void computeKernel3D(MultidimArray<double> &kernel);
 };
 
+/** Multiply the Fourier transform of a filter by the phase that centers
+ * (as CenterFFT(V,false)) the result of filtering a volume of the shape of V.
+ */
+void addCenteringPhase(MultidimArray< std::complex<double> > &fourierL, const MultidimArray<double> &V);
+
+/** Physical indexes of padded that CenterFFT(padded,false) moves to the
+ * region of V (both with the Xmipp origin), one vector per direction.
+ */
+void centeredCropIndexes(const MultidimArray<double> &padded, const MultidimArray<double> &V,
+                         std::vector<size_t> &cropZ, std::vector<size_t> &cropY, std::vector<size_t> &cropX);
+
 class ProgReconsADMM: public XmippProgram
 {
 public:
@@ -93,10 +105,12 @@ public:
 	Mask mask; // Mask
 	String symmetry;
 	bool saveIntermediate;
+	int numThreads; // Number of threads
 	size_t Nprocs;
 	size_t rank;
 public:
 	ProgReconsADMM();
+	~ProgReconsADMM();
     void defineParams();
     void readParams();
     void show();
@@ -110,15 +124,29 @@ public:
     /** Project the volume V onto P using r1 and r2 as the coordinate system */
     void project(const Matrix1D<double> &r1, const Matrix1D<double> &r2, MultidimArray<double> &P, bool adjoint=false, double weight=1.);
 
-    /** H^t*b
+    /** Project the volume V onto P (or backproject P onto V if adjoint) using r1 and r2 as the coordinate system */
+    void project(const Matrix1D<double> &r1, const Matrix1D<double> &r2, MultidimArray<double> &P,
+    		MultidimArray<double> &V, bool adjoint, double weight);
+
+    /** H^t*b.
+     * Images are read in batches and each thread backprojects its images of the
+     * batch onto its own accumulator, the accumulators are added at the end.
      */
     void constructHtb();
 
+    /** Backproject the images of the current batch */
+    void backprojectBatch();
+
     /** Compute H^t*K*H.
-     * H is the projection operator, K is the CTF operator
+     * H is the projection operator, K is the CTF operator.
+     * The slices of the kernel are distributed among threads.
      */
     void computeHtKH(MultidimArray<double> &kernelV);
 
+    /** Add the contribution of one image to the slices k0 to kF of H^t*K*H */
+    void addImageToHtKH(MultidimArray<double> &kernelV, const MultidimArray<double> &kernelAutocorr,
+    		const Matrix1D<double> &r1, const Matrix1D<double> &r2, double weight, int k0, int kF);
+
     /** Add regularization to the kernel */
     void addRegularizationTerms();
 
@@ -152,9 +180,17 @@ public:
 	Image<double>        CHtb; // First reconstructed volume
 	Image<double>        Ck, Vk; // Reconstructed volume
 	MetaData             mdIn; // Set of images and angles
-	MultidimArray<std::complex<double> > fourierKernelV;
+	MultidimArray<std::complex<double> > fourierKernelV; // Already scaled by the size of paddedx
 	MultidimArray<double> paddedx;
 	FourierTransformer    transformerPaddedx, transformerL;
+	std::vector<size_t>   cropZ, cropY, cropX; // Physical indexes of paddedx of the central region before CenterFFT
+
+	ThreadManager        *thMgr;
+	std::vector< MultidimArray<double> > threadHtb; // Htb accumulators of threads 1, 2, ...
+	std::vector< Image<double> > batchImgs; // Images of the current batch of Htb
+	std::vector< Matrix1D<double> > batchR1, batchR2; // Projection directions of the batch
+	std::vector<double>   batchWeights;
+	size_t                batchNImgs;
 
 	MultidimArray<double> ux, uy, uz, dx, dy, dz, ud;
 	MultidimArray< std::complex<double> > fourierLx, fourierLy, fourierLz;
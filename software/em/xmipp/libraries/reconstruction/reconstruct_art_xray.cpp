@@ -149,7 +149,7 @@ double ProgReconsXrayART::singleStep(MultidimArray<double> &muVol, const Project
 
     double outside = 0; //phantom.iniVol.getPixel(0,0,0,0);
 
-    applyGeometry(1, rotVol, muVol, R, IS_NOT_INV, DONT_WRAP, outside);
+    applyGeometry(1, rotVol, muVol, R, IS_NOT_INV, DONT_WRAP, outside, psf.nThr);
 
     psf.adjustParam(rotVol);
 
@@ -52,6 +52,9 @@ void ProgReconstructSignificant::defineParams()
     addParamsLine("  [--keepIntermediateVolumes]  : Keep the volume of each iteration");
     addParamsLine("  [--angularSampling <a=5>]    : Angular sampling in degrees for generating the projection gallery");
     addParamsLine("  [--maxShift <s=-1>]          : Maximum shift allowed (+-this amount)");
+    addParamsLine("  [--maxResolution <f=-1>]     : Resolution (A) up to which images are aligned (neg= full size).");
+    addParamsLine("                               : Images are Fourier-cropped and the gallery is projected at the reduced size");
+    addParamsLine("  [--sampling <Ts=1>]          : Sampling rate (A/pixel), only used with --maxResolution");
     addParamsLine("  [--minTilt <t=0>]            : Minimum tilt angle");
     addParamsLine("  [--maxTilt <t=90>]           : Maximum tilt angle");
     addParamsLine("  [--useImed]                  : Use Imed for weighting");
@@ -60,6 +63,7 @@ void ProgReconstructSignificant::defineParams()
     addParamsLine("  [--dontApplyFisher]          : Do not select directions using Fisher");
     addParamsLine("  [--dontReconstruct]          : Do not reconstruct");
     addParamsLine("  [--useForValidation <numOrientationsPerParticle=10>] : Use the program for validation. This number defines the number of possible orientations per particle");
+    addParamsLine("  [--thr <N=1>]                : Number of threads for projecting the galleries");
 }
 
 // Read arguments ==========================================================
@@ -75,6 +79,8 @@ void ProgReconstructSignificant::readParams()
     keepIntermediateVolumes = checkParam("--keepIntermediateVolumes");
     angularSampling=getDoubleParam("--angularSampling");
     maxShift=getDoubleParam("--maxShift");
+    maxResol=getDoubleParam("--maxResolution");
+    Ts=getDoubleParam("--sampling");
     tilt0=getDoubleParam("--minTilt");
     tiltF=getDoubleParam("--maxTilt");
     useImed=checkParam("--useImed");
@@ -86,6 +92,7 @@ void ProgReconstructSignificant::readParams()
     doReconstruct=!checkParam("--dontReconstruct");
     useForValidation=checkParam("--useForValidation");
     numOrientationsPerParticle = getIntParam("--useForValidation");
+    Nthreads = getIntParam("--thr");
 
     if (!doReconstruct)
     {
@@ -108,6 +115,8 @@ void ProgReconstructSignificant::show()
         std::cout << "Keep intermediate volumes   : "  << keepIntermediateVolumes << std::endl;
         std::cout << "Angular sampling            : "  << angularSampling << std::endl;
         std::cout << "Maximum shift               : "  << maxShift << std::endl;
+        if (maxResol>0)
+        	std::cout << "Maximum resolution          : "  << maxResol << " (" << Ts << " A/pixel)" << std::endl;
         std::cout << "Minimum tilt                : "  << tilt0 << std::endl;
         std::cout << "Maximum tilt                : "  << tiltF << std::endl;
         std::cout << "Use Imed                    : "  << useImed << std::endl;
@@ -115,6 +124,7 @@ void ProgReconstructSignificant::show()
         std::cout << "Apply Fisher                : "  << applyFisher << std::endl;
         std::cout << "Reconstruct                 : "  << doReconstruct << std::endl;
         std::cout << "useForValidation            : "  << useForValidation << std::endl;
+        std::cout << "Threads                     : "  << Nthreads << std::endl;
 
         if (fnSym != "")
             std::cout << "Symmetry for projections    : "  << fnSym << std::endl;
@@ -182,6 +192,8 @@ void ProgReconstructSignificant::alignImagesToGallery()
 #endif
 			I.read(fnImg);
 			MultidimArray<double> &mCurrentImage=I();
+			if (workXdim<Xdim)
+				selfScaleToSizeFourier(workXdim,workXdim,mCurrentImage);
 			mCurrentImage.setXmippOrigin();
 			allM.clear();
 
@@ -198,11 +210,10 @@ void ProgReconstructSignificant::alignImagesToGallery()
 					mCurrentImageAligned=mCurrentImage;
 					mGalleryProjection.aliasImageInStack(gallery[nVolume](),nDir);
 					mGalleryProjection.setXmippOrigin();
-					double corr=alignImagesConsideringMirrors(mGalleryProjection,transforms[nDir],
-							mCurrentImageAligned,M,aux,aux2,aux3,DONT_WRAP);
+					double corr=alignToGalleryProjection(mGalleryProjection,transforms[nDir],
+							mCurrentImageAligned,M,aux,aux2,aux3);
 //					double corr=alignImagesConsideringMirrors(mGalleryProjection,
 //							mCurrentImageAligned,M,aux,aux2,aux3,DONT_WRAP);
-					M=M.inv();
 					double imed=imedDistance(mGalleryProjection, mCurrentImageAligned);
 
 //					if (corr>0.99)
@@ -589,6 +600,19 @@ void ProgReconstructSignificant::reconstructCurrent()
 	}
 }
 
+double ProgReconstructSignificant::alignToGalleryProjection(const MultidimArray<double> &mGalleryProjection,
+		const AlignmentTransforms &transforms, MultidimArray<double> &mCurrentImageAligned,
+		Matrix2D<double> &M, AlignmentAux &aux, CorrelationAux &aux2, RotationalCorrelationAux &aux3) const
+{
+	double corr=alignImagesConsideringMirrors(mGalleryProjection,transforms,
+			mCurrentImageAligned,M,aux,aux2,aux3,DONT_WRAP);
+	M=M.inv();
+	// Shifts in the original pixel size
+	MAT_ELEM(M,0,2)/=workScale;
+	MAT_ELEM(M,1,2)/=workScale;
+	return corr;
+}
+
 void ProgReconstructSignificant::generateProjections()
 {
 	FileName fnGallery, fnGalleryMetaData;
@@ -604,8 +628,11 @@ void ProgReconstructSignificant::generateProjections()
 			fnGallery=formatString("%s/gallery_iter%03d_%02d.stk",fnDir.c_str(),iter,n);
 			fnAngles=formatString("%s/angles_iter%03d_%02d.xmd",fnDir.c_str(),iter-1,n);
 			fnGalleryMetaData=formatString("%s/gallery_iter%03d_%02d.doc",fnDir.c_str(),iter,n);
-			String args=formatString("-i %s -o %s --sampling_rate %f --sym %s --compute_neighbors --angular_distance -1 --experimental_images %s --min_tilt_angle %f --max_tilt_angle %f -v 0",
-					fnVol.c_str(),fnGallery.c_str(),angularSampling,fnSym.c_str(),fnAngles.c_str(),tilt0,tiltF);
+			String args=formatString("-i %s -o %s --sampling_rate %f --sym %s --compute_neighbors --angular_distance -1 --experimental_images %s --min_tilt_angle %f --max_tilt_angle %f --thr %d -v 0",
+					fnVol.c_str(),fnGallery.c_str(),angularSampling,fnSym.c_str(),fnAngles.c_str(),tilt0,tiltF,Nthreads);
+			// The Fourier projector directly produces the working size
+			if (workXdim<Xdim)
+				args+=formatString(" --method fourier --output_size %lu",workXdim);
 
 			String cmd=(String)"xmipp_angular_project_library "+args;
 			if (system(cmd.c_str())==-1)
@@ -645,6 +672,21 @@ void ProgReconstructSignificant::generateProjections()
 			mdGallery[n].push_back(I);
 		}
 		gallery[n].read(fnGallery);
+		if (XSIZE(gallery[n]())!=workXdim)
+		{
+			// A first gallery given by the user is at the original size,
+			// Fourier-crop it to the working size
+			MultidimArray<double> &mGallery=gallery[n]();
+			MultidimArray<double> mCropped(NSIZE(mGallery),1,workXdim,workXdim), mAux;
+			for (size_t k=0; k<NSIZE(mGallery); ++k)
+			{
+				mGalleryProjection.aliasImageInStack(mGallery,k);
+				mAux=mGalleryProjection;
+				selfScaleToSizeFourier(workXdim,workXdim,mAux);
+				memcpy(&DIRECT_NZYX_ELEM(mCropped,k,0,0,0),MULTIDIM_ARRAY(mAux),MULTIDIM_SIZE(mAux)*sizeof(double));
+			}
+			mGallery=mCropped;
+		}
 
 		// Calculate transforms of this gallery
 		size_t kmax=NSIZE(gallery[n]());
@@ -713,6 +755,16 @@ void ProgReconstructSignificant::produceSideinfo()
 	size_t Ydim,Zdim,Ndim;
 	getImageSize(mdIn,Xdim,Ydim,Zdim,Ndim);
 
+	// Working size, the maximum resolution is placed at 0.9 of the new Nyquist
+	workXdim=Xdim;
+	if (maxResol>0)
+	{
+		double newTs=0.9*maxResol/2;
+		if (newTs>Ts)
+			workXdim=XMIPP_MIN(Xdim,2*(size_t)ROUND(0.5*Xdim*Ts/newTs));
+	}
+	workScale=(double)workXdim/Xdim;
+
 	// Adjust alpha
 	if ( (fnSym!="c1") && !useForValidation )
 	{
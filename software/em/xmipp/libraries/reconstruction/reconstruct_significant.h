@@ -59,6 +59,13 @@ public:
     /** Maxshift */
     double maxShift;
 
+    /** Resolution (A) up to which images are compared, if positive images
+        are Fourier-cropped and the gallery projected to workXdim */
+    double maxResol;
+
+    /** Sampling rate (A/pixel) */
+    double Ts;
+
     /** Minimum tilt */
     double tilt0;
 
@@ -88,6 +95,9 @@ public:
 
     size_t numOrientationsPerParticle;
 
+    /** Number of threads for the projection of the galleries */
+    int Nthreads;
+
 public: // Internal members
     size_t rank, Nprocessors;
 
@@ -97,6 +107,10 @@ public: // Internal members
     // Size of the images
     size_t Xdim;
 
+    // Size of the images during the alignment and its ratio to Xdim
+    size_t workXdim;
+    double workScale;
+
     // Partial reconstruction metadatas
     std::vector<MetaData> mdReconstructionPartial;
 
@@ -156,6 +170,16 @@ public:
     /// Align images to gallery projections
     void alignImagesToGallery();
 
+    /** Align an image to a gallery projection in the working box.
+        M is the transformation from the projection to the image, with the
+        shifts in the pixels of the original images. The correlation is
+        returned. */
+    double alignToGalleryProjection(const MultidimArray<double> &mGalleryProjection,
+                                    const AlignmentTransforms &transforms,
+                                    MultidimArray<double> &mCurrentImageAligned,
+                                    Matrix2D<double> &M, AlignmentAux &aux,
+                                    CorrelationAux &aux2, RotationalCorrelationAux &aux3) const;
+
     /// Gather alignment
     virtual void gatherAlignment() {}
 
@@ -29,11 +29,16 @@
 ProgRecWbp::ProgRecWbp()
 {
     iter = NULL;
+    thMgr = NULL;
+    planeDistributor = NULL;
+    batchNImgs = 0;
 }
 
 ProgRecWbp::~ProgRecWbp()
 {
     delete iter;
+    delete thMgr;
+    delete planeDistributor;
 }
 
 // Read arguments ==========================================================
@@ -48,6 +53,12 @@ void ProgRecWbp::readParams()
     sampling = getDoubleParam("--filsam");
     do_all_matrices = checkParam("--use_each_image");
     do_weights = checkParam("--weight");
+    numThreads = getIntParam("--thr");
+    batchSize = getIntParam("--batch");
+    if (numThreads < 1)
+        numThreads = 1;
+    if (batchSize < 1)
+        batchSize = 1;
 }
 
 // Show ====================================================================
@@ -82,6 +93,8 @@ void ProgRecWbp::show()
         if (do_weights)
             std::cerr << " --> Use weights stored in the image headers"
             << std::endl;
+        std::cerr << " Threads                   : " << numThreads << std::endl;
+        std::cerr << " Images per batch          : " << batchSize << std::endl;
         std::cerr
         << " -----------------------------------------------------------------"
         << std::endl;
@@ -158,6 +171,14 @@ void ProgRecWbp::defineParams()
         "                               :+option of using representative projection directions");
     addParamsLine(
         " [ --weight]                   : Use weights stored in image headers or the input metadata");
+    addParamsLine(
+        " [ --thr <N=1>]                : Number of threads for the backprojection");
+    addParamsLine(
+        " [ --batch+ <n=16>]            : Number of filtered images backprojected together");
+    addParamsLine(
+        "                               :+Each row of the volume receives the contribution of all the images ");
+    addParamsLine(
+        "                               :+of the batch while it is in cache.");
     addExampleLine("xmipp_reconstruct_wbp -i images.sel -o reconstruction.vol");
 }
 
@@ -214,6 +235,16 @@ void ProgRecWbp::produceSideInfo()
     time_bar_size = SF.size();
     time_bar_step = CEIL((double)time_bar_size / 60.0);
     time_bar_done = 0;
+
+    // Backprojection in batches
+    batchImgs.resize(batchSize);
+    batchInfo.resize(batchSize);
+    batchNImgs = 0;
+    if (numThreads > 1 && thMgr == NULL)
+    {
+        thMgr = new ThreadManager(numThreads, this);
+        planeDistributor = new ThreadTaskDistributor(dim, 1);
+    }
 }
 
 void ProgRecWbp::getAnglesForImage(size_t id, double &rot, double &tilt,
@@ -365,77 +396,187 @@ void ProgRecWbp::getAllMatrices(MetaData &SF)
 void ProgRecWbp::simpleBackprojection(Projection &img,
                                       MultidimArray<double> &vol, int diameter)
 {
-	//this should be int not size_t ROB
-    int i, j, k, l, m;
+    WBPBackprojInfo info;
+    getBackprojectionInfo(img, info);
+    backprojectPlanes(&info, 1, vol, diameter, 0, (int)dim - 1);
+}
+
+void ProgRecWbp::getBackprojectionInfo(const Projection &img,
+                                       WBPBackprojInfo &info)
+{
     Matrix2D<double> A(3, 3);
-    double dim2, x, y, z, xp, yp;
-    double value1, value2, scalex, scaley, value;
-    double radius2, x2, y2, z2, z2_plus_y2;
 
     // Use minus-tilt, because code copied from OldXmipp
     Euler_angles2matrix(img.rot(), -img.tilt(), img.psi(), A);
     A = A.inv();
+    info.img = MULTIDIM_ARRAY(img());
+    info.a00 = MAT_ELEM(A,0,0);
+    info.a01 = MAT_ELEM(A,0,1);
+    info.a10 = MAT_ELEM(A,1,0);
+    info.a11 = MAT_ELEM(A,1,1);
+    info.a20 = MAT_ELEM(A,2,0);
+    info.a21 = MAT_ELEM(A,2,1);
+}
 
-    radius2 = diameter / 2.;
-    radius2 = radius2 * radius2;
-    dim2 = dim / 2;
-    double a00 = MAT_ELEM(A,0,0);
-    double a01 = MAT_ELEM(A,0,1);
-    double a10 = MAT_ELEM(A,1,0);
-    double a11 = MAT_ELEM(A,1,1);
-    double a20 = MAT_ELEM(A,2,0);
-    double a21 = MAT_ELEM(A,2,1);
+/* Restrict [kmin,kmax] to the k such that 0 <= v0 + k * dv < vmax.
+ * The interval is first estimated and then adjusted with the same
+ * expression used for the interpolation.
+ */
+static inline void clipBackprojectionRange(double v0, double dv, double vmax,
+        int &kmin, int &kmax)
+{
+    if (dv == 0.)
+    {
+        if (v0 < 0. || v0 >= vmax)
+            kmax = kmin - 1;
+        return;
+    }
+    double k1 = -v0 / dv;
+    double k2 = (vmax - v0) / dv;
+    if (dv < 0.)
+    {
+        double aux = k1;
+        k1 = k2;
+        k2 = aux;
+    }
+    if (k1 > kmax + 1 || k2 < kmin - 1)
+    {
+        kmax = kmin - 1;
+        return;
+    }
+    if (k1 > kmin)
+        kmin = XMIPP_MAX(kmin, (int)floor(k1) - 1);
+    if (k2 < kmax)
+        kmax = XMIPP_MIN(kmax, (int)ceil(k2) + 1);
+    double v;
+    while (kmin <= kmax && ((v = v0 + kmin * dv) < 0. || v >= vmax))
+        kmin++;
+    while (kmax >= kmin && ((v = v0 + kmax * dv) < 0. || v >= vmax))
+        kmax--;
+}
 
+void ProgRecWbp::backprojectPlanes(const WBPBackprojInfo *info, size_t nImgs,
+                                   MultidimArray<double> &vol, int diameter,
+                                   int i0, int iF)
+{
+    double radius2 = diameter / 2.;
+    radius2 = radius2 * radius2;
+    double dim2 = dim / 2;
     double dim1 = dim - 1;
-    const MultidimArray<double> mImg = img();
-    int idim;
-    idim = dim;//cast to int from size_t
-    for (i = 0; i < idim; i++)
+    int idim = dim;
+    for (int i = i0; i <= iF; i++)
     {
-        z = -i + dim2; /*** Z points upwards ***/
-        z2 = z * z;
+        double z = -i + dim2; /*** Z points upwards ***/
+        double z2 = z * z;
         if (z2 > radius2)
             continue;
-        double xpz = z * a20 + dim2;
-        double ypz = z * a21 + dim2;
-        for (j = 0; j < idim; j++)
+        for (int j = 0; j < idim; j++)
         {
-            y = j - dim2;
-            y2 = y * y;
-            z2_plus_y2 = z2 + y2;
+            double y = j - dim2;
+            double z2_plus_y2 = z2 + y * y;
             if (z2_plus_y2 > radius2)
                 continue;
-            x = 0 - dim2; /***** X for k == 0 *****/
-            xp = x * a00 + y * a10 + xpz;
-            yp = x * a01 + y * a11 + ypz;
-            if (yp >= dim1 || yp < 0.0)
-                continue;
-            l = (int) yp;
-            scaley = yp - l;
-            double scale1y = 1. - scaley;
-            for (k = 0; k < idim; k++, xp += a00, yp += a01, x++)
+
+            // Voxels of this row inside the reconstruction sphere
+            double r = sqrt(radius2 - z2_plus_y2);
+            int k0 = XMIPP_MAX(0, (int)ceil(dim2 - r));
+            int kF = XMIPP_MIN(idim - 1, (int)floor(dim2 + r));
+            while (k0 > 0 && (k0 - 1 - dim2) * (k0 - 1 - dim2) + z2_plus_y2 <= radius2)
+                k0--;
+            while (k0 <= kF && (k0 - dim2) * (k0 - dim2) + z2_plus_y2 > radius2)
+                k0++;
+            while (kF < idim - 1 && (kF + 1 - dim2) * (kF + 1 - dim2) + z2_plus_y2 <= radius2)
+                kF++;
+            while (kF >= k0 && (kF - dim2) * (kF - dim2) + z2_plus_y2 > radius2)
+                kF--;
+
+            double *ptrVol = &dAkij(vol, i, j, 0);
+            for (size_t n = 0; n < nImgs; n++)
             {
-                x2 = x * x;
-                if (x2 + z2_plus_y2 > radius2)
-                    continue;
-                if (xp >= dim1 || xp < 0.0)
-                    continue;
+                const WBPBackprojInfo &p = info[n];
+                // Position in the image of the voxel k=0 of this row
+                double xp0 = -dim2 * p.a00 + y * p.a10 + z * p.a20 + dim2;
+                double yp0 = -dim2 * p.a01 + y * p.a11 + z * p.a21 + dim2;
+                int kmin = k0, kmax = kF;
+                clipBackprojectionRange(xp0, p.a00, dim1, kmin, kmax);
+                clipBackprojectionRange(yp0, p.a01, dim1, kmin, kmax);
+                if (kmin > kmax)
+                    continue; // The row does not cross this image
 
                 /**** interpolation ****/
-                m = (int) xp;
-                scalex = xp - m;
-                double scale1x = 1. - scalex;
-                value1 = scalex * dAij(mImg, l, m + 1)
-                         + scale1x * dAij(mImg, l, m);
-                value2 = scalex * dAij(mImg, l + 1, m + 1)
-                         + scale1x * dAij(mImg, l + 1, m);
-                value = scaley * value2 + scale1y * value1;
-                dAkij(vol, i, j, k) += value;
+                const double *mImg = p.img;
+                if (p.a01 == 0.)
+                {
+                    // Single axis tilt: the whole row falls on the same image row
+                    int l = (int) yp0;
+                    double scaley = yp0 - l;
+                    const double *ptr1 = mImg + l * idim;
+                    const double *ptr2 = ptr1 + idim;
+                    for (int k = kmin; k <= kmax; k++)
+                    {
+                        double xp = xp0 + k * p.a00;
+                        int m = (int) xp;
+                        double scalex = xp - m;
+                        double value1 = ptr1[m] + scalex * (ptr1[m + 1] - ptr1[m]);
+                        double value2 = ptr2[m] + scalex * (ptr2[m + 1] - ptr2[m]);
+                        ptrVol[k] += value1 + scaley * (value2 - value1);
+                    }
+                }
+                else
+                    for (int k = kmin; k <= kmax; k++)
+                    {
+                        double xp = xp0 + k * p.a00;
+                        double yp = yp0 + k * p.a01;
+                        int m = (int) xp;
+                        int l = (int) yp;
+                        double scalex = xp - m;
+                        double scaley = yp - l;
+                        const double *ptr1 = mImg + l * idim + m;
+                        const double *ptr2 = ptr1 + idim;
+                        double value1 = ptr1[0] + scalex * (ptr1[1] - ptr1[0]);
+                        double value2 = ptr2[0] + scalex * (ptr2[1] - ptr2[0]);
+                        ptrVol[k] += value1 + scaley * (value2 - value1);
+                    }
             }
         }
     }
 }
 
+// Backproject a batch with several threads, each one takes whole planes
+void threadBackprojectBatch(ThreadArgument &thArg)
+{
+    ProgRecWbp * self = (ProgRecWbp *) thArg.workClass;
+    size_t first, last;
+    while (self->planeDistributor->getTasks(first, last))
+        self->backprojectPlanes(&(self->batchInfo[0]), self->batchNImgs,
+                                self->reconstructedVolume(), self->diameter,
+                                (int)first, (int)last);
+}
+
+void ProgRecWbp::addToBatch(const Projection &proj)
+{
+    batchImgs[batchNImgs] = proj();
+    getBackprojectionInfo(proj, batchInfo[batchNImgs]);
+    batchInfo[batchNImgs].img = MULTIDIM_ARRAY(batchImgs[batchNImgs]);
+    if (++batchNImgs == batchImgs.size())
+        backprojectBatch();
+}
+
+void ProgRecWbp::backprojectBatch()
+{
+    if (batchNImgs == 0)
+        return;
+    if (thMgr == NULL)
+        backprojectPlanes(&batchInfo[0], batchNImgs, reconstructedVolume(),
+                          diameter, 0, (int)dim - 1);
+    else
+    {
+        planeDistributor->reset();
+        thMgr->run(threadBackprojectBatch);
+    }
+    batchNImgs = 0;
+}
+
 // Calculate the filter in 2D and apply ======================================
 void ProgRecWbp::filterOneImage(Projection &proj, Tabsinc &TSINC)
 {
@@ -555,10 +696,11 @@ void ProgRecWbp::apply2DFilterArbitraryGeometry()
             proj() *= proj.weight();
         proj().setXmippOrigin();
         filterOneImage(proj, TSINC);
-        simpleBackprojection(proj, mReconstructedVolume, diameter);
+        addToBatch(proj);
 
         showProgress();
     }
+    backprojectBatch();
     if (verbose > 0)
         progress_bar(time_bar_size);
 
@@ -30,6 +30,7 @@
 #include <data/xmipp_image.h>
 #include <data/projection.h>
 #include <data/filters.h>
+#include <data/xmipp_threads.h>
 
 #include <reconstruction/recons.h>
 
@@ -48,6 +49,18 @@ typedef struct
 }
 WBPInfo;
 
+typedef struct
+{
+    const double *img; // Filtered image (dim x dim)
+    double a00; // Inverse projection matrix (only the used elements)
+    double a01;
+    double a10;
+    double a11;
+    double a20;
+    double a21;
+}
+WBPBackprojInfo;
+
 /** WBP parameters. */
 class ProgRecWbp: public ProgReconsBase
 {
@@ -85,6 +98,20 @@ public:
     MDIterator * iter;
     /// Reconstructed volume
     Image<double> reconstructedVolume;
+    /// Number of threads for the backprojection
+    int numThreads;
+    /// Number of images backprojected together
+    int batchSize;
+    /// Filtered images waiting to be backprojected
+    std::vector< MultidimArray<double> > batchImgs;
+    /// Backprojection parameters of the images in the batch
+    std::vector<WBPBackprojInfo> batchInfo;
+    /// Number of images currently in the batch
+    size_t batchNImgs;
+    /// Thread manager
+    ThreadManager * thMgr;
+    /// Distributor of the volume planes among threads
+    ThreadTaskDistributor * planeDistributor;
 public:
 
     ProgRecWbp();
@@ -132,6 +159,23 @@ public:
     void simpleBackprojection(Projection &img, MultidimArray<double> &vol,
                                int diameter) ;
 
+    /// Compute the backprojection parameters of an image
+    void getBackprojectionInfo(const Projection &img, WBPBackprojInfo &info);
+
+    /** Backproject a set of images onto the planes i0 to iF of the volume.
+     * Each row of voxels receives the contribution of all the images
+     * before going to the next one, so the row is kept in cache.
+     */
+    void backprojectPlanes(const WBPBackprojInfo *info, size_t nImgs,
+                           MultidimArray<double> &vol, int diameter,
+                           int i0, int iF);
+
+    /// Add an already filtered image to the batch (backprojecting it if full)
+    void addToBatch(const Projection &proj);
+
+    /// Backproject the images in the batch onto the reconstructed volume
+    void backprojectBatch();
+
     // Calculate the filter and apply it to a projection
     void filterOneImage(Projection &proj, Tabsinc &TSINC);
 
@@ -26,6 +26,8 @@
 #include "symmetrize.h"
 
 #include <data/args.h>
+#include <data/xmipp_fftw.h>
+#include <data/xmipp_threads.h>
 
 /* Read parameters --------------------------------------------------------- */
 void ProgSymmetrize::readParams()
@@ -50,6 +52,10 @@ void ProgSymmetrize::readParams()
     do_not_generate_subgroup = checkParam("--no_group");
     wrap = !checkParam("--dont_wrap");
     sum = checkParam("--sum");
+    fourier = checkParam("--fourier");
+    if (fourier)
+        pad = getIntParam("--fourier");
+    nThreads = getIntParam("--thr");
 }
 
 /* Usage ------------------------------------------------------------------- */
@@ -72,10 +78,19 @@ void ProgSymmetrize::defineParams()
     addParamsLine("   [--dont_wrap]         : by default, the image/volume is wrapped");
     addParamsLine("   [--sum]               : compute the sum of the images/volumes instead of the average. This is useful for symmetrizing pieces");
     addParamsLine("   [--mask_in <fileName>]: symmetrize only in the masked area");
+    addParamsLine("   [--fourier <pad=2>]   : For 3D point groups: symmetrize in Fourier space, padding the volume by this factor");
+    addParamsLine("                         : Much faster for high orders (e.g. I). The volume is wrapped");
+    addParamsLine("                         : It needs about 16*pad^3 bytes per voxel (16 GB for 500^3 and pad 2)");
+    addParamsLine("                         : The interpolation in Fourier space differs from the real space symmetrization");
+    addParamsLine("                         : by up to about 4% of the maximum with pad 2, 2% with pad 3 and 1% with pad 4.");
+    addParamsLine("                         : Use pad 4 for final maps if there is enough memory");
+    addParamsLine("   [--thr <N=1>]         : Number of threads for the Fourier symmetrization");
     addExampleLine("Symmetrize a list of images with 6 fold symmetry",false);
     addExampleLine("   xmipp_symmetrize -i input.sel --sym 6");
     addExampleLine("Symmetrize with i3 symmetry and the volume is not wrapped",false);
     addExampleLine("   xmipp_symmetrize -i input.vol --sym i3 --dont_wrap");
+    addExampleLine("Symmetrize in Fourier space with i3 symmetry and 8 threads",false);
+    addExampleLine("   xmipp_symmetrize -i input.vol --sym i3 --fourier 2 --thr 8");
 }
 
 /* Show ------------------------------------------------------------------- */
@@ -89,6 +104,8 @@ void ProgSymmetrize::show()
     << "No group: " << do_not_generate_subgroup << std::endl
     << "Wrap:     " << wrap << std::endl
     << "Sum:      " << sum << std::endl;
+    if (fourier)
+        std::cout << "Fourier:  padding " << pad << ", " << nThreads << " threads" << std::endl;
     if (doMask)
         std::cout << "mask_in    " << fn_Maskin << std::endl;
     if (helical)
@@ -155,6 +172,157 @@ void symmetrizeVolume(const SymList &SL, const MultidimArray<double> &V_in,
     }
 }
 
+/** Data shared by the threads of the Fourier symmetrization */
+struct FourierSymmetrizeData
+{
+    const SymList *SL;
+    const MultidimArray< std::complex<double> > *Fin; // Transform of the padded volume
+    MultidimArray< std::complex<double> > *Fout; // Transform of the output volume
+    int xdim; // Real space size of the padded volume
+    int xdimOut; // Real space size of the output volume
+    double padVolume; // Ratio between the sizes of the padded and output volumes
+    double norm;
+    ThreadTaskDistributor *distributor;
+};
+
+/* Coefficient of a half Fourier transform at any integer index. The index
+   is wrapped and the missing half is taken from the Hermitian symmetry */
+inline std::complex<double> fourierCoefficient(const MultidimArray< std::complex<double> > &F,
+        int xdim, int k, int i, int j)
+{
+    int zdim=(int)ZSIZE(F), ydim=(int)YSIZE(F);
+    k=intWRAP(k,0,zdim-1);
+    i=intWRAP(i,0,ydim-1);
+    j=intWRAP(j,0,xdim-1);
+    if (j<(int)XSIZE(F))
+        return DIRECT_A3D_ELEM(F,k,i,j);
+    return conj(DIRECT_A3D_ELEM(F,(zdim-k)%zdim,(ydim-i)%ydim,xdim-j));
+}
+
+/* Trilinear interpolation of a half Fourier transform at the digital
+   frequency (fx,fy,fz) */
+inline std::complex<double> interpolatedFourierCoefficient(const MultidimArray< std::complex<double> > &F,
+        int xdim, double fx, double fy, double fz)
+{
+    double xq=fx*xdim, yq=fy*YSIZE(F), zq=fz*ZSIZE(F);
+    int x0=(int)floor(xq), y0=(int)floor(yq), z0=(int)floor(zq);
+    double wx=xq-x0, wy=yq-y0, wz=zq-z0;
+    std::complex<double> c00=fourierCoefficient(F,xdim,z0,y0,x0)*(1-wx)+
+                             fourierCoefficient(F,xdim,z0,y0,x0+1)*wx;
+    std::complex<double> c01=fourierCoefficient(F,xdim,z0,y0+1,x0)*(1-wx)+
+                             fourierCoefficient(F,xdim,z0,y0+1,x0+1)*wx;
+    std::complex<double> c10=fourierCoefficient(F,xdim,z0+1,y0,x0)*(1-wx)+
+                             fourierCoefficient(F,xdim,z0+1,y0,x0+1)*wx;
+    std::complex<double> c11=fourierCoefficient(F,xdim,z0+1,y0+1,x0)*(1-wx)+
+                             fourierCoefficient(F,xdim,z0+1,y0+1,x0+1)*wx;
+    return (c00*(1-wy)+c01*wy)*(1-wz)+(c10*(1-wy)+c11*wy)*wz;
+}
+
+void threadSymmetrizeFourierPlanes(ThreadArgument &thArg)
+{
+    FourierSymmetrizeData *data=(FourierSymmetrizeData *) thArg.data;
+    const SymList &SL=*(data->SL);
+    const MultidimArray< std::complex<double> > &Fin=*(data->Fin);
+    MultidimArray< std::complex<double> > &Fout=*(data->Fout);
+    int xdim=data->xdim, xdimOut=data->xdimOut;
+    int ydimOut=(int)YSIZE(Fout), zdimOut=(int)ZSIZE(Fout);
+    int Nsym=SL.symsNo();
+
+    size_t first, last;
+    while (data->distributor->getTasks(first,last))
+        for (size_t k=first; k<=last; ++k)
+        {
+            double fz, fy, fx;
+            FFT_IDX2DIGFREQ(k,zdimOut,fz);
+            for (size_t i=0; i<YSIZE(Fout); ++i)
+            {
+                FFT_IDX2DIGFREQ(i,ydimOut,fy);
+                for (size_t j=0; j<XSIZE(Fout); ++j)
+                {
+                    FFT_IDX2DIGFREQ(j,xdimOut,fx);
+                    if (fx*fx+fy*fy+fz*fz>0.25)
+                    {
+                        DIRECT_A3D_ELEM(Fout,k,i,j)=0.;
+                        continue;
+                    }
+                    std::complex<double> rotated=0.;
+                    for (int isym=0; isym<Nsym; ++isym)
+                    {
+                        const double *R=SL.matrixR3(isym);
+                        rotated+=interpolatedFourierCoefficient(Fin,xdim,
+                                                                R[0]*fx+R[1]*fy+R[2]*fz,
+                                                                R[3]*fx+R[4]*fy+R[5]*fz,
+                                                                R[6]*fx+R[7]*fy+R[8]*fz);
+                    }
+                    std::complex<double> &value=DIRECT_A3D_ELEM(Fout,k,i,j);
+                    value=(value+rotated*data->padVolume)*data->norm;
+                }
+            }
+        }
+}
+
+void symmetrizeVolumeFourier(const SymList &SL, const MultidimArray<double> &V_in,
+                             MultidimArray<double> &V_out, bool sum, int pad, int nThreads)
+{
+    // Pad the volume
+    MultidimArray<double> Vpad=V_in;
+    Vpad.setXmippOrigin();
+    if (pad>1)
+        Vpad.selfWindow(FIRST_XMIPP_INDEX(pad*ZSIZE(V_in)),FIRST_XMIPP_INDEX(pad*YSIZE(V_in)),
+                        FIRST_XMIPP_INDEX(pad*XSIZE(V_in)),LAST_XMIPP_INDEX(pad*ZSIZE(V_in)),
+                        LAST_XMIPP_INDEX(pad*YSIZE(V_in)),LAST_XMIPP_INDEX(pad*XSIZE(V_in)));
+
+    // Move the origin to the first element, so that the rotations in
+    // Fourier space are around the volume center. The padded volume is
+    // not needed after its transform.
+    CenterFFT(Vpad,true);
+    FourierTransformer transformer;
+    transformer.setThreadsNumber(nThreads);
+    MultidimArray< std::complex<double> > Fin;
+    transformer.FourierTransform(Vpad,Fin,false);
+    int xdim=(int)XSIZE(Vpad);
+    double padVolume=(double)MULTIDIM_SIZE(Vpad)/MULTIDIM_SIZE(V_in);
+    Vpad.clear();
+
+    // The output is computed directly at the input size, starting from
+    // the transform of the input (the identity). The coefficients of the
+    // padded transform are those of the input at a finer sampling, so
+    // they are scaled by the ratio of both sizes.
+    V_out=V_in;
+    V_out.setXmippOrigin();
+    CenterFFT(V_out,true);
+    FourierTransformer transformerOut;
+    transformerOut.setThreadsNumber(nThreads);
+    MultidimArray< std::complex<double> > Fout;
+    transformerOut.FourierTransform(V_out,Fout,false);
+
+    ThreadTaskDistributor distributor(ZSIZE(Fout),1);
+    FourierSymmetrizeData data;
+    data.SL=&SL;
+    data.Fin=&Fin;
+    data.Fout=&Fout;
+    data.xdim=xdim;
+    data.xdimOut=(int)XSIZE(V_out);
+    data.padVolume=padVolume;
+    data.norm=sum ? 1.0 : 1.0/(SL.symsNo()+1.0);
+    data.distributor=&distributor;
+    if (nThreads>1)
+    {
+        ThreadManager thMgr(nThreads);
+        thMgr.run(threadSymmetrizeFourierPlanes,&data);
+    }
+    else
+    {
+        ThreadArgument thArg;
+        thArg.data=&data;
+        threadSymmetrizeFourierPlanes(thArg);
+    }
+
+    transformerOut.inverseFourierTransform();
+    CenterFFT(V_out,false);
+    V_out.copyShape(V_in);
+}
+
 void symmetrizeImage(int symorder, const MultidimArray<double> &I_in,
                      MultidimArray<double> &I_out,
                      bool wrap, bool do_outside_avg, bool sum,
@@ -229,7 +397,22 @@ void ProgSymmetrize::processImage(const FileName &fnImg, const FileName &fnImgOu
     }
     else
     {
-        if (SL.symsNo()>0 || helical || dihedral || helicalDihedral)
+        if (fourier && SL.symsNo()>0 && !helical && !dihedral && !helicalDihedral)
+        {
+            if (doMask)
+                REPORT_ERROR(ERR_ARG_INCORRECT,"The Fourier symmetrization cannot be restricted to a mask");
+            if (!wrap)
+                REPORT_ERROR(ERR_ARG_INCORRECT,"The Fourier symmetrization always wraps the volume");
+            Matrix1D<double> shift;
+            for (int isym=0; isym<SL.symsNo(); ++isym)
+            {
+                SL.getShift(isym,shift);
+                if (shift.module()>0)
+                    REPORT_ERROR(ERR_ARG_INCORRECT,"The Fourier symmetrization is only valid for point groups");
+            }
+            symmetrizeVolumeFourier(SL,Iin(),Iout(),sum,pad,nThreads);
+        }
+        else if (SL.symsNo()>0 || helical || dihedral || helicalDihedral)
         {
             symmetrizeVolume(SL,Iin(),Iout(),wrap,!wrap,
                              sum,helical,dihedral,helicalDihedral,rotHelical,rotPhaseHelical,zHelical,mmask);
@@ -31,6 +31,7 @@
 #include <data/metadata.h>
 #include <data/numerical_tools.h>
 #include <data/morphology.h>
+#include <data/xmipp_threads.h>
 #include <fstream>
 #include <queue>
 #include <iostream>
@@ -69,7 +70,7 @@ void generateMask(const MultidimArray<double> &I, MultidimArray<unsigned char> &
 #undef DEBUG
 
 /* Compute affine matrix --------------------------------------------------- */
-class AffineFitness
+class AffineFitness: public OptimizationObjective
 {
 public:
     Matrix1D<double> minAllowed;
@@ -244,9 +245,9 @@ public:
         return dist;
     }
 
-    static double Powell_affine_fitness_individual(double *p, void *prm)
+    double evaluate(double *p)
     {
-        return ((AffineFitness*)prm)->affine_fitness_individual(p+1);
+        return affine_fitness_individual(p+1);
     }
 };
 
@@ -343,7 +344,6 @@ void setupAffineFitness(AffineFitness &fitness, const MultidimArray<double> &I1,
     fitness.maxAllowed(4)=fitness.maxAllowed(5)= maxShift;
 }
 
-static pthread_mutex_t globalAffineMutex = PTHREAD_MUTEX_INITIALIZER;
 double computeAffineTransformation(const MultidimArray<unsigned char> &I1,
                                    const MultidimArray<unsigned char> &I2, int maxShift, int maxIterDE,
                                    Matrix2D<double> &A12, Matrix2D<double> &A21, bool show,
@@ -387,9 +387,10 @@ double computeAffineTransformation(const MultidimArray<unsigned char> &I1,
             }
             else
             {
-                // Initialize with cross correlation
+                // Initialize with cross correlation. Each thread has its
+                // own auxiliary data, and the creation of the FFTW plans
+                // is already protected by the Fourier transformer
                 double tx, ty;
-                pthread_mutex_lock( &globalAffineMutex );
                 CorrelationAux aux;
                 if (!isMirror)
                     bestShift(I1d,I2d,tx,ty,aux);
@@ -402,7 +403,6 @@ double computeAffineTransformation(const MultidimArray<unsigned char> &I1,
                     bestShift(I1d,auxI2d,tx,ty,aux);
                     ty=-ty;
                 }
-                pthread_mutex_unlock( &globalAffineMutex );
                 A(4)=-tx;
                 A(5)=-ty;
             }
@@ -411,8 +411,7 @@ double computeAffineTransformation(const MultidimArray<unsigned char> &I1,
             Matrix1D<double> steps(A);
             steps.initConstant(1);
             int iter;
-            powellOptimizer(A, 1, VEC_XSIZE(A),
-                            AffineFitness::Powell_affine_fitness_individual, &affy, 0.005,
+            powellOptimizer(A, 1, VEC_XSIZE(A), affy, 0.005,
                             cost, iter, steps, false);
 
             // Separate solution
@@ -579,18 +578,16 @@ void ProgTomographAlignment::defineParams()
 static pthread_mutex_t printingMutex = PTHREAD_MUTEX_INITIALIZER;
 struct ThreadComputeTransformParams
 {
-    int myThreadID;
     ProgTomographAlignment * parent;
+    ThreadTaskDistributor * distributor;
 };
 
-void * threadComputeTransform( void * args )
+void threadComputeTransform(ThreadArgument &thArg)
 {
     ThreadComputeTransformParams * master =
-        (ThreadComputeTransformParams *) args;
+        (ThreadComputeTransformParams *) thArg.workClass;
 
     ProgTomographAlignment * parent = master->parent;
-    int thread_id = master->myThreadID;
-    int localnumThreads = parent->numThreads;
     bool isCapillar = parent->isCapillar;
     int Nimg = parent->Nimg;
     double maxShiftPercentage = parent->maxShiftPercentage;
@@ -606,10 +603,11 @@ void * threadComputeTransform( void * args )
     if (isCapillar)
         initjj=0;
 
-    initjj += thread_id;
-
+    // Each pair of consecutive images is a task
     double cost;
-    for (int jj=initjj; jj<Nimg; jj+= localnumThreads)
+    size_t first, last;
+    while (master->distributor->getTasks(first, last))
+    for (int jj=initjj+first; jj<=initjj+(int)last; jj++)
     {
         int jj_1;
         if (isCapillar)
@@ -665,12 +663,10 @@ void * threadComputeTransform( void * args )
             pthread_mutex_lock( &printingMutex );
             std::cout << "Cost for [" << jj_1 << "] - ["
             << jj << "] = " << cost << std::endl;
-            pthread_mutex_unlock( &printingMutex );
             parent->iteration++;
+            pthread_mutex_unlock( &printingMutex );
         }
     }
-
-    return NULL;
 }
 
 void ProgTomographAlignment::computeAffineTransformations(
@@ -679,24 +675,17 @@ void ProgTomographAlignment::computeAffineTransformations(
     bool oldglobalAffine=globalAffine;
     globalAffine=globalAffineToUse;
 
-    pthread_t * th_ids = new pthread_t[numThreads];
-    ThreadComputeTransformParams * th_args = new ThreadComputeTransformParams[numThreads];
-
-    for( int nt = 0 ; nt < numThreads ; nt ++ )
+    // The pairs are given one by one to the threads as they finish
+    int Npairs=isCapillar ? Nimg : Nimg-1;
+    if (Npairs>0)
     {
-        // Passing parameters to each thread
-        th_args[nt].parent = this;
-        th_args[nt].myThreadID = nt;
-        pthread_create( (th_ids+nt) , NULL, threadComputeTransform, (void *)(th_args+nt) );
+        ThreadTaskDistributor distributor(Npairs, 1);
+        ThreadComputeTransformParams params;
+        params.parent = this;
+        params.distributor = &distributor;
+        ThreadManager thMgr(numThreads, &params);
+        thMgr.run(threadComputeTransform);
     }
-
-    // Waiting for threads to finish
-    for( int nt = 0 ; nt < numThreads ; nt ++ )
-        pthread_join(*(th_ids+nt), NULL);
-
-    // Threads structures are not needed any more
-    delete[] th_ids;
-    delete[] th_args;
     globalAffine=oldglobalAffine;
 }
 
@@ -1040,26 +1029,28 @@ void ProgTomographAlignment::produceSideInfo()
 //#define DEBUG
 struct ThreadGenerateLandmarkSetParams
 {
-    int myThreadID;
     ProgTomographAlignment * parent;
+    ThreadTaskDistributor * distributor;
 
-    std::vector<LandmarkChain> *chainList;
+    // Chains found by each task. Every task writes only in its own list
+    // so that no lock is needed, and the final order of the chains does
+    // not depend on the number of threads.
+    std::vector< std::vector<LandmarkChain> > taskChains;
 };
 
-void * threadgenerateLandmarkSetGrid( void * args )
+void threadgenerateLandmarkSetGrid(ThreadArgument &thArg)
 {
     ThreadGenerateLandmarkSetParams * master =
-        (ThreadGenerateLandmarkSetParams *) args;
+        (ThreadGenerateLandmarkSetParams *) thArg.data;
     ProgTomographAlignment * parent = master->parent;
-    int thread_id = master->myThreadID;
+    int thread_id = thArg.thread_id;
     int Nimg=parent->Nimg;
-    int numThreads=parent->numThreads;
+    CorrelationAux aux;
     const std::vector< std::vector< Matrix2D<double> > > &affineTransformations=
         parent->affineTransformations;
     int gridSamples=parent->gridSamples;
 
     int deltaShift=(int)floor(XSIZE(*(parent->img)[0])/gridSamples);
-    master->chainList=new std::vector<LandmarkChain>;
     Matrix1D<double> rii(3), rjj(3);
     ZZ(rii)=1;
     ZZ(rjj)=1;
@@ -1067,7 +1058,9 @@ void * threadgenerateLandmarkSetGrid( void * args )
         init_progress_bar(gridSamples);
     int includedPoints=0;
     Matrix1D<int> visited(Nimg);
-    for (int nx=thread_id; nx<gridSamples; nx+=numThreads)
+    size_t first, last;
+    while (master->distributor->getTasks(first, last))
+    for (int nx=(int)first; nx<=(int)last; nx++)
     {
         XX(rii)=STARTINGX(*(parent->img)[0])+ROUND(deltaShift*(0.5+nx));
         for (int ny=0; ny<gridSamples; ny+=1)
@@ -1115,7 +1108,7 @@ void * threadgenerateLandmarkSetGrid( void * args )
                     rjj=Aji*rcurrent;
                     double corr;
                     acceptLandmark=parent->refineLandmark(jj_1,jj,rcurrent,rjj,
-                                                          corr,true);
+                                                          corr,true,&aux);
                     if (acceptLandmark)
                     {
                         l.x=XX(rjj);
@@ -1152,7 +1145,7 @@ void * threadgenerateLandmarkSetGrid( void * args )
                     rjj=Aij*rcurrent;
                     double corr;
                     acceptLandmark=parent->refineLandmark(jj_1,jj,rcurrent,rjj,
-                                                          corr,true);
+                                                          corr,true,&aux);
                     if (acceptLandmark)
                     {
                         l.x=XX(rjj);
@@ -1188,7 +1181,7 @@ void * threadgenerateLandmarkSetGrid( void * args )
                             std::cout << chain[i].imgIdx << " ";
 #endif
 
-                        master->chainList->push_back(chain);
+                        master->taskChains[nx].push_back(chain);
                         includedPoints+=chain.size();
                     }
                 }
@@ -1201,9 +1194,9 @@ void * threadgenerateLandmarkSetGrid( void * args )
             std::cout << "Point nx=" << nx << " ny=" << ny
             << " Number of points="
             << includedPoints
-            << " Number of chains=" << master->chainList->size()
+            << " Number of chains=" << master->taskChains[nx].size()
             << " ( " << ((double) includedPoints)/
-            master->chainList->size() << " )\n";
+            master->taskChains[nx].size() << " )\n";
 #endif
 
         }
@@ -1212,23 +1205,20 @@ void * threadgenerateLandmarkSetGrid( void * args )
     }
     if (thread_id==0)
         progress_bar(gridSamples);
-    return NULL;
 }
 
-void * threadgenerateLandmarkSetBlind( void * args )
+void threadgenerateLandmarkSetBlind(ThreadArgument &thArg)
 {
     ThreadGenerateLandmarkSetParams * master =
-        (ThreadGenerateLandmarkSetParams *) args;
+        (ThreadGenerateLandmarkSetParams *) thArg.data;
     ProgTomographAlignment * parent = master->parent;
-    int thread_id = master->myThreadID;
+    int thread_id = thArg.thread_id;
     int Nimg=parent->Nimg;
-    int numThreads=parent->numThreads;
     const std::vector< std::vector< Matrix2D<double> > > &affineTransformations=
         parent->affineTransformations;
     int gridSamples=parent->gridSamples;
 
     int deltaShift=(int)floor(XSIZE(*(parent->img)[0])/gridSamples);
-    master->chainList=new std::vector<LandmarkChain>;
     Matrix1D<double> rii(3), rjj(3);
     ZZ(rii)=1;
     ZZ(rjj)=1;
@@ -1236,7 +1226,9 @@ void * threadgenerateLandmarkSetBlind( void * args )
         init_progress_bar(gridSamples);
     int includedPoints=0;
     int maxSideLength=(parent->blindSeqLength-1)/2;
-    for (int nx=thread_id; nx<gridSamples; nx+=numThreads)
+    size_t first, last;
+    while (master->distributor->getTasks(first, last))
+    for (int nx=(int)first; nx<=(int)last; nx++)
     {
         XX(rii)=STARTINGX(*(parent->img)[0])+ROUND(deltaShift*(0.5+nx));
         for (int ny=0; ny<gridSamples; ny+=1)
@@ -1348,16 +1340,16 @@ void * threadgenerateLandmarkSetBlind( void * args )
                 << " - " << jjright << "]\n";
 #endif
 
-                master->chainList->push_back(chain);
+                master->taskChains[nx].push_back(chain);
                 includedPoints+=chain.size();
             }
 #ifdef DEBUG
             std::cout << "Point nx=" << nx << " ny=" << ny
             << " Number of points="
             << includedPoints
-            << " Number of chains=" << master->chainList->size()
+            << " Number of chains=" << master->taskChains[nx].size()
             << " ( " << ((double) includedPoints)/
-            master->chainList->size() << " )\n";
+            master->taskChains[nx].size() << " )\n";
 #endif
 
         }
@@ -1366,22 +1358,20 @@ void * threadgenerateLandmarkSetBlind( void * args )
     }
     if (thread_id==0)
         progress_bar(gridSamples);
-    return NULL;
 }
 
 //#define DEBUG
-void * threadgenerateLandmarkSetCriticalPoints( void * args )
+void threadgenerateLandmarkSetCriticalPoints(ThreadArgument &thArg)
 {
     ThreadGenerateLandmarkSetParams * master =
-        (ThreadGenerateLandmarkSetParams *) args;
+        (ThreadGenerateLandmarkSetParams *) thArg.data;
     ProgTomographAlignment * parent = master->parent;
-    int thread_id = master->myThreadID;
+    int thread_id = thArg.thread_id;
     int Nimg=parent->Nimg;
-    int numThreads=parent->numThreads;
+    CorrelationAux aux;
     const std::vector< std::vector< Matrix2D<double> > > &affineTransformations=
         parent->affineTransformations;
 
-    master->chainList=new std::vector<LandmarkChain>;
     std::vector<LandmarkChain> candidateChainList;
     if (thread_id==0)
         init_progress_bar(Nimg);
@@ -1395,7 +1385,9 @@ void * threadgenerateLandmarkSetCriticalPoints( void * args )
     BinaryCircularMask(mask,4,OUTSIDE_MASK);
 
     Image<double> I;
-    for (int ii=thread_id; ii<=Nimg-1; ii+=numThreads)
+    size_t first, last;
+    while (master->distributor->getTasks(first, last))
+    for (int ii=(int)first; ii<=(int)last; ii++)
     {
         if (parent->isOutlier(ii))
             continue;
@@ -1515,7 +1507,7 @@ void * threadgenerateLandmarkSetCriticalPoints( void * args )
                 Aji=affineTransformations[jj_1][jj];
                 rjj=Aji*rcurrent;
                 double corr;
-                parent->refineLandmark(jj_1,jj,rcurrent,rjj, corr,true);
+                parent->refineLandmark(jj_1,jj,rcurrent,rjj,corr,true,&aux);
                 l.x=XX(rjj);
                 l.y=YY(rjj);
                 l.imgIdx=jj;
@@ -1538,7 +1530,7 @@ void * threadgenerateLandmarkSetCriticalPoints( void * args )
                 Aji=affineTransformations[jj][jj_1];
                 rjj=Aij*rcurrent;
                 double corr;
-                parent->refineLandmark(jj_1,jj,rcurrent,rjj,corr,true);
+                parent->refineLandmark(jj_1,jj,rcurrent,rjj,corr,true,&aux);
                 l.x=XX(rjj);
                 l.y=YY(rjj);
                 l.imgIdx=jj;
@@ -1562,7 +1554,7 @@ void * threadgenerateLandmarkSetCriticalPoints( void * args )
             int q=idx(XSIZE(idx)-1-iq)-1;
             if (corrQ(q)>0.5)
             {
-                master->chainList->push_back(candidateChainList[q]);
+                master->taskChains[ii].push_back(candidateChainList[q]);
 #ifdef DEBUG
 
                 std::cout << "Corr " << iq << ": " << corrQ(q) << ":";
@@ -1616,7 +1608,6 @@ void * threadgenerateLandmarkSetCriticalPoints( void * args )
     }
     if (thread_id==0)
         progress_bar(Nimg);
-    return NULL;
 }
 #undef DEBUG
 
@@ -1638,65 +1629,52 @@ ProgTomographAlignment::~ProgTomographAlignment()
     }
 }
 
+void collectLandmarkChains(const std::vector< std::vector<LandmarkChain> > &taskChains,
+                           std::vector<LandmarkChain> &chainList, int &includedPoints)
+{
+    for (size_t t=0; t<taskChains.size(); t++)
+        for (size_t i=0; i<taskChains[t].size(); i++)
+        {
+            chainList.push_back(taskChains[t][i]);
+            includedPoints+=taskChains[t][i].size();
+        }
+}
+
 void ProgTomographAlignment::generateLandmarkSet()
 {
     FileName fn_tmp = fnRoot+"_landmarks.txt";
     if (!fn_tmp.exists())
     {
-        pthread_t * th_ids = new pthread_t[numThreads];
-        ThreadGenerateLandmarkSetParams * th_args=
-            new ThreadGenerateLandmarkSetParams[numThreads];
-        for( int nt = 0 ; nt < numThreads ; nt ++ )
-        {
-            th_args[nt].parent = this;
-            th_args[nt].myThreadID = nt;
-            if (useCriticalPoints)
-                pthread_create( (th_ids+nt) , NULL, threadgenerateLandmarkSetCriticalPoints, (void *)(th_args+nt) );
-            else
-                pthread_create( (th_ids+nt) , NULL, threadgenerateLandmarkSetGrid, (void *)(th_args+nt) );
-        }
-
         std::vector<LandmarkChain> chainList;
         int includedPoints=0;
-        for( int nt = 0 ; nt < numThreads ; nt ++ )
+        ThreadManager thMgr(numThreads);
+
+        // Landmarks from critical points (one task per image) or from
+        // a grid (one task per column of the grid)
         {
-            pthread_join(*(th_ids+nt), NULL);
-            int imax=th_args[nt].chainList->size();
-            for (int i=0; i<imax; i++)
-            {
-                chainList.push_back((*th_args[nt].chainList)[i]);
-                includedPoints+=(*th_args[nt].chainList)[i].size();
-            }
-            delete th_args[nt].chainList;
+            size_t Ntasks=useCriticalPoints ? Nimg : gridSamples;
+            ThreadTaskDistributor distributor(Ntasks, 1);
+            ThreadGenerateLandmarkSetParams params;
+            params.parent = this;
+            params.distributor = &distributor;
+            params.taskChains.resize(Ntasks);
+            if (useCriticalPoints)
+                thMgr.run(threadgenerateLandmarkSetCriticalPoints, &params);
+            else
+                thMgr.run(threadgenerateLandmarkSetGrid, &params);
+            collectLandmarkChains(params.taskChains, chainList, includedPoints);
         }
-        delete( th_ids );
-        delete( th_args );
 
         // Add blind landmarks
         if (blindSeqLength>0)
         {
-            th_ids  = new pthread_t[numThreads];
-            th_args = new ThreadGenerateLandmarkSetParams[numThreads];
-            for( int nt = 0 ; nt < numThreads ; nt ++ )
-            {
-                th_args[nt].parent = this;
-                th_args[nt].myThreadID = nt;
-                pthread_create( (th_ids+nt) , NULL, threadgenerateLandmarkSetBlind, (void *)(th_args+nt) );
-            }
-
-            for( int nt = 0 ; nt < numThreads ; nt ++ )
-            {
-                pthread_join(*(th_ids+nt), NULL);
-                int imax=th_args[nt].chainList->size();
-                for (int i=0; i<imax; i++)
-                {
-                    chainList.push_back((*th_args[nt].chainList)[i]);
-                    includedPoints+=(*th_args[nt].chainList)[i].size();
-                }
-                delete th_args[nt].chainList;
-            }
-            delete( th_ids );
-            delete( th_args );
+            ThreadTaskDistributor distributor(gridSamples, 1);
+            ThreadGenerateLandmarkSetParams params;
+            params.parent = this;
+            params.distributor = &distributor;
+            params.taskChains.resize(gridSamples);
+            thMgr.run(threadgenerateLandmarkSetBlind, &params);
+            collectLandmarkChains(params.taskChains, chainList, includedPoints);
         }
 
         // Generate the landmark "matrix"
@@ -1736,7 +1714,7 @@ void ProgTomographAlignment::generateLandmarkSet()
 /* Refine landmark --------------------------------------------------------- */
 bool ProgTomographAlignment::refineLandmark(int ii, int jj,
         const Matrix1D<double> &rii, Matrix1D<double> &rjj, double &maxCorr,
-        bool tryFourier) const
+        bool tryFourier, CorrelationAux *aux) const
 {
     maxCorr=-1;
     int halfSize=XMIPP_MAX(ROUND(localSize*XSIZE(*img[ii]))/2,5);
@@ -1811,8 +1789,13 @@ bool ProgTomographAlignment::refineLandmark(int ii, int jj,
 
             // Now try with the best shift
             double shiftX,shiftY;
-            CorrelationAux aux;
-            bestNonwrappingShift(pieceii,piecejj,shiftX,shiftY,aux);
+            if (aux==NULL)
+            {
+                CorrelationAux localAux;
+                bestNonwrappingShift(pieceii,piecejj,shiftX,shiftY,localAux);
+            }
+            else
+                bestNonwrappingShift(pieceii,piecejj,shiftX,shiftY,*aux);
             Matrix1D<double> fftShift(2);
             VECTOR_R2(fftShift,shiftX,shiftY);
             selfTranslate(LINEAR,piecejj,fftShift,WRAP);
@@ -1858,80 +1841,97 @@ bool ProgTomographAlignment::refineLandmark(const MultidimArray<double> &pieceii
         bool reversed, double &maxCorr) const
 {
     int halfSize=XSIZE(pieceii)/2;
+    int pieceSize=2*halfSize+1;
 
+    // Normalize the piece at ii
+    MultidimArray<double> normalizedii=pieceii;
     double mean_ii=0, stddev_ii=0;
-    FOR_ALL_ELEMENTS_IN_ARRAY2D(pieceii)
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(normalizedii)
     {
-        mean_ii+=A2D_ELEM(pieceii,i,j);
-        stddev_ii+=A2D_ELEM(pieceii,i,j)*A2D_ELEM(pieceii,i,j);
+        double pixval=DIRECT_MULTIDIM_ELEM(normalizedii,n);
+        mean_ii+=pixval;
+        stddev_ii+=pixval*pixval;
     }
-    mean_ii/=MULTIDIM_SIZE(pieceii);
-    stddev_ii = stddev_ii / MULTIDIM_SIZE(pieceii) - mean_ii * mean_ii;
-    stddev_ii *= MULTIDIM_SIZE(pieceii) / (MULTIDIM_SIZE(pieceii) - 1);
+    double N=MULTIDIM_SIZE(normalizedii);
+    mean_ii/=N;
+    stddev_ii = stddev_ii / N - mean_ii * mean_ii;
     stddev_ii = sqrt(static_cast<double>((ABS(stddev_ii))));
+    double sum_ii=0;
     if (stddev_ii>XMIPP_EQUAL_ACCURACY)
-        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(pieceii)
-        DIRECT_MULTIDIM_ELEM(pieceii,n)=
-            (DIRECT_MULTIDIM_ELEM(pieceii,n)-mean_ii)/stddev_ii;
+    {
+        double istddev_ii=1.0/stddev_ii;
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(normalizedii)
+        {
+            double &pixval=DIRECT_MULTIDIM_ELEM(normalizedii,n);
+            pixval=(pixval-mean_ii)*istddev_ii;
+            sum_ii+=pixval;
+        }
+    }
 
     // Try all possible shifts
-    MultidimArray<double> corr((int)(1.5*(2*halfSize+1)),(int)(1.5*(2*halfSize+1)));
+    MultidimArray<double> corr((int)(1.5*pieceSize),(int)(1.5*pieceSize));
     corr.setXmippOrigin();
     corr.initConstant(-1.1);
     bool accept=false;
     double maxval=-1;
-    MultidimArray<double> piecejj(2*halfSize+1,2*halfSize+1);
-    piecejj.setXmippOrigin();
+    const MultidimArray<unsigned char> &Ijj=(*img[jj]);
     if (stddev_ii>XMIPP_EQUAL_ACCURACY)
     {
         int imax=0, jmax=0;
-        std::queue< Matrix1D<double> > Q;
-        Q.push(vectorR2(0,0));
+        std::vector<int> rowIdx(pieceSize), colIdx(pieceSize);
+        std::queue< std::pair<int,int> > Q;
+        Q.push(std::pair<int,int>(0,0));
         while (!Q.empty())
         {
             // Get the first position to evaluate
-            int shifty=(int)YY(Q.front());
-            int shiftx=(int)XX(Q.front());
+            int shifty=Q.front().first;
+            int shiftx=Q.front().second;
             Q.pop();
-            if (!corr(shifty,shiftx)<-1)
+            if (A2D_ELEM(corr,shifty,shiftx)>=-1)
+                continue; // Already evaluated
+
+            // Check that the piece in image jj is inside the image
+            if (XX(rjj)+shiftx-halfSize<STARTINGX(Ijj) ||
+                YY(rjj)+shifty-halfSize<STARTINGY(Ijj) ||
+                XX(rjj)+shiftx+halfSize>FINISHINGX(Ijj) ||
+                YY(rjj)+shifty+halfSize>FINISHINGY(Ijj))
                 continue;
 
-            // Select piece in image jj, compute its statistics and normalize
-            double mean_jj=0, stddev_jj=0;
-            const MultidimArray<unsigned char> &Ijj=(*img[jj]);
-            if (XX(rjj)+shiftx+STARTINGX(piecejj)<STARTINGX(Ijj) ||
-                YY(rjj)+shifty+STARTINGY(piecejj)<STARTINGY(Ijj) ||
-                XX(rjj)+shiftx+FINISHINGX(piecejj)>FINISHINGX(Ijj) ||
-                YY(rjj)+shifty+FINISHINGY(piecejj)>FINISHINGY(Ijj))
-                continue;
-            FOR_ALL_ELEMENTS_IN_ARRAY2D(piecejj)
+            // Rows and columns of the piece in image jj (in physical
+            // coordinates). A reversed piece is read upside down.
+            for (int i=-halfSize; i<=halfSize; i++)
             {
-                double pixval=A2D_ELEM(Ijj,
-                                       (int)(YY(rjj)+shifty+i),
-                                       (int)(XX(rjj)+shiftx+j));
-                A2D_ELEM(piecejj,i,j)=pixval;
-                mean_jj+=pixval;
-                stddev_jj+=pixval*pixval;
+                int ii=reversed ? -i : i;
+                rowIdx[i+halfSize]=(int)(YY(rjj)+shifty+ii)-STARTINGY(Ijj);
+                colIdx[i+halfSize]=(int)(XX(rjj)+shiftx+i)-STARTINGX(Ijj);
             }
-            mean_jj/=MULTIDIM_SIZE(piecejj);
-            stddev_jj = stddev_jj / MULTIDIM_SIZE(piecejj) - mean_jj * mean_jj;
-            stddev_jj *= MULTIDIM_SIZE(piecejj) / (MULTIDIM_SIZE(piecejj) - 1);
-            stddev_jj = sqrt(static_cast<double>((ABS(stddev_jj))));
-            if (reversed)
-                piecejj.selfReverseY();
 
-            // Compute the correlation
-            corr(shifty,shiftx)=0;
-            double &corrRef=corr(shifty,shiftx);
-            if (stddev_jj>XMIPP_EQUAL_ACCURACY)
+            // Statistics of the piece at jj and its product with the
+            // normalized piece at ii in a single pass
+            double sum_jj=0, sum2_jj=0, sum_iijj=0;
+            const double *ptrii=MULTIDIM_ARRAY(normalizedii);
+            for (int i=0; i<pieceSize; i++)
             {
-                double istddev_jj=1.0/stddev_jj;
-                FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(piecejj)
-                corrRef+=
-                    DIRECT_MULTIDIM_ELEM(pieceii,n)*
-                    (DIRECT_MULTIDIM_ELEM(piecejj,n)-mean_jj)*istddev_jj;
-                corrRef/=MULTIDIM_SIZE(piecejj);
+                const unsigned char *rowjj=&DIRECT_A2D_ELEM(Ijj,rowIdx[i],0);
+                for (int j=0; j<pieceSize; j++, ptrii++)
+                {
+                    double pixval=rowjj[colIdx[j]];
+                    sum_jj+=pixval;
+                    sum2_jj+=pixval*pixval;
+                    sum_iijj+=(*ptrii)*pixval;
+                }
             }
+            double mean_jj=sum_jj/N;
+            double stddev_jj = sum2_jj / N - mean_jj * mean_jj;
+            stddev_jj = sqrt(static_cast<double>((ABS(stddev_jj))));
+
+            // Compute the correlation. It is the same as normalizing the
+            // piece at jj and correlating, up to rounding, so shifts whose
+            // correlations tie to the last bits may be chosen differently
+            double &corrRef=A2D_ELEM(corr,shifty,shiftx);
+            corrRef=0;
+            if (stddev_jj>XMIPP_EQUAL_ACCURACY)
+                corrRef=(sum_iijj-mean_jj*sum_ii)/(stddev_jj*N);
 
             if (corrRef>maxval)
             {
@@ -1952,8 +1952,8 @@ bool ProgTomographAlignment::refineLandmark(const MultidimArray<double> &pieceii
                                 (XX(rjj)+newshiftx+halfSize)<=FINISHINGX(Ijj) &&
                                 (YY(rjj)+newshifty-halfSize)>=STARTINGY(Ijj) &&
                                 (YY(rjj)+newshifty+halfSize)<=FINISHINGY(Ijj))
-                                if (corr(newshifty,newshiftx)<-1)
-                                    Q.push(vectorR2(newshiftx,newshifty));
+                                if (A2D_ELEM(corr,newshifty,newshiftx)<-1)
+                                    Q.push(std::pair<int,int>(newshifty,newshiftx));
                         }
             }
         }
@@ -1970,8 +1970,10 @@ bool ProgTomographAlignment::refineLandmark(const MultidimArray<double> &pieceii
         if (showRefinement)
         {
             Image<double> save;
+            MultidimArray<double> piecejj(pieceSize,pieceSize);
+            piecejj.setXmippOrigin();
             FOR_ALL_ELEMENTS_IN_ARRAY2D(piecejj)
-            piecejj(i,j)=(*img[jj])((int)(YY(rjj)+i),(int)(XX(rjj)+j));
+            piecejj(i,j)=Ijj((int)(YY(rjj)+i),(int)(XX(rjj)+j));
             if (reversed)
                 piecejj.selfReverseY();
             save()=piecejj;
@@ -2503,19 +2505,25 @@ void ProgTomographAlignment::removeOutlierLandmarks(
 }
 
 /* Run --------------------------------------------------------------------- */
-namespace TomographAlignment
+/* Error of the alignment as a function of the axis direction (rot, tilt),
+   starting from the best previous alignment of the program. */
+class AxisDirectionObjective: public OptimizationObjective
 {
-const ProgTomographAlignment* global_prm;
-}
+public:
+    const ProgTomographAlignment *prm;
 
-double wrapperError(double *p, void *prm)
-{
-    Alignment alignment(TomographAlignment::global_prm);
-    alignment=*(TomographAlignment::global_prm->bestPreviousAlignment);
-    alignment.rot=p[1];
-    alignment.tilt=p[2];
-    return alignment.optimizeGivenAxisDirection();
-}
+    AxisDirectionObjective(const ProgTomographAlignment *_prm): prm(_prm)
+    {}
+
+    double evaluate(double *p)
+    {
+        Alignment alignment(prm);
+        alignment=*(prm->bestPreviousAlignment);
+        alignment.rot=p[1];
+        alignment.tilt=p[2];
+        return alignment.optimizeGivenAxisDirection();
+    }
+};
 
 #define DEBUG
 void ProgTomographAlignment::run()
@@ -2561,8 +2569,8 @@ void ProgTomographAlignment::run()
         steps(1)=0;
     double fitness;
     int iter;
-    TomographAlignment::global_prm=this;
-    powellOptimizer(axisAngles,1,2,&wrapperError, NULL,
+    AxisDirectionObjective axisObjective(this);
+    powellOptimizer(axisAngles,1,2,axisObjective,
                     0.01,fitness,iter,steps,true);
 
     // Outlier removal
@@ -2584,7 +2592,7 @@ void ProgTomographAlignment::run()
         fitness=bestPreviousAlignment->optimizeGivenAxisDirection();
 
         // Optimize again
-        powellOptimizer(axisAngles,1,2,&wrapperError,NULL,
+        powellOptimizer(axisAngles,1,2,axisObjective,
                         0.01,fitness,iter,steps,true);
     }
     bestPreviousAlignment->rot=axisAngles(0);
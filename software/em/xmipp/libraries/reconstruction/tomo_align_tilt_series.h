@@ -72,6 +72,7 @@ typedef std::vector<Landmark> LandmarkChain;
 
 /* Forward prototype */
 class Alignment;
+class CorrelationAux;
 
 /** This is the main class */
 class ProgTomographAlignment: public XmippProgram
@@ -191,9 +192,14 @@ public:
         image at which the landmark is being refined. rii and rjj are
         the corresponding landmark positions in both images.
         
-        The function returns whether the landmark is accepted or not. */
+        The function returns whether the landmark is accepted or not.
+
+        The auxiliary correlation data can be given so that the Fourier
+        transforms of the pieces reuse their plans and memory between calls
+        (each thread must have its own). */
     bool refineLandmark(int ii, int jj, const Matrix1D<double> &rii,
-                        Matrix1D<double> &rjj, double &maxCorr, bool tryFourier) const;
+                        Matrix1D<double> &rjj, double &maxCorr, bool tryFourier,
+                        CorrelationAux *aux=NULL) const;
 
 
     /** Refine landmark.
@@ -38,8 +38,8 @@
 #include <data/ctf.h>
 #include <data/sampling.h>
 #include <data/symmetries.h>
+#include <data/xmipp_threads.h>
 #include "symmetrize.h"
-#include <pthread.h>
 #include <vector>
 
 /** tomo_extract_subvolume parameters. */
@@ -82,16 +82,35 @@ public:
     int symmetry, sym_order;
     SymList SL;
 
+    /** Number of threads */
+    int numThreads;
+
     //Some local variables
-    FileName fn_out;
-    Image<double> vol, volout;
+    FileName fn_out, fn_vol;
+    // Input volume, mapped to disk whenever its datatype allows it
+    Image<float> vol;
     Matrix1D<double> center, doccenter;
     Matrix2D<double> A, R, I;
     double rot, tilt, psi, rotp, tiltp, psip;
     int x0, xF;
 
+    // B-spline coefficients of the brick of the input volume that
+    // contains all the subvolumes of the current input volume
+    MultidimArray<double> coeffs;
+    // Translation of each subvolume of the current input volume
+    std::vector<Matrix1D<double> > shifts;
+    // Subvolumes of the current input volume
+    std::vector< MultidimArray<double> > subvolumes;
+    // Distributor of the slices of the subvolumes among threads
+    ThreadTaskDistributor *distributor;
+    // Thread manager (only with more than one thread)
+    ThreadManager *thMgr;
+
 public:
 
+    /// Empty constructor
+    ProgTomoExtractSubvolume();
+
     /// Define the arguments accepted
     void defineParams();
 
@@ -106,8 +125,18 @@ public:
     void postProcess();
     void preProcess();
 
-
-    //void processImage(int imgno_start, int imgno_end);
+    /** Compute the B-spline coefficients of the input volume.
+     * Only the brick of the volume that contains all the shifted
+     * subvolumes (plus a margin for the spline prefilter) is transformed,
+     * unless some subvolume falls outside the volume and must be wrapped,
+     * in which case the coefficients of the whole volume are computed.
+     */
+    void produceBrickCoefficients();
+
+    /** Interpolate the slices first to last of the subvolumes.
+     * Slices are numbered consecutively through all the subvolumes.
+     */
+    void extractSlices(size_t first, size_t last);
 
 };
 //@}
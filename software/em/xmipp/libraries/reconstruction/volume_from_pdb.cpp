@@ -27,6 +27,7 @@
 #include "volume_from_pdb.h"
 
 #include <data/args.h>
+#include <data/xmipp_fftw.h>
 
 #include <fstream>
 
@@ -44,6 +45,9 @@ ProgPdbConverter::ProgPdbConverter()
     usePoorGaussian=false;
     useFixedGaussian=false;
     doCenter=false;
+    useFourier=false;
+    numThreads=1;
+    slabDistributor=NULL;
 
     // Periodic table for the blobs
     periodicTable.resize(7, 2);
@@ -73,25 +77,16 @@ ProgPdbConverter::ProgPdbConverter()
 /* Produce Side Info ------------------------------------------------------- */
 void ProgPdbConverter::produceSideInfo()
 {
+    // Parse the PDB file once
+    atoms.read(fn_pdb);
+
     if (useFixedGaussian && sigmaGaussian<0)
     {
         // Check if it is a pseudodensity volume
-        std::ifstream fh_pdb;
-        fh_pdb.open(fn_pdb.c_str());
-        if (!fh_pdb)
-            REPORT_ERROR(ERR_IO_NOTEXIST, fn_pdb);
-        while (!fh_pdb.eof())
+        for (size_t n=0; n<atoms.remarks.size(); n++)
         {
-            // Read an ATOM line
-            std::string line;
-            getline(fh_pdb, line);
-            if (line == "")
-                continue;
-            std::string kind = line.substr(0,6);
-            if (kind!="REMARK")
-                continue;
             std::vector< std::string > results;
-            splitString(line," ",results);
+            splitString(atoms.remarks[n]," ",results);
             if (results[1]=="xmipp_convert_vol2pseudo")
                 useFixedGaussian=true;
             if (useFixedGaussian && results[1]=="fixedGaussian")
@@ -99,7 +94,6 @@ void ProgPdbConverter::produceSideInfo()
             if (useFixedGaussian && results[1]=="intensityColumn")
                 intensityColumn=results[2];
         }
-        fh_pdb.close();
     }
 
     if (!useBlobs && !usePoorGaussian && !useFixedGaussian)
@@ -170,6 +164,15 @@ void ProgPdbConverter::defineParams()
     addParamsLine("                                     :  If not given, the standard deviation is taken from the PDB file");
     addParamsLine("  [--intensityColumn <intensity_type=occupancy>]   : Where to write the intensity in the PDB file");
     addParamsLine("     where <intensity_type> occupancy Bfactor     : Valid values: occupancy, Bfactor");
+    addParamsLine("  [--fourier]                         : Compute the volume in Fourier space from the atomic");
+    addParamsLine("                                     : structure factors (only with scattering factors).");
+    addParamsLine("                                     : It is faster for large boxes with many atoms. The atom");
+    addParamsLine("                                     : profiles are interpolated at the atom positions, so the");
+    addParamsLine("                                     : result differs from the real space one when the atoms");
+    addParamsLine("                                     : are sharp compared to the sampling rate");
+    addParamsLine("  [--thr <N=1>]                       : Number of threads");
+    addExampleLine("Convert a large mmCIF file with 4 threads",false);
+    addExampleLine("   xmipp_volume_from_pdb -i 4v6x.cif --sampling 2 --thr 4");
 }
 /* Read parameters --------------------------------------------------------- */
 void ProgPdbConverter::readParams()
@@ -186,6 +189,8 @@ void ProgPdbConverter::readParams()
         sigmaGaussian = getDoubleParam("--fixed_Gaussian");
     doCenter = checkParam("--centerPDB");
     intensityColumn = getParam("--intensityColumn");
+    useFourier = checkParam("--fourier");
+    numThreads = XMIPP_MAX(1, getIntParam("--thr"));
 }
 
 /* Show -------------------------------------------------------------------- */
@@ -201,6 +206,8 @@ void ProgPdbConverter::show()
     << "Use blobs:          " << useBlobs         << std::endl
     << "Use poor Gaussian:  " << usePoorGaussian  << std::endl
     << "Use fixed Gaussian: " << useFixedGaussian << std::endl
+    << "Use Fourier:        " << useFourier       << std::endl
+    << "Threads:            " << numThreads       << std::endl
     ;
     if (useFixedGaussian)
         std::cout << "Intensity Col:      " << intensityColumn  << std::endl
@@ -211,7 +218,7 @@ void ProgPdbConverter::show()
 void ProgPdbConverter::computeProteinGeometry()
 {
     Matrix1D<double> limit0(3), limitF(3);
-    computePDBgeometry(fn_pdb, centerOfMass, limit0, limitF, intensityColumn);
+    atoms.computeGeometry(centerOfMass, limit0, limitF, intensityColumn);
     if (doCenter)
     {
         limit0-=centerOfMass;
@@ -250,33 +257,16 @@ void ProgPdbConverter::createProteinAtHighSamplingRate()
     	<< std::endl;
 
     // Fill the volume with the different atoms
-    std::ifstream fh_pdb;
-    fh_pdb.open(fn_pdb.c_str());
-    if (!fh_pdb)
-        REPORT_ERROR(ERR_IO_NOTEXIST, fn_pdb);
-
-    // Process all lines of the file
     int col=1;
     if (intensityColumn=="Bfactor")
         col=2;
-    while (!fh_pdb.eof())
+    std::string atom_type(1,' ');
+    for (size_t n=0; n<atoms.size(); n++)
     {
-        // Read an ATOM line
-        std::string line;
-        getline(fh_pdb, line);
-        if (line == "")
-            continue;
-        std::string kind = line.substr(0,4);
-        if (kind != "ATOM" && kind !="HETA")
-            continue;
-
-        // Extract atom type and position
-        // Typical line:
-        // ATOM    909  CA  ALA A 161      58.775  31.984 111.803  1.00 34.78
-        std::string atom_type = line.substr(13,2);
-        double x = textToFloat(line.substr(30,8));
-        double y = textToFloat(line.substr(38,8));
-        double z = textToFloat(line.substr(46,8));
+        atom_type[0]=atoms.atomType[n];
+        double x = atoms.x[n];
+        double y = atoms.y[n];
+        double z = atoms.z[n];
 
         // Correct position
         Matrix1D<double> r(3);
@@ -288,18 +278,14 @@ void ProgPdbConverter::createProteinAtHighSamplingRate()
         // Characterize atom
         double weight, radius;
         if (!useFixedGaussian)
-        {
-            if (atom_type=="HETA")
-                continue;
             atomBlobDescription(atom_type, weight, radius);
-        }
         else
         {
             radius=4.5*sigmaGaussian;
             if (col==1)
-                weight=textToFloat(line.substr(54,6));
+                weight=atoms.occupancy[n];
             else
-                weight=textToFloat(line.substr(60,6));
+                weight=atoms.bfactor[n];
         }
         blob.radius = radius;
         if (usePoorGaussian)
@@ -334,9 +320,6 @@ void ProgPdbConverter::createProteinAtHighSamplingRate()
                                           GaussianNormalization;
                 }
     }
-
-    // Close file
-    fh_pdb.close();
 }
 
 /* Create protein at a low sampling rate ----------------------------------- */
@@ -382,95 +365,287 @@ void ProgPdbConverter::blobProperties() const
     fh_out.close();
 }
 
-/* Create protein using scattering profiles -------------------------------- */
-void ProgPdbConverter::createProteinUsingScatteringProfiles()
+/* Tabulate the atom profiles --------------------------------------------- */
+#define PROFILE_TABLE_SIZE 4096
+void ProgPdbConverter::tabulateProfiles()
 {
-    // Create an empty volume to hold the protein
-    Vlow().initZeros(output_dim,output_dim,output_dim);
-    Vlow().setXmippOrigin();
+    // Profiles as a function of the squared distance
+    const char atomTypes[]="HCNOPSF";
+    size_t nTypes=atomProfiles.radii.size();
+    profileTable.resize(nTypes);
+    profileTableIStep.resize(nTypes);
+    maxAtomRadius=0;
+    for (size_t idx=0; idx<nTypes; idx++)
+    {
+        double radius=atomProfiles.radii[idx];
+        double step=radius*radius/(PROFILE_TABLE_SIZE-1);
+        MultidimArray<double> &table=profileTable[idx];
+        table.initZeros(PROFILE_TABLE_SIZE+1);
+        for (int t=0; t<PROFILE_TABLE_SIZE; t++)
+            DIRECT_A1D_ELEM(table,t)=atomProfiles.volumeAtDistance(atomTypes[idx],
+                                     sqrt(t*step));
+        profileTableIStep[idx]=1.0/step;
+        maxAtomRadius=XMIPP_MAX(maxAtomRadius,radius);
+    }
 
-    // Fill the volume with the different atoms
-    std::ifstream fh_pdb;
-    fh_pdb.open(fn_pdb.c_str());
-    if (!fh_pdb)
-        REPORT_ERROR(ERR_IO_NOTEXIST, fn_pdb);
+    // Profile of each atom (only ATOM records)
+    size_t nAtoms=atoms.size();
+    atomProfileIdx.resize(nAtoms);
+    for (size_t n=0; n<nAtoms; n++)
+    {
+        atomProfileIdx[n]=-1;
+        if (atoms.hetatm[n])
+            continue;
+        try
+        {
+            atomProfileIdx[n]=atomProfiles.getAtomIndex(atoms.atomType[n]);
+        }
+        catch (XmippError XE)
+        {
+            if (verbose)
+                std::cerr << "Ignoring atom of type *" << atoms.atomType[n] << "*" << std::endl;
+        }
+    }
+}
 
-    // Process all lines of the file
-    std::string line, kind, atom_type;
+/* Bin atoms in slabs ------------------------------------------------------ */
+void ProgPdbConverter::binAtomsInSlabs()
+{
+    const MultidimArray<double> &mVlow=Vlow();
+    slabThickness=XMIPP_MAX(8,(int)CEIL(2*maxAtomRadius));
+    size_t nSlabs=(ZSIZE(mVlow)+slabThickness-1)/slabThickness;
     double iTs=1.0/Ts;
-    Matrix1D<double> r(3), rdiff(3);
-    while (!fh_pdb.eof())
+    double z0=doCenter ? ZZ(centerOfMass) : 0;
+
+    // Counting sort of the atoms by slab
+    size_t nAtoms=atoms.size();
+    std::vector<int> atomSlab(nAtoms);
+    slabStart.assign(nSlabs+1,0);
+    for (size_t n=0; n<nAtoms; n++)
     {
-        // Read an ATOM line
-        getline(fh_pdb, line);
-        if (line == "")
-            continue;
-        kind =line.substr(0,4);
-        if (kind != "ATOM")
+        if (atomProfileIdx[n]<0)
             continue;
+        int k=FLOOR((atoms.z[n]-z0)*iTs)-STARTINGZ(mVlow);
+        int slab=XMIPP_MIN(XMIPP_MAX(k,0)/slabThickness,(int)nSlabs-1);
+        atomSlab[n]=slab;
+        slabStart[slab+1]++;
+    }
+    for (size_t s=1; s<=nSlabs; s++)
+        slabStart[s]+=slabStart[s-1];
+    std::vector<size_t> slabFill(slabStart.begin(),slabStart.end()-1);
+    slabAtoms.resize(slabStart[nSlabs]);
+    for (size_t n=0; n<nAtoms; n++)
+        if (atomProfileIdx[n]>=0)
+            slabAtoms[slabFill[atomSlab[n]]++]=n;
+}
+
+/* Splat the atoms of a slab ---------------------------------------------- */
+void ProgPdbConverter::splatSlab(size_t slab)
+{
+    MultidimArray<double> &mVlow=Vlow();
+    int nSlabs=(int)slabStart.size()-1;
+    int z0=STARTINGZ(mVlow)+(int)slab*slabThickness;
+    int zF=XMIPP_MIN(z0+slabThickness-1,FINISHINGZ(mVlow));
 
-        // Extract atom type and position
-        // Typical line:
-        // ATOM    909  CA  ALA A 161      58.775  31.984 111.803  1.00 34.78
-        atom_type = line.substr(13,2);
-        char atom_type0=atom_type[0];
-        double x = textToFloat(line.substr(30,8));
-        double y = textToFloat(line.substr(38,8));
-        double z = textToFloat(line.substr(46,8));
+    // Slabs whose atoms can reach this one
+    int margin=(int)CEIL(maxAtomRadius/slabThickness);
+    int slab0=XMIPP_MAX((int)slab-margin,0);
+    int slabF=XMIPP_MIN((int)slab+margin,nSlabs-1);
+
+    double iTs=1.0/Ts;
+    Matrix1D<double> center(3);
+    if (doCenter)
+        center=centerOfMass;
+    for (size_t a=slabStart[slab0]; a<slabStart[slabF+1]; a++)
+    {
+        size_t n=slabAtoms[a];
+        int idx=atomProfileIdx[n];
 
         // Correct position
-        VECTOR_R3(r, x, y, z);
-        if (doCenter)
-            r -= centerOfMass;
-        r *= iTs;
+        double x=(atoms.x[n]-XX(center))*iTs;
+        double y=(atoms.y[n]-YY(center))*iTs;
+        double z=(atoms.z[n]-ZZ(center))*iTs;
 
-        // Characterize atom
-        try
+        double radius=atomProfiles.radii[idx];
+        double radius2=radius*radius;
+
+        // Find the part of the slab that must be updated
+        int k0 = XMIPP_MAX(FLOOR(z - radius), z0);
+        int kF = XMIPP_MIN(CEIL(z + radius), zF);
+        int i0 = XMIPP_MAX(FLOOR(y - radius), STARTINGY(mVlow));
+        int iF = XMIPP_MIN(CEIL(y + radius), FINISHINGY(mVlow));
+        int j0 = XMIPP_MAX(FLOOR(x - radius), STARTINGX(mVlow));
+        int jF = XMIPP_MIN(CEIL(x + radius), FINISHINGX(mVlow));
+
+        // Fill the volume with this atom
+        for (int k = k0; k <= kF; k++)
         {
-            double radius=atomProfiles.atomRadius(atom_type[0]);
-            double radius2=radius*radius;
-
-            // Find the part of the volume that must be updated
-            const MultidimArray<double> &mVlow=Vlow();
-            int k0 = XMIPP_MAX(FLOOR(ZZ(r) - radius), STARTINGZ(mVlow));
-            int kF = XMIPP_MIN(CEIL(ZZ(r) + radius), FINISHINGZ(mVlow));
-            int i0 = XMIPP_MAX(FLOOR(YY(r) - radius), STARTINGY(mVlow));
-            int iF = XMIPP_MIN(CEIL(YY(r) + radius), FINISHINGY(mVlow));
-            int j0 = XMIPP_MAX(FLOOR(XX(r) - radius), STARTINGX(mVlow));
-            int jF = XMIPP_MIN(CEIL(XX(r) + radius), FINISHINGX(mVlow));
-
-            // Fill the volume with this atom
-            for (int k = k0; k <= kF; k++)
+            double zdiff=z - k;
+            double zdiff2=zdiff*zdiff;
+            for (int i = i0; i <= iF; i++)
             {
-                double zdiff=ZZ(r) - k;
-                double zdiff2=zdiff*zdiff;
-                for (int i = i0; i <= iF; i++)
+                double ydiff=y - i;
+                double zydiff2=zdiff2+ydiff*ydiff;
+                double *ptr=&A3D_ELEM(mVlow,k,i,0);
+                for (int j = j0; j <= jF; j++)
                 {
-                    double ydiff=YY(r) - i;
-                    double zydiff2=zdiff2+ydiff*ydiff;
-                    for (int j = j0; j <= jF; j++)
-                    {
-                        double xdiff=XX(r) - j;
-                        double rdiffModule2=zydiff2+xdiff*xdiff;
-                        if (rdiffModule2<radius2)
-                        {
-                            double rdiffModule=sqrt(rdiffModule2);
-                            A3D_ELEM(mVlow,k, i, j) += atomProfiles.volumeAtDistance(
-                                                 atom_type0,rdiffModule);
-                        }
-                    }
+                    double xdiff=x - j;
+                    double rdiffModule2=zydiff2+xdiff*xdiff;
+                    if (rdiffModule2<radius2)
+                        ptr[j]+=profileAtSquaredDistance(idx,rdiffModule2);
                 }
             }
         }
-        catch (XmippError XE)
+    }
+}
+
+/* Thread function for the scattering profiles ----------------------------- */
+void threadSplatSlabs(ThreadArgument &thArg)
+{
+    ProgPdbConverter *self=(ProgPdbConverter *) thArg.workClass;
+    size_t first, last;
+    while (self->slabDistributor->getTasks(first, last))
+        for (size_t slab=first; slab<=last; slab++)
+            self->splatSlab(slab);
+}
+
+/* Create protein using scattering profiles -------------------------------- */
+void ProgPdbConverter::createProteinUsingScatteringProfiles()
+{
+    // Create an empty volume to hold the protein
+    Vlow().initZeros(output_dim,output_dim,output_dim);
+    Vlow().setXmippOrigin();
+
+    // The volume is divided in slabs along Z. Each slab is computed by a
+    // single thread that adds the contributions of the atoms whose center
+    // is in the slab or in its neighbours, so there are no write conflicts
+    tabulateProfiles();
+    binAtomsInSlabs();
+    size_t nSlabs=slabStart.size()-1;
+    if (numThreads>1)
+    {
+        ThreadTaskDistributor distributor(nSlabs, 1);
+        slabDistributor=&distributor;
+        ThreadManager thMgr(numThreads, this);
+        thMgr.run(threadSplatSlabs);
+        slabDistributor=NULL;
+    }
+    else
+        for (size_t slab=0; slab<nSlabs; slab++)
+            splatSlab(slab);
+}
+
+/* Create protein in Fourier space ----------------------------------------- */
+void ProgPdbConverter::createProteinInFourier()
+{
+    MultidimArray<double> &mVlow=Vlow();
+    mVlow.initZeros(output_dim,output_dim,output_dim);
+    mVlow.setXmippOrigin();
+    tabulateProfiles();
+
+    // The atoms are interpolated with a cubic B-spline onto a grid with the
+    // output sampling. The grid is padded with the atom radius and the spline
+    // support, so that the convolution does not wrap around and the atoms
+    // outside the box only contribute with the part of their profile that
+    // falls inside, as in real space.
+    int N=output_dim;
+    int pad=(int)CEIL(maxAtomRadius)+2;
+    int M=N+2*pad;
+
+    // Transform of the sampled cubic B-spline (1/6, 2/3, 1/6). Dividing by it
+    // gives the spline coefficients of the sampled profile, so that the
+    // result is the profile interpolated at the atom positions
+    MultidimArray<double> iBspline(M);
+    for (int i=0; i<M; i++)
+        DIRECT_A1D_ELEM(iBspline,i)=3.0/(2.0+cos(2*PI*i/M));
+
+    FourierTransformer transformer;
+    if (numThreads>1)
+        transformer.setThreadsNumber(numThreads);
+    MultidimArray<double> grid(M,M,M);
+    MultidimArray< std::complex<double> > Deposit, Profile;
+    double iTs=1.0/Ts;
+    double shift=pad-STARTINGX(mVlow);
+    Matrix1D<double> center(3);
+    if (doCenter)
+        center=centerOfMass;
+
+    // Normalization of the product of the two transforms
+    double K=MULTIDIM_SIZE(grid);
+    for (size_t idx=0; idx<profileTable.size(); idx++)
+    {
+        size_t count=0;
+        for (size_t n=0; n<atoms.size(); n++)
+            if (atomProfileIdx[n]==(int)idx)
+                count++;
+        if (count==0)
+            continue;
+
+        // Profile of this atom centered at the origin
+        grid.initZeros();
+        double radius=atomProfiles.radii[idx];
+        double radius2=radius*radius;
+        int R=(int)CEIL(radius);
+        for (int k=-R; k<=R; k++)
+            for (int i=-R; i<=R; i++)
+                for (int j=-R; j<=R; j++)
+                {
+                    double r2=k*k+i*i+j*j;
+                    if (r2<radius2)
+                        DIRECT_A3D_ELEM(grid,intWRAP(k,0,M-1),intWRAP(i,0,M-1),
+                                        intWRAP(j,0,M-1))+=profileAtSquaredDistance(idx,r2);
+                }
+        transformer.FourierTransform(grid,Profile,true);
+
+        // Interpolate the atoms of this type onto the grid. Atoms whose
+        // weights fall outside the padded grid cannot reach the output box
+        grid.initZeros();
+        for (size_t n=0; n<atoms.size(); n++)
         {
-        	if (verbose)
-        		std::cerr << "Ignoring atom of type *" << atom_type << "*" << std::endl;
+            if (atomProfileIdx[n]!=(int)idx)
+                continue;
+            double x=(atoms.x[n]-XX(center))*iTs+shift;
+            double y=(atoms.y[n]-YY(center))*iTs+shift;
+            double z=(atoms.z[n]-ZZ(center))*iTs+shift;
+            int j0=FLOOR(x), i0=FLOOR(y), k0=FLOOR(z);
+            if (j0<1 || i0<1 || k0<1 || j0+2>=M || i0+2>=M || k0+2>=M)
+                continue;
+            double wx[4], wy[4], wz[4];
+            BSPLINE03_WEIGHTS(wx,x-j0);
+            BSPLINE03_WEIGHTS(wy,y-i0);
+            BSPLINE03_WEIGHTS(wz,z-k0);
+            for (int dk=0; dk<4; dk++)
+                for (int di=0; di<4; di++)
+                {
+                    double wki=wz[dk]*wy[di];
+                    double *ptr=&DIRECT_A3D_ELEM(grid,k0+dk-1,i0+di-1,j0-1);
+                    for (int dj=0; dj<4; dj++)
+                        ptr[dj]+=wki*wx[dj];
+                }
         }
-    }
+        transformer.FourierTransform(grid,Deposit,false);
+
+        // Convolve with the spline coefficients of the profile
+        for (size_t k=0; k<ZSIZE(Deposit); k++)
+            for (size_t i=0; i<YSIZE(Deposit); i++)
+            {
+                double wki=K*DIRECT_A1D_ELEM(iBspline,k)*DIRECT_A1D_ELEM(iBspline,i);
+                for (size_t j=0; j<XSIZE(Deposit); j++)
+                    DIRECT_A3D_ELEM(Deposit,k,i,j)*=DIRECT_A3D_ELEM(Profile,k,i,j)*
+                                                   (wki*DIRECT_A1D_ELEM(iBspline,j));
+            }
+        transformer.inverseFourierTransform();
 
-    // Close file
-    fh_pdb.close();
+        // Keep the central part
+        for (int k=0; k<N; k++)
+            for (int i=0; i<N; i++)
+            {
+                const double *ptrGrid=&DIRECT_A3D_ELEM(grid,k+pad,i+pad,pad);
+                double *ptrV=&DIRECT_A3D_ELEM(mVlow,k,i,0);
+                for (int j=0; j<N; j++)
+                    ptrV[j]+=ptrGrid[j];
+            }
+    }
 }
 
 /* Run --------------------------------------------------------------------- */
@@ -492,10 +667,10 @@ void ProgPdbConverter::run()
         Vlow=Vhigh;
         Vhigh.clear();
     }
+    else if (useFourier)
+        createProteinInFourier();
     else
-    {
         createProteinUsingScatteringProfiles();
-    }
     if (fn_out!="")
         Vlow.write(fn_out + ".vol");
 }
@@ -28,6 +28,7 @@
 #include <data/blobs.h>
 #include <data/pdb.h>
 #include <data/xmipp_program.h>
+#include <data/xmipp_threads.h>
 
 /**@defgroup PDBPhantom convert_pdb2vol (PDB Phantom program)
    @ingroup ReconsLibrary */
@@ -69,6 +70,12 @@ public:
 
     /// Column for the intensity (if any). Only valid for fixed_gaussians
     std::string intensityColumn;
+
+    /** Compute the volume in Fourier space (only with scattering factors) */
+    bool useFourier;
+
+    /** Number of threads */
+    int numThreads;
 public:
     /** Empty constructor */
     ProgPdbConverter();
@@ -104,6 +111,35 @@ public:
     /* Atom interpolator. */
     AtomInterpolator atomProfiles;
 
+    /* Atoms of the PDB file */
+    PDBAtomTable atoms;
+
+    /* Volume profiles of the atoms as a function of the squared distance
+       in voxels (one per atom type of atomProfiles) */
+    std::vector< MultidimArray<double> > profileTable;
+
+    /* Inverse of the squared distance between two samples of each profile */
+    std::vector<double> profileTableIStep;
+
+    /* Index in atomProfiles of each atom (-1 if it is ignored) */
+    std::vector<int> atomProfileIdx;
+
+    /* Atoms sorted by the slab of the volume in which their center is */
+    std::vector<size_t> slabAtoms;
+
+    /* First atom of each slab in slabAtoms (the last element is the
+       total number of atoms) */
+    std::vector<size_t> slabStart;
+
+    /* Thickness in voxels of the slabs */
+    int slabThickness;
+
+    /* Largest radius of the atoms in voxels */
+    double maxAtomRadius;
+
+    /* Distributor of the slabs among threads */
+    ThreadTaskDistributor * slabDistributor;
+
     // Protein geometry
     Matrix1D<double> centerOfMass, limit;
 
@@ -131,6 +167,34 @@ public:
 
     /* Create protein using scattering profiles */
     void createProteinUsingScatteringProfiles();
+
+    /* Tabulate the atom profiles and assign a profile to each atom */
+    void tabulateProfiles();
+
+    /* Value of the profile idx at a squared distance r2 (r2 < radius^2) */
+    inline double profileAtSquaredDistance(int idx, double r2) const
+    {
+        double t = r2 * profileTableIStep[idx];
+        int it = (int)t;
+        const double *ptr = MULTIDIM_ARRAY(profileTable[idx]) + it;
+        return ptr[0] + (t - it) * (ptr[1] - ptr[0]);
+    }
+
+    /* Sort the atoms by slabs of the volume */
+    void binAtomsInSlabs();
+
+    /* Add to the volume the atoms that contribute to a slab.
+       Only the voxels of the slab are written, so that different
+       slabs can be computed in parallel. */
+    void splatSlab(size_t slab);
+
+    /* Create protein using the structure factors of the atoms.
+       The atoms of each type are interpolated with a cubic B-spline onto a
+       grid with the output sampling, zero padded by the atom radius, and its
+       transform is multiplied by the transform of the spline coefficients of
+       the atom profile. Atoms on grid points give the same volume as in
+       real space. */
+    void createProteinInFourier();
 };
 //@}
 #endif